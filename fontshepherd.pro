@@ -25,7 +25,13 @@
 # POSSIBILITY OF SUCH DAMAGE.
 
 TEMPLATE = subdirs
-SUBDIRS = src/qhexedit2/qhexedit.pro src/fontshepherd
+SUBDIRS = src/qhexedit2/qhexedit.pro
+# Use CONFIG+=system_brotli to link against the system Brotli libraries
+# even if the vendored sources are present
+!system_brotli:exists (src/brotli/c/include/brotli/decode.h) {
+  SUBDIRS += src/brotli/brotli.pro
+}
+SUBDIRS += src/fontshepherd src/fontshepherd/fontshepherd-cli.pro
 CONFIG += ordered
 src/fontshepherd.depends = src/qhexedit/qhexedit.pro
 
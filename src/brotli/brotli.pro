@@ -0,0 +1,54 @@
+# Copyright (C) 2022 by Alexey Kryukov
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+# 3. Neither the name of the copyright holder nor the names of its contributors
+#    may be used to endorse or promote products derived from this software
+#    without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Static build of the Brotli library (https://github.com/google/brotli),
+# needed for WOFF2 support. The c/ directory of the upstream source tree
+# is supposed to be copied here as is, so that the application can be
+# built offline. Unless the sources are present, or the project is
+# configured with CONFIG+=system_brotli, the system libraries are used
+# instead (see ../fontshepherd/core.pri)
+
+TEMPLATE = lib
+CONFIG += staticlib warn_off
+CONFIG -= qt
+
+INCLUDEPATH += c/include
+
+SOURCES = \
+    $$files (c/common/*.c) \
+    $$files (c/dec/*.c) \
+    $$files (c/enc/*.c)
+
+HEADERS = \
+    $$files (c/include/brotli/*.h) \
+    $$files (c/common/*.h) \
+    $$files (c/dec/*.h) \
+    $$files (c/enc/*.h)
+
+unix: {
+  DESTDIR = release
+  TARGET = fsbrotli
+}
@@ -30,6 +30,7 @@
 #include <stdint.h>
 #include <array>
 #include <map>
+#include <string>
 #include <vector>
 #include <QtGlobal>
 
@@ -234,13 +235,44 @@ private:
 typedef PseudoMap<int, private_entry> PrivateDict;
 typedef PseudoMap<int, top_dict_entry> TopDict;
 
+// A charstring or a subroutine. Unless modified, it is just a view into
+// the table data, so that nothing has to be copied on load. Assigning
+// new data switches it to an owned buffer
 struct charstring {
-    std::string sdata;
     uint8_t hintcnt;
 
-    charstring () : hintcnt (0) {};
-    charstring (const std::string &s) : sdata (s), hintcnt (0) {};
-    charstring (char *data, int len) : sdata (data, len), hintcnt (0) {};
+    charstring () : hintcnt (0), m_view (nullptr), m_len (0) {};
+    charstring (const std::string &s) : hintcnt (0), m_view (nullptr), m_len (0), m_own (s) {};
+    charstring (const char *data, uint32_t len) : hintcnt (0), m_view (data), m_len (len) {};
+
+    const char *data () const { return m_view ? m_view : m_own.data (); };
+    size_t size () const { return m_view ? m_len : m_own.size (); };
+    bool empty () const { return size () == 0; };
+    std::string str () const { return std::string (data (), size ()); };
+    bool owned () const { return !m_view; };
+    // Heap memory held by this charstring (views cost nothing)
+    size_t memoryUsage () const { return m_own.capacity (); };
+
+    void assign (std::string s) {
+	m_own = std::move (s);
+	m_view = nullptr;
+	m_len = 0;
+    };
+    void bind (const char *data, uint32_t len) {
+	m_view = data;
+	m_len = len;
+	std::string ().swap (m_own);
+    };
+    // Keep pointing to the same bytes after the table data have been moved
+    void rebase (const char *old_base, const char *new_base) {
+	if (m_view)
+	    m_view = new_base + (m_view - old_base);
+    };
+
+private:
+    const char *m_view;
+    uint32_t m_len;
+    std::string m_own;
 };
 
 struct pschars {
@@ -248,6 +280,33 @@ struct pschars {
     std::vector<struct charstring> css;
 };
 
+// A subroutine operand or operator, decoded in advance, so that the
+// charstring interpreter doesn't have to parse the same bytes again
+// each time the subroutine is called
+struct cs_token {
+    static const uint8_t operand = 255;
+
+    double val;		// operand value
+    uint32_t end;	// offset just past the token in the subroutine
+    uint8_t op;		// operator, or 'operand'
+    uint8_t esc;	// second byte of a two-byte (12 x) operator
+};
+
+// Pre-tokenized subroutines of a single INDEX. Tokens of all subroutines
+// are stored together, 'starts' has cnt+1 entries. A subroutine is only
+// tokenized up to its first hintmask or cntrmask: the mask length depends
+// on the number of stems declared by the calling glyph, so the rest
+// is interpreted from bytes
+struct subr_tokens {
+    std::vector<struct cs_token> tokens;
+    std::vector<uint32_t> starts;
+
+    size_t memoryUsage () const {
+	return tokens.capacity () * sizeof (struct cs_token) +
+	    starts.capacity () * sizeof (uint32_t);
+    };
+};
+
 typedef struct cffcontext {
     double version;
     int painttype;
@@ -256,6 +315,12 @@ typedef struct cffcontext {
     const struct pschars &gsubrs;
     const struct pschars &lsubrs;
     const PrivateDict &pdict;
+    // Optional, may be null
+    const struct subr_tokens *gtokens;
+    const struct subr_tokens *ltokens;
+    // CFF2 only: if set, blend operands are evaluated at an instance location
+    // (see FontVariations::dataScalars). Otherwise the default design is used
+    const std::vector<std::vector<double>> *scalars;
 } PSContext;
 
 struct cff_font {
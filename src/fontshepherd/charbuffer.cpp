@@ -25,7 +25,86 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE. */
 
+#include <algorithm>
 #include "charbuffer.h"
+#include "fs_math.h"
+
+size_t SpanIn::read (uint8_t *dest, size_t n) {
+    if (n > remaining ()) {
+	m_fail = true;
+	n = remaining ();
+    }
+    std::copy (m_cur, m_cur + n, dest);
+    m_cur += n;
+    return n;
+}
+
+size_t SpanIn::readFlags (uint8_t *flags, size_t cnt, uint8_t repeat_bit) {
+    size_t i = 0;
+    while (i < cnt) {
+	if (atEnd ()) {
+	    m_fail = true;
+	    break;
+	}
+	uint8_t flag = *m_cur++;
+	flags[i++] = flag;
+	if (flag & repeat_bit) {
+	    if (atEnd ()) {
+		m_fail = true;
+		break;
+	    }
+	    size_t rep = *m_cur++;
+	    if (rep > cnt - i) {
+		m_fail = true;
+		rep = cnt - i;
+	    }
+	    std::fill (flags + i, flags + i + rep, flag);
+	    i += rep;
+	}
+    }
+    return i;
+}
+
+// Deltas are first extracted into the output array (in a loop with no bounds
+// checks, if the total size, known from flags, fits into the buffer), and then
+// converted to absolute values with a vectorized prefix sum
+void SpanIn::readCoordinates (int32_t *coords, const uint8_t *flags, size_t cnt, uint8_t short_bit, uint8_t same_bit) {
+    size_t need = 0;
+    for (size_t i=0; i<cnt; i++) {
+	uint8_t flag = flags[i];
+	need += (flag & short_bit) ? 1 : (flag & same_bit) ? 0 : 2;
+    }
+
+    if (need <= remaining ()) {
+	const uint8_t *p = m_cur;
+	for (size_t i=0; i<cnt; i++) {
+	    uint8_t flag = flags[i];
+	    if (flag & short_bit) {
+		int32_t val = *p++;
+		coords[i] = (flag & same_bit) ? val : -val;
+	    } else if (flag & same_bit) {
+		coords[i] = 0;
+	    } else {
+		coords[i] = static_cast<int16_t> ((p[0]<<8) | p[1]);
+		p += 2;
+	    }
+	}
+	m_cur = p;
+    } else {
+	for (size_t i=0; i<cnt; i++) {
+	    uint8_t flag = flags[i];
+	    if (flag & short_bit) {
+		int32_t val = getByte ();
+		coords[i] = (flag & same_bit) ? val : -val;
+	    } else if (flag & same_bit) {
+		coords[i] = 0;
+	    } else {
+		coords[i] = static_cast<int16_t> (getUShort ());
+	    }
+	}
+    }
+    FontShepherd::math::prefixSum (coords, cnt);
+}
 
 BoostIn& operator>> (BoostIn& is, uint8_t &ch) {
     ch = is.get ();
@@ -87,3 +166,22 @@ BoostOut& operator<< (BoostOut& os, uint32_t &val) {
     os << (val&0xff);
     return os;
 }
+
+std::string FontShepherd::zlibDeflate (const char *src, size_t len) {
+    std::string ret;
+    ZBoostOut zout;
+    zout.push (boost::iostreams::zlib_compressor (boost::iostreams::zlib::best_compression));
+    zout.push (boost::iostreams::back_inserter (ret));
+    zout.write (src, len);
+    // Flushes the compressor and the sink
+    zout.reset ();
+    return ret;
+}
+
+bool FontShepherd::zlibInflate (const char *src, size_t srclen, char *dest, size_t destlen) {
+    ZBoostIn zin;
+    zin.push (boost::iostreams::zlib_decompressor ());
+    zin.push (BoostSourceD (src, srclen));
+    zin.read (dest, destlen);
+    return (static_cast<size_t> (zin.gcount ()) == destlen);
+}
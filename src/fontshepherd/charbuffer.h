@@ -27,20 +27,87 @@
 #ifndef _FS_CHARBUFFER_DEFINED
 #define _FS_CHARBUFFER_DEFINED
 #include <sstream>
+#include <cstdio>
 
 #include <boost/iostreams/device/array.hpp>
 #include <boost/asio/streambuf.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
 
 typedef boost::iostreams::basic_array_source<char> BoostSourceD;
 typedef boost::iostreams::stream<BoostSourceD> BoostIn;
-typedef boost::iostreams::filtering_stream<BoostSourceD> ZBoostIn;
+typedef boost::iostreams::filtering_istream ZBoostIn;
 
 typedef boost::asio::streambuf BoostTargetD;
 typedef boost::iostreams::stream<BoostTargetD> BoostOut;
-typedef boost::iostreams::filtering_stream<BoostTargetD> ZBoostOut;
+typedef boost::iostreams::filtering_ostream ZBoostOut;
+
+// A lightweight big-endian reader over a block of memory, intended for glyph
+// decoders and table readers walking large arrays. Reading past the end never
+// accesses memory outside the block: get () returns EOF, other methods
+// return zeros, and the failure flag is set
+class SpanIn {
+public:
+    SpanIn (const char *data, size_t len) :
+	m_start (reinterpret_cast<const uint8_t *> (data)),
+	m_cur (m_start), m_end (m_start + len), m_fail (false) {};
+
+    size_t pos () const { return m_cur - m_start; };
+    size_t size () const { return m_end - m_start; };
+    size_t remaining () const { return m_end - m_cur; };
+    bool atEnd () const { return m_cur >= m_end; };
+    bool fail () const { return m_fail; };
+
+    void seek (size_t pos) {
+	if (pos > size ()) { m_fail = true; pos = size (); }
+	m_cur = m_start + pos;
+    };
+    void skip (size_t n) { seek (pos () + n); };
+
+    int peek () const { return atEnd () ? EOF : *m_cur; };
+    int get () {
+	if (atEnd ()) { m_fail = true; return EOF; }
+	return *m_cur++;
+    };
+    uint8_t getByte () {
+	if (atEnd ()) { m_fail = true; return 0; }
+	return *m_cur++;
+    };
+    uint16_t getUShort () {
+	if (remaining () < 2) { m_fail = true; m_cur = m_end; return 0; }
+	uint16_t ret = (m_cur[0]<<8) | m_cur[1];
+	m_cur += 2;
+	return ret;
+    };
+    uint32_t getLong () {
+	if (remaining () < 4) { m_fail = true; m_cur = m_end; return 0; }
+	uint32_t ret = (static_cast<uint32_t> (m_cur[0])<<24) | (m_cur[1]<<16) | (m_cur[2]<<8) | m_cur[3];
+	m_cur += 4;
+	return ret;
+    };
+
+    SpanIn& operator>> (uint8_t &val) { val = getByte (); return *this; };
+    SpanIn& operator>> (int8_t &val) { val = getByte (); return *this; };
+    SpanIn& operator>> (uint16_t &val) { val = getUShort (); return *this; };
+    SpanIn& operator>> (int16_t &val) { val = getUShort (); return *this; };
+    SpanIn& operator>> (uint32_t &val) { val = getLong (); return *this; };
+
+    // Copy up to 'n' bytes, returns the number actually read
+    size_t read (uint8_t *dest, size_t n);
+    // Expand TrueType point flags, which may contain repeat counts. Returns the
+    // number of flags read, which is less than 'cnt' if data are exhausted.
+    // Unlike a naive loop, never writes more than 'cnt' flags
+    size_t readFlags (uint8_t *flags, size_t cnt, uint8_t repeat_bit);
+    // Read a sequence of TrueType coordinate deltas, as described by 'flags',
+    // and accumulate them into absolute coordinates
+    void readCoordinates (int32_t *coords, const uint8_t *flags, size_t cnt, uint8_t short_bit, uint8_t same_bit);
+
+private:
+    const uint8_t *m_start, *m_cur, *m_end;
+    bool m_fail;
+};
 
 BoostIn& operator>> (BoostIn& is, uint8_t &ch);
 
@@ -61,4 +128,10 @@ BoostOut& operator<< (BoostOut& os, uint16_t &ch);
 BoostOut& operator<< (BoostOut& os, int16_t &ch);
 
 BoostOut& operator<< (BoostOut& os, uint32_t &ch);
+
+namespace FontShepherd {
+    std::string zlibDeflate (const char *src, size_t len);
+    // Returns false if the data are broken or shorter than expected
+    bool zlibInflate (const char *src, size_t srclen, char *dest, size_t destlen);
+}
 #endif
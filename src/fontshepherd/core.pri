@@ -0,0 +1,75 @@
+# Copyright (C) 2022 by Alexey Kryukov
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+# 3. Neither the name of the copyright holder nor the names of its contributors
+#    may be used to endorse or promote products derived from this software
+#    without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+
+# Settings and sources shared by the GUI application and the batch tool:
+# font and table code, outlines and related math. Nothing here may depend
+# on QtGui or QtWidgets, as the batch tool is linked against QtCore only
+
+QT -= gui
+QT += concurrent
+CONFIG += qt debug
+CONFIG += object_parallel_to_source
+QMAKE_CXXFLAGS += -DBOOST_SYSTEM_NO_DEPRECATED
+QMAKE_CXXFLAGS += -std=c++11
+QMAKE_CXXFLAGS += -Wno-template-id-cdtor
+
+include (tables/tables.pri)
+
+SOURCES += sfnt.cpp sfntwoff.cpp charbuffer.cpp
+SOURCES += tables.cpp splineglyph.cpp splineglyphsvg.cpp splineutil.cpp
+SOURCES += fs_notify.cpp fs_math.cpp commonlists.cpp
+SOURCES += ftwrapper.cpp icuwrapper.cpp fs_mapping.cpp fs_woff2.cpp
+SOURCES += stemdb.cpp fs_trace.cpp
+
+HEADERS += sfnt.h cffstuff.h colors.h
+HEADERS += tables.h splineglyph.h charbuffer.h commonlists.h
+HEADERS += exceptions.h fs_notify.h fs_math.h
+HEADERS += ftwrapper.h icuwrapper.h fs_mapping.h fs_woff2.h
+HEADERS += stemdb.h fs_trace.h fs_arena.h
+
+INCLUDEPATH += /usr/include/freetype2
+
+unix: {
+  DESTDIR = release
+  isEmpty (PREFIX) {
+    PREFIX = /usr/local
+  }
+  BINDIR = $$PREFIX/bin
+  DATADIR = $$PREFIX/share
+  SHAREDIR = $$DATADIR/fontshepherd/
+}
+LIBS += -lfreetype -licuuc -lpugixml -lboost_iostreams
+# Brotli (for WOFF2) is built from the vendored sources in ../brotli if
+# available, otherwise the system libraries are used
+!system_brotli:exists (../brotli/c/include/brotli/decode.h) {
+  INCLUDEPATH += ../brotli/c/include
+  LIBS += -L../brotli/$$DESTDIR -lfsbrotli
+} else {
+  LIBS += -lbrotlienc -lbrotlidec
+}
+QMAKE_RPATHDIR += $${PREFIX}/lib/fontshepherd
+DEFINES += SHAREDIR=\\\"$$SHAREDIR\\\"
@@ -643,7 +643,7 @@ void CffDialog::onTabChange (int index) {
 void CffDialog::setTableVersion (int idx) {
     double newver = m_versionBox->itemData (idx, Qt::UserRole).toFloat ();
     bool update_post = false;
-    int choice;
+    bool choice;
     if (newver == m_cff->version ())
 	return;
     PostTable *post = dynamic_cast<PostTable *> (m_font->table (CHR ('p','o','s','t')));
@@ -657,7 +657,7 @@ void CffDialog::setTableVersion (int idx) {
 		"This format doesn't support storing glyph names in the table. "
 		"Would you like to move them to the 'post' table?"),
 	    this);
-        if (choice == QMessageBox::Yes)
+        if (choice)
 	    update_post = true;
     } else if (newver == 1.0 && post->version () == 2.0) {
         choice = FontShepherd::postYesNoQuestion (
@@ -666,7 +666,7 @@ void CffDialog::setTableVersion (int idx) {
 		"Are you sure to convert your CFF2 table to the older CFF format? "
 		"You will lose all variable font data currently stored in the table."),
 	    this);
-        if (choice == QMessageBox::No) {
+        if (!choice) {
 	    m_versionBox->setCurrentIndex
 		(m_versionBox->findData (m_cff->version (), Qt::UserRole));
 	    return;
@@ -677,7 +677,7 @@ void CffDialog::setTableVersion (int idx) {
 		"Would you like to also remove glyph names from the 'post' "
 		"table after copying them to the 'CFF ' table?"),
 	    this);
-        if (choice == QMessageBox::Yes)
+        if (choice)
 	    update_post = true;
     }
     m_topTab->clearContents ();
@@ -717,11 +717,8 @@ void CffDialog::setTableVersion (int idx) {
     if (!m_cff->cidKeyed () && newver < 2)
 	fillGlyphTab (m_gnTab);
     if (update_post) {
-	TableEdit *ed = post->editor ();
-	if (ed) {
-	    PostEdit *pe = qobject_cast<PostEdit *> (ed);
-	    if (pe) pe->resetData ();
-	}
+	TableEditor *ed = post->editor ();
+	if (ed) ed->resetData ();
     }
 }
 
@@ -282,14 +282,14 @@ void CmapEdit::removeSubTable (int idx) {
 		break;
 	}
 	if (i==m_cmap->numSubTables ()) {
-	    int choice = FontShepherd::postYesNoQuestion (
+	    bool choice = FontShepherd::postYesNoQuestion (
 		QCoreApplication::tr ("Deleting cmap subtable"),
 		QCoreApplication::tr (
 		"Are you sure you want to delete the only currently available "
 		"32-bit Unicode subtable from this font? "
 		"This operation cannot be undone!"),
 		this);
-	    if (choice == QMessageBox::No)
+	    if (!choice)
 		return;
 	}
     } else if (enc->isUnicode ()) {
@@ -299,24 +299,24 @@ void CmapEdit::removeSubTable (int idx) {
 		break;
 	}
 	if (i==m_cmap->numSubTables ()) {
-	    int choice = FontShepherd::postYesNoQuestion (
+	    bool choice = FontShepherd::postYesNoQuestion (
 		QCoreApplication::tr ("Deleting cmap subtable"),
 		QCoreApplication::tr (
 		"Are you sure you want to delete the only currently available "
 		"Unicode subtable from this font? "
 		"This operation cannot be undone!"),
 		this);
-	    if (choice == QMessageBox::No)
+	    if (!choice)
 		return;
 	}
     } else {
-        int choice = FontShepherd::postYesNoQuestion (
+        bool choice = FontShepherd::postYesNoQuestion (
 	    QCoreApplication::tr ("Deleting cmap subtable"),
 	    QCoreApplication::tr (
 	    "Are you sure you want to delete the selected subtable? "
 	    "This operation cannot be undone!"),
 	    this);
-        if (choice == QMessageBox::No)
+        if (!choice)
 	    return;
     }
     m_enctab->removeTab (idx);
@@ -26,7 +26,7 @@
 
 #include <QtWidgets>
 #include <QAbstractListModel>
-#include "tables.h" // Have to load it here due to inheritance from TableEdit
+#include "editors/tableedit.h" // also includes tables.h
 
 class sfntFile;
 typedef struct ttffont sFont;
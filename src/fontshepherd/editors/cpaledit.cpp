@@ -230,14 +230,14 @@ QSize CpalEdit::sizeHint () const {
 
 void CpalEdit::save () {
     if (m_cpalVersionBox->value () > 0 && m_name->editor ()->isModified ()) {
-        int choice = FontShepherd::postYesNoQuestion (
+        bool choice = FontShepherd::postYesNoQuestion (
 	    tr ("Compile font tables"),
 	    tr (
 		"You have unsaved changes in the 'name' table. "
 		"If you compile the 'cpal' table now, 'name' will also be overwritten. "
 		"Do you really want to overwrite it?"),
 	    this);
-        if (choice == QMessageBox::No)
+        if (!choice)
 	    return;
     }
 
@@ -289,7 +289,7 @@ void CpalEdit::setTableVersion (int version) {
 
 void CpalEdit::setPalettesNumber (int value) {
     if (value < m_cpal->numPalettes ()) {
-        int choice = FontShepherd::postYesNoQuestion (
+        bool choice = FontShepherd::postYesNoQuestion (
 	    tr ("Decrease number of palettes"),
 	    tr (
 		"Are you sure you want to delete %1 "
@@ -298,7 +298,7 @@ void CpalEdit::setPalettesNumber (int value) {
 		.arg (m_cpal->numPalettes () - value)
 		.arg (value - m_cpal->numPalettes () == 1 ? tr ("palette") : tr ("palettes")),
 	    this);
-        if (choice == QMessageBox::No) {
+        if (!choice) {
 	    m_numPalettesBox->blockSignals (true);
 	    m_numPalettesBox->setValue (m_cpal->numPalettes ());
 	    m_numPalettesBox->blockSignals (false);
@@ -310,7 +310,7 @@ void CpalEdit::setPalettesNumber (int value) {
 	}
 	m_cpal->setModified (true);
     } else if (value > m_cpal->numPalettes ()) {
-        int choice = FontShepherd::postYesNoQuestion (
+        bool choice = FontShepherd::postYesNoQuestion (
 	    tr ("Increase number of palettes"),
 	    tr (
 		"Would you like to add %1 new %2 to this font, "
@@ -318,7 +318,7 @@ void CpalEdit::setPalettesNumber (int value) {
 		.arg (value - m_cpal->numPalettes ())
 		.arg (value - m_cpal->numPalettes () == 1 ? tr ("palette") : tr ("palettes")),
 	    this);
-        if (choice == QMessageBox::No) {
+        if (!choice) {
 	    m_numPalettesBox->blockSignals (true);
 	    m_numPalettesBox->setValue (m_cpal->numPalettes ());
 	    m_numPalettesBox->blockSignals (false);
@@ -341,7 +341,7 @@ void CpalEdit::setEntriesNumber (int value) {
     if (value == m_cpal->numPaletteEntries ())
 	return;
     else if (value < m_cpal->numPaletteEntries ()) {
-        int choice = FontShepherd::postYesNoQuestion (
+        bool choice = FontShepherd::postYesNoQuestion (
 	    tr ("Decrease number of palette entries"),
 	    tr (
 		"Would you like to decrease the number of palette entries? "
@@ -349,7 +349,7 @@ void CpalEdit::setEntriesNumber (int value) {
 		.arg ((int) m_cpal->numPaletteEntries () - value)
 		.arg ((int) m_cpal->numPaletteEntries () - value > 1 ? "colors" : "color"),
 	    this);
-        if (choice == QMessageBox::No) {
+        if (!choice) {
 	    m_numEntriesBox->blockSignals (true);
 	    m_numEntriesBox->setValue (m_cpal->numPaletteEntries ());
 	    m_numEntriesBox->blockSignals (false);
@@ -41,6 +41,7 @@ SOURCES += editors/instredit.cpp
 SOURCES += editors/maxpedit.cpp
 SOURCES += editors/os_2edit.cpp
 SOURCES += editors/postedit.cpp
+SOURCES += editors/tableedit.cpp
 SOURCES += editors/tinyfont.cpp
 SOURCES += editors/qdruler.cpp
 SOURCES += editors/unispinbox.cpp
@@ -64,6 +65,7 @@ HEADERS += editors/maxpedit.h
 HEADERS += editors/nameedit.h
 HEADERS += editors/os_2edit.h
 HEADERS += editors/postedit.h
+HEADERS += editors/tableedit.h
 HEADERS += editors/tinyfont.h
 HEADERS += editors/unispinbox.h
 HEADERS += editors/glyphprops.h
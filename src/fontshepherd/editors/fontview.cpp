@@ -30,6 +30,9 @@
 #include <assert.h>
 #include <stdint.h>
 #include <limits>
+#include <mutex>
+#include <atomic>
+#include <QtConcurrent>
 
 #include "sfnt.h"
 #include "editors/fontview.h" // also includes tables.h
@@ -54,6 +57,7 @@
 #include "editors/glyphprops.h"
 
 #include "fs_notify.h"
+#include "fs_trace.h"
 #include "icuwrapper.h"
 
 FVLayout::FVLayout (QWidget *parent, int margin, int hSpacing, int vSpacing)
@@ -648,6 +652,7 @@ void FontView::contextMenuEvent (QContextMenuEvent *event) {
 }
 
 void FontView::prepareGlyphCells () {
+    FS_TRACE_SCOPE ("FontView::prepareGlyphCells");
     QWidget *window = new QWidget (this);
     window->setLayout (m_layout);
     m_scroll->setWidget (window);
@@ -943,11 +948,8 @@ void FontView::save () {
 
     if (post && m_post_changed) {
 	post->packData ();
-	TableEdit *ed = post->editor ();
-	if (ed) {
-	    PostEdit *pe = qobject_cast<PostEdit *> (ed);
-	    if (pe) pe->resetData ();
-	}
+	TableEditor *ed = post->editor ();
+	if (ed) ed->resetData ();
 	m_post_changed = false;
     }
 
@@ -959,27 +961,30 @@ void FontView::save () {
     // If we have added any glyphs while the contents of the SVG table was displayed
     // and then going to save the table, then the main glyph container table
     // (glyf or CFF/CFF2) should also be saved to match the new glyph count.
-    // This means we have to ensure all its glyphs have already been loaded.
+    // For CFF this means we have to ensure all its glyphs have already been
+    // loaded, while glyf just copies data for glyphs which are not loaded.
     // Note that the opposite is not necessary, as it is OK to have some glyphs
     // missing in the SVG table
     if (m_gcount_changed && m_gc_table == m_svg_table) {
 	std::shared_ptr<GlyphContainer> other_cnt = m_glyf_table ? m_glyf_table : m_cff_table;
 	OutlinesType other_type = other_cnt->outlinesType ();
 
-	QProgressDialog progress (tr ("Loading glyphs..."), tr ("Abort"), 0, gcnt, this);
-	progress.setCancelButton (nullptr);
-	progress.setWindowModality (Qt::WindowModal);
-	progress.show ();
-
-	for (size_t i=0; i<gcnt; i++) {
-	    GlyphContext &gctx = m_glyphs[i];
-	    if (!gctx.hasOutlinesType (other_type)) {
-		ConicGlyph *g = other_cnt->glyph (m_font, i);
-		gctx.setGlyph (other_type, g);
+	if (other_type != OutlinesType::TT) {
+	    QProgressDialog progress (tr ("Loading glyphs..."), tr ("Abort"), 0, gcnt, this);
+	    progress.setCancelButton (nullptr);
+	    progress.setWindowModality (Qt::WindowModal);
+	    progress.show ();
+
+	    for (size_t i=0; i<gcnt; i++) {
+		GlyphContext &gctx = m_glyphs[i];
+		if (!gctx.hasOutlinesType (other_type)) {
+		    ConicGlyph *g = other_cnt->glyph (m_font, i);
+		    gctx.setGlyph (other_type, g);
+		}
+		progress.setValue (i);
 	    }
-	    progress.setValue (i);
+	    progress.setValue (gcnt);
 	}
-	progress.setValue (gcnt);
 	other_cnt->packData ();
     }
 
@@ -1884,67 +1889,183 @@ void FontView::mouseMoveEvent (QMouseEvent* ev) {
     }
 }
 
+void FontView::attachGlyph (uint16_t gid, bool force) {
+    GlyphContext &gctx = m_glyphs[gid];
+
+    if (force || !gctx.hasOutlinesType (m_content_type)) {
+	ConicGlyph *g = m_gc_table->glyph (m_font, gid);
+	gctx.setGlyph (m_content_type, g);
+	if (m_content_type == OutlinesType::COLR) {
+	    if (m_cff_table && !gctx.hasOutlinesType (OutlinesType::PS)) {
+		ConicGlyph *psg = m_cff_table->glyph (m_font, gid);
+		gctx.setGlyph (OutlinesType::PS, psg);
+	    } else if (m_glyf_table && !gctx.hasOutlinesType (OutlinesType::TT)) {
+		ConicGlyph *ttg = m_glyf_table->glyph (m_font, gid);
+		gctx.setGlyph (OutlinesType::TT, ttg);
+	    }
+	    gctx.providePalette (m_cpal->palette (0));
+	}
+    }
+    gctx.setFontViewSize (m_cell_size);
+    gctx.switchOutlinesType (m_content_type, false);
+}
+
+// Decode glyphs on worker threads in ranges of 256 GIDs. Each finished range is
+// queued and then attached to its glyph contexts by the GUI thread, which stays
+// responsive meanwhile
+bool FontView::attachGlyphsInParallel (QProgressDialog &progress, bool force) {
+    typedef std::pair<uint16_t, uint16_t> glyph_range;
+    const uint16_t range_size = 256;
+    uint16_t gcnt = m_font->glyph_cnt;
+    std::vector<glyph_range> ranges;
+    for (uint32_t start=0; start<gcnt; start+=range_size)
+	ranges.emplace_back (start, std::min<uint32_t> (start+range_size, gcnt));
+
+    std::vector<glyph_range> finished;
+    std::mutex finished_lock;
+    std::atomic<bool> canceled (false);
+    GlyphContainer *gc = m_gc_table.get ();
+    sFont *fnt = m_font;
+    int done = 0;
+
+    auto decodeRange = [&] (const glyph_range &r) {
+	FS_TRACE_SCOPE ("glyph range decode");
+	for (uint32_t gid=r.first; gid<r.second && !canceled; gid++)
+	    gc->glyph (fnt, gid);
+	std::lock_guard<std::mutex> lock (finished_lock);
+	finished.push_back (r);
+    };
+    auto attachFinished = [&] () {
+	std::vector<glyph_range> ready;
+	{
+	    std::lock_guard<std::mutex> lock (finished_lock);
+	    ready.swap (finished);
+	}
+	for (auto &r : ready) {
+	    for (uint32_t gid=r.first; gid<r.second; gid++)
+		attachGlyph (gid, force);
+	    done += r.second - r.first;
+	}
+	progress.setValue (done);
+    };
+
+    QFutureWatcher<void> watcher;
+    QEventLoop loop;
+    connect (&watcher, &QFutureWatcher<void>::progressValueChanged, attachFinished);
+    connect (&watcher, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
+    connect (&progress, &QProgressDialog::canceled, &watcher, [&] () {
+	canceled = true;
+	watcher.cancel ();
+    });
+    watcher.setFuture (QtConcurrent::map (ranges, decodeRange));
+    if (!watcher.isFinished ())
+	loop.exec ();
+    watcher.waitForFinished ();
+    if (canceled)
+	return false;
+    // Progress notifications are throttled, so some ranges may still be waiting
+    attachFinished ();
+    return true;
+}
+
+// Order glyphs so that components come before composites referring to them:
+// resolving a composite glyph is then able to use final outlines and bounding
+// boxes of its components. Reference cycles are just broken at an arbitrary
+// point, as they are going to be reported elsewhere
+static std::vector<uint16_t> referenceOrder (std::deque<GlyphContext> &glyphs, OutlinesType gtype) {
+    size_t cnt = glyphs.size ();
+    std::vector<uint16_t> order;
+    std::vector<uint8_t> visited (cnt, false);
+    std::vector<std::pair<uint16_t, size_t>> stack;
+    order.reserve (cnt);
+
+    for (size_t root=0; root<cnt; root++) {
+	if (visited[root])
+	    continue;
+	visited[root] = true;
+	stack.emplace_back (root, 0);
+	while (!stack.empty ()) {
+	    uint16_t gid = stack.back ().first;
+	    size_t next = stack.back ().second;
+	    ConicGlyph *g = glyphs[gid].glyph (gtype);
+	    if (g && next < g->refs.size ()) {
+		uint16_t ref_gid = g->refs[next].GID;
+		stack.back ().second++;
+		if (ref_gid < cnt && !visited[ref_gid]) {
+		    visited[ref_gid] = true;
+		    stack.emplace_back (ref_gid, 0);
+		}
+	    } else {
+		order.push_back (gid);
+		stack.pop_back ();
+	    }
+	}
+    }
+    return order;
+}
+
+// Glyphs are decoded into the editable form here, rather than drawn into cells
+// from flat outlines (see GlyphContainer::flatOutline ()): selection, metrics,
+// clipboard and reference tracking in the font view all work on ConicGlyph
 bool FontView::loadGlyphs () {
+    FS_TRACE_SCOPE ("FontView::loadGlyphs");
     uint16_t i;
-    ConicGlyph *g;
-    std::vector<uint16_t> refs;
     bool needs_ctx_init = ((int) m_glyphs.size () < m_font->glyph_cnt);
 
     QProgressDialog progress (tr ("Loading glyphs..."), tr ("Abort"), 0, m_font->glyph_cnt, this);
     progress.setWindowModality (Qt::WindowModal);
     progress.show ();
 
-    for (i=0; i<m_font->glyph_cnt; i++) {
-        std::string gname;
-        if (needs_ctx_init) {
-            gname = m_gnp.nameByGid (i);
-            m_glyphs.emplace_back (i, m_gnp, m_glyphs);
-        }
-        GlyphContext &gctx = m_glyphs[i];
-
-        if (needs_ctx_init || !gctx.hasOutlinesType (m_content_type)) {
-            g = m_gc_table->glyph (m_font, i);
-            gctx.setGlyph (m_content_type, g);
-	    if (m_content_type == OutlinesType::COLR) {
-		if (m_cff_table && !gctx.hasOutlinesType (OutlinesType::PS)) {
-		    ConicGlyph *psg = m_cff_table->glyph (m_font, i);
-		    gctx.setGlyph (OutlinesType::PS, psg);
-		} else if (m_glyf_table && !gctx.hasOutlinesType (OutlinesType::TT)) {
-		    ConicGlyph *ttg = m_glyf_table->glyph (m_font, i);
-		    gctx.setGlyph (OutlinesType::TT, ttg);
-		}
-		gctx.providePalette (m_cpal->palette (0));
-	    }
-        }
-	gctx.setFontViewSize (m_cell_size);
-        gctx.switchOutlinesType (m_content_type, false);
-
-        if (needs_ctx_init)
-            m_ug_container->addGroup (gctx.undoGroup ());
+    if (needs_ctx_init) {
+	for (i=m_glyphs.size (); i<m_font->glyph_cnt; i++) {
+	    m_glyphs.emplace_back (i, m_gnp, m_glyphs);
+	    m_ug_container->addGroup (m_glyphs.back ().undoGroup ());
+	}
+    }
 
-        qApp->instance ()->processEvents ();
-        if (progress.wasCanceled ())
-            return false;
-        progress.setValue (i);
+    // COLR glyphs are attached together with their TT/PS counterparts, which is
+    // simpler to do in a single thread
+    if (m_gc_table->parallelDecodable () && m_content_type != OutlinesType::COLR) {
+	if (!attachGlyphsInParallel (progress, needs_ctx_init))
+	    return false;
+    } else {
+	for (i=0; i<m_font->glyph_cnt; i++) {
+	    attachGlyph (i, needs_ctx_init);
+	    if (!(i%64)) {
+		qApp->instance ()->processEvents ();
+		if (progress.wasCanceled ())
+		    return false;
+		progress.setValue (i);
+	    }
+	}
     }
     progress.setValue (m_font->glyph_cnt);
 
     progress.setLabelText (tr ("Resolving references..."));
+    progress.setValue (0);
     progress.show ();
 
-    for (i=0; i<m_font->glyph_cnt; i++) {
-        g = m_glyphs[i].glyph (m_content_type);
-        if (g) {
-	    if (m_content_type == OutlinesType::COLR &&
-		m_outlines_avail & (uint8_t) OutlinesType::TT) {
-		m_glyphs[i].resolveRefs (OutlinesType::TT);
+    std::vector<OutlinesType> passes;
+    if (m_content_type == OutlinesType::COLR &&
+	m_outlines_avail & (uint8_t) OutlinesType::TT)
+	passes.push_back (OutlinesType::TT);
+    passes.push_back (m_content_type);
+
+    // Composite glyphs normally form a small part of a font, so resolving them is
+    // quick. Still process GUI events from time to time rather than on each glyph
+    for (size_t pass=0; pass<passes.size (); pass++) {
+	OutlinesType gtype = passes[pass];
+	std::vector<uint16_t> order = referenceOrder (m_glyphs, gtype);
+	for (size_t j=0; j<order.size (); j++) {
+	    if (m_glyphs[order[j]].glyph (m_content_type))
+		m_glyphs[order[j]].resolveRefs (gtype);
+	    if (!(j%256)) {
+		qApp->instance ()->processEvents ();
+		if (progress.wasCanceled ())
+		    return false;
+		progress.setValue (j);
 	    }
-            m_glyphs[i].resolveRefs (m_content_type);
-            qApp->instance ()->processEvents ();
-        }
-        if (progress.wasCanceled ())
-            return false;
-        progress.setValue (i);
+	}
     }
     progress.setValue (m_font->glyph_cnt);
     return true;
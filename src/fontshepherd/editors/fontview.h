@@ -28,7 +28,7 @@
 #include <deque>
 
 #include <QtWidgets>
-#include "tables.h" // Have to load it here due to inheritance from TableEdit
+#include "editors/tableedit.h" // also includes tables.h
 #include "charbuffer.h"
 #include "tables/glyphnames.h"
 
@@ -192,6 +192,8 @@ private slots:
 private:
     void loadTables (uint32_t tag);
     bool loadGlyphs ();
+    void attachGlyph (uint16_t gid, bool force);
+    bool attachGlyphsInParallel (QProgressDialog &progress, bool force);
     //bool ftRenderGlyphs ();
     bool switchGlyphOutlines ();
     void switchOutlines (OutlinesType val);
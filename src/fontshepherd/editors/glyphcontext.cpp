@@ -42,8 +42,17 @@
 
 #include "fs_notify.h"
 #include "fs_math.h"
+#include "fs_trace.h"
 #include "fs_undo.h"
 
+// The clean state of the undo stack tells the glyph if it has been modified
+class GlyphUndoStack : public QUndoStack, public GlyphHistory {
+public:
+    bool isClean () const override { return QUndoStack::isClean (); }
+    void setClean () override { QUndoStack::setClean (); }
+    void resetClean () override { QUndoStack::resetClean (); }
+};
+
 GlyphContext::GlyphContext (uint16_t gid, GlyphNameProvider &gnp, std::deque<GlyphContext> &glyphs) :
     awItem (nullptr),
     m_gnp (gnp),
@@ -87,21 +96,30 @@ void GlyphContext::setGlyph (OutlinesType gtype, ConicGlyph *g) {
 	;
     }
     if (g) {
-	m_fvUndoGroup->addStack (g->undoStack ());
-	m_gvUndoGroup->addStack (g->undoStack ());
+	m_fvUndoGroup->addStack (undoStack (g));
+	m_gvUndoGroup->addStack (undoStack (g));
     }
 }
 
 void GlyphContext::clearSvgGlyph () {
     if (m_svg_glyph) {
-	m_fvUndoGroup->removeStack (m_svg_glyph->undoStack ());
-	m_gvUndoGroup->removeStack (m_svg_glyph->undoStack ());
+	m_fvUndoGroup->removeStack (undoStack (m_svg_glyph));
+	m_gvUndoGroup->removeStack (undoStack (m_svg_glyph));
 	m_svg_glyph = nullptr;
     }
     if (m_fv_type == OutlinesType::SVG)
 	render (m_fv_type, m_fv_size);
 }
 
+QUndoStack *GlyphContext::undoStack (ConicGlyph *g) {
+    GlyphUndoStack *us = dynamic_cast<GlyphUndoStack *> (g->history ());
+    if (!us) {
+	us = new GlyphUndoStack ();
+	g->setHistory (us);
+    }
+    return us;
+}
+
 bool GlyphContext::hasOutlinesType (OutlinesType gtype) {
     switch (gtype) {
       case OutlinesType::TT:
@@ -123,7 +141,7 @@ void GlyphContext::switchOutlinesType (OutlinesType gtype, bool gv) {
     m_pixmap = QPixmap ();
 
     if (glyph (gtype))
-	ug->setActiveStack (glyph (gtype)->undoStack ());
+	ug->setActiveStack (undoStack (glyph (gtype)));
     else
 	ug->setActiveStack (nullptr);
 }
@@ -608,6 +626,7 @@ void GlyphContext::renderNoGlyph (uint16_t size) {
 }
 
 void GlyphContext::render (OutlinesType gtype, uint16_t size) {
+    FS_TRACE_SCOPE ("GlyphContext::render");
     m_fv_size = size;
     QPainter p;
     QImage canvas (size, size, QImage::Format_ARGB32_Premultiplied);
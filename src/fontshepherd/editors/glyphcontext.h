@@ -136,6 +136,8 @@ public:
     void addDependent (uint16_t gid);
     void removeDependent (uint16_t gid);
 
+    // Undo stack of the glyph, attached to it on first use
+    static QUndoStack *undoStack (ConicGlyph *g);
     static QBrush figureBrush (const SvgState &state, cpal_palette *pal, std::map<std::string, Gradient> &gradients, bool fill=true);
 
 private:
@@ -1652,6 +1652,34 @@ static void show_hint (QPainter *painter, const QRectF &exposed, const StemInfo
     }
 }
 
+static int ft_move_to (const FT_Vector *to, void *user) {
+    QPainterPath *path = static_cast<QPainterPath *> (user);
+    path->moveTo (QPointF (to->x, to->y));
+    return 0;
+}
+
+static int ft_line_to (const FT_Vector *to, void *user) {
+    QPainterPath *path = static_cast<QPainterPath *> (user);
+    path->lineTo (QPointF (to->x, to->y));
+    return 0;
+}
+
+static int ft_conic_to (const FT_Vector *control, const FT_Vector *to, void *user) {
+    QPainterPath *path = static_cast<QPainterPath *> (user);
+    path->quadTo (QPointF (control->x, control->y), QPointF (to->x, to->y));
+    return 0;
+}
+
+static int ft_cubic_to (const FT_Vector *c1, const FT_Vector *c2, const FT_Vector *to, void *user) {
+    QPainterPath *path = static_cast<QPainterPath *> (user);
+    path->cubicTo (QPointF (c1->x, c1->y), QPointF (c2->x, c2->y), QPointF (to->x, to->y));
+    return 0;
+}
+
+static const FT_Outline_Funcs ft_path_funcs = {
+    &ft_move_to, &ft_line_to, &ft_conic_to, &ft_cubic_to, 0, 0
+};
+
 static void draw_gridFittedBitmap (QPainter *p, ConicGlyph *g, freetype_raster &r, int ppemX, int ppemY) {
     static QPen whitePen (Qt::white, 1);
     static QPen melrosePen (QColor (0xb0, 0xb0, 0xff), 3);
@@ -1734,7 +1762,7 @@ void GlyphScene::drawBackground (QPainter *painter, const QRectF &exposed) {
 	}
 
 	if (!m_ftWrapper.setPixelSize (ppemX, ppemY)) {
-	    freetype_raster r = m_ftWrapper.gridFitGlyph (m_context.gid (), ft_flags, &p);
+	    freetype_raster r = m_ftWrapper.gridFitGlyph (m_context.gid (), ft_flags, &ft_path_funcs, &p);
 
 	    if (r.valid) {
 		draw_gridFittedBitmap (painter, m_context.glyph (m_outlines_type), r, ppemX, ppemY);
@@ -25,6 +25,7 @@
  * POSSIBILITY OF SUCH DAMAGE. */
 
 #include "fs_math.h"
+#include "fs_trace.h"
 
 #include "editors/fontview.h" // also includes tables.h
 #include "editors/glyphview.h"
@@ -530,6 +531,7 @@ GlyphChangeCommand::GlyphChangeCommand (GlyphContext &ctx, OutlinesType gtype, Q
     m_outlines_type (gtype),
     m_undone (false)
 {
+    FS_TRACE_SCOPE ("undo snapshot");
     ConicGlyph *g = m_context.glyph (gtype);
     undo_svg = g->toSVG ();
     redo_svg = "";
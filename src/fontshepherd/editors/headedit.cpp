@@ -330,13 +330,13 @@ void HeadEdit::closeEvent (QCloseEvent *event) {
 void HeadEdit::save () {
     uint32_t magic = m_magicField->text ().toUInt (nullptr, 0);
     if (magic != 0x5F0F3CF5) {
-        int choice = FontShepherd::postYesNoQuestion (
+        bool choice = FontShepherd::postYesNoQuestion (
 	    QCoreApplication::tr ("Compiling 'head' table"),
 	    QCoreApplication::tr (
 	    "The Magic Number should be 0x5F0F3CF5, 0x%1 is provided. "
 	    "Are you shure?").arg (magic, 0, 16),
 	    this);
-        if (choice == QMessageBox::No)
+        if (!choice)
 	    return;
     }
 
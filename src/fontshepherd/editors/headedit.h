@@ -25,7 +25,7 @@
  * POSSIBILITY OF SUCH DAMAGE. */
 
 #include <QtWidgets>
-#include "tables.h" // Have to load it here due to inheritance from TableEdit
+#include "editors/tableedit.h" // also includes tables.h
 
 class sfntFile;
 typedef struct ttffont sFont;
@@ -34,10 +34,7 @@
 
 #include "sfnt.h"
 #include "editors/maxpedit.h" // also includes tables.h
-#include "editors/instredit.h"
 #include "tables/maxp.h"
-#include "tables/glyphcontainer.h"
-#include "tables/instr.h"
 
 #include "fs_notify.h"
 
@@ -176,10 +173,10 @@ MaxpEdit::MaxpEdit (std::shared_ptr<FontTable> tptr, sFont* font, QWidget *paren
 
 void MaxpEdit::fillControls (maxp_data &d) {
     m_versionBox->setCurrentIndex
-	(m_versionBox->findData (m_maxp->version (), Qt::UserRole));
+	(m_versionBox->findData (d.version, Qt::UserRole));
     m_numGlyphsBox->setValue (d.numGlyphs);
 
-    if (m_maxp->version () >= 1) {
+    if (d.version >= 1) {
 	m_maxPointsBox->setValue (d.maxPoints);
 	m_maxContoursBox->setValue (d.maxContours);
 	m_maxCompositePointsBox->setValue (d.maxCompositePoints);
@@ -254,160 +251,9 @@ void MaxpEdit::save () {
 }
 
 void MaxpEdit::calculate () {
-    GlyphContainer *glyf = dynamic_cast<GlyphContainer*> (m_font->table (CHR ('g','l','y','f')));
-    GlyphContainer *cff = dynamic_cast<GlyphContainer*> (m_font->table (CHR ('C','F','F',' ')));
-    GlyphContainer *cff2 = dynamic_cast<GlyphContainer*> (m_font->table (CHR ('C','F','F','2')));
-    if (glyf)
-	calculateTTF (glyf);
-    else if (cff)
-	calculateCFF (cff);
-    else if (cff2)
-	calculateCFF (cff2);
-    else
-        FontShepherd::postError (
-            QCoreApplication::tr ("'maxp' table error"),
-            QCoreApplication::tr ("This font has neither 'glyf' nor 'CFF' or 'CFF2' tables. "
-		"Don't know how to calculate 'maxp' table contents"),
-            nullptr);
-}
-
-void MaxpEdit::calculateCFF (GlyphContainer *cff) {
-    m_versionBox->setCurrentIndex (m_versionBox->findData (0.5, Qt::UserRole));
-    cff->fillup ();
-    cff->unpackData (m_font);
-    uint16_t gcnt = cff->countGlyphs ();
-    m_numGlyphsBox->setValue (gcnt);
-}
-
-void MaxpEdit::calculateTTF (GlyphContainer *glyf) {
-    InstrTable *fpgm = dynamic_cast<InstrTable*> (m_font->table (CHR ('f','p','g','m')));
-    InstrTable *prep = dynamic_cast<InstrTable*> (m_font->table (CHR ('p','r','e','p')));
-    FontTable *cvt = m_font->table (CHR ('c','v','t',' '));
-
     maxp_data d;
-
-    instr_props props;
-    props.maxTwilight = 0;
-    props.maxStackDepth = 0;
-    props.maxStorage = 0;
-    props.numIdefs = 0;
-    props.z0used = false;
-    props.rBearingTouched = false;
-
-    GraphicsState state;
-    state.size = 24;
-    state.upm = m_font->units_per_em;
-
-    m_versionBox->setCurrentIndex (m_versionBox->findData (1.0, Qt::UserRole));
-    if (fpgm) {
-	fpgm->fillup ();
-	std::vector<uint8_t> vdata (reinterpret_cast<uint8_t *> (fpgm->getData ()),
-	    reinterpret_cast<uint8_t *> (fpgm->getData ()) + fpgm->length ());
-	InstrEdit::quickExecute (vdata, state, props);
-	InstrEdit::reportError (state, CHR ('f','p','g','m'), 0xFFFF);
-    }
-    if (cvt) {
-	cvt->fillup ();
-	state.cvt.reserve (cvt->dataLength ()/2);
-	uint32_t pos = 0;
-	while (pos < cvt->dataLength ()) {
-	    int16_t cvt_val = cvt->getushort (pos);
-	    pos += 2;
-	    state.cvt.push_back (std::lround (static_cast<double> (cvt_val) * state.size / state.upm * 64));
-	}
-    }
-    if (prep) {
-	prep->fillup ();
-        std::vector<uint8_t> vdata (reinterpret_cast<uint8_t *> (prep->getData ()),
-	    reinterpret_cast<uint8_t *> (prep->getData ()) + prep->length ());
-        InstrEdit::quickExecute (vdata, state, props);
-	InstrEdit::reportError (state, CHR ('p','r','e','p'), 0xFFFF);
-    }
-
-    glyf->fillup ();
-    glyf->unpackData (m_font);
-    uint16_t gcnt = glyf->countGlyphs ();
-
-    // probably there is no reason in attempting to execute glyph program, if there was
-    // an error reading 'prep'
-    if (!state.errorCode) {
-	QProgressDialog progress (
-	    tr ("Executing glyph programs"), tr ("Abort"), 0, gcnt, this);
-	progress.setWindowModality (Qt::WindowModal);
-	progress.show ();
-
-	for (size_t i=0; i<gcnt; i++) {
-	    ConicGlyph *g = glyf->glyph (m_font, i);
-
-	    qApp->instance ()->processEvents ();
-	    if (progress.wasCanceled ())
-		break;
-	    progress.setValue (i);
-
-	    uint16_t pcnt, numcnt;
-	    std::vector<uint16_t> refs = g->refersTo ();
-	    if (refs.empty ()) {
-		pcnt = g->numCompositePoints ();
-		numcnt = g->numCompositeContours ();
-
-		if ((pcnt) > d.maxPoints)
-		    d.maxPoints = pcnt;
-		if ((numcnt) > d.maxContours)
-		    d.maxContours = numcnt;
-	    } else {
-		// cf. GlyphContext::resolveRefs, but here is a simpler version,
-		// as only TrueType glyphs are involved
-		g->provideRefGlyphs (m_font, glyf);
-		if (g->checkRefs (g->gid (), gcnt) != 0) continue;
-		// essentially not needed, but let it be here for consistence
-		g->finalizeRefs ();
-
-		pcnt = g->numCompositePoints ();
-		numcnt = g->numCompositeContours ();
-		uint16_t cd = g->componentDepth ();
-
-		if ((pcnt) > d.maxCompositePoints)
-		    d.maxCompositePoints = pcnt;
-		if ((numcnt) > d.maxCompositeContours)
-		    d.maxCompositeContours = numcnt;
-		if (refs.size () > d.maxComponentElements)
-		    d.maxComponentElements = refs.size ();
-		if (cd > d.maxComponentDepth)
-		    d.maxComponentDepth = cd;
-	    }
-	    if (g->instructions.empty ()) continue;
-
-	    if (g->instructions.size () > d.maxSizeOfInstructions)
-		d.maxSizeOfInstructions = g->instructions.size ();
-
-	    props.rBearingPointNum = pcnt+1;
-	    props.rBearingTouched = false;
-
-	    GraphicsState gstate = state;
-	    gstate.g = g;
-	    for (size_t j=0; j<3; j++) {
-		gstate.zp[j] = 1;
-		gstate.rp[j] = 0;
-	    }
-
-	    InstrEdit::quickExecute (g->instructions, gstate, props);
-	    InstrEdit::reportError (gstate, CHR ('g','l','y','f'), i);
-	    if (gstate.twilightPts.size () > props.maxTwilight)
-		props.maxTwilight = gstate.twilightPts.size ();
-	    if (gstate.storage.size () > props.maxStorage)
-		props.maxStorage = gstate.storage.size ();
-	}
-	progress.setValue (gcnt);
-    }
-
-    d.numGlyphs = gcnt;
-    d.maxZones = props.z0used ? 2 : 1;
-    d.maxTwilightPoints = props.maxTwilight;
-    d.maxStorage = props.maxStorage;
-    d.maxFunctionDefs = props.fdefs.size ();
-    d.maxInstructionDefs = props.numIdefs;
-    d.maxStackElements = props.maxStackDepth;
-    fillControls (d);
+    if (MaxpTable::calculate (m_font, d, this))
+	fillControls (d);
 }
 
 void MaxpEdit::setTableVersion (int idx) {
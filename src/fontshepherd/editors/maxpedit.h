@@ -25,7 +25,7 @@
  * POSSIBILITY OF SUCH DAMAGE. */
 
 #include <QtWidgets>
-#include "tables.h" // Have to load it here due to inheritance from TableEdit
+#include "editors/tableedit.h" // also includes tables.h
 
 class sfntFile;
 typedef struct ttffont sFont;
@@ -58,8 +58,6 @@ public slots:
 
 private:
     void fillControls (maxp_data &d);
-    void calculateCFF (GlyphContainer *cff);
-    void calculateTTF (GlyphContainer *glyf);
 
     std::shared_ptr<MaxpTable> m_maxp;
     sFont *m_font;
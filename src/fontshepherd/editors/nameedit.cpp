@@ -196,14 +196,14 @@ void NameEdit::save () {
 void NameEdit::switchTableVersion (int index) {
     if (index == 0) {
 	if (m_name->numLangTags () > 0) {
-	    int choice = FontShepherd::postYesNoQuestion (
+	    bool choice = FontShepherd::postYesNoQuestion (
 		QCoreApplication::tr ("Setting 'name' table format"),
 		QCoreApplication::tr (
 		    "Are you sure you want to switch to format 0?  "
 		    "You will lose all custom language tags and assotiated "
 		    "strings in the 'name' table. "),
 		this);
-	    if (choice == QMessageBox::No)
+	    if (!choice)
 		return;
 	    QAbstractItemModel *almod = m_langtab->model();
 	    LangTagModel *lmod = qobject_cast<LangTagModel *> (almod);
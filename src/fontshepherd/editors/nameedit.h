@@ -28,7 +28,7 @@
 #define _FONSHEPHERD_NAMEEDIT_H
 #include <QtWidgets>
 #include <QAbstractListModel>
-#include "tables.h"
+#include "editors/tableedit.h" // also includes tables.h
 
 class sfntFile;
 typedef struct ttffont sFont;
@@ -270,25 +270,25 @@ void PostEdit::setTableVersion (int idx) {
 	return;
 
     if (newver == 3.0) {
-        int choice = FontShepherd::postYesNoQuestion (
+        bool choice = FontShepherd::postYesNoQuestion (
 	    QCoreApplication::tr ("Setting 'post' table version"),
 	    QCoreApplication::tr (
 	    "Are you sure you would like to remove glyph names "
 	    "from the 'post' table?"),
 	    this);
-        if (choice == QMessageBox::No) {
+        if (!choice) {
 	    m_versionBox->setCurrentIndex
 		(m_versionBox->findData (m_post->version (), Qt::UserRole));
 	    return;
 	}
     } else if (newver == 2.0 && m_gnp->glyphNameSource () == CHR ('C','F','F',' ')) {
-        int choice = FontShepherd::postYesNoQuestion (
+        bool choice = FontShepherd::postYesNoQuestion (
 	    QCoreApplication::tr ("Setting 'post' table version"),
 	    QCoreApplication::tr (
 	    "This is an OpenType-CFF font, which stores its glyph names "
 	    "in the 'CFF ' table. Would you like to additionally put them to te 'post' table?"),
 	    this);
-        if (choice == QMessageBox::No) {
+        if (!choice) {
 	    m_versionBox->setCurrentIndex
 		(m_versionBox->findData (m_post->version (), Qt::UserRole));
 	    return;
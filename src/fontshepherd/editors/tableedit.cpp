@@ -0,0 +1,299 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+#include "sfnt.h"
+#include "editors/tableedit.h" // also includes tables.h
+#include "editors/cmapedit.h"
+#include "editors/cpaledit.h"
+#include "editors/devmetricsedit.h"
+#include "editors/fontview.h"
+#include "editors/gaspedit.h"
+#include "editors/headedit.h"
+#include "editors/heaedit.h"
+#include "editors/instredit.h"
+#include "editors/maxpedit.h"
+#include "editors/nameedit.h"
+#include "editors/os_2edit.h"
+#include "editors/postedit.h"
+#include "tables/cmap.h"
+#include "tables/colr.h"
+#include "tables/devmetrics.h"
+#include "tables/gasp.h"
+#include "tables/glyphcontainer.h"
+#include "tables/glyphnames.h"
+#include "tables/hea.h"
+#include "tables/head.h"
+#include "tables/instr.h"
+#include "tables/maxp.h"
+#include "tables/name.h"
+#include "tables/os_2.h"
+#include "qhexedit.h"
+
+// Most editors expect the table to be already unpacked
+template <class Editor>
+static Editor *openEditor (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller, bool unpack=true) {
+    if (unpack)
+	tptr->unpackData (fnt);
+    Editor *ed = new Editor (tptr, fnt, caller);
+    tptr->setEditor (ed);
+    ed->show ();
+    return ed;
+}
+
+void TableEdit::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
+    FontTable *tab = tptr.get ();
+    TableEdit *tv = dynamic_cast<TableEdit *> (tab->editor ());
+
+    // No fillup for glyph containers, as it is done by fontview
+    if (dynamic_cast<ColrTable *> (tab)) {
+	if (tv) {
+	    tv->raise ();
+	    return;
+	}
+        FontView *fv = new FontView (tptr, fnt, caller);
+        if (!fv->isValid ()) {
+            fv->close ();
+            return;
+        }
+        tab->setEditor (fv);
+        fv->show ();
+	return;
+    } else if (dynamic_cast<GlyphContainer *> (tab)) {
+	FontView *fv = caller->findChild<FontView *> ();
+	if (fv) {
+	    fv->setTable (tptr);
+	    fv->raise ();
+	} else {
+	    fv = new FontView (fnt->sharedTable (tab->iName ()), fnt, caller);
+	    if (!fv->isValid ()) {
+		fv->close ();
+		return;
+	    }
+	    tab->setEditor (fv);
+	    fv->show ();
+	}
+	return;
+    }
+
+    bool maybe_new = dynamic_cast<MaxpTable *> (tab) ||
+	dynamic_cast<HdmxTable *> (tab) || dynamic_cast<VdmxTable *> (tab);
+    if (!tab->loaded () && !(maybe_new && tab->isNew ()))
+        tab->fillup ();
+
+    if (tv) {
+	tv->raise ();
+    } else if (dynamic_cast<CmapTable *> (tab)) {
+	openEditor<CmapEdit> (fnt, tptr, caller, false);
+    } else if (dynamic_cast<InstrTable *> (tab)) {
+	openEditor<InstrTableEdit> (fnt, tptr, caller, false);
+    } else if (dynamic_cast<CpalTable *> (tab)) {
+	openEditor<CpalEdit> (fnt, tptr, caller);
+    } else if (dynamic_cast<GaspTable *> (tab)) {
+	openEditor<GaspEdit> (fnt, tptr, caller);
+    } else if (dynamic_cast<HeaTable *> (tab)) {
+	openEditor<HeaEdit> (fnt, tptr, caller);
+    } else if (dynamic_cast<HeadTable *> (tab)) {
+	openEditor<HeadEdit> (fnt, tptr, caller);
+    } else if (dynamic_cast<NameTable *> (tab)) {
+	openEditor<NameEdit> (fnt, tptr, caller);
+    } else if (dynamic_cast<OS_2Table *> (tab)) {
+	openEditor<OS_2Edit> (fnt, tptr, caller);
+    } else if (dynamic_cast<MaxpTable *> (tab)) {
+	openEditor<MaxpEdit> (fnt, tptr, caller);
+    } else if (dynamic_cast<HdmxTable *> (tab)) {
+	openEditor<HdmxEdit> (fnt, tptr, caller);
+    } else if (dynamic_cast<VdmxTable *> (tab)) {
+	openEditor<VdmxEdit> (fnt, tptr, caller);
+    } else if (dynamic_cast<PostTable *> (tab)) {
+	PostEdit *postedit = openEditor<PostEdit> (fnt, tptr, caller);
+	FontView *fv = caller->findChild<FontView *> ();
+	if (fv)
+	    QObject::connect (postedit, &PostEdit::glyphNamesChanged, fv, &FontView::updateGlyphNames);
+    } else {
+	hexEdit (fnt, tptr, caller);
+    }
+}
+
+void TableEdit::hexEdit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
+    if (!tptr->loaded () && !tptr->isNew ())
+        tptr->fillup ();
+
+    TableEdit *tv = dynamic_cast<TableEdit *> (tptr->editor ());
+    if (tv == nullptr) {
+        HexTableEdit *hexedit = new HexTableEdit (tptr, caller);
+        hexedit->setWindowTitle
+	    (QString ("%1 - %2").arg (QString::fromStdString (tptr->stringName ())).arg (fnt->fontname));
+        hexedit->setData (tptr->rawData (), tptr->dataLength ());
+        tptr->setEditor (hexedit);
+        hexedit->show ();
+    } else {
+        tv->raise ();
+    }
+}
+
+/* Default editor, based on the QHexEdit widget */
+HexTableEdit::HexTableEdit (std::shared_ptr<FontTable> tab, QWidget* parent) :
+    TableEdit (parent, Qt::Window), m_table (tab) {
+
+    m_edited = m_valid = false;
+
+    saveAction = new QAction (tr ("&Export to font"), this);
+    closeAction = new QAction (tr ("C&lose"), this);
+
+    connect (saveAction, &QAction::triggered, this, &HexTableEdit::save);
+    connect (closeAction, &QAction::triggered, this, &HexTableEdit::close);
+
+    saveAction->setShortcut (QKeySequence::Save);
+    closeAction->setShortcut (QKeySequence::Close);
+
+    undoAction = new QAction (tr ("&Undo"), this);
+    redoAction = new QAction (tr ("Re&do"), this);
+    toggleReadOnlyAction = new QAction (tr ("&Read only"), this);
+    toggleOverwriteAction = new QAction (tr ("&Overwrite mode"), this);
+
+    undoAction->setShortcut (QKeySequence::Undo);
+    redoAction->setShortcut (QKeySequence::Redo);
+    toggleReadOnlyAction->setCheckable (true);
+    toggleReadOnlyAction->setChecked (true);
+    toggleOverwriteAction->setShortcut (QKeySequence (Qt::Key_Insert));
+    toggleOverwriteAction->setCheckable (true);
+    toggleOverwriteAction->setChecked (false);
+
+    connect (toggleReadOnlyAction, &QAction::triggered, this, &HexTableEdit::toggleReadOnly);
+    connect (toggleOverwriteAction, &QAction::triggered, this, &HexTableEdit::toggleOverwrite);
+
+    fileMenu = menuBar ()->addMenu (tr ("&File"));
+    fileMenu->addAction (saveAction);
+    fileMenu->addSeparator ();
+    fileMenu->addAction (closeAction);
+
+    editMenu = menuBar ()->addMenu (tr ("&Edit"));
+    editMenu->addAction (undoAction);
+    editMenu->addAction (redoAction);
+    fileMenu->addSeparator ();
+    editMenu->addAction (toggleReadOnlyAction);
+    editMenu->addAction (toggleOverwriteAction);
+
+    m_hexedit = new QHexEdit ();
+    setAttribute (Qt::WA_DeleteOnClose);
+    m_hexedit->setOverwriteMode (false);
+    m_hexedit->setReadOnly (true);
+    QFontMetrics hexmetr = m_hexedit->fontMetrics();
+    QString line = QString (76, '0');
+    m_hexedit->resize (hexmetr.boundingRect (line).width (), hexmetr.height () * 16);
+    resize (hexmetr.boundingRect (line).width (), hexmetr.height () * 16);
+
+    connect (m_hexedit, &QHexEdit::dataChanged, this, &HexTableEdit::edited);
+    connect (undoAction, &QAction::triggered, m_hexedit, &QHexEdit::undo);
+    connect (redoAction, &QAction::triggered, m_hexedit, &QHexEdit::redo);
+
+    QVBoxLayout *layout;
+    layout = new QVBoxLayout ();
+    layout->addWidget (m_hexedit);
+
+    QWidget *window = new QWidget ();
+    window->setLayout (layout);
+    setCentralWidget (window);
+}
+
+HexTableEdit::~HexTableEdit () {
+}
+
+void HexTableEdit::edited () {
+    m_edited = true;
+}
+
+void HexTableEdit::save () {
+    QByteArray ba = m_hexedit->data ();
+    m_table->releaseData ();
+    m_table->data = new char[ba.size ()];
+    std::copy (ba.data (), ba.data () + ba.size (), m_table->data);
+    m_table->newlen = ba.size ();
+    m_table->changed = false;
+    m_table->td_changed = true;
+    m_edited = false;
+    emit update (m_table);
+}
+
+void HexTableEdit::toggleReadOnly (bool val) {
+    m_hexedit->setReadOnly (val);
+}
+
+void HexTableEdit::toggleOverwrite (bool val) {
+    m_hexedit->setOverwriteMode (val);
+}
+
+void HexTableEdit::setData (const char *data, int len) {
+    m_hexedit->setData (QByteArray (data, ((len+3)&~3)));
+    m_edited = false;
+    m_valid = true;
+}
+
+void HexTableEdit::resetData () {
+    int len = m_table->newlen;
+    m_hexedit->setData (QByteArray (m_table->data, ((len+3)&~3)));
+    m_edited = false;
+    m_valid = true;
+}
+
+bool HexTableEdit::checkUpdate (bool can_cancel) {
+    if (isModified ()) {
+        QMessageBox::StandardButton ask;
+        ask = QMessageBox::question (this,
+            tr ("Unsaved Changes"),
+            tr ("This table has been modified. "
+                "Would you like to export the changes back into the font?"),
+            can_cancel ?  (QMessageBox::Yes|QMessageBox::No|QMessageBox::Cancel) :
+                          (QMessageBox::Yes|QMessageBox::No));
+        if (ask == QMessageBox::Cancel) {
+            return false;
+        } else if (ask == QMessageBox::Yes) {
+            save ();
+        }
+    }
+    return true;
+}
+
+bool HexTableEdit::isModified () {
+    return m_edited;
+}
+
+bool HexTableEdit::isValid () {
+    return m_valid;
+}
+
+std::shared_ptr<FontTable> HexTableEdit::table () {
+    return m_table;
+}
+
+void HexTableEdit::closeEvent (QCloseEvent *event) {
+    // If we are going to delete the font, ignore changes in table edits
+    if (!isModified () || m_table->freeing || checkUpdate (true)) {
+        m_table->tv = nullptr;
+    } else {
+        event->ignore ();
+    }
+}
@@ -0,0 +1,84 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef _FONSHEPHERD_TABLEEDIT_H
+#define _FONSHEPHERD_TABLEEDIT_H
+
+#include <QtWidgets>
+#include "tables.h"
+
+class QHexEdit;
+
+class TableEdit : public QMainWindow, public TableEditor {
+    Q_OBJECT;
+
+public:
+    TableEdit (QWidget* parent, Qt::WindowType type) : QMainWindow (parent, type) {}
+
+    void closeEditor () override { close (); };
+
+    // Open an editor window appropriate for the table type (or raise
+    // the window already opened for it)
+    static void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller);
+    static void hexEdit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller);
+
+signals:
+    void update (std::shared_ptr<FontTable> ft);
+};
+
+/* Default editor, based on the QHexEdit widget */
+class HexTableEdit : public TableEdit {
+    Q_OBJECT;
+
+public:
+    HexTableEdit (std::shared_ptr<FontTable> tab, QWidget* parent);
+    ~HexTableEdit ();
+
+    void setData (const char *data, int len);
+    void resetData () override;
+    bool checkUpdate (bool can_cancel) override;
+    bool isModified () override;
+    bool isValid () override;
+    std::shared_ptr<FontTable> table () override;
+    void closeEvent (QCloseEvent *event);
+
+private slots:
+    void edited ();
+    void save ();
+    void toggleReadOnly (bool val);
+    void toggleOverwrite (bool val);
+
+private:
+    std::shared_ptr<FontTable> m_table;
+    QHexEdit *m_hexedit;
+    bool m_edited, m_valid;
+
+    QAction *saveAction, *closeAction;
+    QAction *undoAction, *redoAction, *toggleReadOnlyAction, *toggleOverwriteAction;
+
+    QMenu *fileMenu, *editMenu;
+};
+#endif
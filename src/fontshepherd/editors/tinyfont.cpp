@@ -123,27 +123,23 @@ uint16_t TinyFontProvider::appendOrReloadGlyph (uint16_t gid) {
     ConicGlyph *g = m_origContainer->glyph (m_origFont, gid);
     bool appended = m_gidCorr.count (gid);
 
-    TableHeader props;
-    props.file = nullptr;
-    props.off = 0xffffffff;
-    props.length = 0;
-    props.checksum = 0;
-    props.iname = CHR ('m','a','x','p');
-    MaxpTable dummy_maxp (nullptr, props);
+    maxp_data dummy_stats;
 
     QByteArray gba;
     QBuffer gbuf (&gba);
     gbuf.open (QIODevice::WriteOnly);
     QDataStream os (&gbuf);
 
-    g->toTTF (gbuf, os, &dummy_maxp);
+    g->toTTF (gbuf, os, dummy_stats);
     gbuf.close ();
 
     uint16_t new_gid = appended ? m_gidCorr[gid] : glyf->addGlyph (&m_font);
     ConicGlyph *ng = glyf->glyph (&m_font, new_gid);
-    BoostIn buf (gba.data (), gba.size ());
+    SpanIn buf (gba.data (), gba.size ());
     ng->fromTTF (buf, 0);
     ng->setHMetrics (g->leftSideBearing (), g->advanceWidth ());
+    // Make sure the glyph is encoded again, rather than copied from 'glyf' data
+    ng->setModified (true);
 
     if (!appended) {
 	m_gidCorr[gid] = new_gid;
@@ -201,9 +197,7 @@ void TinyFontProvider::compile () {
         head->packData ();
     }
 
-    sfntFile::fntWrite (&buf, &m_font);
-
-    uint32_t checksum = sfntFile::fileCheck (&buf);
+    uint32_t checksum = sfntFile::fntWrite (&buf, &m_font);
     if (head) {
         checksum = 0xb1b0afba - checksum;
         buf.seek (head->newstart+2*sizeof (uint32_t));
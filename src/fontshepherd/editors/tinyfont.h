@@ -25,8 +25,9 @@
  * POSSIBILITY OF SUCH DAMAGE. */
 
 #include <QtWidgets>
-#include "tables.h" // Have to load it here due to inheritance from TableEdit
+#include "tables.h"
 #include "sfnt.h"
+#include "ftwrapper.h"
 
 class sfntFile;
 typedef struct ttffont sFont;
@@ -35,7 +36,7 @@ class GlyfTable;
 class GlyphContainer;
 class ConicGlyph;
 
-class TinyFontProvider {
+class TinyFontProvider : public FTMemoryFont {
 public:
     TinyFontProvider (sFont* font, QWidget *parent);
     ~TinyFontProvider () {};
@@ -44,9 +45,9 @@ public:
     void reloadGlyphs ();
     void compile ();
 
-    const char *fontData () const;
-    uint32_t fontDataSize () const;
-    uint16_t gidCorr (uint16_t gid) const;
+    const char *fontData () const override;
+    uint32_t fontDataSize () const override;
+    uint16_t gidCorr (uint16_t gid) const override;
     bool valid () const;
 
 private:
@@ -0,0 +1,147 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+
+#include <cstdio>
+#include <QtCore>
+
+#include "fs_batch.h"
+#include "fs_notify.h"
+#include "fs_trace.h"
+
+int main (int argc, char **argv) {
+    setlocale (LC_ALL,"");
+    QCoreApplication app (argc, argv);
+    QCoreApplication::setApplicationName ("FontShepherd");
+    QCoreApplication::setOrganizationName ("ru.anagnost96");
+    FontShepherd::setInteractive (false);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription (QCoreApplication::translate ("main",
+	"Recalculate and recompile font tables in batch mode"));
+    parser.addHelpOption ();
+    parser.addPositionalArgument ("fonts", QCoreApplication::translate ("main", "Font files to process."), "fonts...");
+
+    struct {
+	const char *name;
+	const char *descr;
+	int op;
+    } ops[] = {
+	{ "hdmx", QT_TRANSLATE_NOOP ("main", "Recalculate 'hdmx' table (if present)."), FontShepherd::batch::Hdmx },
+	{ "ltsh", QT_TRANSLATE_NOOP ("main", "Recalculate 'LTSH' table (if present)."), FontShepherd::batch::Ltsh },
+	{ "vdmx", QT_TRANSLATE_NOOP ("main", "Recalculate 'VDMX' table (if present)."), FontShepherd::batch::Vdmx },
+	{ "maxp", QT_TRANSLATE_NOOP ("main", "Recalculate 'maxp' table."), FontShepherd::batch::Maxp },
+	{ "cmap", QT_TRANSLATE_NOOP ("main", "Rebuild 'cmap' table."), FontShepherd::batch::Cmap },
+	{ "autohint", QT_TRANSLATE_NOOP ("main", "Autohint PostScript glyphs."), FontShepherd::batch::AutoHint },
+	{ "subroutinize", QT_TRANSLATE_NOOP ("main", "Rebuild CFF/CFF2 charstrings and subroutines."), FontShepherd::batch::Subroutinize },
+	{ "optimize-glyf", QT_TRANSLATE_NOOP ("main", "Shrink 'glyf' and 'loca' tables, keeping point numbers used by instructions."), FontShepherd::batch::OptimizeGlyf },
+    };
+    for (auto &op : ops)
+	parser.addOption (QCommandLineOption (op.name, QCoreApplication::translate ("main", op.descr)));
+
+    QCommandLineOption jobsOpt (QStringList () << "j" << "jobs",
+	QCoreApplication::translate ("main", "Number of files to process simultaneously."), "N");
+    QCommandLineOption outOpt (QStringList () << "o" << "output-dir",
+	QCoreApplication::translate ("main", "Save processed fonts to <dir> rather than in place."), "dir");
+    QCommandLineOption reportOpt ("report",
+	QCoreApplication::translate ("main", "Write JSON report to <file> rather than to standard output."), "file");
+    parser.addOption (jobsOpt);
+    parser.addOption (outOpt);
+    QCommandLineOption traceOpt ("trace",
+	QCoreApplication::translate ("main", "Record timings and save them to <file> in Chrome trace format."), "file");
+    QCommandLineOption instOpt ("instance",
+	QCoreApplication::translate ("main",
+	    "Save a static instance of a CFF2 font at the given normalized axis coordinates "
+	    "(comma-separated, -1 to 1). May be repeated; instances are numbered in order."), "coords");
+    parser.addOption (reportOpt);
+    parser.addOption (traceOpt);
+    parser.addOption (instOpt);
+    parser.process (app);
+
+    QStringList files = parser.positionalArguments ();
+    if (files.isEmpty ())
+	parser.showHelp (1);
+
+    int flags = 0;
+    for (auto &op : ops) {
+	if (parser.isSet (op.name))
+	    flags |= op.op;
+    }
+    int jobs = 0;
+    if (parser.isSet (jobsOpt)) {
+	bool ok;
+	jobs = parser.value (jobsOpt).toInt (&ok);
+	if (!ok || jobs < 1) {
+	    fprintf (stderr, "Invalid number of jobs: %s\n", qPrintable (parser.value (jobsOpt)));
+	    return 1;
+	}
+    }
+    QString outdir = parser.value (outOpt);
+    if (!outdir.isEmpty () && !QDir ().mkpath (outdir)) {
+	fprintf (stderr, "Could not create output directory: %s\n", qPrintable (outdir));
+	return 1;
+    }
+
+    std::vector<std::vector<double>> instances;
+    for (const QString &val : parser.values (instOpt)) {
+	std::vector<double> coords;
+	for (const QString &part : val.split (',')) {
+	    bool ok;
+	    double c = part.trimmed ().toDouble (&ok);
+	    if (!ok || c < -1 || c > 1) {
+		fprintf (stderr, "Invalid instance coordinates: %s\n", qPrintable (val));
+		return 1;
+	    }
+	    coords.push_back (c);
+	}
+	instances.push_back (coords);
+    }
+
+    FontShepherd::trace::setEnabled (parser.isSet (traceOpt));
+    FontShepherd::BatchProcessor proc (flags, outdir);
+    proc.setInstances (instances);
+    std::vector<FontShepherd::batch::Result> results = proc.run (files, jobs);
+    if (parser.isSet (traceOpt) &&
+	!FontShepherd::trace::exportChromeTrace (parser.value (traceOpt).toStdString ()))
+	fprintf (stderr, "Could not write trace: %s\n", qPrintable (parser.value (traceOpt)));
+    QByteArray json = FontShepherd::BatchProcessor::report (results).toJson ();
+
+    if (parser.isSet (reportOpt)) {
+	QFile rep (parser.value (reportOpt));
+	if (!rep.open (QIODevice::WriteOnly) || rep.write (json) != json.size ()) {
+	    fprintf (stderr, "Could not write report: %s\n", qPrintable (rep.fileName ()));
+	    return 1;
+	}
+    } else {
+	fwrite (json.constData (), 1, json.size (), stdout);
+    }
+
+    for (auto &res : results) {
+	if (!res.ok)
+	    return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,21 @@
+# Headless batch processor, built from the core sources only
+include (core.pri)
+TEMPLATE = app
+CONFIG += console
+
+# Share the source directory with fontshepherd.pro
+MAKEFILE = Makefile.cli
+OBJECTS_DIR = .obj-cli
+MOC_DIR = .moc-cli
+RCC_DIR = .rcc-cli
+
+RESOURCES = ../../fontshepherd.qrc
+
+SOURCES += fontshepherd-cli.cpp fs_batch.cpp
+HEADERS += fs_batch.h
+
+unix: {
+  TARGET = fontshepherd-cli
+  target.path = $$BINDIR
+}
+INSTALLS += target
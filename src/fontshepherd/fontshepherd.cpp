@@ -30,6 +30,10 @@
 #include "sfnt.h"
 #include "tables.h"
 #include "tableview.h"
+#include "tracepanel.h"
+#include "fs_trace.h"
+#include "fs_dialogs.h"
+#include "editors/tableedit.h"
 
 FontShepherdMain::FontShepherdMain (QApplication *app, QString &path) {
     setAttribute (Qt::WA_DeleteOnClose);
@@ -86,6 +90,12 @@ FontShepherdMain::FontShepherdMain (QApplication *app, QString &path) {
     hdmxAction = new QAction (tr ("Calculate \'hdmx\' table..."), app);
     ltshAction = new QAction (tr ("Calculate \'LTSH\' table..."), app);
     vdmxAction = new QAction (tr ("Calculate \'VDMX\' table..."), app);
+    traceAction = new QAction (tr ("Performance &trace..."), this);
+    connect (traceAction, &QAction::triggered, [] () {
+	TracePanel *panel = TracePanel::instance ();
+	panel->show ();
+	panel->raise ();
+    });
 
     connectEditActions (0);
     connect (QApplication::clipboard (), &QClipboard::dataChanged, this, &FontShepherdMain::checkClipboard);
@@ -145,6 +155,8 @@ FontShepherdMain::FontShepherdMain (QApplication *app, QString &path) {
     toolMenu->addAction (hdmxAction);
     toolMenu->addAction (ltshAction);
     toolMenu->addAction (vdmxAction);
+    toolMenu->addSeparator ();
+    toolMenu->addAction (traceAction);
 
     saveButton = new QPushButton (QWidget::tr ("&Save"));
     closeButton = new QPushButton (QWidget::tr ("&Close"));
@@ -166,6 +178,15 @@ FontShepherdMain::FontShepherdMain (QApplication *app, QString &path) {
     window->setLayout (layout);
     setWindowIcon (QIcon (":/icons/fontshepherd-crozier.svg"));
     setCentralWidget (window);
+
+    // Also evicts unused table data, if the memory budget is exceeded
+    m_memLabel = new QLabel ();
+    statusBar ()->addPermanentWidget (m_memLabel);
+    m_memTimer = new QTimer (this);
+    connect (m_memTimer, &QTimer::timeout, this, &FontShepherdMain::updateMemoryUsage);
+    connect (tmptr, &QTabWidget::currentChanged, this, &FontShepherdMain::updateMemoryUsage);
+    m_memTimer->start (2000);
+    updateMemoryUsage ();
 }
 
 FontShepherdMain::~FontShepherdMain () {
@@ -210,7 +231,7 @@ void FontShepherdMain::saveCollectionAs () {
 void FontShepherdMain::addToCollection () {
     QString path = QFileDialog::getOpenFileName (
 	m_tableMatrix.get (), tr ("Open Font"), "",
-        tr ("OpenType Font Files (*.ttf *.otf *.ttc)"
+        tr ("OpenType Font Files (*.ttf *.otf *.ttc);;WOFF Files (*.woff *.woff2)"
     ));
     if (m_tableMatrix->loadFont (path))
 	setModified (true);
@@ -248,7 +269,7 @@ void FontShepherdMain::closeEvent (QCloseEvent *event) {
 	    sFont *fnt = fcont->font (i);
 	    for (auto &tabptr : fnt->tbls) {
 		FontTable *tab = tabptr.get ();
-		TableEdit *edit = tab->editor ();
+		TableEdit *edit = dynamic_cast<TableEdit *> (tab->editor ());
 		if (edit) {
 		    if (edit->close ()) {
 			edit->deleteLater ();
@@ -311,6 +332,23 @@ void FontShepherdMain::enableEditActions (int index, int row) {
     }
 }
 
+void FontShepherdMain::updateMemoryUsage () {
+    // Dialogs may be waiting for data, which shouldn't be dropped under them
+    if (!QApplication::activeModalWidget ())
+	sfntFile::enforceMemoryBudget ();
+
+    size_t font_usage = m_tableMatrix->font ()->memoryUsage (m_tableMatrix->currentIndex ());
+    size_t total = sfntFile::totalMemoryUsage ();
+    FS_TRACE_COUNTER ("table memory, bytes", total);
+    size_t budget = sfntFile::memoryBudget ();
+    auto mib = [] (size_t val) { return QString::number (val/1048576.0, 'f', 1); };
+
+    QString msg = tr ("Font data: %1 MiB, total: %2 MiB").arg (mib (font_usage)).arg (mib (total));
+    if (budget)
+	msg += tr (" (budget %1 MiB)").arg (mib (budget));
+    m_memLabel->setText (msg);
+}
+
 void FontShepherdMain::connectEditActions (int index) {
     for (int i=0; i<m_tableMatrix->count (); i++) {
 	TableView *tv = qobject_cast<TableView *> (m_tableMatrix->widget (i));
@@ -475,6 +513,10 @@ int main (int argc, char **argv) {
     QApplication app (argc, argv);
     QCoreApplication::setApplicationName ("FontShepherd");
     QCoreApplication::setOrganizationName ("ru.anagnost96");
+    static FontShepherd::DialogHandler dialogs;
+    FontShepherd::setMessageHandler (&dialogs);
+    QSettings settings (QCoreApplication::organizationName (), QCoreApplication::applicationName ());
+    FontShepherd::trace::setEnabled (settings.value ("trace/enabled", false).toBool ());
     FontShepherdMain* fontshepherd = new FontShepherdMain (&app, path);
 
     fontshepherd->show ();
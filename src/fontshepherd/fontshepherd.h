@@ -55,6 +55,7 @@ private slots:
     void checkSelection (TableView *tv);
     void checkClipboard ();
     void connectEditActions (int index);
+    void updateMemoryUsage ();
     //void quit ();
 
 private:
@@ -78,8 +79,11 @@ private:
     QAction *recentFileActs[MaxRecentFiles], *recentFileSeparator, *recentFileSubMenuAct;
     QAction *undoAction, *redoAction;
     QAction *hdmxAction, *ltshAction, *vdmxAction;
+    QAction *traceAction;
 
     QPushButton *openButton, *saveButton, *closeButton;
+    QLabel *m_memLabel;
+    QTimer *m_memTimer;
 
     QMenu *fileMenu, *editMenu, *toolMenu;
 };
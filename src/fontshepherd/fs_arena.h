@@ -0,0 +1,186 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+
+#ifndef _FONSHEPHERD_FS_ARENA_H
+#define _FONSHEPHERD_FS_ARENA_H
+
+#include <stddef.h>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace FontShepherd {
+    // Slab allocator for many small objects of the same type, such as points
+    // and splines of a glyph outline. Objects are placed into slabs of growing
+    // size, so that those created together stay close to each other in memory.
+    // Freed slots are reused in LIFO order, and both destroy () and free () take
+    // constant time. When the arena itself is cleared or destroyed, objects still
+    // in use are destructed, unless their type is trivially destructible, and
+    // then the whole slabs are released at once.
+    //
+    // The interface follows boost::object_pool: free () returns memory to the
+    // arena without calling the destructor.
+    template <typename T>
+    class ObjectArena {
+    public:
+	ObjectArena () {};
+	ObjectArena (const ObjectArena &) = delete;
+	ObjectArena& operator = (const ObjectArena &) = delete;
+	~ObjectArena () {
+	    clear ();
+	};
+
+	template <typename... Args>
+	T *construct (Args&&... args) {
+	    slot *s = allocate ();
+	    T *ret;
+	    try {
+		ret = new (&s->obj) T (std::forward<Args> (args)...);
+	    } catch (...) {
+		s->live = false;
+		s->next_free = m_free;
+		m_free = s;
+		throw;
+	    }
+	    s->live = true;
+	    m_live++;
+	    return ret;
+	};
+
+	void destroy (T *p) {
+	    p->~T ();
+	    free (p);
+	};
+
+	void free (T *p) {
+	    slot *s = reinterpret_cast<slot *> (p);
+	    s->live = false;
+	    s->next_free = m_free;
+	    m_free = s;
+	    m_live--;
+	};
+
+	// Make sure the next cnt objects can be created without further allocations,
+	// and get them placed next to each other. They are taken from the unused
+	// tail of the current slab, bypassing the free list, and if the tail is too
+	// short, a new slab large enough to keep all of them is added
+	void reserve (size_t cnt) {
+	    size_t avail = m_slabs.empty () ? 0 : m_slabs.back ().size - m_used;
+	    if (avail < cnt)
+		addSlab (std::max<size_t> (cnt, first_slab));
+	    m_reserved = cnt;
+	};
+
+	// Release all memory at once
+	void clear () {
+	    for (size_t i=0; i<m_slabs.size (); i++) {
+		slot *items = m_slabs[i].items;
+		size_t used = (i == m_slabs.size () - 1) ? m_used : m_slabs[i].size;
+		if (!std::is_trivially_destructible<T>::value && m_live) {
+		    for (size_t j=0; j<used; j++) {
+			if (items[j].live)
+			    reinterpret_cast<T *> (&items[j].obj)->~T ();
+		    }
+		}
+		::operator delete (items);
+	    }
+	    m_slabs.clear ();
+	    m_used = 0;
+	    m_live = 0;
+	    m_reserved = 0;
+	    m_free = nullptr;
+	};
+
+	size_t size () const {
+	    return m_live;
+	};
+
+	size_t memoryUsage () const {
+	    size_t ret = 0;
+	    for (auto &slab : m_slabs)
+		ret += slab.size * sizeof (slot);
+	    return ret;
+	};
+
+    private:
+	// obj should be the first member, so that an object pointer can be
+	// converted back to its slot
+	struct slot {
+	    typename std::aligned_storage<sizeof (T), alignof (T)>::type obj;
+	    slot *next_free;
+	    bool live;
+	};
+	struct slab {
+	    slot *items;
+	    size_t size;
+	};
+	enum : size_t { first_slab = 32, max_slab = 4096 };
+
+	slot *allocate () {
+	    if (m_reserved && m_used < m_slabs.back ().size) {
+		m_reserved--;
+		return &m_slabs.back ().items[m_used++];
+	    }
+	    m_reserved = 0;
+	    if (m_free) {
+		slot *s = m_free;
+		m_free = s->next_free;
+		return s;
+	    }
+	    if (m_slabs.empty () || m_used == m_slabs.back ().size)
+		addSlab (m_slabs.empty () ? first_slab : std::min<size_t> (m_slabs.back ().size*2, max_slab));
+	    return &m_slabs.back ().items[m_used++];
+	};
+
+	// Unused slots of the current slab are put to the free list, so that
+	// only the last slab may be partially filled
+	void addSlab (size_t cnt) {
+	    if (!m_slabs.empty ()) {
+		slab &last = m_slabs.back ();
+		for (size_t i=m_used; i<last.size; i++) {
+		    last.items[i].live = false;
+		    last.items[i].next_free = m_free;
+		    m_free = &last.items[i];
+		}
+	    }
+	    slot *items = static_cast<slot *> (::operator new (cnt*sizeof (slot)));
+	    m_slabs.push_back ({ items, cnt });
+	    m_used = 0;
+	};
+
+	std::vector<slab> m_slabs;
+	size_t m_used = 0;
+	size_t m_live = 0;
+	// Objects still to be taken from the current slab rather than the free list
+	size_t m_reserved = 0;
+	slot *m_free = nullptr;
+    };
+}
+
+#endif
@@ -0,0 +1,342 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+
+#include <stdint.h>
+#include <exception>
+#include <QtConcurrent>
+
+#include "sfnt.h"
+#include "exceptions.h"
+#include "fs_batch.h"
+#include "fs_notify.h"
+#include "splineglyph.h"
+#include "tables/cff.h"
+#include "tables/cmap.h"
+#include "tables/devmetrics.h"
+#include "tables/glyf.h"
+#include "tables/glyphcontainer.h"
+#include "tables/glyphnames.h"
+#include "tables/maxp.h"
+
+FontShepherd::BatchProcessor::BatchProcessor (int ops, const QString &outdir) :
+    m_ops (ops), m_outdir (outdir) {
+}
+
+void FontShepherd::BatchProcessor::setInstances (const std::vector<std::vector<double>> &locations) {
+    m_instances = locations;
+}
+
+// Device metrics tables are only recalculated if already present in the font,
+// as their parameters (ppem sizes, ratios) can't be guessed reasonably
+void FontShepherd::BatchProcessor::recalcHdmx (sFont *fnt) const {
+    HdmxTable *hdmx = dynamic_cast<HdmxTable *> (fnt->table (CHR ('h','d','m','x')));
+    if (!hdmx)
+	return;
+    hdmx->fillup ();
+    hdmx->unpackData (fnt);
+    hdmx->setNumGlyphs (fnt->glyph_cnt);
+    DeviceMetricsProvider dmp (*fnt);
+    if (dmp.calculateHdmx (*hdmx, nullptr))
+	throw TableDataCompileException ("hdmx", "Could not calculate 'hdmx'");
+    hdmx->packData ();
+}
+
+void FontShepherd::BatchProcessor::recalcLtsh (sFont *fnt) const {
+    LtshTable *ltsh = dynamic_cast<LtshTable *> (fnt->table (CHR ('L','T','S','H')));
+    if (!ltsh)
+	return;
+    ltsh->fillup ();
+    ltsh->unpackData (fnt);
+    ltsh->setNumGlyphs (fnt->glyph_cnt, true);
+    DeviceMetricsProvider dmp (*fnt);
+    if (dmp.calculateLtsh (*ltsh, nullptr))
+	throw TableDataCompileException ("LTSH", "Could not calculate 'LTSH'");
+    ltsh->packData ();
+}
+
+void FontShepherd::BatchProcessor::recalcVdmx (sFont *fnt) const {
+    VdmxTable *vdmx = dynamic_cast<VdmxTable *> (fnt->table (CHR ('V','D','M','X')));
+    if (!vdmx)
+	return;
+    vdmx->fillup ();
+    vdmx->unpackData (fnt);
+    DeviceMetricsProvider dmp (*fnt);
+    if (dmp.calculateVdmx (*vdmx, nullptr))
+	throw TableDataCompileException ("VDMX", "Could not calculate 'VDMX'");
+    vdmx->packData ();
+}
+
+void FontShepherd::BatchProcessor::recalcMaxp (sFont *fnt) const {
+    MaxpTable *maxp = dynamic_cast<MaxpTable *> (fnt->table (CHR ('m','a','x','p')));
+    if (!maxp)
+	return;
+    maxp->fillup ();
+    maxp->unpackData (fnt);
+    maxp_data d;
+    if (!MaxpTable::calculate (fnt, d, nullptr))
+	throw TableDataCompileException ("maxp", "Could not calculate 'maxp'");
+    maxp->setContents (d);
+    maxp->packData ();
+}
+
+void FontShepherd::BatchProcessor::rebuildCmap (sFont *fnt) const {
+    CmapTable *cmap = dynamic_cast<CmapTable *> (fnt->table (CHR ('c','m','a','p')));
+    if (!cmap)
+	return;
+    cmap->fillup ();
+    cmap->unpackData (fnt);
+    cmap->sortSubTables ();
+    cmap->packData ();
+}
+
+// Only PostScript outlines can be autohinted
+void FontShepherd::BatchProcessor::autoHint (sFont *fnt) const {
+    GlyphContainer *gc = dynamic_cast<GlyphContainer *> (fnt->table (CHR ('C','F','F',' ')));
+    if (!gc)
+	gc = dynamic_cast<GlyphContainer *> (fnt->table (CHR ('C','F','F','2')));
+    if (!gc)
+	return;
+    gc->fillup ();
+    gc->unpackData (fnt);
+    if (!gc->usable ())
+	throw TableDataCorruptException (gc->stringName ());
+    for (uint16_t i=0; i<gc->countGlyphs (); i++) {
+	ConicGlyph *g = gc->glyph (fnt, i);
+	if (g && g->autoHint (*fnt))
+	    g->setModified (true);
+    }
+    gc->packData ();
+}
+
+void FontShepherd::BatchProcessor::subroutinize (sFont *fnt) const {
+    CffTable *cff = dynamic_cast<CffTable *> (fnt->table (CHR ('C','F','F',' ')));
+    if (!cff)
+	cff = dynamic_cast<CffTable *> (fnt->table (CHR ('C','F','F','2')));
+    if (!cff)
+	return;
+    cff->fillup ();
+    cff->unpackData (fnt);
+    if (!cff->usable ())
+	throw TableDataCorruptException (cff->stringName ());
+    cff->subroutinize (fnt);
+}
+
+// Variation tables are dropped, as they no longer apply to static outlines.
+// Advance widths are those of the default design, as 'HVAR' isn't supported
+void FontShepherd::BatchProcessor::instantiate (sFont *fnt, const std::vector<double> &coords) const {
+    CffTable *cff = dynamic_cast<CffTable *> (fnt->table (CHR ('C','F','F','2')));
+    if (!cff)
+	throw TableDataCompileException ("CFF2", "No variable CFF data to instantiate");
+    cff->fillup ();
+    cff->unpackData (fnt);
+    if (!cff->usable ())
+	throw TableDataCorruptException (cff->stringName ());
+    GlyphNameProvider gnp (*fnt);
+    cff->instantiate (fnt, gnp, coords);
+    cff->packData ();
+
+    const uint32_t var_tags[] = {
+	CHR ('f','v','a','r'), CHR ('a','v','a','r'), CHR ('H','V','A','R'),
+	CHR ('V','V','A','R'), CHR ('M','V','A','R'),
+    };
+    for (uint32_t tag : var_tags) {
+	for (auto it = fnt->tbls.begin (); it != fnt->tbls.end (); it++) {
+	    if ((*it)->iName () == tag) {
+		fnt->tbls.erase (it);
+		break;
+	    }
+	}
+    }
+}
+
+// Repack 'glyf' and 'loca' as compactly as possible. Point numbers are
+// preserved for all glyphs which may be referred to by instructions
+void FontShepherd::BatchProcessor::optimizeGlyf (sFont *fnt) const {
+    GlyfTable *glyf = dynamic_cast<GlyfTable *> (fnt->table (CHR ('g','l','y','f')));
+    if (!glyf)
+	return;
+    glyf->fillup ();
+    glyf->unpackData (fnt);
+    if (!glyf->usable ())
+	throw TableDataCorruptException (glyf->stringName ());
+    glyf->setOptimized (true);
+    glyf->packData ();
+}
+
+void FontShepherd::BatchProcessor::processFont (sFont *fnt, int idx, batch::Result &res) const {
+    struct {
+	int op;
+	const char *name;
+	void (BatchProcessor::*func) (sFont *) const;
+    } steps[] = {
+	// maxp goes first, as other tables may depend on the glyph count
+	{ batch::Maxp, "maxp", &BatchProcessor::recalcMaxp },
+	{ batch::Cmap, "cmap", &BatchProcessor::rebuildCmap },
+	{ batch::AutoHint, "autohint", &BatchProcessor::autoHint },
+	{ batch::Subroutinize, "subroutinize", &BatchProcessor::subroutinize },
+	{ batch::OptimizeGlyf, "glyf", &BatchProcessor::optimizeGlyf },
+	{ batch::Hdmx, "hdmx", &BatchProcessor::recalcHdmx },
+	{ batch::Ltsh, "LTSH", &BatchProcessor::recalcLtsh },
+	{ batch::Vdmx, "VDMX", &BatchProcessor::recalcVdmx },
+    };
+    QElapsedTimer timer;
+
+    for (auto &step : steps) {
+	if (!(m_ops & step.op))
+	    continue;
+	timer.start ();
+	(this->*step.func) (fnt);
+	res.timings.emplace_back (QString (step.name), timer.elapsed ());
+    }
+
+    GlyfTable *glyf = dynamic_cast<GlyfTable *> (fnt->table (CHR ('g','l','y','f')));
+    if ((m_ops & batch::OptimizeGlyf) && glyf && glyf->optimized ()) {
+	const glyf_savings &sv = glyf->savings ();
+	res.glyf_saved += sv.glyf;
+	res.loca_saved += sv.loca;
+	for (auto &pair : sv.glyphs)
+	    res.glyphs_saved.emplace_back (idx, pair.first, pair.second);
+    }
+}
+
+FontShepherd::batch::Result FontShepherd::BatchProcessor::process (const QString &path, int instance) const {
+    batch::Result res;
+    QElapsedTimer timer;
+    QFileInfo info (path);
+
+    res.file = path;
+    res.output = m_outdir.isEmpty () ? path : QDir (m_outdir).filePath (info.fileName ());
+    if (instance >= 0) {
+	QString fname = QString ("%1-%2.%3")
+	    .arg (info.completeBaseName ()).arg (instance+1).arg (info.suffix ());
+	res.output = m_outdir.isEmpty () ? info.dir ().filePath (fname) : QDir (m_outdir).filePath (fname);
+	res.instance = m_instances[instance];
+    }
+
+    try {
+	timer.start ();
+	sfntFile fcont (path, nullptr);
+	res.timings.emplace_back ("load", timer.elapsed ());
+
+	for (int i=0; i<fcont.fontCount (); i++) {
+	    if (instance >= 0) {
+		timer.start ();
+		instantiate (fcont.font (i), res.instance);
+		res.timings.emplace_back ("instance", timer.elapsed ());
+	    }
+	    processFont (fcont.font (i), i, res);
+	}
+
+	timer.start ();
+	bool ttc = fcont.fontCount () > 1;
+	if (!fcont.save (res.output, ttc, 0))
+	    throw FileAccessException (res.output.toStdString (), "Error: could not save file.");
+	res.timings.emplace_back ("save", timer.elapsed ());
+	res.ok = true;
+    // 'what' is not virtual for our exception classes
+    } catch (FileAccessException &e) {
+	res.error = QString::fromStdString (e.what ());
+    } catch (TableDataCorruptException &e) {
+	res.error = tr ("%1 (table '%2')").arg (e.what ()).arg (e.table ());
+    } catch (TableDataCompileException &e) {
+	res.error = tr ("%1 (table '%2')").arg (e.what ()).arg (e.table ());
+    } catch (std::exception &e) {
+	res.error = QString::fromStdString (e.what ());
+    } catch (...) {
+	res.error = tr ("Unknown error");
+    }
+    return res;
+}
+
+std::vector<FontShepherd::batch::Result> FontShepherd::BatchProcessor::run
+    (const QStringList &files, int jobs) const {
+    // Each instance is a separate job, with its own copy of the font
+    int per_file = m_instances.empty () ? 1 : m_instances.size ();
+    std::vector<batch::Result> ret (files.size () * per_file);
+
+    // Use a private pool, so that parallel table compilation on save
+    // still has the global one at its disposal
+    QThreadPool pool;
+    std::vector<QFuture<void>> futures;
+    if (jobs > 0)
+	pool.setMaxThreadCount (jobs);
+    futures.reserve (ret.size ());
+    for (size_t i=0; i<ret.size (); i++) {
+	futures.push_back (QtConcurrent::run (&pool, [this, &files, &ret, i, per_file] () {
+	    int inst = -1;
+	    if (!m_instances.empty ())
+		inst = i % per_file;
+	    ret[i] = process (files[i / per_file], inst);
+	}));
+    }
+    for (auto &f : futures)
+	f.waitForFinished ();
+    return ret;
+}
+
+QJsonDocument FontShepherd::BatchProcessor::report (const std::vector<batch::Result> &results) {
+    QJsonArray arr;
+    for (auto &res : results) {
+	QJsonObject obj;
+	QJsonObject timings;
+	qint64 total = 0;
+	obj["file"] = res.file;
+	obj["output"] = res.output;
+	obj["status"] = res.ok ? "ok" : "error";
+	if (!res.ok)
+	    obj["error"] = res.error;
+	for (auto &pair : res.timings) {
+	    timings[pair.first] = timings[pair.first].toDouble () + pair.second;
+	    total += pair.second;
+	}
+	timings["total"] = total;
+	obj["timings_ms"] = timings;
+	if (!res.instance.empty ()) {
+	    QJsonArray coords;
+	    for (double c : res.instance)
+		coords.append (c);
+	    obj["instance"] = coords;
+	}
+	if (res.glyf_saved || res.loca_saved || !res.glyphs_saved.empty ()) {
+	    QJsonObject savings;
+	    QJsonArray glyphs;
+	    savings["glyf"] = static_cast<qint64> (res.glyf_saved);
+	    savings["loca"] = static_cast<qint64> (res.loca_saved);
+	    for (auto &entry : res.glyphs_saved) {
+		QJsonObject g;
+		g["font"] = std::get<0> (entry);
+		g["gid"] = std::get<1> (entry);
+		g["bytes"] = static_cast<qint64> (std::get<2> (entry));
+		glyphs.append (g);
+	    }
+	    savings["glyphs"] = glyphs;
+	    obj["bytes_saved"] = savings;
+	}
+	arr.append (obj);
+    }
+    return QJsonDocument (arr);
+}
@@ -0,0 +1,104 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+
+#ifndef _FONSHEPHERD_FS_BATCH_H
+#define _FONSHEPHERD_FS_BATCH_H
+
+#include <stdint.h>
+#include <vector>
+#include <tuple>
+#include <QtCore>
+
+typedef struct ttffont sFont;
+
+namespace FontShepherd {
+    namespace batch {
+	enum Operation {
+	    Hdmx = 0x1,
+	    Ltsh = 0x2,
+	    Vdmx = 0x4,
+	    Maxp = 0x8,
+	    Cmap = 0x10,
+	    AutoHint = 0x20,
+	    Subroutinize = 0x40,
+	    OptimizeGlyf = 0x80,
+	};
+
+	struct Result {
+	    QString file;
+	    QString output;
+	    bool ok = false;
+	    QString error;
+	    // Wall clock time spent at each stage, in milliseconds
+	    std::vector<std::pair<QString, qint64>> timings;
+	    // Bytes saved by 'glyf' optimization: table totals and per glyph
+	    // (font index, GID, bytes)
+	    int64_t glyf_saved = 0, loca_saved = 0;
+	    std::vector<std::tuple<int, uint16_t, uint32_t>> glyphs_saved;
+	    // Normalized coordinates, if this is a static instance of a CFF2 font
+	    std::vector<double> instance;
+	};
+    }
+
+    // Runs a fixed set of compile/recalculate operations on a list of
+    // font files, processing several files simultaneously. Intended for
+    // non-interactive use, so it never shows any dialogs (see setInteractive)
+    class BatchProcessor {
+	Q_DECLARE_TR_FUNCTIONS (BatchProcessor)
+
+    public:
+	BatchProcessor (int ops, const QString &outdir);
+
+	// If set, every file produces a static instance for each location
+	// (normalized coordinates) instead of being processed in place
+	void setInstances (const std::vector<std::vector<double>> &locations);
+
+	// Process a single file; never throws
+	batch::Result process (const QString &path, int instance=-1) const;
+	std::vector<batch::Result> run (const QStringList &files, int jobs) const;
+
+	static QJsonDocument report (const std::vector<batch::Result> &results);
+
+    private:
+	void processFont (sFont *fnt, int idx, batch::Result &res) const;
+	void recalcHdmx (sFont *fnt) const;
+	void recalcLtsh (sFont *fnt) const;
+	void recalcVdmx (sFont *fnt) const;
+	void recalcMaxp (sFont *fnt) const;
+	void rebuildCmap (sFont *fnt) const;
+	void optimizeGlyf (sFont *fnt) const;
+	void autoHint (sFont *fnt) const;
+	void subroutinize (sFont *fnt) const;
+	void instantiate (sFont *fnt, const std::vector<double> &coords) const;
+
+	int m_ops;
+	QString m_outdir;
+	std::vector<std::vector<double>> m_instances;
+    };
+}
+
+#endif
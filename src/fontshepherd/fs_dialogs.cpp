@@ -0,0 +1,76 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+#include "fs_dialogs.h"
+
+using namespace FontShepherd;
+
+class ProgressDialog : public ProgressDisplay {
+public:
+    ProgressDialog (const QString &label, int min, int max, QWidget *parent) :
+	m_dlg (label, QCoreApplication::translate ("ProgressNotifier", "Abort"), min, max, parent) {
+	m_dlg.setWindowModality (Qt::WindowModal);
+	m_dlg.show ();
+    }
+
+    bool setValue (int val) override {
+	QCoreApplication::processEvents ();
+	if (m_dlg.wasCanceled ())
+	    return false;
+	m_dlg.setValue (val);
+	return true;
+    }
+
+private:
+    QProgressDialog m_dlg;
+};
+
+void DialogHandler::message (MessageType type, const QString &title, const QString &text, QWidget *w) {
+    switch (type) {
+      case MessageType::Warning:
+	QMessageBox::warning (w, title, text);
+	break;
+      case MessageType::Error:
+	QMessageBox::critical (w, title, text);
+	break;
+      default:
+	QMessageBox::information (w, title, text);
+    }
+}
+
+bool DialogHandler::question (const QString &title, const QString &text, QWidget *w) {
+    QMessageBox msgBox (w);
+    msgBox.setText (text);
+    msgBox.setWindowTitle (title);
+    msgBox.setIcon (QMessageBox::Question);
+    msgBox.setStandardButtons (QMessageBox::Yes | QMessageBox::No);
+    msgBox.setDefaultButton (QMessageBox::Yes);
+    return (msgBox.exec () == QMessageBox::Yes);
+}
+
+ProgressDisplay *DialogHandler::progress (const QString &label, int min, int max, QWidget *parent) {
+    return new ProgressDialog (label, min, max, parent);
+}
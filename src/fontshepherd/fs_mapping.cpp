@@ -0,0 +1,135 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <atomic>
+#include <mutex>
+
+#include "fs_mapping.h"
+
+// Accessing a mapped page which is no longer backed by the file raises SIGBUS.
+// While copy () is in progress on the current thread, the handler returns to
+// it, otherwise the previous disposition is restored and the access repeated
+static thread_local sigjmp_buf * volatile bus_jump = nullptr;
+static struct sigaction prev_bus_action;
+
+static void bus_handler (int sig) {
+    if (bus_jump)
+	siglongjmp (*bus_jump, 1);
+    sigaction (sig, &prev_bus_action, nullptr);
+}
+
+static void install_bus_handler () {
+    static std::once_flag installed;
+    std::call_once (installed, [] () {
+	struct sigaction sa;
+	memset (&sa, 0, sizeof (sa));
+	sa.sa_handler = bus_handler;
+	sigemptyset (&sa.sa_mask);
+	sigaction (SIGBUS, &sa, &prev_bus_action);
+    });
+}
+
+FontShepherd::FileMapping::FileMapping (const QString &path) : m_addr (nullptr), m_size (0), m_fd (-1) {
+    QByteArray fname = QFile::encodeName (path);
+    int fd = open (fname.constData (), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+	return;
+
+    struct stat st;
+    if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) && st.st_size > 0) {
+	void *addr = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr != MAP_FAILED) {
+	    m_addr = addr;
+	    m_size = st.st_size;
+	    m_mtime = st.st_mtim;
+	}
+    }
+    if (m_addr)
+	m_fd = fd;
+    else
+	close (fd);
+}
+
+FontShepherd::FileMapping::~FileMapping () {
+    if (m_addr)
+	munmap (m_addr, m_size);
+    if (m_fd >= 0)
+	close (m_fd);
+}
+
+const char *FontShepherd::FileMapping::data () const {
+    return static_cast<const char *> (m_addr);
+}
+
+size_t FontShepherd::FileMapping::size () const {
+    return m_size;
+}
+
+bool FontShepherd::FileMapping::valid () const {
+    return (m_addr != nullptr);
+}
+
+bool FontShepherd::FileMapping::contains (uint32_t off, uint32_t len) const {
+    return (m_addr && (uint64_t) off + len <= m_size);
+}
+
+int FontShepherd::FileMapping::handle () const {
+    return m_fd;
+}
+
+bool FontShepherd::FileMapping::intact () const {
+    struct stat st;
+    if (m_fd < 0 || fstat (m_fd, &st) != 0)
+	return false;
+    return ((size_t) st.st_size == m_size &&
+	st.st_mtim.tv_sec == m_mtime.tv_sec && st.st_mtim.tv_nsec == m_mtime.tv_nsec);
+}
+
+bool FontShepherd::FileMapping::copy (uint32_t off, uint32_t len, char *dest) const {
+    if (!contains (off, len))
+	return false;
+    install_bus_handler ();
+    sigjmp_buf env;
+    if (sigsetjmp (env, 1)) {
+	bus_jump = nullptr;
+	return false;
+    }
+    // Keep the compiler from moving the copy out of the guarded region
+    bus_jump = &env;
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+    memcpy (dest, static_cast<const char *> (m_addr) + off, len);
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+    bus_jump = nullptr;
+    return true;
+}
@@ -0,0 +1,77 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef _FONSHEPHERD_FS_MAPPING_H
+#define _FONSHEPHERD_FS_MAPPING_H
+
+#include <stdint.h>
+#include <time.h>
+#include <memory>
+#include <QtCore>
+
+namespace FontShepherd {
+    // A read-only private memory mapping of a font file. Table data buffers
+    // may point directly into the mapped area, so the object is shared
+    // between the sfntFile and all tables which reference it.
+    //
+    // The mapping stays valid if the source file is replaced (renamed over)
+    // or unlinked, which is how both sfntFile::save () and most other tools
+    // write files. If the file is rewritten in place, the mapped bytes change
+    // as well, and pages past the new end of a truncated file raise SIGBUS
+    // on access. Such a change is detected by intact (), which compares
+    // size and modification time of the mapped inode with those it had when
+    // mapped. sfntFile checks this before saving and when notified of
+    // a change to the file, and then moves all views into own buffers with
+    // copy (), which fails rather than crashes on a truncated area. There
+    // is no protection for data accessed between a change and such a check
+    class FileMapping {
+    public:
+	FileMapping (const QString &path);
+	~FileMapping ();
+
+	const char *data () const;
+	size_t size () const;
+	bool valid () const;
+	bool contains (uint32_t off, uint32_t len) const;
+	// Descriptor of the mapped file, kept open as long as the mapping
+	// exists. It refers to the mapped inode even if the file has been
+	// renamed or unlinked since, so may be used to copy mapped data
+	int handle () const;
+	// False if the mapped file has been modified since it was mapped
+	bool intact () const;
+	// Copy mapped data, returning false if the area is no longer
+	// backed by the file
+	bool copy (uint32_t off, uint32_t len, char *dest) const;
+
+    private:
+	void *m_addr;
+	size_t m_size;
+	int m_fd;
+	struct timespec m_mtime;
+    };
+}
+
+#endif
@@ -28,6 +28,9 @@
 #include <cmath>
 #include <algorithm>
 #include <iterator>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "fs_math.h"
 
 static const double RE_NearZero	= .00000001;
@@ -123,3 +126,74 @@ bool FontShepherd::math::within16RoundingErrors (double v1, double v2) {
     }
 }
 
+// A big-endian word sum modulo 2^32 is the same as the sum of separate
+// totals for each byte position within a word, shifted into place. So
+// instead of swapping bytes in every word, accumulate bytes from each
+// position in 16-bit fields of 32-bit lanes (two positions per lane),
+// which needs no carries between fields and is easy to vectorize.
+// A 16-bit field can take 256 additions of 0xFF without overflowing,
+// after which the lanes are flushed to 64-bit totals
+uint32_t FontShepherd::math::checksum (const char *data, size_t len) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *> (data);
+    uint64_t pos_sum[4] = { 0, 0, 0, 0 };
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32 (0x00FF00FF);
+    while (len - i >= 16) {
+	__m128i even = _mm_setzero_si128 ();
+	__m128i odd = _mm_setzero_si128 ();
+	for (int n=0; n<256 && len - i >= 16; n++, i+=16) {
+	    __m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (p+i));
+	    even = _mm_add_epi32 (even, _mm_and_si128 (v, mask));
+	    odd = _mm_add_epi32 (odd, _mm_and_si128 (_mm_srli_epi32 (v, 8), mask));
+	}
+	uint32_t ev[4], od[4];
+	_mm_storeu_si128 (reinterpret_cast<__m128i *> (ev), even);
+	_mm_storeu_si128 (reinterpret_cast<__m128i *> (od), odd);
+	// Lanes are loaded little-endian, so the low field of 'even' holds
+	// bytes at offset 0 of each word, and its high field those at offset 2
+	for (int k=0; k<4; k++) {
+	    pos_sum[0] += ev[k]&0xFFFF;
+	    pos_sum[2] += ev[k]>>16;
+	    pos_sum[1] += od[k]&0xFFFF;
+	    pos_sum[3] += od[k]>>16;
+	}
+    }
+#endif
+    for (; i+4 <= len; i+=4) {
+	pos_sum[0] += p[i];
+	pos_sum[1] += p[i+1];
+	pos_sum[2] += p[i+2];
+	pos_sum[3] += p[i+3];
+    }
+    for (int k=0; i<len; i++, k++)
+	pos_sum[k] += p[i];
+
+    return static_cast<uint32_t> ((pos_sum[0]<<24) + (pos_sum[1]<<16) + (pos_sum[2]<<8) + pos_sum[3]);
+}
+
+// Within a vector of four lanes the sum is computed with two shifted
+// additions; the last lane is then broadcast to be carried into the next one
+void FontShepherd::math::prefixSum (int32_t *vals, size_t cnt) {
+    size_t i = 0;
+    int32_t last = 0;
+
+#ifdef __SSE2__
+    __m128i carry = _mm_setzero_si128 ();
+    for (; i+4 <= cnt; i+=4) {
+	__m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (vals+i));
+	v = _mm_add_epi32 (v, _mm_slli_si128 (v, 4));
+	v = _mm_add_epi32 (v, _mm_slli_si128 (v, 8));
+	v = _mm_add_epi32 (v, carry);
+	_mm_storeu_si128 (reinterpret_cast<__m128i *> (vals+i), v);
+	carry = _mm_shuffle_epi32 (v, _MM_SHUFFLE (3, 3, 3, 3));
+    }
+    if (i)
+	last = vals[i-1];
+#endif
+    for (; i<cnt; i++) {
+	last += vals[i];
+	vals[i] = last;
+    }
+}
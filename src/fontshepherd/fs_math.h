@@ -25,6 +25,9 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE. */
 
+#include <stdint.h>
+#include <stddef.h>
+
 namespace FontShepherd {
     namespace math {
         //void matMultiply (const std::array<double, 6> &m1, const std::array<double, 6> &m2, std::array<double, 6> &to);
@@ -35,5 +38,11 @@ namespace FontShepherd {
         bool realRatio (double a, double b, double fudge);
         double round (double f, float prec);
 	bool within16RoundingErrors (double v1, double v2);
+	// Sum of big-endian 32-bit words, as used for sfnt table checksums.
+	// A trailing partial word is treated as if padded with zeros
+	uint32_t checksum (const char *data, size_t len);
+	// In-place inclusive prefix sum, e. g. to turn coordinate deltas into
+	// absolute values
+	void prefixSum (int32_t *vals, size_t cnt);
     }
 }
@@ -25,10 +25,48 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE. */
 
+#include <atomic>
 #include "fs_notify.h"
 
+static std::atomic<bool> interactive_mode (true);
+static std::atomic<FontShepherd::MessageHandler *> message_handler (nullptr);
+
+void FontShepherd::setInteractive (bool val) {
+    interactive_mode = val;
+}
+
+void FontShepherd::setMessageHandler (MessageHandler *handler) {
+    message_handler = handler;
+}
+
+bool FontShepherd::interactive () {
+    QCoreApplication *app = QCoreApplication::instance ();
+    return (interactive_mode && message_handler && app && QThread::currentThread () == app->thread ());
+}
+
+// Messages posted by worker threads (e. g. while tables are being compiled
+// concurrently) can't open a dialog in place. In interactive mode they are
+// passed to the GUI thread instead, and shown once it gets back to its event
+// loop. The parent widget is not passed, as it may be gone by that time
+static bool queue_message (FontShepherd::MessageType type, const QString &title, const QString &text) {
+    QCoreApplication *app = QCoreApplication::instance ();
+    if (!interactive_mode || !message_handler || !app || QThread::currentThread () == app->thread ())
+	return false;
+    QMetaObject::invokeMethod (app, [type, title, text] () {
+	FontShepherd::MessageHandler *handler = message_handler;
+	if (handler)
+	    handler->message (type, title, text, nullptr);
+    }, Qt::QueuedConnection);
+    return true;
+}
+
 void FontShepherd::postWarning (QString title, QString text, QWidget *w) {
-    QMessageBox::warning (w, title, text);
+    if (queue_message (MessageType::Warning, title, text))
+	return;
+    if (!interactive ())
+	postWarning (QString ("%1: %2").arg (title).arg (text));
+    else
+	message_handler.load ()->message (MessageType::Warning, title, text, w);
 }
 
 void FontShepherd::postWarning (QString text) {
@@ -36,7 +74,12 @@ void FontShepherd::postWarning (QString text) {
 }
 
 void FontShepherd::postError (QString title, QString text, QWidget *w) {
-    QMessageBox::critical (w, title, text);
+    if (queue_message (MessageType::Error, title, text))
+	return;
+    if (!interactive ())
+	postError (QString ("%1: %2").arg (title).arg (text));
+    else
+	message_handler.load ()->message (MessageType::Error, title, text, w);
 }
 
 void FontShepherd::postError (QString text) {
@@ -44,21 +87,35 @@ void FontShepherd::postError (QString text) {
 }
 
 void FontShepherd::postNotice (QString title, QString text, QWidget *w) {
-    QMessageBox::information (w, title, text);
+    if (queue_message (MessageType::Notice, title, text))
+	return;
+    if (!interactive ())
+	postNotice (QString ("%1: %2").arg (title).arg (text));
+    else
+	message_handler.load ()->message (MessageType::Notice, title, text, w);
 }
 
 void FontShepherd::postNotice (QString text) {
     qDebug () << text;
 }
 
-int FontShepherd::postYesNoQuestion (QString title, QString text, QWidget *w) {
-    QMessageBox msgBox (w);
-    msgBox.setText (text);
-    msgBox.setWindowTitle (title);
-    msgBox.setIcon (QMessageBox::Question);
-    msgBox.setStandardButtons (QMessageBox::Yes | QMessageBox::No);
-    msgBox.setDefaultButton (QMessageBox::Yes);
-    int ret = msgBox.exec();
-    return ret;
+bool FontShepherd::postYesNoQuestion (QString title, QString text, QWidget *w) {
+    if (!interactive ())
+	return true;
+    return message_handler.load ()->question (title, text, w);
+}
+
+
+FontShepherd::ProgressNotifier::ProgressNotifier (const QString &label, int min, int max, QWidget *parent) {
+    if (interactive ())
+	m_dlg.reset (message_handler.load ()->progress (label, min, max, parent));
 }
 
+FontShepherd::ProgressNotifier::~ProgressNotifier () {
+}
+
+bool FontShepherd::ProgressNotifier::setValue (int val) {
+    if (!m_dlg)
+	return true;
+    return m_dlg->setValue (val);
+}
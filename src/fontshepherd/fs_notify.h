@@ -24,7 +24,10 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE. */
 
-#include <QtWidgets>
+#include <memory>
+#include <QtCore>
+
+class QWidget;
 
 namespace FontShepherd {
     void postWarning (QString title, QString text, QWidget *w=nullptr);
@@ -33,5 +36,46 @@ namespace FontShepherd {
     void postError (QString text);
     void postNotice (QString title, QString text, QWidget *w=nullptr);
     void postNotice (QString text);
-    int postYesNoQuestion (QString title, QString text, QWidget *w=nullptr);
+    // Returns true if the answer is 'Yes'
+    bool postYesNoQuestion (QString title, QString text, QWidget *w=nullptr);
+
+    // In non-interactive (batch) mode messages are just logged, and questions
+    // get their default answers. Outside the GUI thread questions get their
+    // default answers as well, while messages are deferred to the GUI thread
+    void setInteractive (bool val);
+    bool interactive ();
+
+    enum class MessageType { Notice, Warning, Error };
+
+    class ProgressDisplay {
+    public:
+	virtual ~ProgressDisplay () {};
+	// Returns false if canceled by user
+	virtual bool setValue (int val) = 0;
+    };
+
+    // Message boxes and progress dialogs are provided by the GUI application
+    // (see fs_dialogs.h), which installs a handler for them. Without a handler
+    // the library behaves as in non-interactive mode
+    class MessageHandler {
+    public:
+	virtual ~MessageHandler () {};
+	virtual void message (MessageType type, const QString &title, const QString &text, QWidget *w) = 0;
+	virtual bool question (const QString &title, const QString &text, QWidget *w) = 0;
+	virtual ProgressDisplay *progress (const QString &label, int min, int max, QWidget *parent) = 0;
+    };
+    void setMessageHandler (MessageHandler *handler);
+
+    // A modal progress dialog, which is only displayed in interactive mode
+    class ProgressNotifier {
+    public:
+	ProgressNotifier (const QString &label, int min, int max, QWidget *parent);
+	~ProgressNotifier ();
+
+	// Returns false if canceled by user
+	bool setValue (int val);
+
+    private:
+	std::unique_ptr<ProgressDisplay> m_dlg;
+    };
 }
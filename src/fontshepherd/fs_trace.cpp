@@ -0,0 +1,202 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include "fs_trace.h"
+
+namespace {
+    enum EventType { Complete, Counter };
+
+    struct Event {
+	const char *name;
+	uint64_t ts;		// microseconds since the clock origin
+	int64_t val;		// duration for complete events
+	EventType type;
+    };
+
+    // Each thread records into its own buffer, so that the only lock taken
+    // on the hot path is never contended except while exporting
+    struct ThreadBuffer {
+	static const size_t max_events = 1<<20;
+
+	std::mutex lock;
+	std::vector<Event> events;
+	uint32_t tid;
+	uint64_t dropped = 0;
+    };
+
+    std::mutex registry_lock;
+    std::vector<std::shared_ptr<ThreadBuffer>> registry;
+    std::atomic<uint32_t> next_tid {1};
+    const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now ();
+
+    // Buffers are kept in the registry after their threads have finished,
+    // so that short-lived worker threads still show up in the trace
+    ThreadBuffer &threadBuffer () {
+	thread_local std::shared_ptr<ThreadBuffer> buf;
+	if (!buf) {
+	    buf = std::make_shared<ThreadBuffer> ();
+	    buf->tid = next_tid++;
+	    std::lock_guard<std::mutex> guard (registry_lock);
+	    registry.push_back (buf);
+	}
+	return *buf;
+    }
+
+    void record (const Event &ev) {
+	ThreadBuffer &buf = threadBuffer ();
+	std::lock_guard<std::mutex> guard (buf.lock);
+	if (buf.events.size () < ThreadBuffer::max_events)
+	    buf.events.push_back (ev);
+	else
+	    buf.dropped++;
+    }
+
+    void jsonEscape (std::ostream &os, const char *s) {
+	for (; *s; s++) {
+	    switch (*s) {
+	      case '"':
+	      case '\\':
+		os << '\\' << *s;
+		break;
+	      default:
+		if (static_cast<unsigned char> (*s) >= 0x20)
+		    os << *s;
+	    }
+	}
+    }
+}
+
+std::atomic<bool> FontShepherd::trace::g_enabled {false};
+
+void FontShepherd::trace::setEnabled (bool val) {
+    g_enabled.store (val, std::memory_order_relaxed);
+}
+
+void FontShepherd::trace::reset () {
+    std::lock_guard<std::mutex> guard (registry_lock);
+    for (auto &buf : registry) {
+	std::lock_guard<std::mutex> buf_guard (buf->lock);
+	buf->events.clear ();
+	buf->dropped = 0;
+    }
+}
+
+uint64_t FontShepherd::trace::now () {
+    return std::chrono::duration_cast<std::chrono::microseconds>
+	(std::chrono::steady_clock::now () - origin).count ();
+}
+
+void FontShepherd::trace::complete (const char *name, uint64_t start, uint64_t end) {
+    record ({ name, start, static_cast<int64_t> (end - start), Complete });
+}
+
+void FontShepherd::trace::counter (const char *name, int64_t val) {
+    record ({ name, now (), val, Counter });
+}
+
+uint64_t FontShepherd::trace::dropped () {
+    uint64_t ret = 0;
+    std::lock_guard<std::mutex> guard (registry_lock);
+    for (auto &buf : registry) {
+	std::lock_guard<std::mutex> buf_guard (buf->lock);
+	ret += buf->dropped;
+    }
+    return ret;
+}
+
+std::vector<FontShepherd::trace::OpSummary> FontShepherd::trace::summary () {
+    // Names are compared by value, as the same literal may have different
+    // addresses in different translation units
+    std::map<std::string, std::vector<uint64_t>> durations;
+    {
+	std::lock_guard<std::mutex> guard (registry_lock);
+	for (auto &buf : registry) {
+	    std::lock_guard<std::mutex> buf_guard (buf->lock);
+	    for (auto &ev : buf->events) {
+		if (ev.type == Complete)
+		    durations[ev.name].push_back (ev.val);
+	    }
+	}
+    }
+
+    std::vector<OpSummary> ret;
+    ret.reserve (durations.size ());
+    for (auto &pair : durations) {
+	std::vector<uint64_t> &d = pair.second;
+	OpSummary op;
+	std::sort (d.begin (), d.end ());
+	op.name = pair.first;
+	op.count = d.size ();
+	op.min_us = d.front ();
+	op.max_us = d.back ();
+	op.p50_us = d[(d.size ()-1)/2];
+	op.p95_us = d[(d.size ()-1)*95/100];
+	for (uint64_t val : d) {
+	    size_t bucket = 0;
+	    op.total_us += val;
+	    for (; val && bucket < op.histogram.size ()-1; val >>= 1)
+		bucket++;
+	    op.histogram[bucket]++;
+	}
+	ret.push_back (op);
+    }
+    return ret;
+}
+
+bool FontShepherd::trace::exportChromeTrace (const std::string &path) {
+    std::ofstream os (path, std::ios::out | std::ios::trunc);
+    if (!os)
+	return false;
+    int pid = getpid ();
+    bool first = true;
+
+    os << "{\"traceEvents\":[\n";
+    std::lock_guard<std::mutex> guard (registry_lock);
+    for (auto &buf : registry) {
+	std::lock_guard<std::mutex> buf_guard (buf->lock);
+	for (auto &ev : buf->events) {
+	    if (!first) os << ",\n";
+	    first = false;
+	    os << "{\"name\":\"";
+	    jsonEscape (os, ev.name);
+	    os << "\",\"pid\":" << pid << ",\"tid\":" << buf->tid << ",\"ts\":" << ev.ts;
+	    if (ev.type == Complete)
+		os << ",\"ph\":\"X\",\"cat\":\"fontshepherd\",\"dur\":" << ev.val << "}";
+	    else
+		os << ",\"ph\":\"C\",\"args\":{\"value\":" << ev.val << "}}";
+	}
+    }
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool> (os);
+}
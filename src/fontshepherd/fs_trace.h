@@ -0,0 +1,102 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+
+#ifndef _FONSHEPHERD_FS_TRACE_H
+#define _FONSHEPHERD_FS_TRACE_H
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace FontShepherd {
+    // Lightweight instrumentation for hot paths. When tracing is disabled
+    // at runtime, a scope costs one relaxed atomic load. Define FS_NO_TRACE
+    // to compile it out completely. Names passed to Scope and counter ()
+    // should be string literals, as only pointers to them are stored
+    namespace trace {
+	extern std::atomic<bool> g_enabled;
+
+	inline bool enabled () {
+	    return g_enabled.load (std::memory_order_relaxed);
+	}
+	void setEnabled (bool val);
+	// Drops all events recorded so far
+	void reset ();
+
+	uint64_t now ();
+	void complete (const char *name, uint64_t start, uint64_t end);
+	void counter (const char *name, int64_t val);
+
+	class Scope {
+	public:
+	    Scope (const char *name) : m_name (enabled () ? name : nullptr) {
+		if (m_name) m_start = now ();
+	    }
+	    ~Scope () {
+		if (m_name) complete (m_name, m_start, now ());
+	    }
+	    Scope (const Scope &) = delete;
+	    Scope &operator= (const Scope &) = delete;
+
+	private:
+	    const char *m_name;
+	    uint64_t m_start = 0;
+	};
+
+	// Latency histogram with power of two buckets: bucket i counts
+	// durations in [2^(i-1), 2^i) microseconds (bucket 0: under 1 us)
+	struct OpSummary {
+	    std::string name;
+	    uint64_t count = 0;
+	    uint64_t total_us = 0, min_us = 0, max_us = 0;
+	    uint64_t p50_us = 0, p95_us = 0;
+	    std::array<uint64_t, 32> histogram {};
+	};
+	std::vector<OpSummary> summary ();
+	// Number of events discarded since the per-thread buffers were full
+	uint64_t dropped ();
+
+	// Writes events in the Chrome trace event format, which can be loaded
+	// into chrome://tracing or Perfetto
+	bool exportChromeTrace (const std::string &path);
+    }
+}
+
+#ifndef FS_NO_TRACE
+#define FS_TRACE_CONCAT2(a, b) a##b
+#define FS_TRACE_CONCAT(a, b) FS_TRACE_CONCAT2 (a, b)
+#define FS_TRACE_SCOPE(name) FontShepherd::trace::Scope FS_TRACE_CONCAT (fs_trace_scope_, __LINE__) (name)
+#define FS_TRACE_COUNTER(name, val) \
+    do { if (FontShepherd::trace::enabled ()) FontShepherd::trace::counter (name, val); } while (0)
+#else
+#define FS_TRACE_SCOPE(name) do {} while (0)
+#define FS_TRACE_COUNTER(name, val) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,778 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#include "fs_woff2.h"
+
+static const uint32_t known_tags[63] = {
+    0x636d6170, 0x68656164, 0x68686561, 0x686d7478, // cmap head hhea hmtx
+    0x6d617870, 0x6e616d65, 0x4f532f32, 0x706f7374, // maxp name OS/2 post
+    0x63767420, 0x6670676d, 0x676c7966, 0x6c6f6361, // cvt  fpgm glyf loca
+    0x70726570, 0x43464620, 0x564f5247, 0x45424454, // prep CFF  VORG EBDT
+    0x45424c43, 0x67617370, 0x68646d78, 0x6b65726e, // EBLC gasp hdmx kern
+    0x4c545348, 0x50434c54, 0x56444d58, 0x76686561, // LTSH PCLT VDMX vhea
+    0x766d7478, 0x42415345, 0x47444546, 0x47504f53, // vmtx BASE GDEF GPOS
+    0x47535542, 0x45425343, 0x4a535446, 0x4d415448, // GSUB EBSC JSTF MATH
+    0x43424454, 0x43424c43, 0x434f4c52, 0x4350414c, // CBDT CBLC COLR CPAL
+    0x53564720, 0x73626978, 0x61636e74, 0x61766172, // SVG  sbix acnt avar
+    0x62646174, 0x626c6f63, 0x62736c6e, 0x63766172, // bdat bloc bsln cvar
+    0x66647363, 0x66656174, 0x666d7478, 0x66766172, // fdsc feat fmtx fvar
+    0x67766172, 0x68737479, 0x6a757374, 0x6c636172, // gvar hsty just lcar
+    0x6d6f7274, 0x6d6f7278, 0x6f706264, 0x70726f70, // mort morx opbd prop
+    0x7472616b, 0x5a617066, 0x53696c66, 0x476c6174, // trak Zapf Silf Glat
+    0x476c6f63, 0x46656174, 0x53696c6c              // Gloc Feat Sill
+};
+
+// TrueType glyph flags
+enum {
+    ON_CURVE = 0x01, X_SHORT = 0x02, Y_SHORT = 0x04, REPEAT = 0x08,
+    X_SAME = 0x10, Y_SAME = 0x20, OVERLAP_SIMPLE = 0x40
+};
+
+// Composite glyph flags
+enum {
+    ARGS_ARE_WORDS = 0x0001, HAVE_SCALE = 0x0008, MORE_COMPONENTS = 0x0020,
+    HAVE_XY_SCALE = 0x0040, HAVE_2X2 = 0x0080, HAVE_INSTRUCTIONS = 0x0100
+};
+
+static uint16_t get16 (const char *p) {
+    const uint8_t *up = reinterpret_cast<const uint8_t *> (p);
+    return (up[0]<<8) | up[1];
+}
+
+static uint32_t get32 (const char *p) {
+    const uint8_t *up = reinterpret_cast<const uint8_t *> (p);
+    return ((uint32_t) up[0]<<24) | (up[1]<<16) | (up[2]<<8) | up[3];
+}
+
+static void put16 (std::string &s, uint16_t val) {
+    s.push_back (val>>8);
+    s.push_back (val&0xff);
+}
+
+static void put32 (std::string &s, uint32_t val) {
+    put16 (s, val>>16);
+    put16 (s, val&0xffff);
+}
+
+static void put16 (char *p, uint16_t val) {
+    p[0] = val>>8;
+    p[1] = val&0xff;
+}
+
+// Output buffer for the reconstructed glyf table. Its capacity is calculated
+// in advance from the sizes of the transformed substreams, so that glyphs
+// can be written straight to the memory which then becomes table data
+struct GlyfOut {
+    std::unique_ptr<char[]> data;
+    size_t pos = 0, cap = 0;
+    bool overflow = false;
+
+    size_t size () const { return pos; };
+    char &operator[] (size_t i) { return data[i]; };
+    void push_back (char c) {
+	if (pos < cap) data[pos++] = c; else overflow = true;
+    };
+    void append (const char *from, const char *to) {
+	if ((size_t) (to - from) > cap - pos) { overflow = true; return; }
+	std::copy (from, to, data.get () + pos);
+	pos += to - from;
+    };
+    // The buffer is zero-filled, so there is nothing to initialize
+    void resize (size_t n) {
+	if (n > cap) overflow = true; else pos = n;
+    };
+};
+
+static void put16 (GlyfOut &v, uint16_t val) {
+    v.push_back (val>>8);
+    v.push_back (val&0xff);
+}
+
+// A cursor over one of the substreams of the transformed glyf table
+struct Stream {
+    const char *p, *end;
+
+    bool has (size_t n) const { return (size_t) (end - p) >= n; };
+    bool get16 (uint16_t &val) {
+	if (!has (2)) return false;
+	val = ::get16 (p); p += 2;
+	return true;
+    };
+    bool get255 (uint16_t &val) {
+	return FontShepherd::woff2::read255UShort (p, end, val);
+    };
+};
+
+uint32_t FontShepherd::woff2::knownTag (int idx) {
+    return (idx >= 0 && idx < 63) ? known_tags[idx] : 0;
+}
+
+int FontShepherd::woff2::knownTagIndex (uint32_t tag) {
+    for (int i=0; i<63; i++) {
+	if (known_tags[i] == tag)
+	    return i;
+    }
+    return 63;
+}
+
+bool FontShepherd::woff2::readBase128 (const char *&p, const char *end, uint32_t &val) {
+    val = 0;
+    for (int i=0; i<5 && p<end; i++) {
+	uint8_t b = *p++;
+	// No leading zeros allowed
+	if (i == 0 && b == 0x80)
+	    return false;
+	// Would overflow uint32
+	if (val & 0xfe000000)
+	    return false;
+	val = (val<<7) | (b&0x7f);
+	if (!(b&0x80))
+	    return true;
+    }
+    return false;
+}
+
+void FontShepherd::woff2::putBase128 (std::string &s, uint32_t val) {
+    int len = 1;
+    for (uint32_t v = val>>7; v; v >>= 7)
+	len++;
+    for (int i=len-1; i>=0; i--)
+	s.push_back (((val>>(i*7))&0x7f) | (i ? 0x80 : 0));
+}
+
+bool FontShepherd::woff2::read255UShort (const char *&p, const char *end, uint16_t &val) {
+    if (p >= end)
+	return false;
+    uint8_t code = *p++;
+    if (code == 253) {
+	if (end - p < 2)
+	    return false;
+	val = get16 (p);
+	p += 2;
+    } else if (code == 254 || code == 255) {
+	if (p >= end)
+	    return false;
+	val = static_cast<uint8_t> (*p++) + (code == 254 ? 253*2 : 253);
+    } else {
+	val = code;
+    }
+    return true;
+}
+
+void FontShepherd::woff2::put255UShort (std::string &s, uint16_t val) {
+    if (val < 253) {
+	s.push_back (val);
+    } else if (val < 506) {
+	s.push_back (255);
+	s.push_back (val - 253);
+    } else if (val < 762) {
+	s.push_back (254);
+	s.push_back (val - 506);
+    } else {
+	s.push_back (253);
+	put16 (s, val);
+    }
+}
+
+std::string FontShepherd::woff2::compress (const char *src, size_t len) {
+    size_t out_len = BrotliEncoderMaxCompressedSize (len);
+    std::string ret (out_len, '\0');
+    if (!out_len || !BrotliEncoderCompress (BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_FONT,
+	len, reinterpret_cast<const uint8_t *> (src), &out_len, reinterpret_cast<uint8_t *> (&ret[0])))
+	return std::string ();
+    ret.resize (out_len);
+    return ret;
+}
+
+FontShepherd::woff2::StreamDecoder::StreamDecoder (const char *src, size_t len) :
+    m_state (BrotliDecoderCreateInstance (nullptr, nullptr, nullptr)),
+    m_next_in (reinterpret_cast<const uint8_t *> (src)),
+    m_avail_in (len) {
+}
+
+FontShepherd::woff2::StreamDecoder::~StreamDecoder () {
+    if (m_state)
+	BrotliDecoderDestroyInstance (m_state);
+}
+
+bool FontShepherd::woff2::StreamDecoder::read (char *dest, size_t len) {
+    uint8_t *next_out = reinterpret_cast<uint8_t *> (dest);
+    size_t avail_out = len;
+    if (!m_state)
+	return false;
+    while (avail_out > 0) {
+	BrotliDecoderResult res = BrotliDecoderDecompressStream (
+	    m_state, &m_avail_in, &m_next_in, &avail_out, &next_out, nullptr);
+	if (res == BROTLI_DECODER_RESULT_ERROR || res == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT)
+	    return false;
+	if (res == BROTLI_DECODER_RESULT_SUCCESS && avail_out > 0)
+	    return false;
+    }
+    return true;
+}
+
+bool FontShepherd::woff2::StreamDecoder::finished () {
+    if (!m_state)
+	return false;
+    if (!BrotliDecoderIsFinished (m_state)) {
+	size_t avail_out = 0;
+	uint8_t *next_out = nullptr;
+	BrotliDecoderDecompressStream (m_state, &m_avail_in, &m_next_in, &avail_out, &next_out, nullptr);
+    }
+    return BrotliDecoderIsFinished (m_state);
+}
+
+static void writeTriplet (std::string &flags, std::string &glyphs, bool on_curve, int x, int y) {
+    int abs_x = std::abs (x), abs_y = std::abs (y);
+    int on_curve_bit = on_curve ? 0 : 128;
+    int x_sign_bit = (x < 0) ? 0 : 1;
+    int y_sign_bit = (y < 0) ? 0 : 1;
+    int xy_sign_bits = x_sign_bit + 2*y_sign_bit;
+
+    if (x == 0 && abs_y < 1280) {
+	flags.push_back (on_curve_bit + ((abs_y&0xf00)>>7) + y_sign_bit);
+	glyphs.push_back (abs_y&0xff);
+    } else if (y == 0 && abs_x < 1280) {
+	flags.push_back (on_curve_bit + 10 + ((abs_x&0xf00)>>7) + x_sign_bit);
+	glyphs.push_back (abs_x&0xff);
+    } else if (abs_x < 65 && abs_y < 65) {
+	flags.push_back (on_curve_bit + 20 + ((abs_x-1)&0x30) + (((abs_y-1)&0x30)>>2) + xy_sign_bits);
+	glyphs.push_back ((((abs_x-1)&0xf)<<4) | ((abs_y-1)&0xf));
+    } else if (abs_x < 769 && abs_y < 769) {
+	flags.push_back (on_curve_bit + 84 + 12*(((abs_x-1)&0x300)>>8) + (((abs_y-1)&0x300)>>6) + xy_sign_bits);
+	glyphs.push_back ((abs_x-1)&0xff);
+	glyphs.push_back ((abs_y-1)&0xff);
+    } else if (abs_x < 4096 && abs_y < 4096) {
+	flags.push_back (on_curve_bit + 120 + xy_sign_bits);
+	glyphs.push_back (abs_x>>4);
+	glyphs.push_back (((abs_x&0xf)<<4) | (abs_y>>8));
+	glyphs.push_back (abs_y&0xff);
+    } else {
+	flags.push_back (on_curve_bit + 124 + xy_sign_bits);
+	put16 (glyphs, abs_x);
+	put16 (glyphs, abs_y);
+    }
+}
+
+static bool readTriplet (Stream &glyphs, uint8_t flag, int &dx, int &dy) {
+    auto with_sign = [](int flag, int baseval) {
+	return (flag&1) ? baseval : -baseval;
+    };
+    const uint8_t *in = reinterpret_cast<const uint8_t *> (glyphs.p);
+    flag &= 0x7f;
+    size_t nbytes = flag < 84 ? 1 : flag < 120 ? 2 : flag < 124 ? 3 : 4;
+    if (!glyphs.has (nbytes))
+	return false;
+
+    if (flag < 10) {
+	dx = 0;
+	dy = with_sign (flag, ((flag&14)<<7) + in[0]);
+    } else if (flag < 20) {
+	dx = with_sign (flag, (((flag-10)&14)<<7) + in[0]);
+	dy = 0;
+    } else if (flag < 84) {
+	int b0 = flag - 20;
+	dx = with_sign (flag, 1 + (b0&0x30) + (in[0]>>4));
+	dy = with_sign (flag>>1, 1 + ((b0&0x0c)<<2) + (in[0]&0x0f));
+    } else if (flag < 120) {
+	int b0 = flag - 84;
+	dx = with_sign (flag, 1 + ((b0/12)<<8) + in[0]);
+	dy = with_sign (flag>>1, 1 + (((b0%12)>>2)<<8) + in[1]);
+    } else if (flag < 124) {
+	dx = with_sign (flag, (in[0]<<4) + (in[1]>>4));
+	dy = with_sign (flag>>1, ((in[1]&0x0f)<<8) + in[2]);
+    } else {
+	dx = with_sign (flag, (in[0]<<8) + in[1]);
+	dy = with_sign (flag>>1, (in[2]<<8) + in[3]);
+    }
+    glyphs.p += nbytes;
+    return true;
+}
+
+// Returns the size of composite glyph components starting at p, or 0 if
+// the data are broken
+static size_t compositeSize (const char *p, const char *end, bool &have_instr) {
+    const char *start = p;
+    uint16_t flags;
+    have_instr = false;
+    do {
+	if (end - p < 4)
+	    return 0;
+	flags = get16 (p);
+	size_t args = (flags & ARGS_ARE_WORDS) ? 4 : 2;
+	size_t scale = (flags & HAVE_2X2) ? 8 : (flags & HAVE_XY_SCALE) ? 4 : (flags & HAVE_SCALE) ? 2 : 0;
+	if ((size_t) (end - p) < 4 + args + scale)
+	    return 0;
+	p += 4 + args + scale;
+	have_instr |= (flags & HAVE_INSTRUCTIONS);
+    } while (flags & MORE_COMPONENTS);
+    return p - start;
+}
+
+bool FontShepherd::woff2::transformGlyf (const char *glyf, size_t glyf_len, const char *loca, size_t loca_len,
+    bool long_loca, uint16_t num_glyphs, std::string &out, std::vector<int16_t> &xmins) {
+    std::string ncont, npts, flags, glyphs, comps, bboxes, instrs;
+    std::vector<uint8_t> bbox_bitmap (4*((num_glyphs+31)/32));
+    std::vector<uint8_t> overlap_bitmap ((num_glyphs+7)>>3);
+    bool has_overlap = false;
+    std::vector<uint16_t> endpts;
+    std::vector<uint8_t> pt_flags;
+    std::vector<int> dxs, dys;
+
+    if (loca_len < (size_t) (num_glyphs+1)*(long_loca ? 4 : 2))
+	return false;
+    xmins.assign (num_glyphs, 0);
+
+    for (uint16_t i=0; i<num_glyphs; i++) {
+	uint32_t off = long_loca ? get32 (loca + i*4) : get16 (loca + i*2)*2;
+	uint32_t end = long_loca ? get32 (loca + i*4 + 4) : get16 (loca + i*2 + 2)*2;
+	if (end < off || end > glyf_len)
+	    return false;
+	if (end == off) {
+	    put16 (ncont, 0);
+	    continue;
+	}
+	if (end - off < 10)
+	    return false;
+	const char *g = glyf + off, *gend = glyf + end;
+	int16_t nc = get16 (g);
+	int16_t bb[4];
+	for (int j=0; j<4; j++)
+	    bb[j] = get16 (g + 2 + j*2);
+	xmins[i] = bb[0];
+	put16 (ncont, nc);
+
+	if (nc > 0) {
+	    const char *p = g + 10;
+	    if (gend - p < nc*2 + 2)
+		return false;
+	    endpts.resize (nc);
+	    int prev = -1;
+	    for (int j=0; j<nc; j++) {
+		endpts[j] = get16 (p); p += 2;
+		if (endpts[j] <= prev)
+		    return false;
+		put255UShort (npts, endpts[j] - prev);
+		prev = endpts[j];
+	    }
+	    size_t npoints = endpts.back () + 1;
+	    uint16_t instr_len = get16 (p); p += 2;
+	    if (gend - p < instr_len)
+		return false;
+	    const char *instr = p;
+	    p += instr_len;
+
+	    pt_flags.resize (npoints);
+	    for (size_t j=0; j<npoints; ) {
+		if (p >= gend)
+		    return false;
+		uint8_t fl = *p++;
+		int rep = 0;
+		if (fl & REPEAT) {
+		    if (p >= gend)
+			return false;
+		    rep = static_cast<uint8_t> (*p++);
+		}
+		for (int k=0; k<=rep && j<npoints; k++)
+		    pt_flags[j++] = fl;
+	    }
+	    dxs.resize (npoints);
+	    dys.resize (npoints);
+	    for (int pass=0; pass<2; pass++) {
+		std::vector<int> &ds = pass ? dys : dxs;
+		uint8_t short_bit = pass ? Y_SHORT : X_SHORT;
+		uint8_t same_bit = pass ? Y_SAME : X_SAME;
+		for (size_t j=0; j<npoints; j++) {
+		    uint8_t fl = pt_flags[j];
+		    if (fl & short_bit) {
+			if (p >= gend)
+			    return false;
+			uint8_t v = *p++;
+			ds[j] = (fl & same_bit) ? v : -v;
+		    } else if (fl & same_bit) {
+			ds[j] = 0;
+		    } else {
+			if (gend - p < 2)
+			    return false;
+			ds[j] = static_cast<int16_t> (get16 (p));
+			p += 2;
+		    }
+		}
+	    }
+
+	    int x = 0, y = 0;
+	    int xmin = std::numeric_limits<int>::max (), ymin = xmin;
+	    int xmax = std::numeric_limits<int>::min (), ymax = xmax;
+	    for (size_t j=0; j<npoints; j++) {
+		writeTriplet (flags, glyphs, pt_flags[j] & ON_CURVE, dxs[j], dys[j]);
+		x += dxs[j]; y += dys[j];
+		xmin = std::min (xmin, x); xmax = std::max (xmax, x);
+		ymin = std::min (ymin, y); ymax = std::max (ymax, y);
+	    }
+	    put255UShort (glyphs, instr_len);
+	    instrs.append (instr, instr_len);
+	    if (pt_flags[0] & OVERLAP_SIMPLE) {
+		overlap_bitmap[i>>3] |= 0x80>>(i&7);
+		has_overlap = true;
+	    }
+	    // The bounding box is stored explicitly only if it differs
+	    // from the one calculated from the points
+	    if (xmin != bb[0] || ymin != bb[1] || xmax != bb[2] || ymax != bb[3]) {
+		bbox_bitmap[i>>3] |= 0x80>>(i&7);
+		for (int j=0; j<4; j++)
+		    put16 (bboxes, bb[j]);
+	    }
+	} else if (nc == -1) {
+	    bool have_instr;
+	    size_t size = compositeSize (g + 10, gend, have_instr);
+	    if (!size)
+		return false;
+	    comps.append (g + 10, size);
+	    if (have_instr) {
+		const char *p = g + 10 + size;
+		if (gend - p < 2)
+		    return false;
+		uint16_t instr_len = get16 (p);
+		if (gend - p - 2 < instr_len)
+		    return false;
+		put255UShort (glyphs, instr_len);
+		instrs.append (p + 2, instr_len);
+	    }
+	    bbox_bitmap[i>>3] |= 0x80>>(i&7);
+	    for (int j=0; j<4; j++)
+		put16 (bboxes, bb[j]);
+	} else {
+	    return false;
+	}
+    }
+
+    out.clear ();
+    put16 (out, 0);				/* reserved */
+    put16 (out, has_overlap ? 1 : 0);	/* optionFlags */
+    put16 (out, num_glyphs);
+    put16 (out, long_loca ? 1 : 0);
+    put32 (out, ncont.size ());
+    put32 (out, npts.size ());
+    put32 (out, flags.size ());
+    put32 (out, glyphs.size ());
+    put32 (out, comps.size ());
+    put32 (out, bbox_bitmap.size () + bboxes.size ());
+    put32 (out, instrs.size ());
+    out += ncont;
+    out += npts;
+    out += flags;
+    out += glyphs;
+    out += comps;
+    out.append (bbox_bitmap.begin (), bbox_bitmap.end ());
+    out += bboxes;
+    out += instrs;
+    if (has_overlap)
+	out.append (overlap_bitmap.begin (), overlap_bitmap.end ());
+    return true;
+}
+
+// Encode point coordinates the usual TrueType way
+static void putSimpleGlyphPoints (GlyfOut &glyf, const std::vector<uint8_t> &on_curve,
+    const std::vector<int> &dxs, const std::vector<int> &dys, bool overlap) {
+    size_t npoints = on_curve.size ();
+    std::vector<uint8_t> fls (npoints);
+    for (size_t j=0; j<npoints; j++) {
+	uint8_t fl = on_curve[j] ? ON_CURVE : 0;
+	if (dxs[j] == 0)
+	    fl |= X_SAME;
+	else if (std::abs (dxs[j]) < 256)
+	    fl |= X_SHORT | (dxs[j] > 0 ? X_SAME : 0);
+	if (dys[j] == 0)
+	    fl |= Y_SAME;
+	else if (std::abs (dys[j]) < 256)
+	    fl |= Y_SHORT | (dys[j] > 0 ? Y_SAME : 0);
+	fls[j] = fl;
+    }
+    if (overlap && npoints)
+	fls[0] |= OVERLAP_SIMPLE;
+
+    for (size_t j=0; j<npoints; ) {
+	size_t rep = 0;
+	while (j+rep+1 < npoints && fls[j+rep+1] == fls[j] && rep < 255)
+	    rep++;
+	if (rep) {
+	    glyf.push_back (fls[j] | REPEAT);
+	    glyf.push_back (rep);
+	} else {
+	    glyf.push_back (fls[j]);
+	}
+	j += rep+1;
+    }
+    for (int pass=0; pass<2; pass++) {
+	const std::vector<int> &ds = pass ? dys : dxs;
+	uint8_t short_bit = pass ? Y_SHORT : X_SHORT;
+	uint8_t same_bit = pass ? Y_SAME : X_SAME;
+	for (size_t j=0; j<npoints; j++) {
+	    if (fls[j] & short_bit)
+		glyf.push_back (std::abs (ds[j]));
+	    else if (!(fls[j] & same_bit))
+		put16 (glyf, ds[j]);
+	}
+    }
+}
+
+bool FontShepherd::woff2::reconstructGlyf (const char *src, size_t len, std::unique_ptr<char[]> &glyf_data,
+    size_t &glyf_len, char *loca, size_t loca_len, std::vector<int16_t> &xmins) {
+    if (len < 36)
+	return false;
+    uint16_t options = get16 (src + 2);
+    uint16_t num_glyphs = get16 (src + 4);
+    bool long_loca = get16 (src + 6);
+    if (loca_len != (size_t) (num_glyphs+1)*(long_loca ? 4 : 2))
+	return false;
+
+    Stream streams[7];
+    const char *p = src + 36, *end = src + len;
+    for (int i=0; i<7; i++) {
+	uint32_t size = get32 (src + 8 + i*4);
+	if ((size_t) (end - p) < size)
+	    return false;
+	streams[i].p = p;
+	streams[i].end = p + size;
+	p += size;
+    }
+    Stream &ncont = streams[0], &npts = streams[1], &flags = streams[2], &glyphs = streams[3];
+    Stream &comps = streams[4], &bboxes = streams[5], &instrs = streams[6];
+    size_t bitmap_size = 4*((num_glyphs+31)/32);
+    if (!bboxes.has (bitmap_size))
+	return false;
+    const uint8_t *bbox_bitmap = reinterpret_cast<const uint8_t *> (bboxes.p);
+    bboxes.p += bitmap_size;
+    const uint8_t *overlap_bitmap = nullptr;
+    if (options & 1) {
+	if ((size_t) (end - p) < (size_t) ((num_glyphs+7)>>3))
+	    return false;
+	overlap_bitmap = reinterpret_cast<const uint8_t *> (p);
+    }
+
+    // Each glyph takes at most 10 bytes of header, 2 bytes of instruction
+    // length and 3 bytes of padding. Each contour takes at least one byte
+    // of the nPoints stream, and 2 bytes for its end point. Each point takes
+    // one byte of the flag stream, and at most 5 bytes (flag plus two words)
+    // when decoded. Composite descriptions and instructions are copied as is
+    GlyfOut glyf;
+    glyf.cap = (size_t) num_glyphs*15 + 2*(npts.end - npts.p) + 5*(flags.end - flags.p) +
+	(comps.end - comps.p) + (instrs.end - instrs.p);
+    glyf.data.reset (new char[glyf.cap] ());
+
+    std::vector<uint16_t> endpts;
+    std::vector<uint8_t> on_curve;
+    std::vector<int> dxs, dys;
+    xmins.assign (num_glyphs, 0);
+
+    auto put_loca = [loca, long_loca](uint16_t gid, size_t off) {
+	if (long_loca) {
+	    put16 (loca + gid*4, off>>16);
+	    put16 (loca + gid*4 + 2, off&0xffff);
+	} else {
+	    put16 (loca + gid*2, off>>1);
+	}
+    };
+
+    for (uint16_t i=0; i<num_glyphs; i++) {
+	uint16_t nc_val;
+	bool has_bbox = bbox_bitmap[i>>3] & (0x80>>(i&7));
+	put_loca (i, glyf.size ());
+	if (!ncont.get16 (nc_val))
+	    return false;
+	int16_t nc = nc_val;
+	if (nc == 0) {
+	    if (has_bbox)
+		return false;
+	    continue;
+	}
+
+	int16_t bb[4];
+	if (has_bbox) {
+	    if (!bboxes.has (8))
+		return false;
+	    for (int j=0; j<4; j++)
+		bb[j] = get16 (bboxes.p + j*2);
+	    bboxes.p += 8;
+	}
+	size_t gstart = glyf.size ();
+	// Placeholder for the header
+	glyf.resize (gstart + 10);
+	if (glyf.overflow)
+	    return false;
+	put16 (&glyf[gstart], nc);
+
+	if (nc > 0) {
+	    size_t npoints = 0;
+	    endpts.resize (nc);
+	    for (int j=0; j<nc; j++) {
+		uint16_t cnt;
+		if (!npts.get255 (cnt))
+		    return false;
+		npoints += cnt;
+		if (npoints > 0x10000)
+		    return false;
+		endpts[j] = npoints - 1;
+		put16 (glyf, endpts[j]);
+	    }
+	    if (!flags.has (npoints))
+		return false;
+	    on_curve.resize (npoints);
+	    dxs.resize (npoints);
+	    dys.resize (npoints);
+	    int x = 0, y = 0;
+	    int xmin = std::numeric_limits<int>::max (), ymin = xmin;
+	    int xmax = std::numeric_limits<int>::min (), ymax = xmax;
+	    for (size_t j=0; j<npoints; j++) {
+		uint8_t fl = *flags.p++;
+		on_curve[j] = !(fl>>7);
+		if (!readTriplet (glyphs, fl, dxs[j], dys[j]))
+		    return false;
+		if (std::abs (dxs[j]) > 0x7fff || std::abs (dys[j]) > 0x7fff)
+		    return false;
+		x += dxs[j]; y += dys[j];
+		xmin = std::min (xmin, x); xmax = std::max (xmax, x);
+		ymin = std::min (ymin, y); ymax = std::max (ymax, y);
+	    }
+	    if (!has_bbox) {
+		bb[0] = xmin; bb[1] = ymin; bb[2] = xmax; bb[3] = ymax;
+	    }
+	    uint16_t instr_len;
+	    if (!glyphs.get255 (instr_len) || !instrs.has (instr_len))
+		return false;
+	    put16 (glyf, instr_len);
+	    glyf.append (instrs.p, instrs.p + instr_len);
+	    instrs.p += instr_len;
+	    bool overlap = overlap_bitmap && (overlap_bitmap[i>>3] & (0x80>>(i&7)));
+	    putSimpleGlyphPoints (glyf, on_curve, dxs, dys, overlap);
+	} else if (nc == -1) {
+	    bool have_instr;
+	    if (!has_bbox)
+		return false;
+	    size_t size = compositeSize (comps.p, comps.end, have_instr);
+	    if (!size)
+		return false;
+	    glyf.append (comps.p, comps.p + size);
+	    comps.p += size;
+	    if (have_instr) {
+		uint16_t instr_len;
+		if (!glyphs.get255 (instr_len) || !instrs.has (instr_len))
+		    return false;
+		put16 (glyf, instr_len);
+		glyf.append (instrs.p, instrs.p + instr_len);
+		instrs.p += instr_len;
+	    }
+	} else {
+	    return false;
+	}
+	for (int j=0; j<4; j++)
+	    put16 (&glyf[gstart + 2 + j*2], bb[j]);
+	xmins[i] = bb[0];
+	while (glyf.size () & 3)
+	    glyf.push_back (0);
+	if (glyf.overflow || (!long_loca && glyf.size () > 0x1fffe))
+	    return false;
+    }
+    put_loca (num_glyphs, glyf.size ());
+    // Glyphs are padded, so the table doesn't need any further padding
+    glyf_data = std::move (glyf.data);
+    glyf_len = glyf.size ();
+    return true;
+}
+
+bool FontShepherd::woff2::transformHmtx (const char *hmtx, size_t len, uint16_t num_hmetrics,
+    const std::vector<int16_t> &xmins, std::string &out) {
+    size_t num_glyphs = xmins.size ();
+    if (num_hmetrics == 0 || num_hmetrics > num_glyphs || len < num_hmetrics*4 + (num_glyphs - num_hmetrics)*2)
+	return false;
+    const char *lsbs = hmtx + num_hmetrics*4;
+    bool prop_ok = true, mono_ok = true;
+    for (size_t i=0; i<num_hmetrics && prop_ok; i++)
+	prop_ok = (static_cast<int16_t> (get16 (hmtx + i*4 + 2)) == xmins[i]);
+    for (size_t i=num_hmetrics; i<num_glyphs && mono_ok; i++)
+	mono_ok = (static_cast<int16_t> (get16 (lsbs + (i - num_hmetrics)*2)) == xmins[i]);
+    if (!prop_ok && !mono_ok)
+	return false;
+
+    out.clear ();
+    out.push_back ((prop_ok ? 1 : 0) | (mono_ok ? 2 : 0));
+    for (size_t i=0; i<num_hmetrics; i++)
+	out.append (hmtx + i*4, 2);
+    if (!prop_ok) {
+	for (size_t i=0; i<num_hmetrics; i++)
+	    out.append (hmtx + i*4 + 2, 2);
+    }
+    if (!mono_ok)
+	out.append (lsbs, (num_glyphs - num_hmetrics)*2);
+    return true;
+}
+
+bool FontShepherd::woff2::reconstructHmtx (const char *src, size_t len, uint16_t num_hmetrics,
+    const std::vector<int16_t> &xmins, char *hmtx, size_t hmtx_len) {
+    size_t num_glyphs = xmins.size ();
+    if (len < 1 || num_hmetrics == 0 || num_hmetrics > num_glyphs ||
+	hmtx_len != num_hmetrics*4 + (num_glyphs - num_hmetrics)*2)
+	return false;
+    uint8_t flags = src[0];
+    bool prop_omitted = flags & 1, mono_omitted = flags & 2;
+    if ((flags & 0xfc) || !(prop_omitted || mono_omitted))
+	return false;
+    size_t need = 1 + num_hmetrics*2 +
+	(prop_omitted ? 0 : num_hmetrics*2) + (mono_omitted ? 0 : (num_glyphs - num_hmetrics)*2);
+    if (len < need)
+	return false;
+
+    const char *advances = src + 1;
+    const char *p = advances + num_hmetrics*2;
+    for (size_t i=0; i<num_hmetrics; i++) {
+	hmtx[i*4] = advances[i*2];
+	hmtx[i*4+1] = advances[i*2+1];
+	if (prop_omitted) {
+	    put16 (hmtx + i*4 + 2, xmins[i]);
+	} else {
+	    hmtx[i*4+2] = p[0];
+	    hmtx[i*4+3] = p[1];
+	    p += 2;
+	}
+    }
+    char *lsbs = hmtx + num_hmetrics*4;
+    for (size_t i=num_hmetrics; i<num_glyphs; i++) {
+	if (mono_omitted) {
+	    put16 (lsbs + (i - num_hmetrics)*2, xmins[i]);
+	} else {
+	    lsbs[(i - num_hmetrics)*2] = p[0];
+	    lsbs[(i - num_hmetrics)*2+1] = p[1];
+	    p += 2;
+	}
+    }
+    return true;
+}
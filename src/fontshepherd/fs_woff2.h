@@ -0,0 +1,92 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+
+#ifndef _FONSHEPHERD_FS_WOFF2_H
+#define _FONSHEPHERD_FS_WOFF2_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct BrotliDecoderStateStruct;
+
+namespace FontShepherd {
+    // Helpers for the WOFF2 format (https://www.w3.org/TR/WOFF2/). They
+    // operate on raw table data and don't depend on the table classes,
+    // so that the transforms can be applied to the output of packData ()
+    // directly. Functions returning bool fail on malformed data
+    namespace woff2 {
+	uint32_t knownTag (int idx);
+	// Returns 63 (meaning the tag should be stored explicitly) if the
+	// tag is not in the list of known tags
+	int knownTagIndex (uint32_t tag);
+
+	bool readBase128 (const char *&p, const char *end, uint32_t &val);
+	void putBase128 (std::string &s, uint32_t val);
+	bool read255UShort (const char *&p, const char *end, uint16_t &val);
+	void put255UShort (std::string &s, uint16_t val);
+
+	std::string compress (const char *src, size_t len);
+
+	// Decompresses the brotli stream piece by piece, so that the data
+	// of each table can be written directly to its own buffer
+	class StreamDecoder {
+	public:
+	    StreamDecoder (const char *src, size_t len);
+	    ~StreamDecoder ();
+
+	    bool read (char *dest, size_t len);
+	    bool finished ();
+
+	private:
+	    BrotliDecoderStateStruct *m_state;
+	    const uint8_t *m_next_in;
+	    size_t m_avail_in;
+	};
+
+	// glyf/loca transform. Reconstruction produces the loca table of the
+	// specified size into a preallocated buffer, and also returns xMin
+	// values for each glyph, which are needed to reconstruct hmtx. The glyf
+	// table is written to a buffer allocated by reconstructGlyf (), which
+	// can be passed to the table as is
+	bool transformGlyf (const char *glyf, size_t glyf_len, const char *loca, size_t loca_len,
+	    bool long_loca, uint16_t num_glyphs, std::string &out, std::vector<int16_t> &xmins);
+	bool reconstructGlyf (const char *src, size_t len, std::unique_ptr<char[]> &glyf,
+	    size_t &glyf_len, char *loca, size_t loca_len, std::vector<int16_t> &xmins);
+
+	// hmtx transform. Returns false from transformHmtx if the transform
+	// is not applicable, i. e. side bearings don't match glyph xMin values
+	bool transformHmtx (const char *hmtx, size_t len, uint16_t num_hmetrics,
+	    const std::vector<int16_t> &xmins, std::string &out);
+	bool reconstructHmtx (const char *src, size_t len, uint16_t num_hmetrics,
+	    const std::vector<int16_t> &xmins, char *hmtx, size_t hmtx_len);
+    }
+}
+
+#endif
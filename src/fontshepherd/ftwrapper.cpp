@@ -26,13 +26,10 @@
 
 #include <QCoreApplication>
 #include <QtGlobal>
-#include <QImage>
-#include <QPainterPath>
 
 #include "tables.h"
 #include "tables/glyphcontainer.h" // also includes splineglyph.h
 #include "tables/glyf.h"
-#include "editors/tinyfont.h"
 #include "fs_notify.h"
 #include "ftwrapper.h"
 
@@ -56,32 +53,7 @@ void FTWrapper::qDeviceClose (FT_Stream stream) {
     fd->close ();
 }
 
-int FTWrapper::moveToFunction (const FT_Vector *to, void *user) {
-    QPainterPath *path = static_cast<QPainterPath *> (user);
-    path->moveTo (QPointF (to->x, to->y));
-    return 0;
-}
-
-int FTWrapper::lineToFunction (const FT_Vector *to, void *user) {
-    QPainterPath *path = static_cast<QPainterPath *> (user);
-    path->lineTo (QPointF (to->x, to->y));
-    return 0;
-}
-
-int FTWrapper::conicToFunction (const FT_Vector *control, const FT_Vector *to, void *user) {
-    QPainterPath *path = static_cast<QPainterPath *> (user);
-    path->quadTo (QPointF (control->x, control->y), QPointF (to->x, to->y));
-    return 0;
-}
-
-int FTWrapper::cubicToFunction (const FT_Vector *c1, const FT_Vector *c2, const FT_Vector *to, void *user) {
-    QPainterPath *path = static_cast<QPainterPath *> (user);
-    path->cubicTo (QPointF (c1->x, c1->y), QPointF (c2->x, c2->y), QPointF (to->x, to->y));
-    return 0;
-}
-
-
-FTWrapper::FTWrapper () : m_hasContext (false), m_hasFace (false), m_tfp (nullptr) {
+FTWrapper::FTWrapper () : m_hasContext (false), m_hasFace (false), m_mf (nullptr) {
     int err = FT_Init_FreeType (&m_context);
     if (!err) m_hasContext = true;
 
@@ -138,14 +110,14 @@ void FTWrapper::init (const QString &fpath, int idx) {
     }
 }
 
-void FTWrapper::init (TinyFontProvider *tfp) {
-    m_tfp = tfp;
-    if (m_tfp && m_hasContext) {
+void FTWrapper::init (FTMemoryFont *mf) {
+    m_mf = mf;
+    if (m_mf && m_hasContext) {
 	if (m_hasFace)
 	    FT_Done_Face (m_aface);
 
-	const uint8_t *buf = reinterpret_cast<const uint8_t *> (m_tfp->fontData ());
-	size_t size = m_tfp->fontDataSize ();
+	const uint8_t *buf = reinterpret_cast<const uint8_t *> (m_mf->fontData ());
+	size_t size = m_mf->fontDataSize ();
 	int err = FT_New_Memory_Face (m_context, buf, size, 0, &m_aface);
 
 	if (err) {
@@ -167,10 +139,11 @@ int FTWrapper::setPixelSize (int xsize, int ysize) {
     return ret;
 }
 
-struct freetype_raster FTWrapper::gridFitGlyph (uint16_t gid, uint16_t flags, QPainterPath *p) {
+struct freetype_raster FTWrapper::gridFitGlyph
+    (uint16_t gid, uint16_t flags, const FT_Outline_Funcs *funcs, void *user) {
     struct freetype_raster ret;
 
-    uint16_t real_gid = m_tfp ? m_tfp->gidCorr (gid) : gid;
+    uint16_t real_gid = m_mf ? m_mf->gidCorr (gid) : gid;
     if (FT_Load_Glyph (m_aface, real_gid, flags)) {
         FontShepherd::postError (
 	    tr ("Missing glyph: could not load glyph %1").arg (real_gid)
@@ -191,17 +164,9 @@ struct freetype_raster FTWrapper::gridFitGlyph (uint16_t gid, uint16_t flags, QP
     ret.bitmap.insert (ret.bitmap.end (), slot->bitmap.buffer, slot->bitmap.buffer + bsize);
     ret.valid = true;
 
-    FT_Outline_Funcs callbacks;
-    callbacks.move_to = &moveToFunction;
-    callbacks.line_to = &lineToFunction;
-    callbacks.conic_to = &conicToFunction;
-    callbacks.cubic_to = &cubicToFunction;
-    callbacks.shift = 0;
-    callbacks.delta = 0;
-
     FT_Outline &outline = slot->outline;
 
-    if (p && FT_Outline_Decompose (&outline, &callbacks, p)) {
+    if (funcs && FT_Outline_Decompose (&outline, funcs, user)) {
         FontShepherd::postError (
 	    tr ("Missing glyph: could not decompose outline for %1").arg (real_gid)
 	);
@@ -27,8 +27,13 @@
 #ifndef _FONSHEPHERD_FTWRAPPER_H
 #define _FONSHEPHERD_FTWRAPPER_H
 
+#include <vector>
+#include <QtCore>
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_OUTLINE_H
+
+class QPixmap;
 
 struct freetype_raster {
     bool valid;
@@ -44,7 +49,15 @@ struct freetype_raster {
     freetype_raster (): valid (false), rows (0), cols(0), as(0), lb(0), bytes_per_row(0), num_grays(0) {}
 };
 
-class TinyFontProvider;
+// An in-memory font to be loaded into FreeType, with a possibly different
+// glyph order (see editors/tinyfont.h)
+class FTMemoryFont {
+public:
+    virtual ~FTMemoryFont () {};
+    virtual const char *fontData () const = 0;
+    virtual uint32_t fontDataSize () const = 0;
+    virtual uint16_t gidCorr (uint16_t gid) const = 0;
+};
 
 class FTWrapper {
     Q_DECLARE_TR_FUNCTIONS (FTWrapper);
@@ -53,20 +66,17 @@ public:
     static unsigned long qDeviceRead (FT_Stream stream, unsigned long offset, unsigned char* buffer, unsigned long count);
     static void qDeviceClose (FT_Stream stream);
 
-    static int moveToFunction (const FT_Vector *to, void *user);
-    static int lineToFunction (const FT_Vector *to, void *user);
-    static int conicToFunction (const FT_Vector *control, const FT_Vector *to, void *user);
-    static int cubicToFunction (const FT_Vector *c1, const FT_Vector *c2, const FT_Vector *to, void *user);
-
     FTWrapper ();
     ~FTWrapper ();
 
     void init (const char* filename, int idx);
     void init (const QString &fpath, int idx);
-    void init (TinyFontProvider *tfp);
+    void init (FTMemoryFont *mf);
 
     int setPixelSize (int xsize, int ysize);
-    struct freetype_raster gridFitGlyph (uint16_t gid, uint16_t flags, QPainterPath *p);
+    // If callbacks are given, the grid-fitted outline is decomposed with them
+    struct freetype_raster gridFitGlyph (uint16_t gid, uint16_t flags,
+	const FT_Outline_Funcs *funcs=nullptr, void *user=nullptr);
     bool hasContext ();
     bool hasFace ();
 
@@ -77,7 +87,7 @@ private:
     bool m_hasContext, m_hasFace;
     FT_Library m_context;
     FT_Face m_aface;
-    TinyFontProvider *m_tfp;
+    FTMemoryFont *m_mf;
 };
 
 #endif
@@ -26,13 +26,21 @@
  * POSSIBILITY OF SUCH DAMAGE. */
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <cstdio>
 #include <assert.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <exception>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <QtConcurrent>
 
 #include "exceptions.h"
 #include "sfnt.h"
-#include "editors/fontview.h"
+#include "fs_trace.h"
+#include "tables.h"
 #include "tables/cmap.h"
 #include "tables/devmetrics.h"
 #include "tables/hea.h"
@@ -52,6 +60,7 @@
 #include "tables/gasp.h"
 
 #include "fs_notify.h"
+#include "fs_math.h"
 
 std::shared_ptr<FontTable> ttffont::sharedTable (uint32_t tag) const {
     for (auto tptr: tbls) {
@@ -109,6 +118,16 @@ uint32_t sfntFile::getlong (QIODevice *f) {
     return (((uint8_t) ch[0]<<24)|((uint8_t) ch[1]<<16)|((uint8_t) ch[2]<<8)|(uint8_t) ch[3]);
 }
 
+uint16_t sfntFile::getushort (const char *bdata) {
+    const uint8_t *ch = reinterpret_cast<const uint8_t *> (bdata);
+    return ((ch[0]<<8)|ch[1]);
+}
+
+uint32_t sfntFile::getlong (const char *bdata) {
+    const uint8_t *ch = reinterpret_cast<const uint8_t *> (bdata);
+    return ((ch[0]<<24)|(ch[1]<<16)|(ch[2]<<8)|ch[3]);
+}
+
 double sfntFile::getfixed (QIODevice *f) {
     uint32_t val = getlong (f);
     int mant = val&0xffff;
@@ -156,31 +175,6 @@ void sfntFile::put2d14 (QIODevice *f, double dval) {
     putushort (f, val);
 }
 
-uint32_t sfntFile::fileCheck (QIODevice *f) {
-    uint32_t sum = 0, chunk;
-
-    f->seek (0);
-    chunk = getlong (f);
-    while (!f->atEnd()) {
-	sum += chunk;
-	chunk = getlong (f);
-    }
-    f->seek (0);
-    return (sum);
-}
-
-uint32_t sfntFile::figureCheck (QIODevice *f, uint32_t start, uint32_t lcnt) {
-    uint32_t sum = 0, chunk;
-
-    f->seek (start);
-    while (!f->atEnd () && lcnt > 0) {
-	chunk = getlong (f);
-	sum += chunk;
-        lcnt--;
-    }
-    return (sum);
-}
-
 QString sfntFile::getFontName (sFont *tf) {
     NameTable *name = dynamic_cast<NameTable *> (tf->table (CHR ('n','a','m','e')));
     if (name) {
@@ -214,15 +208,19 @@ bool sfntFile::checkFSType (sFont *tf) {
     bool no_edit = os_2->fsType (1);
 
     if (no_edit) {
-        QMessageBox::StandardButton ask;
-        ask = QMessageBox::question (m_parent,
-            m_parent->tr ("Restricted font"),
-            m_parent->tr ("This font is marked with an FSType of 2 "
+	// Don't silently edit restricted fonts in batch mode
+	if (!FontShepherd::interactive ()) {
+	    FontShepherd::postError (QString ("%1: the font is marked with an FSType of 2 (Restricted License)")
+		.arg (tf->fontname));
+	    return false;
+	}
+	if (!FontShepherd::postYesNoQuestion (
+            QCoreApplication::translate ("sfntFile", "Restricted font"),
+            QCoreApplication::translate ("sfntFile", "This font is marked with an FSType of 2 "
                         "(Restricted License). That means it is "
                         "not editable without the permission of the "
                         "legal owner.\n\nDo you have such a permission?"),
-            QMessageBox::Yes|QMessageBox::No);
-	if (ask == QMessageBox::No)
+            m_parent))
             return false;
     }
 
@@ -250,34 +248,25 @@ void sfntFile::getEmSize (sFont *tf) {
     }
 }
 
-std::shared_ptr<FontTable> sfntFile::readTableHead (QFile *f, int file_idx) {
-    TableHeader props;
-    props.file = f;
-    props.iname = getlong (f);
-    props.checksum = getlong (f);
-    props.off = getlong (f);
-    props.length = getlong (f);
+std::shared_ptr<FontTable> sfntFile::readTableHead (const TableHeader &props) {
     FontTable *table;
 
     /* GWW: In a TTC file some tables may be shared, check through previous fonts */
     /*  in the file to see if we've got this already */
-    int fcnt = m_fonts.size ();
-    for (int i=0; i<fcnt; ++i) {
-	sFont *fnt = m_fonts[i].get ();
-	if (fnt->file_index != file_idx)
-	    continue;
-	for (int j=0; j<fnt->tableCount (); ++j) {
-	    std::shared_ptr<FontTable> tptr = fnt->tbls[j];
-	    if (tptr->start==props.off && tptr->len==props.length) {
-		if (tptr->iName ()==props.iname)
-                    return (tptr);
-		/* GWW: EBDT/bdat, EBLC/bloc use the same structure and could share tables */
-		for (size_t k=0; k<sizeof(tptr->m_tags)/sizeof(tptr->m_tags[0]); ++k) {
-		    if (tptr->m_tags[k]==props.iname || tptr->m_tags[k]==0) {
-			tptr->m_tags[k] = props.iname;
-                        return (tptr);
-		    }
-		}
+    // AMK: tables of the file being loaded are indexed by offset and length.
+    // Tables which aren't stored in the file as is (e. g. decoded from WOFF2)
+    // have no offset and are never shared
+    uint64_t key = ((uint64_t) props.off<<32) | props.length;
+    auto found = props.off == 0xffffffff ? m_load_index.end () : m_load_index.find (key);
+    if (found != m_load_index.end ()) {
+	std::shared_ptr<FontTable> tptr = found->second;
+	if (tptr->iName ()==props.iname)
+	    return (tptr);
+	/* GWW: EBDT/bdat, EBLC/bloc use the same structure and could share tables */
+	for (size_t k=0; k<sizeof(tptr->m_tags)/sizeof(tptr->m_tags[0]); ++k) {
+	    if (tptr->m_tags[k]==props.iname || tptr->m_tags[k]==0) {
+		tptr->m_tags[k] = props.iname;
+		return (tptr);
 	    }
 	}
     }
@@ -351,7 +340,10 @@ std::shared_ptr<FontTable> sfntFile::readTableHead (QFile *f, int file_idx) {
         default:
             table = new FontTable (this, props);
     }
-    return (std::shared_ptr<FontTable> (table));
+    std::shared_ptr<FontTable> tptr (table);
+    if (found == m_load_index.end () && props.off != 0xffffffff)
+	m_load_index[key] = tptr;
+    return (tptr);
 }
 
 void sfntFile::readSfntHeader (QFile *f, int file_idx) {
@@ -364,9 +356,36 @@ void sfntFile::readSfntHeader (QFile *f, int file_idx) {
     /* searchRange = */ getushort (f);
     /* entrySelector = */ getushort (f);
     /* rangeshift = */ getushort (f);
+
+    // Parse the table directory in place if the file is mapped, otherwise
+    // read it in a single chunk rather than field by field
+    const char *dir;
+    QByteArray dir_buf;
+    std::shared_ptr<FontShepherd::FileMapping> map = fileMapping (f);
+    if (map && map->contains (f->pos (), tbl_cnt*16)) {
+	dir = map->data () + f->pos ();
+    } else {
+	dir_buf = f->read (tbl_cnt*16);
+	if (dir_buf.size () < tbl_cnt*16)
+	    throw FileDamagedException (f->fileName ().toStdString ());
+	dir = dir_buf.constData ();
+    }
     tf->tbls.reserve (tbl_cnt);
-    for (int i=0; i<tbl_cnt; ++i)
-	tf->tbls.push_back (readTableHead (f, file_idx));
+    for (int i=0; i<tbl_cnt; ++i) {
+	const char *entry = dir + i*16;
+	TableHeader props;
+	props.file = f;
+	props.map = map;
+	props.iname = getlong (entry);
+	props.checksum = getlong (entry+4);
+	props.off = getlong (entry+8);
+	props.length = getlong (entry+12);
+	tf->tbls.push_back (readTableHead (props));
+    }
+    readFontInfo (tf, file_idx);
+}
+
+void sfntFile::readFontInfo (sFont *tf, int file_idx) {
     tf->fontname = getFontName (tf);
     tf->index = 0;
     tf->file_index = file_idx;
@@ -399,32 +418,192 @@ void sfntFile::readTtcfHeader (QFile *f, int file_idx) {
         throw FileLoadCanceledException (f->fileName ().toStdString());
 }
 
-void sfntFile::dumpFontHeader (QIODevice *newf, sFont *fnt) {
+// Compile all tables which have been modified, but not yet packed. Tables
+// are grouped into waves: a table gets into a later wave than any table
+// whose packData () updates it (see FontTable::packTargets ()), and two
+// tables sharing a target never get into the same wave. Tables of the same
+// wave are then compiled concurrently, each into its own buffer
+void sfntFile::compileTables (std::vector<sFont *> fonts) {
+    FS_TRACE_SCOPE ("save: compile tables");
+    std::vector<FontTable *> pending;
+    std::map<FontTable *, std::set<FontTable *>> direct, targets;
+
+    for (sFont *fnt : fonts) {
+	for (auto &tptr : fnt->tbls) {
+	    FontTable *tab = tptr.get ();
+	    // A table shared between fonts of a collection may be related
+	    // to different tables in each of them
+	    std::set<FontTable *> &tgt = direct[tab];
+	    for (uint32_t tag : tab->packTargets ()) {
+		FontTable *dep = fnt->table (tag);
+		if (dep && dep != tab)
+		    tgt.insert (dep);
+	    }
+	    if (tab->changed && tab->td_loaded &&
+		std::find (pending.begin (), pending.end (), tab) == pending.end ())
+		pending.push_back (tab);
+	}
+    }
+    if (pending.empty ())
+	return;
+
+    // Targets may in turn update other tables (glyf->loca->head), so
+    // extend each set with indirect dependencies as well. The targets
+    // themselves are scheduled too, even if still clean: e. g. hmtx and
+    // maxp only get modified when glyf is being packed. The ones which
+    // stay unchanged are skipped at compile time
+    for (size_t i=0; i<pending.size (); i++) {
+	FontTable *tab = pending[i];
+	std::set<FontTable *> &tgt = targets[tab];
+	std::vector<FontTable *> queue (direct[tab].begin (), direct[tab].end ());
+	while (!queue.empty ()) {
+	    FontTable *dep = queue.back ();
+	    queue.pop_back ();
+	    if (dep == tab || !tgt.insert (dep).second)
+		continue;
+	    queue.insert (queue.end (), direct[dep].begin (), direct[dep].end ());
+	}
+	for (FontTable *dep : tgt) {
+	    if (dep->td_loaded &&
+		std::find (pending.begin (), pending.end (), dep) == pending.end ())
+		pending.push_back (dep);
+	}
+    }
+
+    auto conflicts = [&targets](FontTable *t1, FontTable *t2) {
+	const std::set<FontTable *> &tgt1 = targets[t1];
+	const std::set<FontTable *> &tgt2 = targets[t2];
+	if (tgt1.count (t2) || tgt2.count (t1))
+	    return true;
+	for (FontTable *dep : tgt1) {
+	    if (tgt2.count (dep))
+		return true;
+	}
+	return false;
+    };
+
+    std::vector<std::vector<FontTable *>> waves;
+    std::map<FontTable *, size_t> wave_of;
+    bool progress = true;
+    while (wave_of.size () < pending.size () && progress) {
+	progress = false;
+	for (FontTable *tab : pending) {
+	    if (wave_of.count (tab))
+		continue;
+	    size_t wave = 0;
+	    bool ready = true;
+	    for (FontTable *pred : pending) {
+		if (pred == tab || !targets[pred].count (tab))
+		    continue;
+		if (!wave_of.count (pred)) {
+		    ready = false;
+		    break;
+		}
+		wave = std::max (wave, wave_of[pred] + 1);
+	    }
+	    if (!ready)
+		continue;
+	    for (; wave < waves.size (); wave++) {
+		bool clash = false;
+		for (FontTable *other : waves[wave])
+		    clash |= conflicts (tab, other);
+		if (!clash)
+		    break;
+	    }
+	    if (wave == waves.size ())
+		waves.emplace_back ();
+	    waves[wave].push_back (tab);
+	    wave_of[tab] = wave;
+	    progress = true;
+	}
+    }
+    // Should never happen, but circular dependencies would leave some
+    // tables unscheduled. Compile them serially at the end
+    for (FontTable *tab : pending) {
+	if (!wave_of.count (tab))
+	    waves.push_back ({ tab });
+    }
+
+    std::exception_ptr error;
+    std::mutex error_lock;
+    auto compile = [&error, &error_lock](FontTable *tab) {
+	// May have already been compiled by another table in an earlier wave
+	if (!tab->changed)
+	    return;
+	try {
+	    FS_TRACE_SCOPE ("table compile");
+	    tab->packData ();
+	} catch (...) {
+	    std::lock_guard<std::mutex> guard (error_lock);
+	    if (!error)
+		error = std::current_exception ();
+	}
+    };
+    for (auto &wave : waves) {
+	if (wave.size () == 1)
+	    compile (wave[0]);
+	else
+	    QtConcurrent::blockingMap (wave, compile);
+	if (error)
+	    std::rethrow_exception (error);
+    }
+
+    // Editors can only be updated from the main thread
+    std::set<FontTable *> updated;
+    for (FontTable *tab : pending)
+	updated.insert (targets[tab].begin (), targets[tab].end ());
+    for (FontTable *tab : updated) {
+	if (tab->editor () && tab->td_changed)
+	    tab->editor ()->resetData ();
+    }
+}
+
+// Returns the checksum of the header, which is always 32-bit aligned
+uint32_t sfntFile::dumpFontHeader (QIODevice *newf, sFont *fnt) {
     int bit, i;
     int tbl_cnt = fnt->tableCount ();
     FontTable *tab;
+    QByteArray ba;
+    QBuffer buf (&ba);
+    buf.open (QIODevice::WriteOnly);
 
-    putlong (newf, fnt->version);
-    putushort (newf, tbl_cnt);
+    putlong (&buf, fnt->version);
+    putushort (&buf, tbl_cnt);
     for (i= -1, bit = 1; bit<tbl_cnt; bit<<=1, ++i);
     bit>>=1;
-    putushort (newf, bit*16);
-    putushort (newf, i);
-    putushort (newf, (tbl_cnt-bit)*16);
+    putushort (&buf, bit*16);
+    putushort (&buf, i);
+    putushort (&buf, (tbl_cnt-bit)*16);
     for (i=0; i<tbl_cnt; ++i) {
 	tab = fnt->tbls[i].get ();
-	putlong (newf, tab->iName ());
-	putlong (newf, tab->newchecksum);
-	putlong (newf, tab->newstart);
-	putlong (newf, tab->newlen);
+	putlong (&buf, tab->iName ());
+	putlong (&buf, tab->newchecksum);
+	putlong (&buf, tab->newstart);
+	putlong (&buf, tab->newlen);
     }
+    buf.close ();
+    newf->write (ba);
+    return FontShepherd::math::checksum (ba.constData (), ba.size ());
 }
 
-void sfntFile::dumpFontTables (QIODevice *newf, std::vector<sFont *> fonts) {
+// Table checksums are calculated from the data being written, so there is
+// no need to read the output back. Returns the sum of checksums of all
+// tables written, which is the checksum of the table data area.
+// When writing a collection, tables which are not shared between fonts
+// in memory, but have identical contents (e. g. 'cvt ' or 'prep' of fonts
+// imported from separate files), are written just once: the table tag,
+// length and checksum are used as a hash key, and then the data are compared.
+// To make this comparison cheap, tables written to a collection keep their
+// data until all tables are written, even if they were loaded just for saving
+uint32_t sfntFile::dumpFontTables (QIODevice *newf, std::vector<sFont *> fonts) {
+    FS_TRACE_SCOPE ("save: write tables");
+    uint32_t sum = 0;
     int cnt;
     int font_cnt = fonts.size ();
     FontTable *tab;
     std::vector<std::shared_ptr<FontTable>> ordered;
+    std::unordered_multimap<uint64_t, FontTable *> written;
+    std::vector<FontTable *> loaded;
 
     for (int i=cnt=0; i<font_cnt; ++i)
         cnt += fonts[i]->tableCount ();
@@ -463,12 +642,37 @@ void sfntFile::dumpFontTables (QIODevice *newf, std::vector<sFont *> fonts) {
 	tab->newstart = newf->pos ();
 	{
             bool clear_data = false;
+	    FontTable *dup = nullptr;
             if (!tab->data) {
                 tab->fillup ();
                 clear_data = true;
             }
-	    newf->write (tab->data, tab->newlen);
-            if (clear_data)
+	    // The checksum is still calculated from the data, as there is no
+	    // guarantee the value from the original file is correct
+	    tab->newchecksum = FontShepherd::math::checksum (tab->data, tab->newlen);
+	    uint64_t key = ((uint64_t) tab->newlen<<32) | tab->newchecksum;
+	    if (font_cnt > 1) {
+		auto range = written.equal_range (key);
+		for (auto it = range.first; it != range.second && !dup; ++it) {
+		    FontTable *prev = it->second;
+		    if (prev->iName () == tab->iName () &&
+			std::equal (tab->data, tab->data + tab->newlen, prev->data))
+			dup = prev;
+		}
+	    }
+	    if (dup) {
+		tab->newstart = dup->newstart;
+		tab->newlen = dup->newlen;
+		if (clear_data)
+		    tab->clearData ();
+		continue;
+	    }
+	    written.insert (std::make_pair (key, tab));
+	    if (!tab->is_mapped || !copyTableRange (newf, tab))
+		newf->write (tab->data, tab->newlen);
+            if (clear_data && font_cnt > 1)
+		loaded.push_back (tab);
+	    else if (clear_data)
 		tab->clearData ();
 	}
 	tab->newlen = newf->pos () - tab->newstart;
@@ -476,22 +680,22 @@ void sfntFile::dumpFontTables (QIODevice *newf, std::vector<sFont *> fonts) {
 	    newf->putChar ('\0');
 	if ((tab->newlen+1)&2)
 	    putushort (newf, 0);
+	sum += tab->newchecksum;
     }
-
-    for (int i=0; i<cnt; ++i) {
-	tab = ordered[i].get ();
-	if (tab->newchecksum != 0)
-            continue;
-	tab->newchecksum = figureCheck (newf, tab->newstart, (tab->newlen+3)>>2);
-    }
+    for (FontTable *t : loaded)
+	t->clearData ();
+    return sum;
 }
 
-void sfntFile::fntWrite (QIODevice *newf, sFont *fnt) {
+// Returns the checksum of the entire font, needed for checkSumAdjustment
+uint32_t sfntFile::fntWrite (QIODevice *newf, sFont *fnt) {
+    uint32_t sum;
     fnt->version_pos = newf->pos ();
     dumpFontHeader (newf, fnt);		/* Placeholder */
-    dumpFontTables (newf, { fnt });
+    sum = dumpFontTables (newf, { fnt });
     newf->seek (fnt->version_pos);
-    dumpFontHeader (newf, fnt);		/* Filling with correct values now we know them */
+    sum += dumpFontHeader (newf, fnt);	/* Filling with correct values now we know them */
+    return sum;
 }
 
 void sfntFile::ttcWrite (QIODevice *newf) {
@@ -515,7 +719,8 @@ void sfntFile::ttcWrite (QIODevice *newf) {
 	putlong (newf, m_fonts[i]->version_pos);/* GWW: Fill in first set of placeholders */
 
     newf->seek (pos);
-    std::vector<sFont *> fnt_raw (m_fonts.size ());
+    std::vector<sFont *> fnt_raw;
+    fnt_raw.reserve (m_fonts.size ());
     for (auto &fptr : m_fonts) fnt_raw.push_back (fptr.get ());
     dumpFontTables (newf, fnt_raw);
 
@@ -538,14 +743,29 @@ QFile *sfntFile::makeBackup (QFile *origf) {
     int len;
     QString backupname = QString (origf->fileName ().append (QChar ('~')));
     QFile *backup = new QFile (backupname);
+    std::shared_ptr<FontShepherd::FileMapping> map = fileMapping (origf);
+
+    // AMK: As the new file is renamed into place rather than written over
+    // the original one, just give the original file another name. Copy
+    // the data only if hard links are not supported
+    if (backup->exists ())
+	backup->remove ();
+    if (::link (QFile::encodeName (origf->fileName ()).constData (),
+	QFile::encodeName (backupname).constData ()) == 0)
+	return backup;
 
     if (!backup->open (QIODevice::WriteOnly) || !origf->open (QIODevice::ReadOnly)) {
 	delete backup;
         throw CantBackupException (backupname.toStdString ());
     }
 
-    origf->seek (0);
-    len = backup->write (origf->readAll ());
+    // If the original file is mapped, then there is no need to read it again
+    if (map) {
+	len = backup->write (map->data (), map->size ());
+    } else {
+	origf->seek (0);
+	len = backup->write (origf->readAll ());
+    }
     backup->close ();
 
     if (len < 0) {
@@ -557,38 +777,64 @@ QFile *sfntFile::makeBackup (QFile *origf) {
     return backup;
 }
 
-void sfntFile::restoreFromBackup (QFile *target, QFile *source, int backidx) {
-    source->open (QIODevice::ReadOnly);
-    source->seek (0);
-    target->open (QIODevice::WriteOnly);
-    target->resize (0);
-    int len = target->write (source->readAll ());
-    if (len<0)
-        throw CantRestoreException (source->fileName ().toStdString ());
-    source->close ();
-    target->close ();
+// Copy a table which has not been changed since loading directly from the
+// source file, so that the kernel (or a network file server) may do that
+// without passing data through user space, or even share filesystem blocks.
+// The data are copied from the file the table is mapped from, and from the
+// same position its (already checksummed) data are viewed at. The file is
+// accessed through the descriptor held by the mapping rather than by name,
+// as the name may already refer to another file
+bool sfntFile::copyTableRange (QIODevice *newf, FontTable *tab) {
+#ifdef __linux__
+    QFileDevice *dev = qobject_cast<QFileDevice *> (newf);
+    if (!dev || !tab->is_mapped || !tab->m_map || tab->m_map->handle () < 0 ||
+	tab->changed || tab->td_changed || tab->is_new)
+	return false;
+    const char *base = tab->m_map->data ();
+    if (tab->data < base || !tab->m_map->contains (tab->data - base, tab->newlen))
+	return false;
 
-    for (size_t i=0; i<m_fonts.size (); ++i) {
-	sFont *tf = m_fonts[i].get ();
-	if (tf->file_index == backidx) {
-	    for (int j=0; j < tf->tableCount (); ++j)
-		tf->tbls[j]->infile = target;
-	}
+    dev->flush ();
+    loff_t off_in = tab->data - base;
+    loff_t off_out = dev->pos ();
+    size_t left = tab->newlen;
+    while (left > 0) {
+	ssize_t copied = copy_file_range (tab->m_map->handle (), &off_in, dev->handle (), &off_out, left, 0);
+	if (copied <= 0)
+	    break;
+	left -= copied;
     }
+    // Whatever has been copied so far will be overwritten by the caller
+    if (left > 0)
+	return false;
+    dev->seek (off_out);
+    return true;
+#else
+    Q_UNUSED (newf);
+    Q_UNUSED (tab);
+    return false;
+#endif
 }
 
 bool sfntFile::save (const QString &newpath, bool ttc, int fidx) {
-    QTemporaryFile newf;
+    FS_TRACE_SCOPE ("sfntFile::save");
+    checkSources ();
+    // Create the temporary file in the same directory where the font is
+    // going to be saved, so that it can then be atomically renamed into place
+    QFileInfo dest_info (newpath);
+    QTemporaryFile newf (dest_info.absolutePath () + "/." + dest_info.fileName () + ".XXXXXX");
     int file_idx = hasSource (fidx, ttc) ? m_fonts[fidx]->file_index : 0;
     int backup_idx = -1;
     size_t font_cnt = m_fonts.size ();
     size_t imin = ttc ? 0 : fidx;
     size_t imax = ttc ? font_cnt : fidx+1;
+    bool woff = !ttc && dest_info.suffix ().compare ("woff", Qt::CaseInsensitive) == 0;
+    bool woff2 = !ttc && dest_info.suffix ().compare ("woff2", Qt::CaseInsensitive) == 0;
     uint32_t checksum;
 
     // QTemporaryFile will always be opened in QIODevice::ReadWrite mode
     if (!newf.open ())
-        throw FileAccessException (newf.fileName ().toStdString ());
+        throw FileAccessException (newpath.toStdString ());
 
     // Check if we are going to save a font into the same location (so a backup is needed)
     QFile testf;
@@ -608,16 +854,15 @@ bool sfntFile::save (const QString &newpath, bool ttc, int fidx) {
     /* GWW: Mark all tables as unsaved */
     for (size_t i=imin; i<imax; ++i) {
 	sFont *tf = m_fonts[i].get ();
-	// If some of the source files are going to be rewritten, then we are
-	// supposed to have a backup at this point. So make internal pointers
-	// in table structures to refer to the backed up file rather than
-	// to the original one. We need this because table data aren't loaded
-	// into application until they are requested to, so it is necessary
-	// to have a relevant data source on the disk
+	// Source files are left untouched until the new file is renamed into
+	// place (the backup is only made just before that), so tables which
+	// haven't been loaded yet can still be read from their original
+	// locations while saving
 	for (int j=0; j < tf->tableCount (); ++j) {
 	    FontTable *tab = tf->tbls[j].get ();
 	    tab->newstart = 0;
 	    tab->newchecksum = 0;
+	    tab->newcomplen = 0;
 	    tab->inserted = false;
        }
        // Sort tables alphabetically for font header output and further
@@ -629,6 +874,11 @@ bool sfntFile::save (const QString &newpath, bool ttc, int fidx) {
        });
     }
 
+    std::vector<sFont *> to_save;
+    for (size_t i=imin; i<imax; ++i)
+	to_save.push_back (m_fonts[i].get ());
+    compileTables (to_save);
+
     for (size_t i=imin; i<imax; ++i) {
 	sFont *tf = m_fonts[i].get ();
 	HeadTable *head = dynamic_cast<HeadTable *> (tf->table (CHR ('h','e','a','d')));
@@ -638,12 +888,17 @@ bool sfntFile::save (const QString &newpath, bool ttc, int fidx) {
 	}
     }
 
-    if (ttc)
+    // Checksum adjustment is irrelevant for TTC, see below
+    if (ttc) {
 	ttcWrite (&newf);
-    else
-	fntWrite (&newf, m_fonts[fidx].get ());
-
-    checksum = fileCheck (&newf);
+	checksum = 0;
+    } else if (woff) {
+	checksum = woffWrite (&newf, m_fonts[fidx].get ());
+    } else if (woff2) {
+	checksum = woff2Write (&newf, m_fonts[fidx].get ());
+    } else {
+	checksum = fntWrite (&newf, m_fonts[fidx].get ());
+    }
     for (size_t i=imin; i<imax; ++i) {
 	sFont *tf = m_fonts[i].get ();
 	HeadTable *head = dynamic_cast<HeadTable *> (tf->table (CHR ('h','e','a','d')));
@@ -652,10 +907,14 @@ bool sfntFile::save (const QString &newpath, bool ttc, int fidx) {
 	// a shared head table, which is not always the case. The spec
 	// now says the checksum adjustment field is irrelevant for TTC fonts
 	// and should be ignored. So just set it to zero in case of TTC.
+	// For WOFF/WOFF2 the adjustment has already been stored by the
+	// writer, as it should go into the head table before compression
 	if (head) {
-	    checksum = ttc ? 0 : 0xb1b0afba - checksum;
-	    newf.seek (head->newstart+2*sizeof (uint32_t));
-	    putlong (&newf, checksum);
+	    checksum = ttc ? 0 : (woff || woff2) ? checksum : 0xb1b0afba - checksum;
+	    if (!woff && !woff2) {
+		newf.seek (head->newstart+2*sizeof (uint32_t));
+		putlong (&newf, checksum);
+	    }
 	    head->setCheckSumAdjustment (checksum);
 	    // Redisplay modified checksumadjust fields
 	    if (head->editor ())
@@ -663,16 +922,34 @@ bool sfntFile::save (const QString &newpath, bool ttc, int fidx) {
 	}
     }
 
-    if (backup_idx >= 0) {
-	QFile *oldf = m_files[backup_idx].get ();
-	makeBackup (oldf);
-	oldf->remove ();
-    } else if (testf.exists ()) {
-	testf.remove ();
-    }
-
-    if (newf.copy (newpath)) {
+    FS_TRACE_SCOPE ("save: commit");
+    // QTemporaryFile is created with owner-only permissions
+    if (info.exists ())
+	newf.setPermissions (testf.permissions ());
+    else
+	newf.setPermissions (QFileDevice::ReadOwner | QFileDevice::WriteOwner |
+	    QFileDevice::ReadGroup | QFileDevice::ReadOther);
+    if (!newf.flush ())
+        throw FileAccessException (newpath.toStdString ());
+    if (m_sync_on_save)
+	::fsync (newf.handle ());
+
+    if (backup_idx >= 0)
+	delete makeBackup (m_files[backup_idx].get ());
+
+    // Replacing the original file this way unlinks it rather than rewrites,
+    // so any mappings of the old file stay valid
+    if (::rename (QFile::encodeName (newf.fileName ()).constData (),
+	QFile::encodeName (newpath).constData ()) == 0) {
+	newf.setAutoRemove (false);
 	newf.close ();
+	if (m_sync_on_save) {
+	    int dirfd = ::open (QFile::encodeName (dest_info.absolutePath ()).constData (), O_RDONLY);
+	    if (dirfd >= 0) {
+		::fsync (dirfd);
+		::close (dirfd);
+	    }
+	}
 
 	// if a TTC file has successfully been written, then we now have just one
 	// source file, so all existing pointers to source files shoud be cleaned
@@ -684,17 +961,45 @@ bool sfntFile::save (const QString &newpath, bool ttc, int fidx) {
 	    for (auto &file: m_files)
 		file->close ();
 	    m_files.clear ();
+	    m_maps.clear ();
 	    m_files.emplace_back (new QFile ());
 	    m_files.back ()->setFileName (newpath);
 	}
 
+	// Table offsets now refer to the newly written file, so are to be
+	// resolved against a mapping of that file. Existing views into the
+	// old mapping (which is still alive, as the old file has been unlinked
+	// rather than rewritten) are moved to the new one, as the bytes are
+	// the same
+	std::shared_ptr<FontShepherd::FileMapping> newmap;
+	if (m_use_mapping) {
+	    newmap = std::make_shared<FontShepherd::FileMapping> (newpath);
+	    if (!newmap->valid ())
+		newmap.reset ();
+	}
+	size_t written_idx = ttc ? 0 : backup_idx >= 0 ? backup_idx : file_idx;
+	m_maps.resize (m_files.size ());
+	m_maps[written_idx] = newmap;
+
 	for (size_t i=imin; i<imax; ++i) {
 	    sFont *tf = m_fonts[i].get ();
 	    tf->file_index = file_idx;
 	    for (int j=0; j<tf->tableCount (); ++j) {
 		FontTable *tab = tf->tbls[j].get ();
+		// Compressed WOFF data can't be viewed in place
+		if (tab->is_mapped) {
+		    if (!tab->newcomplen && newmap &&
+			newmap->contains (tab->newstart, (tab->newlen+3)&~3)) {
+			char *old_data = tab->data;
+			tab->data = const_cast<char *> (newmap->data () + tab->newstart);
+			tab->dataMoved (old_data);
+		    } else
+			tab->detachData ();
+		}
+		tab->m_map = newmap;
 		tab->start = tab->newstart;
 		tab->len = tab->newlen;
+		tab->complen = tab->newcomplen;
 		tab->oldchecksum = tab->newchecksum;
 		tab->changed = tab->td_changed = false;
 		tab->inserted = false;
@@ -707,7 +1012,7 @@ bool sfntFile::save (const QString &newpath, bool ttc, int fidx) {
 	}
 	return (true);
     }
-    throw FileAccessException (newf.fileName ().toStdString ());
+    throw FileAccessException (newpath.toStdString ());
 }
 
 QString sfntFile::name () const {
@@ -742,8 +1047,10 @@ sFont *sfntFile::font (int index) {
 }
 
 void sfntFile::doLoadFile (QFile *newf) {
+    FS_TRACE_SCOPE ("sfntFile::load");
     uint32_t version = getlong (newf);
     int file_idx = m_fonts.empty () ? 0 : m_fonts.back ()->file_index+1;
+    m_load_index.clear ();
 
     if (version==CHR('t','t','c','f')) {
         readTtcfHeader (newf, file_idx);
@@ -759,9 +1066,19 @@ void sfntFile::doLoadFile (QFile *newf) {
         m_font_name = m_fonts[0]->fontname;
         if (!checkFSType (m_fonts[0].get ()))
             throw FileLoadCanceledException (newf->fileName ().toStdString ());
+    } else if (version==CHR('w','O','F','F') || version==CHR('w','O','F','2')) {
+	newf->seek (0);
+	if (version==CHR('w','O','F','F'))
+	    readWoffHeader (newf, file_idx);
+	else
+	    readWoff2Header (newf, file_idx);
+        m_font_name = m_fonts[0]->fontname;
+        if (!checkFSType (m_fonts[0].get ()))
+            throw FileLoadCanceledException (newf->fileName ().toStdString ());
     } else {
         throw FileDamagedException (newf->fileName ().toStdString ());
     }
+    m_load_index.clear ();
 }
 
 void sfntFile::addToCollection (const QString &path) {
@@ -790,6 +1107,7 @@ void sfntFile::addToCollection (const QString &path) {
 	}
     }
 
+    mapFile (newf);
     doLoadFile (newf);
     newf->close ();
     changed = true;
@@ -812,7 +1130,74 @@ int sfntFile::tableRefCount (FontTable *tbl) {
     return cnt;
 }
 
+void sfntFile::mapFile (QFile *newf) {
+    std::shared_ptr<FontShepherd::FileMapping> map;
+    if (m_use_mapping) {
+	map = std::make_shared<FontShepherd::FileMapping> (newf->fileName ());
+	if (!map->valid ())
+	    map.reset ();
+    }
+    // m_files may contain a stale entry left by a failed import
+    m_maps.resize (m_files.size ());
+    for (size_t i=0; i<m_files.size (); i++) {
+	if (m_files[i].get () == newf)
+	    m_maps[i] = map;
+    }
+}
+
+std::shared_ptr<FontShepherd::FileMapping> sfntFile::fileMapping (QFile *f) {
+    for (size_t i=0; i<m_files.size () && i<m_maps.size (); i++) {
+	if (m_files[i].get () == f)
+	    return m_maps[i];
+    }
+    return nullptr;
+}
+
+// Source files may be rewritten in place by another application while
+// mapped (see FontShepherd::FileMapping). In that case move table data
+// still viewed in such files into own buffers, and stop using the mappings
+void sfntFile::checkSources () {
+    QStringList lost;
+    for (size_t i=0; i<m_maps.size (); i++) {
+	std::shared_ptr<FontShepherd::FileMapping> map = m_maps[i];
+	if (!map || map->intact ())
+	    continue;
+	for (auto &fnt : m_fonts) {
+	    for (auto &tptr : fnt->tbls) {
+		FontTable *tab = tptr.get ();
+		if (tab->m_map != map)
+		    continue;
+		if (tab->is_mapped) {
+		    uint32_t padded = (tab->newlen+3)&~3;
+		    char *copy = new char[padded] ();
+		    char *old_data = tab->data;
+		    if (!map->copy (old_data - map->data (), padded, copy))
+			lost << QString::fromStdString (tab->stringName ());
+		    tab->data = copy;
+		    tab->is_mapped = false;
+		    tab->dataMoved (old_data);
+		}
+		tab->m_map.reset ();
+	    }
+	}
+	m_maps[i].reset ();
+    }
+    if (!lost.isEmpty ()) {
+	FontShepherd::postError (
+	    QCoreApplication::translate ("sfntFile", "Source file changed"),
+	    QCoreApplication::translate ("sfntFile",
+		"The font file has been truncated by another application. "
+		"Data of the following tables could not be preserved: %1")
+		.arg (lost.join (", ")),
+	    m_parent);
+    }
+}
+
 sfntFile::sfntFile (const QString &path, QWidget *w) : m_parent (w), changed (false) {
+    QSettings settings (QCoreApplication::organizationName (), QCoreApplication::applicationName ());
+    m_use_mapping = settings.value ("sfnt/mapFiles", true).toBool ();
+    m_sync_on_save = settings.value ("sfnt/syncOnSave", false).toBool ();
+
     m_files.emplace_back (new QFile ());
     QFile *newf = m_files.back ().get ();
 
@@ -820,8 +1205,121 @@ sfntFile::sfntFile (const QString &path, QWidget *w) : m_parent (w), changed (fa
     if (!newf->open (QIODevice::ReadOnly))
         throw FileNotFoundException (newf->fileName ().toStdString ());
 
+    mapFile (newf);
     doLoadFile (newf);
     newf->close ();
+
+    std::lock_guard<std::mutex> lock (s_instances_lock);
+    s_instances.insert (this);
+}
+
+sfntFile::~sfntFile () {
+    std::lock_guard<std::mutex> lock (s_instances_lock);
+    s_instances.erase (this);
+}
+
+std::mutex sfntFile::s_instances_lock;
+std::set<sfntFile *> sfntFile::s_instances;
+
+size_t sfntFile::memoryUsage (int index) const {
+    size_t ret = 0;
+    if (index < 0 || index >= (int) m_fonts.size ())
+	return ret;
+    for (auto &tptr : m_fonts[index]->tbls)
+	ret += tptr->memoryUsage ();
+    return ret;
+}
+
+size_t sfntFile::memoryBudget () {
+    QSettings settings (QCoreApplication::organizationName (), QCoreApplication::applicationName ());
+    // In MiB, zero means no limit
+    return static_cast<size_t> (settings.value ("sfnt/memoryBudget", 0).toULongLong ()) << 20;
 }
 
-sfntFile::~sfntFile () {}
+size_t sfntFile::totalMemoryUsage () {
+    std::lock_guard<std::mutex> lock (s_instances_lock);
+    std::set<FontTable *> seen;
+    size_t ret = 0;
+    for (sfntFile *sf : s_instances) {
+	for (auto &fnt : sf->m_fonts) {
+	    for (auto &tptr : fnt->tbls) {
+		if (seen.insert (tptr.get ()).second)
+		    ret += tptr->memoryUsage ();
+	    }
+	}
+    }
+    return ret;
+}
+
+// A font is considered being edited if any of its tables has an open editor,
+// as editors may refer to (decoded) data of other tables via plain pointers
+bool sfntFile::fontInUse (sFont *fnt) {
+    for (auto &tptr : fnt->tbls) {
+	// 'glyf' keeps a reference to 'loca'
+	long own_refs = tableRefCount (tptr.get ());
+	if (tptr->iName () == CHR ('l','o','c','a'))
+	    own_refs++;
+	if (tptr->tv || tptr.use_count () > own_refs)
+	    return true;
+    }
+    return false;
+}
+
+// Should only be called from the event loop of the GUI thread, when no
+// table data are being processed (and no modal dialog is waiting for them)
+void sfntFile::enforceMemoryBudget () {
+    struct candidate {
+	uint64_t stamp;
+	size_t size;
+	std::shared_ptr<FontTable> tptr;
+    };
+    size_t budget = memoryBudget ();
+    if (!budget)
+	return;
+
+    std::lock_guard<std::mutex> lock (s_instances_lock);
+    std::vector<candidate> cands;
+    std::set<FontTable *> seen, busy;
+    size_t total = 0;
+
+    // Tables may be shared by several fonts in a collection, so first
+    // collect all tables of the fonts currently in use. This should be done
+    // before taking any references to tables, as that affects use_count ()
+    for (sfntFile *sf : s_instances) {
+	for (auto &fnt : sf->m_fonts) {
+	    // SVG and COLR glyphs refer to outline tables
+	    FontTable *svg = fnt->table (CHR ('S','V','G',' '));
+	    FontTable *colr = fnt->table (CHR ('C','O','L','R'));
+	    bool outlines_used = (svg && svg->td_loaded) || (colr && colr->td_loaded);
+	    bool in_use = sf->fontInUse (fnt.get ());
+	    for (auto &tptr : fnt->tbls) {
+		if (in_use || (outlines_used && dynamic_cast<GlyphContainer *> (tptr.get ())))
+		    busy.insert (tptr.get ());
+	    }
+	}
+    }
+    for (sfntFile *sf : s_instances) {
+	for (auto &fnt : sf->m_fonts) {
+	    for (auto &tptr : fnt->tbls) {
+		if (!seen.insert (tptr.get ()).second)
+		    continue;
+		size_t size = tptr->memoryUsage ();
+		total += size;
+		if (size && !busy.count (tptr.get ()) && tptr->evictable ())
+		    cands.push_back ({ tptr->lastUsed (), size, tptr });
+	    }
+	}
+    }
+    if (total <= budget)
+	return;
+
+    std::sort (cands.begin (), cands.end (), [] (const candidate &c1, const candidate &c2) {
+	return c1.stamp < c2.stamp;
+    });
+    for (auto &c : cands) {
+	if (total <= budget)
+	    break;
+	c.tptr->evict ();
+	total -= c.size;
+    }
+}
@@ -28,13 +28,19 @@
 #ifndef _FONSHEPHERD_SFNT_H
 #define _FONSHEPHERD_SFNT_H
 
-#include <QtWidgets>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <QtCore>
+#include "fs_mapping.h"
 
 #define CHR(ch1,ch2,ch3,ch4) (((ch1)<<24)|((ch2)<<16)|((ch3)<<8)|(ch4))
 
+class QWidget;
 class sfntFile;
 class CmapEnc;
 class FontTable;
+struct TableHeader;
 
 // Data types representing the font itself
 
@@ -71,10 +77,20 @@ public:
     void addToCollection (const QString &path);
     void removeFromCollection (int index);
     int tableRefCount (FontTable *tbl);
+    size_t memoryUsage (int index) const;
+    // Should be called when source files may have been modified externally
+    void checkSources ();
+
+    // Memory budget (see sfnt/memoryBudget setting) is shared by all open files
+    static size_t memoryBudget ();
+    static size_t totalMemoryUsage ();
+    static void enforceMemoryBudget ();
 
 private:
     static uint16_t getushort (QIODevice *f);
     static uint32_t getlong (QIODevice *f);
+    static uint16_t getushort (const char *bdata);
+    static uint32_t getlong (const char *bdata);
     static double getfixed (QIODevice *f);
     static double getvfixed (QIODevice *f);
     static double get2dot14 (QIODevice *f);
@@ -82,12 +98,14 @@ private:
     static void putushort (QIODevice *f, uint16_t val);
     static void putlong (QIODevice *f, uint32_t val);
     static void put2d14 (QIODevice *f, double dval);
-    static uint32_t fileCheck (QIODevice *f);
-    static uint32_t figureCheck (QIODevice *f, uint32_t start, uint32_t lcnt);
 
-    static void dumpFontHeader (QIODevice *newf, sFont *fnt);
-    static void dumpFontTables (QIODevice *newf, std::vector<sFont *> fonts);
-    static void fntWrite (QIODevice *newf, sFont *fnt);
+    static void compileTables (std::vector<sFont *> fonts);
+    static uint32_t dumpFontHeader (QIODevice *newf, sFont *fnt);
+    static uint32_t dumpFontTables (QIODevice *newf, std::vector<sFont *> fonts);
+    static bool copyTableRange (QIODevice *newf, FontTable *tab);
+    static uint32_t fntWrite (QIODevice *newf, sFont *fnt);
+    static uint32_t woffWrite (QIODevice *newf, sFont *fnt);
+    static uint32_t woff2Write (QIODevice *newf, sFont *fnt);
 
     void ttcWrite (QIODevice *newf);
 
@@ -98,20 +116,35 @@ private:
     void getEmSize (sFont *tf);
 
     void doLoadFile (QFile *newf);
-    std::shared_ptr<FontTable> readTableHead (QFile *f, int file_idx);
+    void mapFile (QFile *newf);
+    std::shared_ptr<FontShepherd::FileMapping> fileMapping (QFile *f);
+    std::shared_ptr<FontTable> readTableHead (const TableHeader &props);
     void readSfntHeader (QFile *f, int file_idx);
     void readTtcfHeader (QFile *f, int file_idx);
+    void readWoffHeader (QFile *f, int file_idx);
+    void readWoff2Header (QFile *f, int file_idx);
+    void readFontInfo (sFont *tf, int file_idx);
+
+    bool fontInUse (sFont *fnt);
 
     QFile *makeBackup (QFile *origf);
-    void restoreFromBackup (QFile *target, QFile *source, int backidx);
 
     std::vector<std::unique_ptr<sFont>> m_fonts;
     std::vector<std::unique_ptr<QFile>> m_files;
+    // Parallel to m_files. May contain nulls if a file could not be mapped
+    std::vector<std::shared_ptr<FontShepherd::FileMapping>> m_maps;
+    // Tables of the file being currently loaded, by offset and length
+    std::unordered_map<uint64_t, std::shared_ptr<FontTable>> m_load_index;
     QString m_font_name;
     QWidget *m_parent;
 
     bool changed;
+    bool m_use_mapping;
+    bool m_sync_on_save;
     bool backedup;		/* a backup file has been created */
+
+    static std::mutex s_instances_lock;
+    static std::set<sfntFile *> s_instances;
 };
 
 #endif
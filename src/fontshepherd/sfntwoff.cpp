@@ -0,0 +1,474 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+
+// WOFF (https://www.w3.org/TR/WOFF/) and WOFF2 (https://www.w3.org/TR/WOFF2/)
+// reading and writing. Both formats are just wrappers around sfnt data,
+// so they are handled by sfntFile itself: tables loaded from a WOFF/WOFF2
+// file are decoded into their own buffers, and any further processing
+// is the same as for a regular TTF/OTF font.
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <cmath>
+#include <QtConcurrent>
+#include "exceptions.h"
+#include "charbuffer.h"
+#include "fs_math.h"
+#include "fs_trace.h"
+#include "fs_woff2.h"
+#include "sfnt.h"
+#include "tables.h"
+#include "tables/head.h"
+
+void sfntFile::readWoffHeader (QFile *f, int file_idx) {
+    FS_TRACE_SCOPE ("load: WOFF decode");
+    m_fonts.emplace_back (new sFont ());
+    sFont *tf = m_fonts.back ().get ();
+    std::shared_ptr<FontShepherd::FileMapping> map = fileMapping (f);
+
+    /* signature = */ getlong (f);
+    tf->version = getlong (f);
+    uint32_t woff_len = getlong (f);
+    int tbl_cnt = getushort (f);
+    uint16_t reserved = getushort (f);
+    /* totalSfntSize = */ getlong (f);
+    /* majorVersion = */ getushort (f);
+    /* minorVersion = */ getushort (f);
+    // Extended metadata and private data blocks are not preserved, as
+    // there is nothing to edit them with
+    /* metaOffset = */ getlong (f);
+    /* metaLength = */ getlong (f);
+    /* metaOrigLength = */ getlong (f);
+    /* privOffset = */ getlong (f);
+    /* privLength = */ getlong (f);
+    tf->container = this;
+
+    if (reserved != 0 || woff_len > f->size ())
+	throw FileDamagedException (f->fileName ().toStdString ());
+
+    QByteArray dir_buf = f->read (tbl_cnt*20);
+    if (dir_buf.size () < tbl_cnt*20)
+	throw FileDamagedException (f->fileName ().toStdString ());
+    const char *dir = dir_buf.constData ();
+
+    tf->tbls.reserve (tbl_cnt);
+    for (int i=0; i<tbl_cnt; ++i) {
+	const char *entry = dir + i*20;
+	TableHeader props;
+	props.file = f;
+	props.map = map;
+	props.iname = getlong (entry);
+	props.off = getlong (entry+4);
+	props.complen = getlong (entry+8);
+	props.length = getlong (entry+12);
+	props.checksum = getlong (entry+16);
+	if (props.complen > props.length || (uint64_t) props.off + props.complen > woff_len)
+	    throw FileDamagedException (f->fileName ().toStdString ());
+	// Table stored uncompressed
+	if (props.complen == props.length)
+	    props.complen = 0;
+	tf->tbls.push_back (readTableHead (props));
+    }
+
+    // Inflating tables is independent for each table, so do that
+    // concurrently. This is safe only if compressed data are read from
+    // a mapping rather than from a shared QFile, otherwise leave the
+    // tables to be inflated on demand
+    if (map) {
+	std::vector<FontTable *> packed;
+	for (auto &tptr : tf->tbls) {
+	    if (tptr->complen && !tptr->data)
+		packed.push_back (tptr.get ());
+	}
+	std::exception_ptr error;
+	std::mutex error_lock;
+	QtConcurrent::blockingMap (packed, [&error, &error_lock](FontTable *tab) {
+	    try {
+		tab->fillup ();
+	    } catch (...) {
+		std::lock_guard<std::mutex> guard (error_lock);
+		if (!error)
+		    error = std::current_exception ();
+	    }
+	});
+	if (error)
+	    std::rethrow_exception (error);
+    }
+    readFontInfo (tf, file_idx);
+}
+
+// Writes the font as WOFF and returns the value stored into the
+// checkSumAdjustment field of the head table. The font is first compiled
+// to an in-memory sfnt, so that the checksums and the adjustment refer to
+// the uncompressed data, as the spec requires
+uint32_t sfntFile::woffWrite (QIODevice *newf, sFont *fnt) {
+    FS_TRACE_SCOPE ("save: WOFF encode");
+    QBuffer sfnt_buf;
+    sfnt_buf.open (QIODevice::ReadWrite);
+    uint32_t adjust = 0xb1b0afba - fntWrite (&sfnt_buf, fnt);
+    uint16_t major = 0, minor = 0;
+
+    HeadTable *head = dynamic_cast<HeadTable *> (fnt->table (CHR ('h','e','a','d')));
+    if (head) {
+	sfnt_buf.seek (head->newstart+2*sizeof (uint32_t));
+	putlong (&sfnt_buf, adjust);
+	head->setCheckSumAdjustment (adjust);
+	double rev = head->fontRevision ();
+	major = std::floor (rev);
+	minor = std::lround ((rev - major)*1000);
+    }
+    const QByteArray &sfnt = sfnt_buf.data ();
+
+    std::vector<FontTable *> tbls;
+    tbls.reserve (fnt->tableCount ());
+    for (auto &tptr : fnt->tbls)
+	tbls.push_back (tptr.get ());
+    std::sort (tbls.begin (), tbls.end (), [](FontTable *t1, FontTable *t2) {
+	return (t1->iName () < t2->iName ());
+    });
+    int cnt = tbls.size ();
+
+    // Compress tables concurrently. If compression doesn't make a table
+    // smaller, it is stored as is
+    std::vector<std::string> packed (cnt);
+    std::vector<int> indices (cnt);
+    std::iota (indices.begin (), indices.end (), 0);
+    QtConcurrent::blockingMap (indices, [&tbls, &packed, &sfnt](int i) {
+	FontTable *tab = tbls[i];
+	std::string zdata = FontShepherd::zlibDeflate (sfnt.constData () + tab->newstart, tab->newlen);
+	if (zdata.size () < tab->newlen)
+	    packed[i].swap (zdata);
+    });
+
+    uint32_t woff_len = 44 + cnt*20;
+    for (int i=0; i<cnt; ++i) {
+	uint32_t len = packed[i].empty () ? tbls[i]->newlen : packed[i].size ();
+	woff_len += (len+3)&~3;
+    }
+
+    putlong (newf, CHR ('w','O','F','F'));
+    putlong (newf, fnt->version);
+    putlong (newf, woff_len);
+    putushort (newf, cnt);
+    putushort (newf, 0);			/* reserved */
+    putlong (newf, sfnt.size ());
+    putushort (newf, major);
+    putushort (newf, minor);
+    for (int i=0; i<5; i++)
+	putlong (newf, 0);			/* no metadata or private data */
+
+    uint32_t pos = 44 + cnt*20;
+    for (int i=0; i<cnt; ++i) {
+	FontTable *tab = tbls[i];
+	uint32_t len = packed[i].empty () ? tab->newlen : packed[i].size ();
+	putlong (newf, tab->iName ());
+	putlong (newf, pos);
+	putlong (newf, len);
+	putlong (newf, tab->newlen);
+	putlong (newf, tab->newchecksum);
+	pos += (len+3)&~3;
+    }
+
+    for (int i=0; i<cnt; ++i) {
+	FontTable *tab = tbls[i];
+	tab->newcomplen = packed[i].size ();
+	const char *src = packed[i].empty () ?
+	    sfnt.constData () + tab->newstart : packed[i].data ();
+	uint32_t len = packed[i].empty () ? tab->newlen : packed[i].size ();
+	tab->newstart = newf->pos ();
+	newf->write (src, len);
+	while (len&3) {
+	    newf->putChar ('\0');
+	    len++;
+	}
+    }
+    return adjust;
+}
+
+void sfntFile::readWoff2Header (QFile *f, int file_idx) {
+    FS_TRACE_SCOPE ("load: WOFF2 decode");
+    std::shared_ptr<FontShepherd::FileMapping> map = fileMapping (f);
+    std::string fname = f->fileName ().toStdString ();
+    QByteArray file_buf;
+    const char *fdata;
+    size_t fsize;
+    if (map) {
+	fdata = map->data ();
+	fsize = map->size ();
+    } else {
+	file_buf = f->readAll ();
+	fdata = file_buf.constData ();
+	fsize = file_buf.size ();
+    }
+    if (fsize < 48)
+	throw FileDamagedException (fname);
+
+    m_fonts.emplace_back (new sFont ());
+    sFont *tf = m_fonts.back ().get ();
+    tf->container = this;
+    tf->version = getlong (fdata+4);
+    uint32_t woff_len = getlong (fdata+8);
+    int tbl_cnt = getushort (fdata+12);
+    uint16_t reserved = getushort (fdata+14);
+    /* totalSfntSize = */ getlong (fdata+16);
+    uint32_t comp_size = getlong (fdata+20);
+    // Extended metadata and private data blocks are not preserved
+
+    if (tf->version == CHR('t','t','c','f'))
+	throw FileDamagedException (fname, "Error: WOFF2 font collections are not supported.");
+    if (reserved != 0 || woff_len > fsize)
+	throw FileDamagedException (fname);
+
+    struct Woff2Entry {
+	uint32_t tag, orig_len, stream_len;
+	bool transformed;
+    };
+    std::vector<Woff2Entry> entries (tbl_cnt);
+    const char *p = fdata + 48, *end = fdata + woff_len;
+    for (auto &entry : entries) {
+	if (p >= end)
+	    throw FileDamagedException (fname);
+	uint8_t flags = *p++;
+	int xform = flags>>6;
+	if ((flags&0x3f) == 63) {
+	    if (end - p < 4)
+		throw FileDamagedException (fname);
+	    entry.tag = getlong (p);
+	    p += 4;
+	} else {
+	    entry.tag = FontShepherd::woff2::knownTag (flags&0x3f);
+	}
+	if (!FontShepherd::woff2::readBase128 (p, end, entry.orig_len))
+	    throw FileDamagedException (fname);
+
+	// For glyf and loca the null transform is 3, for other tables 0.
+	// The only other transform defined is 1 for hmtx
+	bool glyf_loca = entry.tag == CHR('g','l','y','f') || entry.tag == CHR('l','o','c','a');
+	entry.transformed = glyf_loca ? xform == 0 : xform != 0;
+	if (glyf_loca ? (xform != 0 && xform != 3) : (xform > 1 || (xform == 1 && entry.tag != CHR('h','m','t','x'))))
+	    throw FileDamagedException (fname, "Error: unsupported WOFF2 table transform.");
+	entry.stream_len = entry.orig_len;
+	if (entry.transformed) {
+	    if (!FontShepherd::woff2::readBase128 (p, end, entry.stream_len))
+		throw FileDamagedException (fname);
+	    if (entry.tag == CHR('l','o','c','a') && entry.stream_len != 0)
+		throw FileDamagedException (fname);
+	}
+    }
+    if ((size_t) (end - p) < comp_size)
+	throw FileDamagedException (fname);
+
+    // Untransformed tables are decompressed straight into the buffers
+    // which then become table data
+    std::vector<std::unique_ptr<char[]>> bufs (tbl_cnt);
+    std::vector<std::vector<char>> xformed (tbl_cnt);
+    FontShepherd::woff2::StreamDecoder dec (p, comp_size);
+    int glyf_idx = -1, loca_idx = -1, hmtx_idx = -1, hhea_idx = -1;
+    for (int i=0; i<tbl_cnt; i++) {
+	Woff2Entry &entry = entries[i];
+	bool ok;
+	if (entry.transformed) {
+	    xformed[i].resize (entry.stream_len);
+	    ok = dec.read (xformed[i].data (), entry.stream_len);
+	} else {
+	    bufs[i].reset (new char[(entry.orig_len+3)&~3] ()); // padding to uint32
+	    ok = dec.read (bufs[i].get (), entry.orig_len);
+	}
+	if (!ok)
+	    throw FileDamagedException (fname);
+	switch (entry.tag) {
+	  case CHR('g','l','y','f'):
+	    glyf_idx = i;
+	    break;
+	  case CHR('l','o','c','a'):
+	    loca_idx = i;
+	    break;
+	  case CHR('h','m','t','x'):
+	    hmtx_idx = i;
+	    break;
+	  case CHR('h','h','e','a'):
+	    hhea_idx = i;
+	}
+    }
+    if (!dec.finished ())
+	throw FileDamagedException (fname);
+
+    std::vector<int16_t> xmins;
+    if (glyf_idx >= 0 && entries[glyf_idx].transformed) {
+	if (loca_idx < 0 || !entries[loca_idx].transformed)
+	    throw FileDamagedException (fname);
+	size_t glyf_len;
+	uint32_t loca_len = entries[loca_idx].orig_len;
+	bufs[loca_idx].reset (new char[(loca_len+3)&~3] ());
+	if (!FontShepherd::woff2::reconstructGlyf (xformed[glyf_idx].data (), xformed[glyf_idx].size (),
+	    bufs[glyf_idx], glyf_len, bufs[loca_idx].get (), loca_len, xmins))
+	    throw FileDamagedException (fname);
+	entries[glyf_idx].orig_len = glyf_len;
+    } else if (loca_idx >= 0 && entries[loca_idx].transformed) {
+	throw FileDamagedException (fname);
+    }
+    if (hmtx_idx >= 0 && entries[hmtx_idx].transformed) {
+	if (xmins.empty () || hhea_idx < 0 || entries[hhea_idx].orig_len < 36)
+	    throw FileDamagedException (fname);
+	uint32_t hmtx_len = entries[hmtx_idx].orig_len;
+	bufs[hmtx_idx].reset (new char[(hmtx_len+3)&~3] ());
+	if (!FontShepherd::woff2::reconstructHmtx (xformed[hmtx_idx].data (), xformed[hmtx_idx].size (),
+	    getushort (bufs[hhea_idx].get () + 34), xmins, bufs[hmtx_idx].get (), hmtx_len))
+	    throw FileDamagedException (fname);
+    }
+
+    tf->tbls.reserve (tbl_cnt);
+    for (int i=0; i<tbl_cnt; i++) {
+	TableHeader props;
+	props.file = f;
+	props.map = map;
+	props.iname = entries[i].tag;
+	props.off = 0xffffffff;
+	props.length = entries[i].orig_len;
+	props.checksum = FontShepherd::math::checksum (bufs[i].get (), entries[i].orig_len);
+	std::shared_ptr<FontTable> tptr = readTableHead (props);
+	tptr->data = bufs[i].release ();
+	tf->tbls.push_back (tptr);
+    }
+    readFontInfo (tf, file_idx);
+}
+
+// Writes the font as WOFF2 and returns the value stored into the
+// checkSumAdjustment field of the head table. The glyf/loca and hmtx
+// transforms are applied to the compiled table data, if possible
+uint32_t sfntFile::woff2Write (QIODevice *newf, sFont *fnt) {
+    FS_TRACE_SCOPE ("save: WOFF2 encode");
+    // Tables can't be read back from a WOFF2 file individually, so all
+    // of them should be kept loaded after saving
+    for (auto &tptr : fnt->tbls)
+	tptr->fillup ();
+
+    QBuffer sfnt_buf;
+    sfnt_buf.open (QIODevice::ReadWrite);
+    uint32_t adjust = 0xb1b0afba - fntWrite (&sfnt_buf, fnt);
+    uint16_t major = 0, minor = 0;
+
+    HeadTable *head = dynamic_cast<HeadTable *> (fnt->table (CHR ('h','e','a','d')));
+    if (head) {
+	sfnt_buf.seek (head->newstart+2*sizeof (uint32_t));
+	putlong (&sfnt_buf, adjust);
+	head->setCheckSumAdjustment (adjust);
+	double rev = head->fontRevision ();
+	major = std::floor (rev);
+	minor = std::lround ((rev - major)*1000);
+    }
+    const QByteArray &sfnt = sfnt_buf.data ();
+    auto table_data = [&sfnt](FontTable *tab) {
+	return sfnt.constData () + tab->newstart;
+    };
+
+    // The spec requires loca to immediately follow glyf
+    std::vector<FontTable *> tbls;
+    FontTable *glyf = fnt->table (CHR ('g','l','y','f'));
+    FontTable *loca = fnt->table (CHR ('l','o','c','a'));
+    FontTable *hmtx = fnt->table (CHR ('h','m','t','x'));
+    FontTable *hhea = fnt->table (CHR ('h','h','e','a'));
+    FontTable *maxp = fnt->table (CHR ('m','a','x','p'));
+    tbls.reserve (fnt->tableCount ());
+    for (auto &tptr : fnt->tbls) {
+	if (tptr.get () != loca || !glyf)
+	    tbls.push_back (tptr.get ());
+    }
+    std::sort (tbls.begin (), tbls.end (), [](FontTable *t1, FontTable *t2) {
+	return (t1->iName () < t2->iName ());
+    });
+    if (glyf && loca)
+	tbls.insert (std::find (tbls.begin (), tbls.end (), glyf) + 1, loca);
+
+    std::string glyf_t, hmtx_t;
+    std::vector<int16_t> xmins;
+    bool glyf_xform = glyf && loca && head && maxp && head->newlen >= 54 && maxp->newlen >= 6 &&
+	FontShepherd::woff2::transformGlyf (table_data (glyf), glyf->newlen, table_data (loca), loca->newlen,
+	    getushort (table_data (head) + 50), getushort (table_data (maxp) + 4), glyf_t, xmins);
+    bool hmtx_xform = glyf_xform && hmtx && hhea && hhea->newlen >= 36 &&
+	FontShepherd::woff2::transformHmtx (table_data (hmtx), hmtx->newlen,
+	    getushort (table_data (hhea) + 34), xmins, hmtx_t);
+
+    std::string dir, stream;
+    stream.reserve (sfnt.size ());
+    for (FontTable *tab : tbls) {
+	uint32_t tag = tab->iName ();
+	int idx = FontShepherd::woff2::knownTagIndex (tag);
+	int xform = 0;
+	if (tab == glyf || tab == loca)
+	    xform = glyf_xform ? 0 : 3;
+	else if (tab == hmtx && hmtx_xform)
+	    xform = 1;
+	dir.push_back (idx | (xform<<6));
+	if (idx == 63) {
+	    for (int i=3; i>=0; i--)
+		dir.push_back ((tag>>(i*8))&0xff);
+	}
+	FontShepherd::woff2::putBase128 (dir, tab->newlen);
+	if (tab == glyf && glyf_xform) {
+	    FontShepherd::woff2::putBase128 (dir, glyf_t.size ());
+	    stream += glyf_t;
+	} else if (tab == loca && glyf_xform) {
+	    FontShepherd::woff2::putBase128 (dir, 0);
+	} else if (tab == hmtx && hmtx_xform) {
+	    FontShepherd::woff2::putBase128 (dir, hmtx_t.size ());
+	    stream += hmtx_t;
+	} else {
+	    stream.append (table_data (tab), tab->newlen);
+	}
+    }
+    std::string comp = FontShepherd::woff2::compress (stream.data (), stream.size ());
+    if (comp.empty ())
+	throw std::bad_alloc ();
+    uint32_t woff_len = (48 + dir.size () + comp.size () + 3)&~3;
+
+    putlong (newf, CHR ('w','O','F','2'));
+    putlong (newf, fnt->version);
+    putlong (newf, woff_len);
+    putushort (newf, tbls.size ());
+    putushort (newf, 0);			/* reserved */
+    putlong (newf, sfnt.size ());
+    putlong (newf, comp.size ());
+    putushort (newf, major);
+    putushort (newf, minor);
+    for (int i=0; i<5; i++)
+	putlong (newf, 0);			/* no metadata or private data */
+    newf->write (dir.data (), dir.size ());
+    newf->write (comp.data (), comp.size ());
+    while (newf->pos () & 3)
+	newf->putChar ('\0');
+
+    for (FontTable *tab : tbls) {
+	tab->newstart = 0xffffffff;
+	tab->newcomplen = 0;
+    }
+    return adjust;
+}
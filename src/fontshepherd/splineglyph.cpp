@@ -37,6 +37,7 @@
 #include <inttypes.h>
 #include <set>
 #include <iterator>
+#include <algorithm>
 
 #include "cffstuff.h"
 #include "tables.h"
@@ -67,9 +68,8 @@ using namespace FontShepherd::math;
 #define _SCALED_OFFSETS		0x800	/* Use Apple definition of offset interpretation */
 #define _UNSCALED_OFFSETS	0x1000	/* Use MS definition */
 
-static float get2dot14 (BoostIn &buf) {
-    uint16_t val;
-    buf >> val;
+static float get2dot14 (SpanIn &buf) {
+    uint16_t val = buf.getUShort ();
     int mant = val&0x3fff;
     /* GWW: This oddity may be needed to deal with the first 2 bits being signed */
     /*  and the low-order bits unsigned */
@@ -91,7 +91,6 @@ ConicGlyph::ConicGlyph (uint16_t gid, BaseMetrics gm) :
     clipBox = { 0, 0, 0, 0 };
     origPoint = { 0, 0 };
     awPoint = { 0, 0 };
-    m_undoStack = std::unique_ptr<QUndoStack> (new QUndoStack ());
 };
 
 ConicGlyph::~ConicGlyph () {};
@@ -107,13 +106,65 @@ void ConicGlyph::clear () {
     instructions.clear ();
 }
 
-static void attachControls (ConicPoint *from, ConicPoint *to, BasePoint *cp, int &num) {
-    from->nextcp = to->prevcp = *cp;
+static void attachControls (ConicPoint *from, ConicPoint *to, const BasePoint &cp, int &num) {
+    from->nextcp = to->prevcp = cp;
     from->nextcpindex = num++;
     from->nonextcp = to->noprevcp = false;
 }
 
-void ConicGlyph::ttfBuildContours (int path_cnt, uint16_t *endpt, uint8_t *flags, std::vector<BasePoint> &pts) {
+void flat_outline::clear () {
+    numberOfContours = 0;
+    overlap = false;
+    bb = { 0, 0, 0, 0 };
+    x.clear ();
+    y.clear ();
+    on_curve.clear ();
+    end_pts.clear ();
+    components.clear ();
+    instructions.clear ();
+}
+
+uint16_t flat_outline::numPoints () const {
+    return x.size ();
+}
+
+void flat_outline::addPoint (const BasePoint &pt, bool on) {
+    x.push_back (pt.x);
+    y.push_back (pt.y);
+    on_curve.push_back (on);
+}
+
+// Control box, i. e. bounds of all points, including off-curve ones
+void flat_outline::calcBounds (DBounds &b) const {
+    b = { 0, 0, 0, 0 };
+    if (x.empty ())
+	return;
+    auto xr = std::minmax_element (x.begin (), x.end ());
+    auto yr = std::minmax_element (y.begin (), y.end ());
+    b.minx = *xr.first; b.maxx = *xr.second;
+    b.miny = *yr.first; b.maxy = *yr.second;
+}
+
+// Used to substitute components of a composite glyph
+void flat_outline::append (const flat_outline &other, const std::array<double, 6> &transform) {
+    uint16_t base = x.size ();
+    size_t cnt = other.x.size ();
+
+    x.reserve (base + cnt);
+    y.reserve (base + cnt);
+    for (size_t i=0; i<cnt; i++) {
+	x.push_back (transform[0]*other.x[i] + transform[2]*other.y[i] + transform[4]);
+	y.push_back (transform[1]*other.x[i] + transform[3]*other.y[i] + transform[5]);
+    }
+    on_curve.insert (on_curve.end (), other.on_curve.begin (), other.on_curve.end ());
+    for (uint16_t end : other.end_pts)
+	end_pts.push_back (base + end);
+}
+
+void ConicGlyph::ttfBuildContours (const flat_outline &fo) {
+    const std::vector<uint16_t> &endpt = fo.end_pts;
+    const std::vector<uint8_t> &on_curve = fo.on_curve;
+    int path_cnt = endpt.size ();
     int i, path, start;
     bool last_off;
     ConicPoint *sp;
@@ -124,8 +175,15 @@ void ConicGlyph::ttfBuildContours (int path_cnt, uint16_t *endpt, uint8_t *flags
     figures.back ().order2 = true;
     std::vector<ConicPointList> &conics = figures.back ().contours;
     conics.reserve (path_cnt);
-    boost::object_pool<ConicPoint> &points_pool = figures.back ().points_pool;
-    boost::object_pool<Conic> &splines_pool = figures.back ().splines_pool;
+    FontShepherd::ObjectArena<ConicPoint> &points_pool = figures.back ().points_pool;
+    FontShepherd::ObjectArena<Conic> &splines_pool = figures.back ().splines_pool;
+    // Implied on-curve points may add more, but normally this is enough
+    // to place the whole outline into a single slab
+    points_pool.reserve (fo.numPoints ());
+    splines_pool.reserve (fo.numPoints ());
+    auto pts = [&fo] (int idx) {
+	return BasePoint { fo.x[idx], fo.y[idx] };
+    };
 
     for (path=i=0; path<path_cnt; ++path) {
 	if (endpt[path]<i)	/* GWW: Sigh. Yes there are fonts with bad endpt info */
@@ -134,23 +192,23 @@ void ConicGlyph::ttfBuildContours (int path_cnt, uint16_t *endpt, uint8_t *flags
 	last_off = false;
 	start = i;
 	while (i<=endpt[path]) {
-	    if (flags[i]&_On_Curve) {
+	    if (on_curve[i]) {
 		sp = points_pool.construct ();
-		sp->me = pts[i];
+		sp->me = pts (i);
 		sp->nonextcp = sp->noprevcp = true;
 		if (last_off && cur.last)
-		    attachControls (cur.last, sp, &pts[i-1], num);
+		    attachControls (cur.last, sp, pts (i-1), num);
 		sp->ttfindex = num++;
 		last_off = false;
 	    } else if (last_off) {
 		/* GWW: two off curve points get a third on curve point created */
 		/* half-way between them. Now isn't that special */
 		sp = points_pool.construct ();
-		sp->me.x = (pts[i].x+pts[i-1].x)/2;
-		sp->me.y = (pts[i].y+pts[i-1].y)/2;
+		sp->me.x = (fo.x[i]+fo.x[i-1])/2;
+		sp->me.y = (fo.y[i]+fo.y[i-1])/2;
 		sp->nonextcp = sp->noprevcp = true;
 		if (last_off && cur.last)
-		    attachControls (cur.last, sp, &pts[i-1], num);
+		    attachControls (cur.last, sp, pts (i-1), num);
 		sp->ttfindex = -1;
 		/* GWW: last_off continues to be true */
 	    } else {
@@ -174,39 +232,39 @@ void ConicGlyph::ttfBuildContours (int path_cnt, uint16_t *endpt, uint8_t *flags
 	    }
 	    ++i;
 	}
-	if (start==i-1 && !(flags[start]&_On_Curve)) {
+	if (start==i-1 && !on_curve[start]) {
 	    /* GWW: MS chinese fonts have contours consisting of a single off curve*/
 	    /*  point. What on earth do they think that means? */
 	    // AMK: I suppose this was just to mark something for TTF instructions.
 	    // But I guess it would not be a problem to turn such a point into oncurve
 	    sp = points_pool.construct ();
-	    sp->me.x = pts[start].x;
-	    sp->me.y = pts[start].y;
+	    sp->me.x = fo.x[start];
+	    sp->me.y = fo.y[start];
             sp->nonextcp = sp->noprevcp = true;
 	    sp->ttfindex = num++;
 	    cur.first = cur.last = sp;
             sp->isfirst = true;
 
-	} else if (!(flags[start]&_On_Curve) && !(flags[i-1]&_On_Curve)) {
+	} else if (!on_curve[start] && !on_curve[i-1]) {
 	    sp = points_pool.construct ();
-	    sp->me.x = (pts[start].x+pts[i-1].x)/2;
-	    sp->me.y = (pts[start].y+pts[i-1].y)/2;
+	    sp->me.x = (fo.x[start]+fo.x[i-1])/2;
+	    sp->me.y = (fo.y[start]+fo.y[i-1])/2;
 	    sp->nonextcp = sp->noprevcp = true;
-	    attachControls (cur.last, sp, &pts[i-1], num);
+	    attachControls (cur.last, sp, pts (i-1), num);
 	    sp->ttfindex = -1;
 	    splines_pool.construct (cur.last, sp, true);
 	    cur.last = sp;
-	    attachControls (sp, cur.first, &pts[start], num);
+	    attachControls (sp, cur.first, pts (start), num);
 
-	} else if (!(flags[i-1]&_On_Curve)) {
-	    attachControls (cur.last, cur.first, &pts[i-1], num);
+	} else if (!on_curve[i-1]) {
+	    attachControls (cur.last, cur.first, pts (i-1), num);
 
-	} else if (!(flags[start]&_On_Curve)) {
-	    attachControls (cur.last, cur.first, &pts[start], num);
+	} else if (!on_curve[start]) {
+	    attachControls (cur.last, cur.first, pts (start), num);
 	}
 	// Fixup the number of the starting point of the contour
 	// in case it was an offcurve point.
-	if (!(flags[start]&_On_Curve)) {
+	if (!on_curve[start]) {
 	    sp->nextcpindex = start; num--;
 	}
 
@@ -235,91 +293,44 @@ void ConicGlyph::categorizePoints () {
     }
 }
 
-void ConicGlyph::readttfsimpleglyph (BoostIn &buf, int path_cnt, uint32_t start_pos) {
-    uint16_t endpt[path_cnt + 1] = { 0 };
-    std::vector<BasePoint> pts;
-    int i, j, tot;
-    int last_pos;
+void ConicGlyph::readttfsimpleglyph (SpanIn &buf, flat_outline &out, uint16_t gid, uint32_t start_pos) {
+    int path_cnt = out.numberOfContours;
+    int i, tot;
 
+    out.end_pts.resize (path_cnt);
     for (i=0; i<path_cnt; ++i)
-	buf >> endpt[i];
-
-    if (path_cnt==0) {
-	tot = 0;
-	pts.resize (1);
-    } else {
-	tot = endpt[path_cnt-1]+1;
-	pts.resize (tot);
-    }
+	out.end_pts[i] = buf.getUShort ();
+    tot = path_cnt ? out.end_pts[path_cnt-1]+1 : 0;
 
-    uint16_t instr_cnt;
-    buf >> instr_cnt;
-    instructions.resize (instr_cnt);
-    for (size_t i=0; i<instr_cnt; i++) {
-	uint8_t code;
-	buf >> code;
-	instructions[i] = code;
-    }
+    uint16_t instr_cnt = buf.getUShort ();
+    out.instructions.resize (instr_cnt);
+    out.instructions.resize (buf.read (out.instructions.data (), instr_cnt));
 
-    uint8_t flags[tot] = { 0 };
-    for (i=0; i<tot; ++i) {
-	buf >> flags[i];
-	if (flags[i]&_Repeat) {
-	    unsigned char cnt;
-	    buf >> cnt;
-	    for (j=0; j<cnt; ++j)
-		flags[i+j+1] = flags[i];
-	    i += cnt;
-	}
-    }
+    std::vector<uint8_t> flags (tot, 0);
+    i = buf.readFlags (flags.data (), tot, _Repeat);
     if (i!=tot)
         FontShepherd::postError (
             tr ("Bad glyf data"),
             tr ("Flag count in %1 at 0x%2 is %3, while %4 is expected")
-		.arg (GID)
+		.arg (gid)
 		.arg (start_pos, 0, 16)
 		.arg (i)
 		.arg (tot),
             nullptr);
 
-    last_pos = 0;
-    for (i=0; i<tot; ++i) {
-	int16_t off;
-	if (flags[i]&_X_Short) {
-	    uint8_t ch;
-	    buf >> ch;
-	    off = (flags[i]&_X_Same) ? ch : -ch;
-	} else if (flags[i]&_X_Same)
-	    off = 0;
-	else
-	    buf >> off;
-
-	pts[i].x = last_pos + off;
-	last_pos = pts[i].x;
-    }
-
-    last_pos = 0;
-    for (i=0; i<tot; ++i) {
-	int16_t off;
-	if (flags[i]&_Y_Short) {
-	    uint8_t ch;
-	    buf >> ch;
-	    off = (flags[i]&_Y_Same) ? ch : -ch;
-	} else if (flags[i]&_Y_Same)
-	    off = 0;
-	else
-	    buf >> off;
-
-	pts[i].y = last_pos + off;
-	last_pos = pts[i].y;
-    }
-
-    ttfBuildContours (path_cnt, endpt, flags, pts);
-    point_cnt = tot;
-    categorizePoints ();
+    // All X coordinates, followed by all Y coordinates
+    std::vector<int32_t> coords (tot*2);
+    buf.readCoordinates (coords.data (), flags.data (), tot, _X_Short, _X_Same);
+    buf.readCoordinates (coords.data () + tot, flags.data (), tot, _Y_Short, _Y_Same);
+    out.x.assign (coords.begin (), coords.begin () + tot);
+    out.y.assign (coords.begin () + tot, coords.end ());
+    out.on_curve.resize (tot);
+    for (i=0; i<tot; ++i)
+	out.on_curve[i] = (flags[i]&_On_Curve) ? 1 : 0;
+    out.overlap = tot && (flags[0]&_Overlap_Simple);
 }
 
-void ConicGlyph::readttfcompositeglyph (BoostIn &buf) {
+void ConicGlyph::readttfcompositeglyph (SpanIn &buf, flat_outline &out, uint16_t gid) {
     static bool default_to_Apple = false;
     uint16_t flags;
 
@@ -327,13 +338,12 @@ void ConicGlyph::readttfcompositeglyph (BoostIn &buf) {
 	if ((int) buf.peek () == EOF) {
             FontShepherd::postError (
                 tr ("Bad glyf data"),
-                tr ("Reached end of table when reading composite glyph : %1").arg (GID),
+                tr ("Reached end of table when reading composite glyph : %1").arg (gid),
                 nullptr);
 	    break;
 	}
 
-	DrawableReference cur;
-	cur.outType = OutlinesType::TT;
+	flat_component cur = flat_component ();
 	int16_t arg1, arg2;
 
 	buf >> flags;
@@ -412,19 +422,13 @@ void ConicGlyph::readttfcompositeglyph (BoostIn &buf) {
 	}
 	cur.use_my_metrics = (flags&_USE_MY_METRICS)?1:0;
 	cur.round = (flags&_ROUND) ? 1 : 0;
-	cur.cc = nullptr;
-	refs.push_back (cur);
+	out.components.push_back (cur);
     } while (flags&_MORE);
 
     if (flags&_INSTR) {
-	uint16_t instr_cnt;
-	buf >> instr_cnt;
-	instructions.resize (instr_cnt);
-	for (size_t i=0; i<instr_cnt; i++) {
-	    uint8_t code;
-	    buf >> code;
-	    instructions[i] = code;
-	}
+	uint16_t instr_cnt = buf.getUShort ();
+	out.instructions.resize (instr_cnt);
+	out.instructions.resize (buf.read (out.instructions.data (), instr_cnt));
     }
 }
 
@@ -584,34 +588,85 @@ void ConicGlyph::unlinkRefs (bool selected) {
     checkBounds (bb, false);
 }
 
-void ConicGlyph::fromTTF (BoostIn &buf, uint32_t off) {
-    int16_t path_cnt;
+// Decode a 'glyf' record without building any splines. Returns false for
+// empty glyphs, which have no data at all
+bool ConicGlyph::readFlatTTF (SpanIn &buf, flat_outline &out, uint16_t gid, uint32_t off) {
     int16_t min_x, max_x, min_y, max_y;
 
-    if ((int) buf.peek () == EOF) {
-	loaded= true;
-	return;
+    out.clear ();
+    out.order2 = true;
+    if ((int) buf.peek () == EOF)
+	return false;
+
+    buf >> out.numberOfContours;
+    buf >> min_x; out.bb.minx = min_x;
+    buf >> min_y; out.bb.miny = min_y;
+    buf >> max_x; out.bb.maxx = max_x;
+    buf >> max_y; out.bb.maxy = max_y;
+
+    if (out.numberOfContours>=0) {
+	readttfsimpleglyph (buf, out, gid, off);
+    } else {
+	out.numberOfContours = -1;
+	readttfcompositeglyph (buf, out, gid);
     }
+    return true;
+}
 
-    buf >> path_cnt;
-    buf >> min_x; bb.minx = min_x;
-    buf >> min_y; bb.miny = min_y;
-    buf >> max_x; bb.maxx = max_x;
-    buf >> max_y; bb.maxy = max_y;
+void ConicGlyph::fromTTF (SpanIn &buf, uint32_t off) {
+    flat_outline fo;
 
-    if (path_cnt>=0)
-	readttfsimpleglyph (buf, path_cnt, off);
-    else
-	readttfcompositeglyph (buf);
-    m_outType = OutlinesType::TT;
+    if (readFlatTTF (buf, fo, GID, off)) {
+	bb = fo.bb;
+	fromFlatOutline (fo);
+	m_outType = OutlinesType::TT;
+    }
     loaded = true;
 }
 
-uint32_t ConicGlyph::toTTF (QBuffer &buf, QDataStream &os, MaxpTable *maxp) {
+// Build editable splines from a quadratic flat outline
+void ConicGlyph::fromFlatOutline (const flat_outline &fo) {
+    instructions = fo.instructions;
+    if (fo.numberOfContours >= 0) {
+	ttfBuildContours (fo);
+	point_cnt = fo.numPoints ();
+	categorizePoints ();
+    } else {
+	for (auto &comp : fo.components) {
+	    DrawableReference cur;
+	    cur.outType = OutlinesType::TT;
+	    cur.GID = comp.GID;
+	    cur.transform = comp.transform;
+	    cur.point_match = comp.point_match;
+	    cur.match_pt_base = comp.match_pt_base;
+	    cur.match_pt_ref = comp.match_pt_ref;
+	    cur.use_my_metrics = comp.use_my_metrics;
+	    cur.round = comp.round;
+	    cur.cc = nullptr;
+	    refs.push_back (cur);
+	}
+    }
+}
+
+void ConicGlyph::toFlatOutline (flat_outline &out) const {
+    out.clear ();
+    out.bb = bb;
+    out.instructions = instructions;
+    if (!figures.empty ())
+	out.order2 = figures.front ().order2;
+    for (auto &fig : figures)
+	fig.appendPoints (out);
+    for (auto &ref : refs) {
+	out.components.push_back ({
+	    ref.GID, ref.transform, ref.point_match, ref.round, ref.use_my_metrics,
+	    ref.match_pt_base, ref.match_pt_ref
+	});
+    }
+    out.numberOfContours = refs.empty () ? out.end_pts.size () : -1;
+}
+
+void ConicGlyph::unlinkMixedRefs () {
     static bool mixed_glyph_warned = false;
-    DBounds bb;
-    checkBounds (bb, true);
-    maxp_data &maxp_contents = maxp->contents;
 
     if (!figures.empty () && !refs.empty ()) {
 	if (!mixed_glyph_warned) {
@@ -625,11 +680,22 @@ uint32_t ConicGlyph::toTTF (QBuffer &buf, QDataStream &os, MaxpTable *maxp) {
 	}
 	unlinkRefs (false);
     }
+}
+
+// Glyph statistics are accumulated in 'stats' rather than stored directly
+// into the 'maxp' table, so that glyphs can be encoded by several threads,
+// each of them having its own copy. Note that the caller should call
+// unlinkMixedRefs () for all glyphs in advance in such a case, as unlinking
+// references modifies outlines
+uint32_t ConicGlyph::toTTF (QBuffer &buf, QDataStream &os, maxp_data &stats, bool elide_implied) {
+    unlinkMixedRefs ();
+    DBounds bb;
+    checkBounds (bb, true);
 
     int16_t ccnt = refs.size () ? -1 :
 	figures.size () ? figures.front ().contours.size () : 0;
-    if (ccnt > maxp->maxContours ())
-	maxp_contents.maxContours = ccnt;
+    if (ccnt > stats.maxContours)
+	stats.maxContours = ccnt;
     uint32_t startpos = buf.pos ();
 
     // No data for empty glyphs
@@ -642,41 +708,28 @@ uint32_t ConicGlyph::toTTF (QBuffer &buf, QDataStream &os, MaxpTable *maxp) {
     }
 
     if (figures.size ()) {
-	std::vector<int16_t> x_coords;
-	std::vector<int16_t> y_coords;
-	std::vector<uint8_t> flags;
+	std::vector<uint16_t> endpts;
+	std::vector<uint8_t> flags, x_data, y_data;
 
-	uint16_t ptcnt = figures.front ().toCoordList (x_coords, y_coords, flags, GID);
-	if (ptcnt > maxp->maxPoints ())
-	    maxp_contents.maxPoints = ptcnt;
+	// Implied points can only be dropped if nothing refers to them by number
+	uint16_t ptcnt = figures.front ().toCoordList (endpts, flags, x_data, y_data, GID,
+	    elide_implied && instructions.empty ());
+	if (ptcnt > stats.maxPoints)
+	    stats.maxPoints = ptcnt;
 
-	for (int i=0; i<ccnt; i++) {
-	    auto &spls = figures.front ().contours[i];
-	    os << spls.lastPointIndex ();
-	}
+	for (uint16_t end : endpts)
+	    os << end;
 	uint16_t instr_cnt = instructions.size ();
         os << instr_cnt;
-        if (instr_cnt > maxp->maxSizeOfInstructions ())
-    	maxp_contents.maxSizeOfInstructions = instr_cnt;
-        for (size_t j=0; j<instr_cnt; j++)
-	    os << instructions[j];
-        for (size_t j=0; j<flags.size (); j++)
-	    os << flags[j];
-        for (size_t j=0; j<x_coords.size (); j++) {
-	    if (x_coords[j] >= 0 && x_coords[j] < 256)
-		os << (uint8_t) x_coords[j];
-	    else
-		os << x_coords[j];
-        }
-        for (size_t j=0; j<y_coords.size (); j++) {
-	    if (y_coords[j] >= 0 && y_coords[j] < 256)
-		os << (uint8_t) y_coords[j];
-	    else
-		os << y_coords[j];
-	}
+        if (instr_cnt > stats.maxSizeOfInstructions)
+    	stats.maxSizeOfInstructions = instr_cnt;
+	os.writeRawData (reinterpret_cast<const char *> (instructions.data ()), instr_cnt);
+	os.writeRawData (reinterpret_cast<const char *> (flags.data ()), flags.size ());
+	os.writeRawData (reinterpret_cast<const char *> (x_data.data ()), x_data.size ());
+	os.writeRawData (reinterpret_cast<const char *> (y_data.data ()), y_data.size ());
     } else if (refs.size ()) {
-	if (refs.size () > maxp->maxComponentElements ())
-	    maxp_contents.maxComponentElements = refs.size ();
+	if (refs.size () > stats.maxComponentElements)
+	    stats.maxComponentElements = refs.size ();
 	size_t i=1;
 	for (auto &ref : refs) {
 	    uint16_t flags = 0;
@@ -737,19 +790,19 @@ uint32_t ConicGlyph::toTTF (QBuffer &buf, QDataStream &os, MaxpTable *maxp) {
 	    uint16_t comp_pt = numCompositePoints ();
 	    uint16_t comp_cc = numCompositeContours ();
 	    uint16_t comp_dp = componentDepth ();
-	    if (maxp->maxCompositePoints () < comp_pt)
-		maxp_contents.maxCompositePoints = comp_pt;
-	    if (maxp->maxCompositeContours () < comp_cc)
-		maxp_contents.maxCompositeContours = comp_cc;
-	    if (maxp->maxComponentDepth () < comp_dp)
-		maxp_contents.maxComponentDepth = comp_dp;
+	    if (stats.maxCompositePoints < comp_pt)
+		stats.maxCompositePoints = comp_pt;
+	    if (stats.maxCompositeContours < comp_cc)
+		stats.maxCompositeContours = comp_cc;
+	    if (stats.maxComponentDepth < comp_dp)
+		stats.maxComponentDepth = comp_dp;
 	    i++;
 	}
         if (instructions.size ()) {
 	    uint16_t instr_cnt = instructions.size ();
 	    os << instr_cnt;
-	    if (instr_cnt > maxp->maxSizeOfInstructions ())
-		maxp_contents.maxSizeOfInstructions = instr_cnt;
+	    if (instr_cnt > stats.maxSizeOfInstructions)
+		stats.maxSizeOfInstructions = instr_cnt;
 	    for (size_t j=0; j<instr_cnt; j++)
 		os << instructions[j];
         }
@@ -761,7 +814,6 @@ uint32_t ConicGlyph::toTTF (QBuffer &buf, QDataStream &os, MaxpTable *maxp) {
 	if (len&2)
 	    os << (uint16_t) 0;
     }
-    maxp->setModified (true);
     return buf.pos ();
 }
 
@@ -861,7 +913,85 @@ void ConicGlyph::findTop (BasePoint *top, std::array<double, 6> &transform) {
     }
 }
 
-void ConicGlyph::fromPS (BoostIn &buf, const struct cffcontext &ctx) {
+/* Decode a charstring operand, which starts with byte v (v>=32 or v==28) */
+static double read_cs_operand (SpanIn &buf, uint8_t v, bool is_type2) {
+    if (v==28)
+	return (int16_t) buf.getUShort ();
+    /* In the Dict tables of CFF, a 5byte fixed value is prefixed by a */
+    /*  29 code. In Type2 strings the prefix is 255. */
+    else if (v<=246)
+	return v - 139;
+    else if (v<=250)
+	return (v-247)*256 + (uint8_t) buf.get () + 108;
+    else if (v<=254)
+	return -(v-251)*256 - (uint8_t) buf.get () - 108;
+
+    /* 255 */
+    uint32_t val;
+    buf >> val;
+    /* GWW: The type2 spec is contradictory. It says this is a */
+    /*  two's complement number, but it also says it is a */
+    /*  Fixed, which in truetype is not two's complement */
+    /*  (mantisa is always unsigned) */
+    /* AMK: as I read the spec, it mentions a "16-bit signed */
+    /* integer with 16 bits of fraction". So mantissa is supposed */
+    /* to be unsigned indeed */
+    if (is_type2) {
+	uint16_t mant = val&0xffff;
+	return ((int16_t) (val>>16)) + mant/65536.;
+    }
+    return val;
+}
+
+// A charstring or subroutine being interpreted. If the subroutine has
+// been tokenized in advance, tokens are consumed first, and the rest of it
+// (if any) is then decoded from bytes, starting just past the last token
+struct ps_frame {
+    SpanIn buf;
+    const struct cs_token *tok, *tok_end;
+
+    ps_frame (const SpanIn &span) : buf (span), tok (nullptr), tok_end (nullptr) {};
+    ps_frame (const char *data, size_t len,
+	const struct cs_token *start=nullptr, const struct cs_token *end=nullptr) :
+	buf (data, len), tok (start), tok_end (end) {};
+};
+
+void ConicGlyph::tokenizeSubrs (const struct pschars &subrs, struct subr_tokens &out, double version) {
+    bool is_type2 = (version > 0);
+
+    out.tokens.clear ();
+    out.starts.clear ();
+    out.starts.reserve (subrs.css.size () + 1);
+    for (auto &cs : subrs.css) {
+	SpanIn buf (cs.data (), cs.size ());
+	bool stop = false;
+
+	out.starts.push_back (out.tokens.size ());
+	while (!stop && !buf.atEnd ()) {
+	    struct cs_token tok = { 0, 0, 0, 0 };
+	    uint8_t v = buf.getByte ();
+	    if (v>=32 || v==28) {
+		tok.op = cs_token::operand;
+		tok.val = read_cs_operand (buf, v, is_type2);
+	    } else {
+		tok.op = v;
+		if (v==12)
+		    tok.esc = buf.getByte ();
+		// The length of a hintmask depends on the caller. Nothing
+		// is executed after return or endchar
+		stop = (v==19 || v==20 || v==11 || v==14);
+	    }
+	    // Leave truncated data to the interpreter, so that it is reported
+	    if (buf.fail ())
+		break;
+	    tok.end = buf.pos ();
+	    out.tokens.push_back (tok);
+	}
+    }
+    out.starts.push_back (out.tokens.size ());
+}
+
+void ConicGlyph::fromPS (SpanIn &buf, const struct cffcontext &ctx) {
     /* GWW: Type1 stack is about 25 long, Type2 stack is 48 */
     // AMK: increased to 513 in CFF v2
     uint16_t max_stack = ctx.version > 1 ? 513 : 48;
@@ -873,21 +1003,26 @@ void ConicGlyph::fromPS (BoostIn &buf, const struct cffcontext &ctx) {
     double dx, dy, dx2, dy2, dx3, dy3, dx4, dy4, dx5, dy5, dx6, dy6;
     ConicPoint *pt;
     /* GWW: subroutines may be nested to a depth of 10 */
-    std::vector<BoostIn *> buf_stack;
+    std::vector<struct ps_frame> buf_stack;
     std::array<double, 30> pops;
     int popsp=0;
     int base, polarity;
     double coord;
     const struct pschars *s;
+    const struct subr_tokens *st;
     std::unique_ptr<HintMask> pending_hm;
     int cp=0;
     int sp=0;
     uint8_t v;
+    bool escaped;
     bool is_type2 = (ctx.version > 0);
+    // Keep the current variation store index local, so that glyphs
+    // sharing the same context can be decoded simultaneously
+    uint16_t vsindex = ctx.pdict.has_key (cff::vsindex) ? ctx.pdict[cff::vsindex].i : 0;
 
     stack.resize (max_stack+2);
     buf_stack.reserve (11);
-    buf_stack.push_back (&buf);
+    buf_stack.push_back (buf);
 
     if (!widthset) m_aw = 0x8000;
     current.x = current.y = 0;
@@ -898,13 +1033,12 @@ void ConicGlyph::fromPS (BoostIn &buf, const struct cffcontext &ctx) {
     figures.back ().type = "path";
     figures.back ().order2 = false;
     std::vector<ConicPointList> &conics = figures. back ().contours;
-    boost::object_pool<ConicPoint> &points_pool = figures.back ().points_pool;
-    boost::object_pool<Conic> &splines_pool = figures.back ().splines_pool;
+    FontShepherd::ObjectArena<ConicPoint> &points_pool = figures.back ().points_pool;
+    FontShepherd::ObjectArena<Conic> &splines_pool = figures.back ().splines_pool;
 
-    while (!(buf_stack.size () == 1 && (int) buf_stack.back ()->peek () == EOF)) {
-	if ((int) buf_stack.back ()->peek () == EOF) {
+    while (!(buf_stack.size () == 1 && (int) buf_stack.back ().buf.peek () == EOF)) {
+	if ((int) buf_stack.back ().buf.peek () == EOF) {
 	    if (ctx.version > 1) {
-		delete buf_stack.back ();
 		buf_stack.pop_back ();
 		continue;
 	    } else
@@ -915,35 +1049,28 @@ void ConicGlyph::fromPS (BoostIn &buf, const struct cffcontext &ctx) {
 	    sp = max_stack;
 	}
 	base = 0;
-	if ((v = buf_stack.back ()->get ())>=32) {
-	    if (v<=246) {
-		stack[sp++] = v - 139;
-	    } else if (v<=250) {
-		stack[sp++] =  (v-247)*256 + (uint8_t) buf_stack.back ()->get () + 108;
-	    } else if (v<=254) {
-		stack[sp++] = -(v-251)*256 - (uint8_t) buf_stack.back ()->get () - 108;
-	    } else { /* 255 */
-		uint32_t val;
-                *buf_stack.back () >> val;
-		stack[sp++] = val;
-      		/* GWW: The type2 spec is contradictory. It says this is a */
-      		/*  two's complement number, but it also says it is a */
-      		/*  Fixed, which in truetype is not two's complement */
-      		/*  (mantisa is always unsigned) */
-		/* AMK: as I read the spec, it mentions a "16-bit signed */
-		/* integer with 16 bits of fraction". So mantissa is supposed */
-		/* to be unsigned indeed */
-		if (is_type2) {
-		    uint16_t mant = val&0xffff;
-		    stack[sp-1] = ((int16_t) (val>>16)) + mant/65536.;
-		}
+	escaped = false;
+	struct ps_frame &fr = buf_stack.back ();
+	if (fr.tok != fr.tok_end) {
+	    const struct cs_token &tok = *fr.tok++;
+	    fr.buf.seek (tok.end);
+	    if (tok.op == cs_token::operand) {
+		stack[sp++] = tok.val;
+		continue;
 	    }
-	} else if (v==28) {
-	    stack[sp++] = (short) ((uint8_t) buf_stack.back ()->get ()<<8 | (uint8_t) buf_stack.back ()->get ());
-	/* In the Dict tables of CFF, a 5byte fixed value is prefixed by a */
-	/*  29 code. In Type2 strings the prefix is 255. */
+	    v = tok.op;
+	    if (v==12) {
+		v = tok.esc;
+		escaped = true;
+	    }
+	} else if ((v = fr.buf.get ())>=32 || v==28) {
+	    stack[sp++] = read_cs_operand (fr.buf, v, is_type2);
+	    continue;
 	} else if (v==12) {
-	    v = buf_stack.back ()->get ();
+	    v = fr.buf.get ();
+	    escaped = true;
+	}
+	if (escaped) {
 	    switch (v) {
 	      case 0: /* dotsection */
 		if (is_type2)
@@ -1449,7 +1576,7 @@ void ConicGlyph::fromPS (BoostIn &buf, const struct cffcontext &ctx) {
 		    HintMask tocopy = HintMask ();
 		    if (bytes>sizeof (HintMask)) bytes = sizeof (HintMask);
 		    for (i=0; i<bytes; i++)
-			*buf_stack.back () >> tocopy[i];
+			buf_stack.back ().buf >> tocopy[i];
 		    if (v==19) {
 			if (!pending_hm)
 			    pending_hm = std::unique_ptr<HintMask> (new HintMask (tocopy));
@@ -1470,9 +1597,7 @@ void ConicGlyph::fromPS (BoostIn &buf, const struct cffcontext &ctx) {
 		    m_aw = stack[0];
 		if (ctx.painttype!=2)
 		    figures.back ().closepath (cur, is_type2);
-		for (size_t i=1; i<buf_stack.size (); i++)
-		    delete buf_stack[i];
-		buf_stack.resize (1);
+		buf_stack.erase (buf_stack.begin () + 1, buf_stack.end ());
 		if (sp==4) {
 		    /* GWW: In Type2 strings endchar has a depreciated function of doing */
 		    /*  a seac (which doesn't exist at all). Except endchar takes */
@@ -1724,46 +1849,62 @@ void ConicGlyph::fromPS (BoostIn &buf, const struct cffcontext &ctx) {
 		    break;
 		}
 		s = &ctx.lsubrs;
-		if (v==29) s = &ctx.gsubrs;
+		st = ctx.ltokens;
+		if (v==29) {
+		    s = &ctx.gsubrs;
+		    st = ctx.gtokens;
+		}
 		if (s) stack[sp-1] += s->bias;
 		/* GWW: Type2 subrs have a bias that must be added to the subr-number */
 		/* Type1 subrs do not. We set the bias on them to 0 */
-		if (!s || stack[sp-1]>=s->cnt || stack[sp-1]<0 || s->css[(int) stack[sp-1]].sdata.empty ()) {
+		if (!s || stack[sp-1]>=s->cnt || stack[sp-1]<0 || s->css[(int) stack[sp-1]].empty ()) {
 		    FontShepherd::postError (tr ("Subroutine number out of bounds in %1").arg (GID));
 		} else {
-		    uint16_t len = s->css[(int) stack[sp-1]].sdata.length ();
-		    buf_stack.push_back (new BoostIn (s->css[(int) stack[sp-1]].sdata.c_str (), len));
+		    int idx = stack[sp-1];
+		    const struct charstring &subr = s->css[idx];
+		    if (st && (size_t) idx+1 < st->starts.size ())
+			buf_stack.emplace_back (subr.data (), subr.size (),
+			    st->tokens.data () + st->starts[idx], st->tokens.data () + st->starts[idx+1]);
+		    else
+			buf_stack.emplace_back (subr.data (), subr.size ());
 		}
 		if (--sp<0) sp = 0;
               break;
               case 11: /* return */
 		/* return from a subroutine */
-		if (buf_stack.size () < 1)
+		if (buf_stack.size () < 2)
 		    FontShepherd::postError (tr ("return when not in subroutine in %1").arg (GID));
-		else {
-		    delete buf_stack.back ();
+		else
 		    buf_stack.pop_back ();
-		}
 		if (ctx.version > 1)
 		    FontShepherd::postError (tr ("return is deprecated for CFF2: found in %1").arg (GID));
 	      break;
 	      // vsindex -- added in CFF2
 	      case 15:
-		ctx.vstore.index = stack[sp-1];
+		vsindex = stack[sp-1];
 	      break;
 	      // blend -- obsolete multiple master operator, now relevant again for CFF2
               case 16:
 		if (ctx.version < 2) {
 		    FontShepherd::postError (tr ("Attempt to use a multiple master subroutine in a non-mm font."));
 		} else {
-		    // Currently just attemting to skip the deltas and show the default design,
-		    // but it is not so trivial to do this correctly
+		    // Show the default design, unless the deltas are to be applied
+		    // for a specific instance. In the latter case values from
+		    // the bottom of the operand list are adjusted in place
 		    double n_base = stack[sp-1];
-		    if (ctx.vstore.data.size () > ctx.vstore.index) {
-			int n_regions = ctx.vstore.data[ctx.vstore.index].regionIndexes.size ();
-			if (sp >= n_base*(n_regions+1) + 1)
+		    if (ctx.vstore.data.size () > vsindex) {
+			int n_regions = ctx.vstore.data[vsindex].regionIndexes.size ();
+			if (sp >= n_base*(n_regions+1) + 1) {
+			    if (ctx.scalars && ctx.scalars->size () > vsindex) {
+				const std::vector<double> &scalars = (*ctx.scalars)[vsindex];
+				int cnt = n_base;
+				int first = sp - 1 - cnt*(n_regions+1);
+				const double *deltas = &stack[first + cnt];
+				for (int i=0; i<cnt; i++)
+				    stack[first+i] += FontVariations::applyDeltas (deltas + i*n_regions, scalars, n_regions);
+			    }
 			    sp -= (n_base*(n_regions) + 1);
-			else
+			} else
 			    FontShepherd::postError (tr (
 				"Stack depth on blend operator is %1, while at least %2 is expected.")
 				.arg (sp).arg (n_base*(n_regions+1) + 1));
@@ -2126,13 +2267,11 @@ static BasePoint ps_encode_contour (std::vector<std::pair<int, std::string>> &sp
     return (spls.last->me);
 }
 
-void ConicGlyph::splitToPS (std::vector<std::pair<int, std::string>> &splitted, const struct cffcontext &ctx) {
-    const PrivateDict &pd = ctx.pdict;
-    int stdw = pd.has_key (cff::defaultWidthX) ? pd[cff::defaultWidthX].i : 0;
-    int nomw = pd.has_key (cff::nominalWidthX) ? pd[cff::defaultWidthX].i : 0;
-    int version = ctx.version;
+// Glyph references aren't supported by CFF, so they are converted to splines.
+// This reads other glyphs and may show a warning, so has to be done from
+// the main thread before glyphs are split in parallel
+void ConicGlyph::unlinkRefsForPS () {
     static bool refs_warned = false;
-    std::stringstream ss;
 
     if (!refs.empty ()) {
 	if (!refs_warned) {
@@ -2146,6 +2285,16 @@ void ConicGlyph::splitToPS (std::vector<std::pair<int, std::string>> &splitted,
 	}
 	unlinkRefs (false);
     }
+}
+
+void ConicGlyph::splitToPS (std::vector<std::pair<int, std::string>> &splitted, const struct cffcontext &ctx) {
+    const PrivateDict &pd = ctx.pdict;
+    int stdw = pd.has_key (cff::defaultWidthX) ? pd[cff::defaultWidthX].i : 0;
+    int nomw = pd.has_key (cff::nominalWidthX) ? pd[cff::defaultWidthX].i : 0;
+    int version = ctx.version;
+    std::stringstream ss;
+
+    unlinkRefsForPS ();
 
     if (version < 2 && this->advanceWidth () != stdw) {
         CffTable::encodeInt (ss, this->advanceWidth () - nomw);
@@ -2226,12 +2375,15 @@ bool ConicGlyph::isEmpty () {
 }
 
 bool ConicGlyph::isModified () const {
-    return !m_undoStack->isClean ();
+    return m_history ? !m_history->isClean () : m_modified;
 }
 
 void ConicGlyph::setModified (bool val) {
-    if (val) m_undoStack->resetClean ();
-    else m_undoStack->setClean ();
+    m_modified = val;
+    if (m_history) {
+	if (val) m_history->resetClean ();
+	else m_history->setClean ();
+    }
 }
 
 void ConicGlyph::setOutlinesType (OutlinesType val) {
@@ -2317,8 +2469,16 @@ OutlinesType ConicGlyph::outlinesType () const {
     return m_outType;
 }
 
-QUndoStack *ConicGlyph::undoStack () {
-    return m_undoStack.get ();
+GlyphHistory *ConicGlyph::history () {
+    return m_history.get ();
+}
+
+void ConicGlyph::setHistory (GlyphHistory *hist) {
+    if (hist) {
+	if (m_modified) hist->resetClean ();
+	else hist->setClean ();
+    }
+    m_history.reset (hist);
 }
 
 void DrawableReference::setGlyph (ConicGlyph *g) {
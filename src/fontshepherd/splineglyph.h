@@ -35,8 +35,8 @@
 #include <boost/pool/object_pool.hpp>
 #include <pugixml.hpp>
 #include <QtCore>
-#include <QUndoStack>
 #include "charbuffer.h"
+#include "fs_arena.h"
 
 #include "colors.h"
 #include "cffstuff.h"
@@ -49,6 +49,7 @@
 #define _Repeat		8
 #define _X_Same		0x10
 #define _Y_Same		0x20
+#define _Overlap_Simple	0x40	/* only meaningful for the first point */
 
 typedef long double extended_t;
 typedef struct ttffont sFont;
@@ -294,9 +295,9 @@ public:
     extended_t secondDerivative (extended_t t) const;
 
     static std::vector<TPoint> figureTPsBetween (ConicPoint *from, ConicPoint *to);
-    static Conic * approximateFromPoints (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2);
-    static Conic * approximateFromPointsSlopes (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2);
-    static Conic * isLinearApprox (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2);
+    static Conic * approximateFromPoints (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2, FontShepherd::ObjectArena<Conic> &pool);
+    static Conic * approximateFromPointsSlopes (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2, FontShepherd::ObjectArena<Conic> &pool);
+    static Conic * isLinearApprox (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2, FontShepherd::ObjectArena<Conic> &pool);
     static const double CURVATURE_ERROR;
 
 private:
@@ -386,6 +387,8 @@ public:
     virtual void realBounds (DBounds &b, bool do_init=false) = 0;
 };
 
+struct flat_outline;
+
 class DrawableFigure : public Drawable {
     friend class ConicGlyph;
     friend class GlyphContext;
@@ -398,7 +401,9 @@ public:
     uint16_t countPoints (const uint16_t first=0, bool ttf=false) const;
     uint16_t renumberPoints (const uint16_t first=0);
     ConicPointList *getPointContour (ConicPoint *sp);
-    uint16_t toCoordList (std::vector<int16_t> &x_coords, std::vector<int16_t> &y_coords, std::vector<uint8_t> &flags, uint16_t gid);
+    uint16_t toCoordList (std::vector<uint16_t> &endpts, std::vector<uint8_t> &flags,
+	std::vector<uint8_t> &x_data, std::vector<uint8_t> &y_data, uint16_t gid, bool elide_implied=false);
+    void appendPoints (flat_outline &out) const;
 
     void svgClosePath (ConicPointList *cur, bool order2);
     void svgReadPointProps (const std::string &pp, int hintcnt);
@@ -419,6 +424,7 @@ public:
     void toCubic ();
 
     void clearHintMasks ();
+    size_t memoryUsage () const;
 
     bool addExtrema (bool selected);
     bool roundToInt (bool selected);
@@ -448,8 +454,8 @@ private:
     void forceLines (ConicPointList &spls, extended_t bump_size, int upm);
     void ssSimplify (ConicPointList &spls, int upm, double lenmax2);
 
-    boost::object_pool<ConicPoint> points_pool;
-    boost::object_pool<Conic> splines_pool;
+    FontShepherd::ObjectArena<ConicPoint> points_pool;
+    FontShepherd::ObjectArena<Conic> splines_pool;
 };
 
 class ConicGlyph;
@@ -469,8 +475,8 @@ public:
     OutlinesType outType = OutlinesType::NONE;
     // for GUI: that's where the source glyph name is going to be displayed
     BasePoint top;
-    ConicGlyph *cc;
-    RefItem *item;
+    ConicGlyph *cc = nullptr;
+    RefItem *item = nullptr;
 
     void setGlyph (ConicGlyph *g);
     ElementType elementType () const override;
@@ -494,6 +500,38 @@ typedef struct base_glyph_metrics {
     uint16_t ascent, descent;
 } BaseMetrics;
 
+struct flat_component {
+    uint16_t GID;
+    std::array<double, 6> transform;
+    bool point_match, round, use_my_metrics;
+    uint16_t match_pt_base, match_pt_ref;
+};
+
+// Immutable outline form for read-only bulk work, such as collecting statistics
+// or executing glyph programs: coordinates of all points are stored in contiguous
+// arrays rather than in linked ConicPoint/Conic lists. Points of quadratic
+// outlines are numbered as in the 'glyf' table, cubic curves have two off-curve
+// points each
+struct flat_outline {
+    bool order2 = true;
+    int16_t numberOfContours = 0;	// -1 for composite glyphs
+    bool overlap = false;		// OVERLAP_SIMPLE was set on the first point
+    DBounds bb = { 0, 0, 0, 0 };
+    std::vector<double> x, y;
+    std::vector<uint8_t> on_curve;
+    std::vector<uint16_t> end_pts;
+    std::vector<flat_component> components;
+    std::vector<uint8_t> instructions;
+
+    void clear ();
+    uint16_t numPoints () const;
+    void addPoint (const BasePoint &pt, bool on);
+    void calcBounds (DBounds &b) const;
+    void append (const flat_outline &other, const std::array<double, 6> &transform);
+    uint16_t toTTF (std::vector<uint16_t> &endpts, std::vector<uint8_t> &flags,
+	std::vector<uint8_t> &x_data, std::vector<uint8_t> &y_data, bool elide_implied=false) const;
+};
+
 struct pschars;
 class GlyphGraphicsView;
 class AdvanceWidthItem;
@@ -501,6 +539,7 @@ class CffTable;
 class ColrTable;
 class CpalTable;
 class MaxpTable;
+struct maxp_data;
 class MoveCommand;
 
 namespace SVGOptions {
@@ -515,6 +554,17 @@ namespace SVGOptions {
 
 class GlyphContainer;
 
+// Edit history of a glyph. The GUI attaches an undo stack to each glyph it
+// displays, and the glyph is then modified as long as the stack isn't clean
+class GlyphHistory {
+public:
+    virtual ~GlyphHistory () {};
+
+    virtual bool isClean () const = 0;
+    virtual void setClean () = 0;
+    virtual void resetClean () = 0;
+};
+
 class ConicGlyph {
     Q_DECLARE_TR_FUNCTIONS (ConicGlyph)
     friend class MoveCommand;
@@ -528,10 +578,15 @@ public:
     ConicGlyph (uint16_t gid, BaseMetrics gm);
     ~ConicGlyph ();
 
-    void fromPS (BoostIn &buf, const struct cffcontext &ctx);
-    void fromTTF (BoostIn &buf, uint32_t off);
-    uint32_t toTTF (QBuffer &buf, QDataStream &os, MaxpTable *maxp);
+    void fromPS (SpanIn &buf, const struct cffcontext &ctx);
+    static void tokenizeSubrs (const struct pschars &subrs, struct subr_tokens &out, double version);
+    void fromTTF (SpanIn &buf, uint32_t off);
+    static bool readFlatTTF (SpanIn &buf, flat_outline &out, uint16_t gid, uint32_t off);
+    void fromFlatOutline (const flat_outline &fo);
+    void toFlatOutline (flat_outline &out) const;
+    uint32_t toTTF (QBuffer &buf, QDataStream &os, maxp_data &stats, bool elide_implied=false);
     uint32_t toPS (QBuffer &buf, QDataStream &os, const struct cffcontext &ctx);
+    void unlinkRefsForPS ();
     void splitToPS (std::vector<std::pair<int, std::string>> &splitted, const struct cffcontext &ctx);
 
     // g_idx: if -1, then look for element with id 'glyph<GID>', as defined in the
@@ -560,12 +615,15 @@ public:
     uint16_t getTTFPoint (uint16_t pnum, uint16_t add, BasePoint *&pt);
     void unlinkRef (DrawableReference &ref);
     void unlinkRefs (bool selected);
+    void unlinkMixedRefs ();
 
     uint16_t gid ();
     uint16_t upm ();
     int leftSideBearing ();
     int advanceWidth ();
-    QUndoStack *undoStack ();
+    GlyphHistory *history ();
+    // Takes ownership of the object
+    void setHistory (GlyphHistory *hist);
     const PrivateDict *privateDict () const;
     OutlinesType outlinesType () const;
 
@@ -613,9 +671,9 @@ private:
     void svgAsRef (std::stringstream &ss, uint8_t flags);
 
     Conic* conicMake (ConicPoint *from, ConicPoint *to, bool order2);
-    void ttfBuildContours (int path_cnt, uint16_t *endpt, uint8_t *flags, std::vector<BasePoint> &pts);
-    void readttfsimpleglyph (BoostIn &buf, int path_cnt, uint32_t off);
-    void readttfcompositeglyph (BoostIn &buf);
+    void ttfBuildContours (const flat_outline &fo);
+    static void readttfsimpleglyph (SpanIn &buf, flat_outline &out, uint16_t gid, uint32_t off);
+    static void readttfcompositeglyph (SpanIn &buf, flat_outline &out, uint16_t gid);
     void categorizePoints ();
     uint16_t appendHint (double start, double width, bool is_v);
     bool hasHintMasks ();
@@ -650,5 +708,6 @@ private:
     std::list<DrawableReference> refs;
     std::vector<ConicGlyph*> dependents;
     std::vector <HintMask> countermasks;
-    std::unique_ptr<QUndoStack> m_undoStack;
+    bool m_modified = false;
+    std::unique_ptr<GlyphHistory> m_history;
 };
@@ -1357,8 +1357,8 @@ void ConicGlyph::svgParsePath (DrawableFigure &fig, const std::string &d) {
     std::stringstream ss;
 
     std::vector<ConicPointList> &conics = fig.contours;
-    boost::object_pool<ConicPoint> &points_pool = fig.points_pool;
-    boost::object_pool<Conic> &splines_pool = fig.splines_pool;
+    FontShepherd::ObjectArena<ConicPoint> &points_pool = fig.points_pool;
+    FontShepherd::ObjectArena<Conic> &splines_pool = fig.splines_pool;
 
     current.x = current.y = 0;
     ss.str (d);
@@ -1587,8 +1587,8 @@ void ConicGlyph::svgParseEllipse (DrawableFigure &fig, bool inv) {
     ConicPoint *sp;
     ConicPointList cur;
     double x_ctl_off, y_ctl_off;
-    boost::object_pool<ConicPoint> &points_pool = fig.points_pool;
-    boost::object_pool<Conic> &splines_pool = fig.splines_pool;
+    FontShepherd::ObjectArena<ConicPoint> &points_pool = fig.points_pool;
+    FontShepherd::ObjectArena<Conic> &splines_pool = fig.splines_pool;
     auto &conics = fig.contours;
 
     if (fig.type.compare ("circle") == 0 && fig.props.count ("r")) {
@@ -1653,8 +1653,8 @@ void ConicGlyph::svgParseRect (DrawableFigure &fig, bool inv) {
     double height = fig.props["height"];
     double rx = fig.props.count ("rx") ? fig.props["rx"] : 0;
     double ry = fig.props.count ("ry") ? fig.props["ry"] : rx;
-    boost::object_pool<ConicPoint> &points_pool = fig.points_pool;
-    boost::object_pool<Conic> &splines_pool = fig.splines_pool;
+    FontShepherd::ObjectArena<ConicPoint> &points_pool = fig.points_pool;
+    FontShepherd::ObjectArena<Conic> &splines_pool = fig.splines_pool;
     auto &conics = fig.contours;
 
     if (2*rx>width) rx = width/2;
@@ -1750,8 +1750,8 @@ void ConicGlyph::svgParseLine (DrawableFigure &fig) {
     ConicPointList cur = ConicPointList ();
     conics.push_back (cur);
     ConicPointList &newss = conics.back ();
-    boost::object_pool<ConicPoint> &points_pool = fig.points_pool;
-    boost::object_pool<Conic> &splines_pool = fig.splines_pool;
+    FontShepherd::ObjectArena<ConicPoint> &points_pool = fig.points_pool;
+    FontShepherd::ObjectArena<Conic> &splines_pool = fig.splines_pool;
 
     newss.first = points_pool.construct (fig.props["x1"], fig.props["y1"]);
     newss.first->isfirst = true;
@@ -1763,8 +1763,8 @@ void ConicGlyph::svgParsePoly (DrawableFigure &fig, bool is_gon) {
     ConicPoint *sp;
     ConicPointList cur;
     uint32_t i;
-    boost::object_pool<ConicPoint> &points_pool = fig.points_pool;
-    boost::object_pool<Conic> &splines_pool = fig.splines_pool;
+    FontShepherd::ObjectArena<ConicPoint> &points_pool = fig.points_pool;
+    FontShepherd::ObjectArena<Conic> &splines_pool = fig.splines_pool;
     auto &conics = fig.contours;
 
     if (fig.points.empty ())
@@ -30,10 +30,11 @@
 #include <cctype>
 #include <assert.h>
 #include <set>
+#include <array>
+#include <limits>
 
 #include "splineglyph.h"
 #include "stemdb.h"
-#include "editors/glyphcontext.h"
 #include "fs_notify.h"
 #include "fs_math.h"
 
@@ -2472,7 +2473,7 @@ bool Conic::_approximateFromPoints (ConicPoint *from, ConicPoint *to,
     return ret;
 }
 
-Conic *Conic::isLinearApprox (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2) {
+Conic *Conic::isLinearApprox (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2, FontShepherd::ObjectArena<Conic> &pool) {
     double vx, vy, slope;
 
     vx = to->me.x-from->me.x; vy = to->me.y-from->me.y;
@@ -2492,7 +2493,7 @@ Conic *Conic::isLinearApprox (ConicPoint *from, ConicPoint *to, std::vector<TPoi
 		return nullptr;
     }
     from->nonextcp = to->noprevcp = true;
-    return new Conic (from, to, order2);
+    return pool.construct (from, to, order2);
 }
 
 /* GWW: Find a spline which best approximates the list of intermediate points we */
@@ -2532,7 +2533,7 @@ Conic *Conic::isLinearApprox (ConicPoint *from, ConicPoint *to, std::vector<TPoi
 /*        Σ (t-2*t^2) * [Pf - 2*Pf*t + Pf*t^2 + Pt*t^2 - Pi] */
 /* CP = ----------------------------------------------------- */
 /*                    Σ 2*(t-2*t^2)*(t-2*t^2)                */
-Conic *Conic::approximateFromPoints (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2) {
+Conic *Conic::approximateFromPoints (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2, FontShepherd::ObjectArena<Conic> &pool) {
     int ret;
     Conic *spline;
     BasePoint nextcp, prevcp;
@@ -2551,7 +2552,7 @@ Conic *Conic::approximateFromPoints (ConicPoint *from, ConicPoint *to, std::vect
 	    BasePoint cp;
 	    cp.x = xconst/term; cp.y = yconst/term;
 	    from->nextcp = to->prevcp = cp;
-	    return new Conic (from,to, true);
+	    return pool.construct (from,to, true);
 	}
     } else {
 	double xconst[2], yconst[2], f_term[2], t_term[2] /* Same for x and y */;
@@ -2585,11 +2586,11 @@ Conic *Conic::approximateFromPoints (ConicPoint *from, ConicPoint *to, std::vect
 		from->nextcp.y = (-yconst[1]-t_term[1]*to->prevcp.y)/f_term[1];
 	    }
 	    to->noprevcp = from->nonextcp = false;
-	    return new Conic (from, to, false);
+	    return pool.construct (from, to, false);
 	}
     }
 
-    if ((spline = Conic::isLinearApprox (from, to, mid, order2))!=nullptr)
+    if ((spline = Conic::isLinearApprox (from, to, mid, order2, pool))!=nullptr)
 	return spline;
 
     ret = Conic::_approximateFromPoints (from, to, mid, &nextcp, &prevcp, order2);
@@ -2608,7 +2609,7 @@ Conic *Conic::approximateFromPoints (ConicPoint *from, ConicPoint *to, std::vect
 	to->prevcp = to->me;
 	to->noprevcp = true;
     }
-    spline = new Conic (from,to,order2);
+    spline = pool.construct (from,to,order2);
     spline->testForLinear ();
     return spline;
 }
@@ -2658,7 +2659,7 @@ Conic *Conic::approximateFromPoints (ConicPoint *from, ConicPoint *to, std::vect
 /*  improve it further yet */
 #define TRY_CNT		2
 #define DECIMATION	5
-Conic *Conic::approximateFromPointsSlopes (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2) {
+Conic *Conic::approximateFromPointsSlopes (ConicPoint *from, ConicPoint *to, std::vector<TPoint> &mid, bool order2, FontShepherd::ObjectArena<Conic> &pool) {
     BasePoint tounit, fromunit, ftunit;
     double flen, tlen, ftlen, dot;
     Conic *spline, temp;
@@ -2696,7 +2697,7 @@ Conic *Conic::approximateFromPointsSlopes (ConicPoint *from, ConicPoint *to, std
 	    ((to->nonextcp && to->noprevcp) || !to->nonextcp)))
 	) {
 	from->pointtype = to->pointtype = pt_corner;
-	return Conic::approximateFromPoints (from, to, mid, order2);
+	return Conic::approximateFromPoints (from, to, mid, order2, pool);
     }
 
     /* If we are going to honour the slopes of a quadratic spline, there is */
@@ -2718,12 +2719,12 @@ Conic *Conic::approximateFromPointsSlopes (ConicPoint *from, ConicPoint *to, std
 	    from->nonextcp = to->noprevcp = true;
 	    from->nextcp = from->me;
 	    to->prevcp = to->me;
-	    ret = new Conic (from, to, true);
+	    ret = pool.construct (from, to, true);
 	    ret->testForLinear ();
 	} else {
 	    from->nextcp = to->prevcp = nextcp;
 	    from->nonextcp = to->noprevcp = false;
-	    ret = new Conic (from, to, true);
+	    ret = pool.construct (from, to, true);
 	}
 	return ret;
     }
@@ -2755,7 +2756,7 @@ Conic *Conic::approximateFromPointsSlopes (ConicPoint *from, ConicPoint *to, std
 		to->prevcp.y = to->me.y + poff.y;
 	    }
 	}
-	return new Conic (from, to, false);
+	return pool.construct (from, to, false);
     }
 
     if (to->prev && (( to->noprevcp && to->nonextcp ) || to->prev->islinear)) {
@@ -2817,7 +2818,7 @@ Conic *Conic::approximateFromPointsSlopes (ConicPoint *from, ConicPoint *to, std
 	/* It's a line. Slopes are parallel, and parallel to vector between (from,to) */
 	from->nonextcp = to->noprevcp = true;
 	from->nextcp = from->me; to->prevcp = to->me;
-	return new Conic (from, to, false);
+	return pool.construct (from, to, false);
     }
 
     pt_pf_x = to->me.x - from->me.x;
@@ -2869,7 +2870,7 @@ Conic *Conic::approximateFromPointsSlopes (ConicPoint *from, ConicPoint *to, std
 	    to->prevcp.y = to->me.y - rt*tounit.y;
 	    from->nonextcp = rf==0;
 	    to->noprevcp = rt==0;
-	    return new Conic (from, to, false);
+	    return pool.construct (from, to, false);
 	}
     }
 
@@ -2932,7 +2933,7 @@ Conic *Conic::approximateFromPointsSlopes (ConicPoint *from, ConicPoint *to, std
 
     finaldiff = 1e20;
     offn_ = offp_ = -1;
-    spline = new Conic (from, to, false);
+    spline = pool.construct (from, to, false);
     for (int k=-1; k<TRY_CNT; ++k) {
 	if (k<0) {
 	    BasePoint nextcp, prevcp;
@@ -3488,6 +3489,11 @@ ConicPointList *DrawableFigure::getPointContour (ConicPoint *sp) {
     return nullptr;
 }
 
+// Memory taken by points and splines, including unused slots of the arenas
+size_t DrawableFigure::memoryUsage () const {
+    return points_pool.memoryUsage () + splines_pool.memoryUsage ();
+}
+
 void DrawableFigure::clearHintMasks () {
     for (ConicPointList &spls: contours) {
 	ConicPoint *sp = spls.first;
@@ -4068,7 +4074,7 @@ void DrawableFigure::splinesRemoveBetween (ConicPoint *from, ConicPoint *to) {
     oldfrom = *from;
     tp = Conic::figureTPsBetween (from, to);
 
-    Conic::approximateFromPointsSlopes (from, to, tp, order2);
+    Conic::approximateFromPointsSlopes (from, to, tp, order2, splines_pool);
 
     /* GWW: Have to do the frees after the approximation because the approx */
     /*  uses the splines to determine slopes */
@@ -4164,115 +4170,262 @@ bool DrawableFigure::join (bool doall, double fudge) {
     return changed;
 }
 
-static int val_to_ttf (const double val, double &prev, uint8_t &flag, const bool is_x) {
-    int diff = rint (val) - rint (prev);
-    prev = val;
+// Ways to store a coordinate delta: omitted (zero only), a byte with the sign
+// in the flag (magnitudes up to 255, including zero), or a signed word
+struct ttf_coord_mode {
+    uint8_t bits;
+    uint8_t size;
+};
+
+static int ttfCoordModes (int32_t delta, bool is_x, ttf_coord_mode modes[3]) {
     uint8_t same_flag  = is_x ? _X_Same : _Y_Same;
     uint8_t short_flag = is_x ? _X_Short : _Y_Short;
-    if (diff == 0) {
-        flag |= same_flag;
-    } else if (diff > 0 && diff < 256) {
-        flag |= short_flag;
-        flag |= same_flag;
-    } else if (diff > -256 && diff < 0) {
-        diff = abs (diff);
-        flag |= short_flag;
-    }
-    return diff;
-}
-
-uint16_t DrawableFigure::toCoordList (std::vector<int16_t> &x_coords,
-    std::vector<int16_t> &y_coords, std::vector<uint8_t> &flags, uint16_t gid) {
-    double last_x = 0, last_y = 0;
-    int diff_x, diff_y;
-    const int tot = renumberPoints (0);
-    x_coords.reserve (tot);
-    y_coords.reserve (tot);
-    flags.reserve (tot);
-    int ptcnt = 0, repeat, startcnt;
-    bool last_repeat = false;
-    uint8_t flag;
+    int cnt = 0;
+    if (delta == 0)
+	modes[cnt++] = { same_flag, 0 };
+    if (delta > -256 && delta < 256)
+	modes[cnt++] = { static_cast<uint8_t> (short_flag | (delta >= 0 ? same_flag : 0)), 1 };
+    modes[cnt++] = { 0, 2 };
+    return cnt;
+}
 
-    for (ConicPointList &spls: contours) {
-	ConicPoint *sp = spls.first, *nextsp;
-	startcnt = ptcnt;
-	repeat = 0;
-
-	if (sp->ttfindex == -1 && sp->prev && !sp->noprevcp) {
-	    flag = 0;
-	    diff_x = val_to_ttf (sp->prevcp.x, last_x, flag, true);
-	    if (diff_x)
-		x_coords.push_back (diff_x);
-	    diff_y = val_to_ttf (sp->prevcp.y, last_y, flag, false);
-	    if (diff_y)
-		y_coords.push_back (diff_y);
+// Choose point flags and coordinate formats minimizing the total size of
+// flags and coordinates. Just taking the shortest form for each coordinate
+// is not always the best: e. g. storing a zero delta as a byte rather than
+// omitting it may be worth doing if it makes the flag equal to its
+// neighbors, so that the whole run of flags can be stored as a flag
+// and a repeat count. So this is a dynamic programming over candidate flags
+// of each point, with two states: either the point starts a new run of
+// flags (costs a flag byte), or continues a run (costs a repeat count byte
+// for the second point in the run, nothing for subsequent ones). The limit
+// of 255 repeats is ignored here, as long runs are split anyway when emitted
+static void encodeTTFPoints (const std::vector<int32_t> &xs, const std::vector<int32_t> &ys,
+    const std::vector<uint8_t> &on_curve, bool overlap,
+    std::vector<uint8_t> &flags, std::vector<uint8_t> &x_data, std::vector<uint8_t> &y_data) {
+    struct candidate {
+	uint8_t flag, xsize, ysize;
+	uint32_t cost[2];	// 0: starts a run, 1: continues a run
+	uint8_t prev[2];	// candidate index (with state in the high bit) at the previous point
+    };
+    const size_t cnt = xs.size ();
+    std::vector<std::array<candidate, 9>> cands (cnt);
+    std::vector<uint8_t> ncands (cnt);
+    const uint32_t inf = std::numeric_limits<uint32_t>::max ()/2;
+
+    int32_t last_x = 0, last_y = 0;
+    for (size_t i=0; i<cnt; i++) {
+	ttf_coord_mode xm[3], ym[3];
+	int nx = ttfCoordModes (xs[i] - last_x, true, xm);
+	int ny = ttfCoordModes (ys[i] - last_y, false, ym);
+	last_x = xs[i]; last_y = ys[i];
+
+	uint8_t n = 0;
+	for (int xi=0; xi<nx; xi++) {
+	    for (int yi=0; yi<ny; yi++) {
+		candidate &c = cands[i][n++];
+		c.flag = (on_curve[i] ? _On_Curve : 0) | xm[xi].bits | ym[yi].bits;
+		if (i == 0 && overlap)
+		    c.flag |= _Overlap_Simple;
+		c.xsize = xm[xi].size;
+		c.ysize = ym[yi].size;
+		uint32_t own = c.xsize + c.ysize;
+
+		// Start a new run after the cheapest state of the previous point
+		c.cost[0] = inf; c.cost[1] = inf;
+		if (i == 0) {
+		    c.cost[0] = own + 1;
+		    continue;
+		}
+		for (uint8_t k=0; k<ncands[i-1]; k++) {
+		    const candidate &p = cands[i-1][k];
+		    for (uint8_t st=0; st<2; st++) {
+			if (p.cost[st] + own + 1 < c.cost[0]) {
+			    c.cost[0] = p.cost[st] + own + 1;
+			    c.prev[0] = k | (st<<7);
+			}
+			// Continue the run of the same flag
+			if (p.flag == c.flag && p.cost[st] + own + (st ? 0 : 1) < c.cost[1]) {
+			    c.cost[1] = p.cost[st] + own + (st ? 0 : 1);
+			    c.prev[1] = k | (st<<7);
+			}
+		    }
+		}
+	    }
+	}
+	ncands[i] = n;
+    }
+    if (!cnt)
+	return;
+
+    // Trace the best path back
+    std::vector<uint8_t> choice (cnt);
+    uint32_t best = inf;
+    uint8_t idx = 0, state = 0;
+    for (uint8_t k=0; k<ncands[cnt-1]; k++) {
+	for (uint8_t st=0; st<2; st++) {
+	    if (cands[cnt-1][k].cost[st] < best) {
+		best = cands[cnt-1][k].cost[st];
+		idx = k; state = st;
+	    }
+	}
+    }
+    for (size_t i=cnt; i-- > 0;) {
+	choice[i] = idx;
+	if (i) {
+	    uint8_t prev = cands[i][idx].prev[state];
+	    idx = prev&0x7f;
+	    state = prev>>7;
+	}
+    }
+
+    // Emit flags, grouping equal neighbors into runs (at most 256 points each)
+    for (size_t i=0; i<cnt;) {
+	uint8_t flag = cands[i][choice[i]].flag;
+	size_t j = i+1;
+	while (j<cnt && j-i<256 && cands[j][choice[j]].flag == flag)
+	    j++;
+	if (j-i == 1) {
 	    flags.push_back (flag);
-	    ptcnt++;
-	} else if (sp->ttfindex!=startcnt && sp->ttfindex!=-1) {
-	    FontShepherd::postError (
-		QCoreApplication::tr ("Unexpected point count"),
-		QCoreApplication::tr (
-		    "Unexpected point count in DrawableFigure::toCoordList (glyph %1): "
-		    "got %2, while %3 is expected").arg (gid).arg (spls.first->ttfindex).arg (ptcnt),
-		nullptr);
+	} else {
+	    flags.push_back (flag | _Repeat);
+	    flags.push_back (j-i-1);
+	}
+	i = j;
+    }
+
+    last_x = 0; last_y = 0;
+    for (size_t i=0; i<cnt; i++) {
+	const candidate &c = cands[i][choice[i]];
+	int32_t dx = xs[i] - last_x, dy = ys[i] - last_y;
+	last_x = xs[i]; last_y = ys[i];
+	if (c.xsize == 1) {
+	    x_data.push_back (std::abs (dx));
+	} else if (c.xsize == 2) {
+	    x_data.push_back ((dx>>8)&0xff);
+	    x_data.push_back (dx&0xff);
 	}
+	if (c.ysize == 1) {
+	    y_data.push_back (std::abs (dy));
+	} else if (c.ysize == 2) {
+	    y_data.push_back ((dy>>8)&0xff);
+	    y_data.push_back (dy&0xff);
+	}
+    }
+}
 
+// Quadratic points are listed in the order they are stored in 'glyf', so that
+// they can be addressed by TrueType instructions. Each contour gets an end index
+void DrawableFigure::appendPoints (flat_outline &out) const {
+    for (const ConicPointList &spls: contours) {
+	ConicPoint *sp = spls.first, *nextsp;
+	if (!sp)
+	    continue;
+
+	if (order2 && sp->ttfindex == -1 && sp->prev && !sp->noprevcp)
+	    out.addPoint (sp->prevcp, false);
 	do {
-	    if (sp->ttfindex != -1) {
-		flag = _On_Curve;
-		diff_x = val_to_ttf (sp->me.x, last_x, flag, true);
-		if (diff_x)
-		    x_coords.push_back (diff_x);
-		diff_y = val_to_ttf (sp->me.y, last_y, flag, false);
-		if (diff_y)
-		    y_coords.push_back (diff_y);
-		if (flag != flags.back () || last_repeat) {
-		    if (repeat) {
-			flags.back () |= _Repeat;
-			flags.push_back (repeat);
-			last_repeat = true;
-			repeat = 0;
-		    }
-		    flags.push_back (flag);
-		    last_repeat = false;
-		} else {
-		    repeat++;
-		}
-		ptcnt++;
-	    }
 	    nextsp = sp->next ? sp->next->to : nullptr;
-	    if (!sp->nonextcp && (nextsp != spls.first || spls.first->ttfindex != -1)) {
-		flag = 0;
-		diff_x = val_to_ttf (sp->nextcp.x, last_x, flag, true);
-		if (diff_x)
-		    x_coords.push_back (diff_x);
-		diff_y = val_to_ttf (sp->nextcp.y, last_y, flag, false);
-		if (diff_y)
-		    y_coords.push_back (diff_y);
-		if (flag != flags.back () || last_repeat) {
-		    if (repeat) {
-			flags.back () |= _Repeat;
-			flags.push_back (repeat);
-			last_repeat = true;
-			repeat = 0;
-		    }
-		    flags.push_back (flag);
-		    last_repeat = false;
-		} else {
-		    repeat++;
+	    if (order2) {
+		if (sp->ttfindex != -1)
+		    out.addPoint (sp->me, true);
+		if (!sp->nonextcp && (nextsp != spls.first || spls.first->ttfindex != -1))
+		    out.addPoint (sp->nextcp, false);
+	    } else {
+		out.addPoint (sp->me, true);
+		if (nextsp && !(sp->nonextcp && nextsp->noprevcp)) {
+		    out.addPoint (sp->nextcp, false);
+		    out.addPoint (nextsp->prevcp, false);
 		}
-		ptcnt++;
 	    }
 	    sp = nextsp;
 	} while (sp && sp!=spls.first);
-	if (repeat) {
-	    flags.back () |= _Repeat;
-	    flags.push_back (repeat);
-	    last_repeat = true;
-	    repeat = 0;
+	out.end_pts.push_back (out.numPoints () - 1);
+    }
+}
+
+uint16_t DrawableFigure::toCoordList (std::vector<uint16_t> &endpts, std::vector<uint8_t> &flags,
+    std::vector<uint8_t> &x_data, std::vector<uint8_t> &y_data, uint16_t gid, bool elide_implied) {
+    renumberPoints (0);
+    flat_outline fo;
+    appendPoints (fo);
+
+    for (size_t i=0; i<contours.size (); i++) {
+	int startcnt = i ? fo.end_pts[i-1] + 1 : 0;
+	ConicPoint *sp = contours[i].first;
+	if (sp && sp->ttfindex!=startcnt && sp->ttfindex!=-1) {
+	    FontShepherd::postError (
+		QCoreApplication::tr ("Unexpected point count"),
+		QCoreApplication::tr (
+		    "Unexpected point count in DrawableFigure::toCoordList (glyph %1): "
+		    "got %2, while %3 is expected").arg (gid).arg (sp->ttfindex).arg (startcnt),
+		nullptr);
+	}
+    }
+    return fo.toTTF (endpts, flags, x_data, y_data, elide_implied);
+}
+
+// Drop on-curve points lying exactly halfway between two off-curve points, as
+// TrueType rasterizers imply them anyway. This changes point numbering, so
+// should not be done for glyphs whose points are addressed by instructions.
+// At least one on-curve point is left in each contour
+static void elideImpliedPoints (std::vector<int32_t> &xs, std::vector<int32_t> &ys,
+    std::vector<uint8_t> &on_curve, std::vector<uint16_t> &endpts) {
+    size_t start = 0;
+
+    for (uint16_t end : endpts) {
+	if (end < start || end >= on_curve.size ())
+	    return;
+	start = end + 1;
+    }
+
+    // Neighbours are looked up in the original arrays (the last point of
+    // a contour is compared with its first one), so the remaining points
+    // are collected separately rather than compacted in place
+    std::vector<int32_t> out_x, out_y;
+    std::vector<uint8_t> out_on;
+    out_x.reserve (xs.size ());
+    out_y.reserve (ys.size ());
+    out_on.reserve (on_curve.size ());
+
+    start = 0;
+    for (uint16_t &end : endpts) {
+	size_t on_cnt = std::count (on_curve.begin () + start, on_curve.begin () + end + 1, 1);
+	for (size_t i=start; i<=end; i++) {
+	    size_t prev = (i == start) ? end : i-1;
+	    size_t next = (i == end) ? start : i+1;
+	    if (on_curve[i] && on_cnt > 1 && end - start >= 2 &&
+		!on_curve[prev] && !on_curve[next] &&
+		xs[prev] + xs[next] == 2*xs[i] && ys[prev] + ys[next] == 2*ys[i]) {
+		on_cnt--;
+		continue;
+	    }
+	    out_x.push_back (xs[i]);
+	    out_y.push_back (ys[i]);
+	    out_on.push_back (on_curve[i]);
 	}
+	start = end + 1;
+	end = out_on.size () - 1;
+    }
+    xs.swap (out_x);
+    ys.swap (out_y);
+    on_curve.swap (out_on);
+}
+
+uint16_t flat_outline::toTTF (std::vector<uint16_t> &endpts, std::vector<uint8_t> &flags,
+    std::vector<uint8_t> &x_data, std::vector<uint8_t> &y_data, bool elide_implied) const {
+    uint16_t ptcnt = numPoints ();
+    std::vector<int32_t> xs (ptcnt), ys (ptcnt);
+    std::vector<uint8_t> on (on_curve);
+
+    for (uint16_t i=0; i<ptcnt; i++) {
+	xs[i] = rint (x[i]);
+	ys[i] = rint (y[i]);
     }
-    return ptcnt;
+    endpts = end_pts;
+    if (elide_implied)
+	elideImpliedPoints (xs, ys, on, endpts);
+    encodeTTFPoints (xs, ys, on, overlap, flags, x_data, y_data);
+    return xs.size ();
 }
 
 bool DrawableFigure::startToPoint (ConicPoint *nst) {
@@ -5093,9 +5246,9 @@ bool DrawableFigure::splinesRemoveBetweenMaybe (ConicPoint *from, ConicPoint *to
     tp = Conic::figureTPsBetween (from, to);
 
     if (Simplify::ignoreSlopes)
-	Conic::approximateFromPointsSlopes (from, to, tp, order2);
+	Conic::approximateFromPointsSlopes (from, to, tp, order2, splines_pool);
     else
-	Conic::approximateFromPoints (from, to, tp, order2);
+	Conic::approximateFromPoints (from, to, tp, order2, splines_pool);
 
     i = tp.size ();
 
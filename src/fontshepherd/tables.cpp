@@ -25,10 +25,13 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE. */
 
+#include <typeinfo>
 #include "exceptions.h"
+#include "charbuffer.h"
+#include "fs_trace.h"
 
 #include "sfnt.h"
-#include "editors/fontview.h" // also includes tables.h
+#include "tables.h"
 #include "tables/maxp.h"
 #include "tables/mtx.h"
 #include "tables/glyphcontainer.h" // also includes splineglyph.h
@@ -36,15 +39,19 @@
 FontTable::FontTable (sfntFile *fontfile, const TableHeader &props) :
     container (fontfile),
     infile (props.file),
+    m_map (props.map),
     m_tags {props.iname, 0, 0, 0},
     oldchecksum (props.checksum),
     start (props.off),
     len (props.length),
+    complen (props.complen),
     newlen (len),
+    newcomplen (0),
     data (nullptr),
     tv (nullptr) {
 
     changed = td_changed = required = is_new = freeing = inserted = processed = td_loaded = false;
+    is_mapped = false;
     if (infile == nullptr) is_new = true;
 }
 
@@ -53,9 +60,11 @@ FontTable::FontTable (FontTable* table) {
     m_tags = table->m_tags;
     start = table->start;
     len = table->len;
+    complen = newcomplen = 0;
     newlen = table->newlen == 0 ? table->len : table->newlen;
     oldchecksum = table->oldchecksum;
     tv = nullptr;
+    is_mapped = false;
 
     if (table->data) {
         data = new char[(newlen+3)&~3]; // padding to uint32
@@ -74,6 +83,7 @@ FontTable::FontTable (QByteArray storage) {
     buf >> start;
     buf >> len;
     buf >> newlen;
+    complen = newcomplen = 0;
     buf >> oldchecksum;
     buf >> newchecksum;
     buf >> flags;
@@ -88,6 +98,7 @@ FontTable::FontTable (QByteArray storage) {
 
     data = nullptr;
     tv = nullptr;
+    is_mapped = false;
 
     if (has_data > 0) {
         data = new char[(len+3)&~3](); // padding to uint32
@@ -96,12 +107,9 @@ FontTable::FontTable (QByteArray storage) {
 }
 
 FontTable::~FontTable () {
-    if (data) {
-        delete[] data;
-        data = nullptr;
-    }
+    releaseData ();
     if (tv) {
-        tv->close ();
+        tv->closeEditor ();
         tv = nullptr;
     }
 }
@@ -116,6 +124,10 @@ uint32_t FontTable::dataLength () const {
     return newlen;
 }
 
+const char *FontTable::rawData () const {
+    return data;
+}
+
 bool FontTable::isRequired () const {
     return required;
 }
@@ -206,6 +218,12 @@ double FontTable::get2dot14 (uint32_t pos) {
     return get2dot14 (data, pos);
 }
 
+SpanIn FontTable::span (uint32_t pos) const {
+    SpanIn ret (data, data ? newlen : 0);
+    ret.seek (pos);
+    return ret;
+}
+
 uint32_t FontTable::getoffset (uint32_t pos, uint8_t size) {
     switch (size) {
       case 1:
@@ -304,7 +322,33 @@ void FontTable::put2dot14 (QDataStream &os, double dval) {
     os << val;
 }
 
+static std::atomic<uint64_t> lru_clock {0};
+
 void FontTable::fillup () {
+    m_last_used = ++lru_clock;
+    if (!infile || data)
+	return;
+    FS_TRACE_SCOPE ("table fillup");
+    if (infile && !data && complen) {
+	fillupCompressed ();
+	return;
+    }
+    if (infile && !data && m_map) {
+	uint32_t padded = (len+3)&~3;
+	// The view must include the padding bytes, as they are accessed e. g.
+	// when copying or serializing the table, and they should be zero
+	if (m_map->contains (start, padded) && m_map->intact ()) {
+	    const char *view = m_map->data () + start;
+	    bool zero_pad = true;
+	    for (uint32_t i=len; i<padded && zero_pad; i++)
+		zero_pad = (view[i] == 0);
+	    if (zero_pad) {
+		data = const_cast<char *> (view);
+		is_mapped = true;
+		return;
+	    }
+	}
+    }
     if (infile && !data) {
 	QDataStream in (infile);
 	bool was_open = infile->isOpen ();
@@ -318,6 +362,31 @@ void FontTable::fillup () {
     }
 }
 
+void FontTable::fillupCompressed () {
+    const char *src = nullptr;
+    QByteArray comp;
+    if (m_map && m_map->contains (start, complen) && m_map->intact ()) {
+	src = m_map->data () + start;
+    } else {
+	bool was_open = infile->isOpen ();
+	if (!was_open) infile->open (QIODevice::ReadOnly);
+	infile->seek (start);
+	comp = infile->read (complen);
+	if (!was_open) infile->close ();
+	if ((uint32_t) comp.size () < complen)
+	    throw TableDataCorruptException (stringName ().c_str ());
+	src = comp.constData ();
+    }
+
+    uint32_t padded = (len+3)&~3;
+    char *buf = new char[padded] (); // padding to uint32
+    if (!FontShepherd::zlibInflate (src, complen, buf, len)) {
+	delete[] buf;
+	throw TableDataCorruptException (stringName ().c_str ());
+    }
+    data = buf;
+}
+
 bool FontTable::loaded () const {
     return (data != nullptr);
 }
@@ -326,16 +395,72 @@ bool FontTable::isNew () const {
     return is_new;
 }
 
+bool FontTable::mapped () const {
+    return is_mapped;
+}
+
 bool FontTable::compiled () const {
     return td_changed;
 }
 
-void FontTable::clearData () {
-    delete[] data;
+void FontTable::releaseData () {
+    if (!is_mapped)
+	delete[] data;
     data = nullptr;
+    is_mapped = false;
+}
+
+void FontTable::clearData () {
+    releaseData ();
+    td_loaded = false;
+}
+
+size_t FontTable::memoryUsage () const {
+    // Mapped data are backed by the font file and can be reclaimed by
+    // the OS at any moment, so they are not counted
+    return (data && !is_mapped) ? (newlen+3)&~3 : 0;
+}
+
+// True if table data are still available in the source file, so that they
+// can be dropped and read again
+bool FontTable::reloadable () const {
+    return (infile && !is_new && !changed && !td_changed && !tv &&
+	start != 0xffffffff);
+}
+
+// Tables represented by subclasses usually have decoded structures, which may
+// be referenced from elsewhere, so they have to opt in explicitly
+bool FontTable::evictable () const {
+    return (typeid (*this) == typeid (FontTable) && reloadable ());
+}
+
+void FontTable::evict () {
+    releaseData ();
     td_loaded = false;
 }
 
+uint64_t FontTable::lastUsed () const {
+    return m_last_used;
+}
+
+// Copy-on-write: replace a view into the mapped file with an own buffer
+// before the table data are modified in place
+void FontTable::detachData () {
+    if (!is_mapped)
+	return;
+    uint32_t padded = (newlen+3)&~3;
+    char *copy = new char[padded];
+    char *old_data = data;
+    std::copy (data, data + padded, copy);
+    data = copy;
+    is_mapped = false;
+    dataMoved (old_data);
+}
+
+void FontTable::dataMoved (const char *old_data) {
+    Q_UNUSED (old_data);
+}
+
 // See https://docs.microsoft.com/en-us/typography/opentype/otspec140/recom,
 // "Optimized table ordering", for reference. This order is recommended
 // for the TrueType fonts to be used on Windows platform. We don't attempt to
@@ -396,10 +521,7 @@ int FontTable::orderingVal () {
 }
 
 void FontTable::copyData (FontTable *source) {
-    if (data) {
-        delete[] data;
-        data = nullptr;
-    }
+    releaseData ();
 
     if (!source->data)
         return;
@@ -444,32 +566,16 @@ void FontTable::clearEditor () {
     this->tv = nullptr;
 }
 
-void FontTable::setEditor (TableEdit *editor) {
+void FontTable::setEditor (TableEditor *editor) {
     this->tv = editor;
 }
 
-TableEdit *FontTable::editor () {
+TableEditor *FontTable::editor () {
     return this->tv;
 }
 
-void FontTable::hexEdit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr && !is_new)
-        fillup ();
-
-    if (tv == nullptr) {
-        HexTableEdit *hexedit = new HexTableEdit (tptr, caller);
-        hexedit->setWindowTitle
-	    (QString ("%1 - %2").arg (QString::fromStdString (stringName ())).arg (fnt->fontname));
-        hexedit->setData (data, newlen);
-        tv = hexedit;
-        hexedit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
-void FontTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    hexEdit (fnt, tptr, caller);
+std::vector<uint32_t> FontTable::packTargets () const {
+    return {};
 }
 
 sfntFile* FontTable::containerFile () {
@@ -482,6 +588,7 @@ GlyphContainer::GlyphContainer (sfntFile* fontfile, const TableHeader &props) :
 };
 
 void GlyphContainer::unpackData (sFont* fnt) {
+    FS_TRACE_SCOPE ("glyph container unpack");
     m_glyphs.reserve (fnt->glyph_cnt + 256);
     m_glyphs.resize (fnt->glyph_cnt, nullptr);
 
@@ -494,22 +601,102 @@ void GlyphContainer::unpackData (sFont* fnt) {
     m_hmtx->unpackData (fnt);
 }
 
-void GlyphContainer::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    // No fillup here, as it is done by fontview
-    FontView *fv = caller->findChild<FontView *> ();
+// Glyph metrics are stored into hmtx when glyphs are compiled
+std::vector<uint32_t> GlyphContainer::packTargets () const {
+    return { CHR ('h','m','t','x') };
+}
 
-    if (fv) {
-        fv->setTable (tptr);
-        fv->raise ();
-    } else {
-        fv = new FontView (fnt->sharedTable (this->iName ()), fnt, caller);
-        if (!fv->isValid ()) {
-            fv->close ();
-            return;
-        }
-        tv = fv;
-        fv->show ();
+size_t GlyphContainer::memoryUsage () const {
+    // A rough estimate, which doesn't take into account hints, gradients, etc.
+    size_t ret = FontTable::memoryUsage ();
+    for (ConicGlyph *g : m_glyphs) {
+	if (!g)
+	    continue;
+	ret += sizeof (ConicGlyph);
+	for (auto &fig : g->figures)
+	    ret += fig.memoryUsage ();
     }
+    return ret;
+}
+
+// object_pool is not thread safe, so glyphs decoded by worker threads are allocated
+// under a lock. Undo stacks are only attached later by the GUI thread
+ConicGlyph *GlyphContainer::newGlyph (uint16_t gid, BaseMetrics gm) {
+    std::lock_guard<std::mutex> lock (m_pool_lock);
+    return glyph_pool.construct (gid, gm);
+}
+
+void GlyphContainer::clearGlyphs () {
+    for (ConicGlyph *g : m_glyphs) {
+	if (g)
+	    glyph_pool.destroy (g);
+    }
+    m_glyphs.clear ();
+}
+
+// Generic versions, which have to decode the glyph
+bool GlyphContainer::glyphHeader (sFont* fnt, uint16_t gid, glyph_header &hdr) {
+    ConicGlyph *g = glyph (fnt, gid);
+    if (!g)
+	return false;
+
+    std::vector<uint16_t> refs = g->refersTo ();
+    hdr.bb = g->bb;
+    hdr.numberOfContours = refs.empty () ? g->numCompositeContours () : -1;
+    hdr.numPoints = refs.empty () ? g->numCompositePoints () : 0;
+    hdr.instructionLength = g->instructions.size ();
+    hdr.numComponents = refs.size ();
+    hdr.useMyMetrics = g->useMyMetricsGlyph ();
+    hdr.advanceWidth = g->advanceWidth ();
+    return true;
+}
+
+std::vector<uint16_t> GlyphContainer::glyphComponents (sFont* fnt, uint16_t gid) {
+    ConicGlyph *g = glyph (fnt, gid);
+    if (!g)
+	return {};
+    return g->refersTo ();
+}
+
+bool GlyphContainer::parallelDecodable () const {
+    return false;
+}
+
+bool GlyphContainer::flatOutline (sFont* fnt, uint16_t gid, flat_outline &out) {
+    ConicGlyph *g = glyph (fnt, gid);
+    if (!g)
+	return false;
+    g->toFlatOutline (out);
+    return true;
+}
+
+// Substitute components recursively, so that points are numbered as TrueType
+// instructions of the glyph see them. Returns false for broken references
+bool GlyphContainer::composedOutline (sFont* fnt, uint16_t gid, flat_outline &out, uint16_t depth) {
+    const uint16_t max_depth = 64;
+    if (depth > max_depth || !flatOutline (fnt, gid, out))
+	return false;
+
+    std::vector<flat_component> comps;
+    comps.swap (out.components);
+    for (auto &comp : comps) {
+	flat_outline part;
+	if (!composedOutline (fnt, comp.GID, part, depth+1))
+	    return false;
+	std::array<double, 6> trans = comp.transform;
+	if (comp.point_match) {
+	    uint16_t base = comp.match_pt_base, ref = comp.match_pt_ref;
+	    if (base >= out.numPoints () || ref >= part.numPoints ())
+		return false;
+	    trans[4] = out.x[base] - (trans[0]*part.x[ref] + trans[2]*part.y[ref]);
+	    trans[5] = out.y[base] - (trans[1]*part.x[ref] + trans[3]*part.y[ref]);
+	} else if (comp.round) {
+	    trans[4] = rint (trans[4]);
+	    trans[5] = rint (trans[5]);
+	}
+	out.append (part, trans);
+    }
+    return true;
 }
 
 uint16_t GlyphContainer::countGlyphs () {
@@ -533,148 +720,3 @@ OutlinesType GlyphContainer::outlinesType () const {
 	return OutlinesType::NONE;
     }
 }
-
-/* Default editor, based on the QHexEdit widget */
-HexTableEdit::HexTableEdit (std::shared_ptr<FontTable> tab, QWidget* parent) :
-    TableEdit (parent, Qt::Window), m_table (tab) {
-
-    m_edited = m_valid = false;
-
-    saveAction = new QAction (tr ("&Export to font"), this);
-    closeAction = new QAction (tr ("C&lose"), this);
-
-    connect (saveAction, &QAction::triggered, this, &HexTableEdit::save);
-    connect (closeAction, &QAction::triggered, this, &HexTableEdit::close);
-
-    saveAction->setShortcut (QKeySequence::Save);
-    closeAction->setShortcut (QKeySequence::Close);
-
-    undoAction = new QAction (tr ("&Undo"), this);
-    redoAction = new QAction (tr ("Re&do"), this);
-    toggleReadOnlyAction = new QAction (tr ("&Read only"), this);
-    toggleOverwriteAction = new QAction (tr ("&Overwrite mode"), this);
-
-    undoAction->setShortcut (QKeySequence::Undo);
-    redoAction->setShortcut (QKeySequence::Redo);
-    toggleReadOnlyAction->setCheckable (true);
-    toggleReadOnlyAction->setChecked (true);
-    toggleOverwriteAction->setShortcut (QKeySequence (Qt::Key_Insert));
-    toggleOverwriteAction->setCheckable (true);
-    toggleOverwriteAction->setChecked (false);
-
-    connect (toggleReadOnlyAction, &QAction::triggered, this, &HexTableEdit::toggleReadOnly);
-    connect (toggleOverwriteAction, &QAction::triggered, this, &HexTableEdit::toggleOverwrite);
-
-    fileMenu = menuBar ()->addMenu (tr ("&File"));
-    fileMenu->addAction (saveAction);
-    fileMenu->addSeparator ();
-    fileMenu->addAction (closeAction);
-
-    editMenu = menuBar ()->addMenu (tr ("&Edit"));
-    editMenu->addAction (undoAction);
-    editMenu->addAction (redoAction);
-    fileMenu->addSeparator ();
-    editMenu->addAction (toggleReadOnlyAction);
-    editMenu->addAction (toggleOverwriteAction);
-
-    m_hexedit = new QHexEdit ();
-    setAttribute (Qt::WA_DeleteOnClose);
-    m_hexedit->setOverwriteMode (false);
-    m_hexedit->setReadOnly (true);
-    QFontMetrics hexmetr = m_hexedit->fontMetrics();
-    QString line = QString (76, '0');
-    m_hexedit->resize (hexmetr.boundingRect (line).width (), hexmetr.height () * 16);
-    resize (hexmetr.boundingRect (line).width (), hexmetr.height () * 16);
-
-    connect (m_hexedit, &QHexEdit::dataChanged, this, &HexTableEdit::edited);
-    connect (undoAction, &QAction::triggered, m_hexedit, &QHexEdit::undo);
-    connect (redoAction, &QAction::triggered, m_hexedit, &QHexEdit::redo);
-
-    QVBoxLayout *layout;
-    layout = new QVBoxLayout ();
-    layout->addWidget (m_hexedit);
-
-    QWidget *window = new QWidget ();
-    window->setLayout (layout);
-    setCentralWidget (window);
-}
-
-HexTableEdit::~HexTableEdit () {
-}
-
-void HexTableEdit::edited () {
-    m_edited = true;
-}
-
-void HexTableEdit::save () {
-    QByteArray ba = m_hexedit->data ();
-    if (m_table->loaded ())
-        delete[] m_table->data;
-    m_table->data = new char[ba.size ()];
-    std::copy (ba.data (), ba.data () + ba.size (), m_table->data);
-    m_table->newlen = ba.size ();
-    m_table->changed = false;
-    m_table->td_changed = true;
-    m_edited = false;
-    emit update (m_table);
-}
-
-void HexTableEdit::toggleReadOnly (bool val) {
-    m_hexedit->setReadOnly (val);
-}
-
-void HexTableEdit::toggleOverwrite (bool val) {
-    m_hexedit->setOverwriteMode (val);
-}
-
-void HexTableEdit::setData (char *data, int len) {
-    m_hexedit->setData (QByteArray (data, ((len+3)&~3)));
-    m_edited = false;
-    m_valid = true;
-}
-
-void HexTableEdit::resetData () {
-    int len = m_table->newlen;
-    m_hexedit->setData (QByteArray (m_table->data, ((len+3)&~3)));
-    m_edited = false;
-    m_valid = true;
-}
-
-bool HexTableEdit::checkUpdate (bool can_cancel) {
-    if (isModified ()) {
-        QMessageBox::StandardButton ask;
-        ask = QMessageBox::question (this,
-            tr ("Unsaved Changes"),
-            tr ("This table has been modified. "
-                "Would you like to export the changes back into the font?"),
-            can_cancel ?  (QMessageBox::Yes|QMessageBox::No|QMessageBox::Cancel) :
-                          (QMessageBox::Yes|QMessageBox::No));
-        if (ask == QMessageBox::Cancel) {
-            return false;
-        } else if (ask == QMessageBox::Yes) {
-            save ();
-        }
-    }
-    return true;
-}
-
-bool HexTableEdit::isModified () {
-    return m_edited;
-}
-
-bool HexTableEdit::isValid () {
-    return m_valid;
-}
-
-std::shared_ptr<FontTable> HexTableEdit::table () {
-    return m_table;
-}
-
-void HexTableEdit::closeEvent (QCloseEvent *event) {
-    // If we are going to delete the font, ignore changes in table edits
-    if (!isModified () || m_table->freeing || checkUpdate (true)) {
-        m_table->tv = nullptr;
-    } else {
-        event->ignore ();
-    }
-}
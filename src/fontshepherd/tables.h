@@ -30,16 +30,36 @@
 #include <stdint.h>
 // otherwise getting "incomplete type error" on array declarations
 #include <array>
-#include <QtWidgets>
-#include "qhexedit.h"
+#include <atomic>
+#include <memory>
+#include <QtCore>
+#include "fs_mapping.h"
 
 class sfntFile;
 typedef struct ttffont sFont;
-class TableEdit;
+class FontTable;
+class SpanIn;
+
+// Table editors as seen from the table code. The editor windows themselves
+// (see editors/tableedit.h) are only built into the GUI application
+class TableEditor {
+public:
+    virtual ~TableEditor () {};
+
+    virtual void resetData () = 0;
+    virtual bool checkUpdate (bool can_cancel) = 0;
+    virtual bool isModified () = 0;
+    virtual bool isValid () = 0;
+    virtual std::shared_ptr<FontTable> table () = 0;
+    virtual void closeEditor () = 0;
+};
 
 struct TableHeader {
     QFile *file;
+    // If set, table data are not copied from the file, but viewed in place
+    std::shared_ptr<FontShepherd::FileMapping> map;
     uint32_t iname, checksum, off, length;
+    uint32_t complen = 0;	// length of zlib compressed data in a WOFF file
 };
 
 /* GWW: The EBDT and bdat tags could reasonable point to the same table
@@ -80,25 +100,41 @@ public:
     sfntFile *containerFile ();
     uint32_t iName (int index=0) const;
     uint32_t dataLength () const;
+    // Table bytes as loaded or last compiled (null unless filled up)
+    const char *rawData () const;
     bool isRequired () const;
 
     virtual void unpackData (sFont*) {};
-    // takes shared_ptr to itself, as it is needed for the editor class
-    virtual void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller);
-    void hexEdit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller);
-
+    virtual void packData () {};
+    // Tags of the tables which are updated (or compiled) as a side effect
+    // of packData (). They should be compiled after this table and never
+    // concurrently with it
+    virtual std::vector<uint32_t> packTargets () const;
     void setModified (bool val);
     bool modified () const;
     void setContainer (sfntFile *cont_file);
     void clearEditor ();
-    void setEditor (TableEdit *editor);
-    TableEdit *editor ();
+    void setEditor (TableEditor *editor);
+    TableEditor *editor ();
     bool loaded () const;
     bool compiled () const;
     bool isNew () const;
+    bool mapped () const;
     void clearData ();
+    void detachData ();
+    // Called when 'data' has been replaced by the same bytes at another
+    // address, so that tables keeping pointers into it can update them
+    virtual void dataMoved (const char *old_data);
     int orderingVal ();
 
+    // Memory management. Unmodified tables which are not being edited may
+    // drop both their raw and decoded data when the memory budget is
+    // exceeded. The data are rebuilt on demand by fillup () and unpackData ()
+    virtual size_t memoryUsage () const;
+    virtual bool evictable () const;
+    virtual void evict ();
+    uint64_t lastUsed () const;
+
     static uint16_t getushort (char *bdata, uint32_t pos);
     static uint32_t getlong (char *bdata, uint32_t pos);
     static double get2dot14 (char *bdata, uint32_t pos);
@@ -113,21 +149,30 @@ protected:
     double getversion (uint32_t pos);
     double get2dot14 (uint32_t pos);
     uint32_t getoffset (uint32_t pos, uint8_t size);
+    // Reader over table data from 'pos' on, for arrays and other bulk data.
+    // Check its failure flag after reading, and throw TableDataCorruptException
+    SpanIn span (uint32_t pos) const;
+    void releaseData ();
+    void fillupCompressed ();
+    bool reloadable () const;
 
     sfntFile *container;
     /* No pointer to the font, because a given table may be part of several */
     /*  different fonts in a ttc */
 
     QFile *infile = nullptr;
+    std::shared_ptr<FontShepherd::FileMapping> m_map;
     // May be referenced more than once (bdat/EBDT etc.), hence the list of names
     std::array<uint32_t, 4> m_tags;
     uint32_t oldchecksum;
     uint32_t start;
     uint32_t len;
+    uint32_t complen;		// non-zero if the data are stored compressed (WOFF)
 
     uint32_t newchecksum;	/* used during saving */
     uint32_t newstart;		/* used during saving */
     uint32_t newlen;		// actual length, but data will be padded out to 32bit boundary with 0
+    uint32_t newcomplen;	/* used during saving */
     char *data;
     bool changed: 1;		// the table has been modified, but the changes not yet compiled
     bool td_changed: 1;		// the table has been compiled (so table data changed), but not yet saved
@@ -137,54 +182,9 @@ protected:
     bool inserted: 1;		// temporary: table has been inserted into ordered table list (for save)
     bool processed: 1;		// seems to be currently unused
     bool td_loaded: 1;		// data has been read into table structures
-    TableEdit *tv;
+    bool is_mapped: 1;		// data is a read-only view into m_map rather than an own buffer
+    TableEditor *tv;
+    std::atomic<uint64_t> m_last_used {0};	// LRU stamp, updated by fillup ()
 };
 
-class TableEdit : public QMainWindow {
-    Q_OBJECT;
-
-public:
-    TableEdit (QWidget* parent, Qt::WindowType type) : QMainWindow (parent, type) {}
-
-    virtual void resetData () = 0;
-    virtual bool checkUpdate (bool can_cancel) = 0;
-    virtual bool isModified () = 0;
-    virtual bool isValid () = 0;
-    virtual std::shared_ptr<FontTable> table () = 0;
-
-signals:
-    void update (std::shared_ptr<FontTable> ft);
-};
-
-class HexTableEdit : public TableEdit {
-    Q_OBJECT;
-
-public:
-    HexTableEdit (std::shared_ptr<FontTable> tab, QWidget* parent);
-    ~HexTableEdit ();
-
-    void setData (char *data, int len);
-    void resetData () override;
-    bool checkUpdate (bool can_cancel) override;
-    bool isModified () override;
-    bool isValid () override;
-    std::shared_ptr<FontTable> table () override;
-    void closeEvent (QCloseEvent *event);
-
-private slots:
-    void edited ();
-    void save ();
-    void toggleReadOnly (bool val);
-    void toggleOverwrite (bool val);
-
-private:
-    std::shared_ptr<FontTable> m_table;
-    QHexEdit *m_hexedit;
-    bool m_edited, m_valid;
-
-    QAction *saveAction, *closeAction;
-    QAction *undoAction, *redoAction, *toggleReadOnlyAction, *toggleOverwriteAction;
-
-    QMenu *fileMenu, *editMenu;
-};
 #endif
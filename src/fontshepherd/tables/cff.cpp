@@ -26,21 +26,26 @@
  * POSSIBILITY OF SUCH DAMAGE. */
 
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <unordered_map>
 #include <iostream>
 #include <iomanip>
 #include <assert.h>
 #include <ctype.h>
-#include <boost/pool/object_pool.hpp>
+#include <QtConcurrent>
 
 #include "exceptions.h"
 #include "sfnt.h"
-#include "editors/fontview.h" // Includes also tables.h
+#include "tables.h"
 #include "tables/glyphcontainer.h"
 #include "tables/cff.h"
 #include "tables/cmap.h"
 #include "tables/mtx.h"
+#include "fs_arena.h"
 #include "fs_notify.h"
 #include "fs_math.h"
+#include "fs_trace.h"
 #include "tables/maxp.h"
 #include "tables/name.h"
 #include "tables/os_2.h"
@@ -248,7 +253,7 @@ static std::string print_ps (const std::string &s, struct pschars *gsubrs=nullpt
 	  case cff::cs::callsubr:
 	    if (lsubrs) {
 		ss << "callsubr{";
-		extr = print_ps (lsubrs->css[prev_num + lsubrs->bias].sdata, gsubrs, lsubrs, hint_cnt);
+		extr = print_ps (lsubrs->css[prev_num + lsubrs->bias].str (), gsubrs, lsubrs, hint_cnt);
 		ss << extr;
 		ss << "} ";
 	    } else
@@ -345,7 +350,7 @@ static std::string print_ps (const std::string &s, struct pschars *gsubrs=nullpt
 	  case cff::cs::callgsubr:
 	    if (gsubrs) {
 		ss << "callgsubr{";
-		extr = print_ps (gsubrs->css[prev_num + gsubrs->bias].sdata, gsubrs, lsubrs, hint_cnt);
+		extr = print_ps (gsubrs->css[prev_num + gsubrs->bias].str (), gsubrs, lsubrs, hint_cnt);
 		ss << extr;
 		ss << "} ";
 	    } else
@@ -404,6 +409,7 @@ CffTable::CffTable (sfntFile *fontfile, TableHeader &props) :
     GlyphContainer (fontfile, props) {
 
     m_bad_cff = false;
+    m_rebuild_all = false;
     m_version = (props.iname == CHR('C','F','F','2')) ? 2 : 1;
 }
 
@@ -546,9 +552,8 @@ void CffTable::readCffSubrs (struct pschars &subs) {
     for (i=0; i<count; ++i) {
 	m_pos = base + offsets[i]-1;
 	if (offsets[i+1]>offsets[i] && offsets[i+1]-offsets[i]<0x10000) {
-	    int len = offsets[i+1]-offsets[i];
-	    struct charstring cs {data + m_pos, len};
-            subs.css.push_back (cs);
+	    uint32_t len = offsets[i+1]-offsets[i];
+            subs.css.emplace_back (data + m_pos, len);
 	// In CFF2 may have zero-length data for an empty glyph (as the advance
 	// width is obtained from hmtx anyway and the return op is deprecated)
 	} else if (m_version == 2 && offsets[i] == offsets[i+1]) {
@@ -563,7 +568,7 @@ void CffTable::readCffSubrs (struct pschars &subs) {
                     container->parent ());
 	    m_bad_cff = true;
 	    err = true;
-	    cs.sdata.push_back (11);		/* return */
+	    cs.assign (std::string (1, 11));	/* return */
             subs.css.push_back (cs);
 	}
     }
@@ -895,6 +900,60 @@ static void write_string_array (QDataStream &os, QBuffer &buf, std::vector<std::
     }
 }
 
+// Same as above, but takes data directly from charstring views
+static void write_charstrings (QDataStream &os, QBuffer &buf, const struct pschars &chars, double table_v) {
+    int len = chars.css.size ();
+    if (table_v > 1)
+        os << (uint32_t) len;
+    else
+        os << (uint16_t) len;
+    if (len == 0)
+	return;
+
+    uint32_t maxl = 0;
+    for (auto &cs : chars.css)
+        maxl += cs.size ();
+    uint8_t off_size = maxl > 0xFFFFFF ? 4 : maxl > 0xFFFF ? 3 : maxl > 0xFF ? 2 : 1;
+    os << off_size;
+    CffTable::encodeOff (os, off_size, 1);
+    uint32_t cur_off = 1;
+    for (auto &cs : chars.css) {
+        cur_off += cs.size ();
+        CffTable::encodeOff (os, off_size, cur_off);
+    }
+    for (auto &cs : chars.css)
+        buf.write (cs.data (), cs.size ());
+}
+
+// Point charstrings to their location in the newly compiled table data,
+// releasing the copies made for modified entries
+static void bind_charstrings (struct pschars &chars, const char *base, uint32_t pos, double table_v) {
+    uint32_t count;
+    if (table_v > 1) {
+	count = ((uint8_t) base[pos]<<24) | ((uint8_t) base[pos+1]<<16) |
+	    ((uint8_t) base[pos+2]<<8) | (uint8_t) base[pos+3];
+	pos += 4;
+    } else {
+	count = ((uint8_t) base[pos]<<8) | (uint8_t) base[pos+1];
+	pos += 2;
+    }
+    if (count == 0 || count != chars.css.size ())
+	return;
+    uint8_t off_size = base[pos++];
+    auto offset = [base, off_size] (uint32_t p) {
+	uint32_t ret = 0;
+	for (uint8_t i=0; i<off_size; i++)
+	    ret = (ret<<8) | (uint8_t) base[p+i];
+	return ret;
+    };
+    uint32_t data_start = pos + (count+1)*off_size - 1;
+    for (uint32_t i=0; i<count; i++) {
+	uint32_t off = offset (pos + i*off_size);
+	uint32_t noff = offset (pos + (i+1)*off_size);
+	chars.css[i].bind (base + data_start + off, noff - off);
+    }
+}
+
 void CffTable::writeCffTopDict (TopDict &td, QDataStream &os, QBuffer &buf, uint16_t off_size) {
     for (size_t i=0; i<td.size (); i++) {
 	auto &pair = td.by_idx (i);
@@ -1228,7 +1287,6 @@ void CffTable::writeSubFonts (QDataStream &os, QBuffer &buf, uint8_t off_size) {
     QBuffer sub_buf;
     QDataStream sub_os (&sub_buf);
     size_t cnt = m_core_font.subfonts.size ();
-    auto cs_data_extractor = [](const struct charstring &cs) { return cs.sdata; };
 
     top_dicts.resize (cnt);
     prv_dicts.resize (cnt);
@@ -1243,13 +1301,8 @@ void CffTable::writeSubFonts (QDataStream &os, QBuffer &buf, uint8_t off_size) {
 	sub_buf.open (QIODevice::WriteOnly);
 	writeCffPrivate (subf.private_dict, sub_os, sub_buf);
 	subf.top_dict[cff::Private].so.size = prv_dicts[i].size ();
-	if (subf.private_dict.has_key (cff::Subrs)) {
-	    std::vector<std::string> ls;
-	    ls.reserve (subf.local_subrs.cnt);
-	    std::transform (subf.local_subrs.css.cbegin (), subf.local_subrs.css.cend (),
-		std::back_inserter (ls), cs_data_extractor);
-	    write_string_array (sub_os, sub_buf, ls, m_version);
-	}
+	if (subf.private_dict.has_key (cff::Subrs))
+	    write_charstrings (sub_os, sub_buf, subf.local_subrs, m_version);
 	sub_buf.close ();
     }
 
@@ -1602,6 +1655,7 @@ void CffTable::readCffNames (std::vector<std::string> &names) {
 void CffTable::unpackData (sFont *font) {
     if (td_loaded)
         return;
+    FS_TRACE_SCOPE ("CFF unpack");
     // reading PS data may fail in various places, so set this flag here
     // (rather than at the end of the function)
     td_loaded = true;
@@ -1725,6 +1779,9 @@ void CffTable::updateGlyph (uint16_t gid) {
 	m_gsubrs,
 	lsubrs,
 	pdict,
+	nullptr,
+	nullptr,
+	nullptr,
     };
     m_hmtx->setaw (g->gid (), g->advanceWidth ());
     m_hmtx->setlsb (g->gid (), g->leftSideBearing ());
@@ -1732,10 +1789,11 @@ void CffTable::updateGlyph (uint16_t gid) {
     gbuf.open (QIODevice::WriteOnly);
     g->toPS (gbuf, gstream, ctx);
     gbuf.close ();
-    m_core_font.glyphs.css[gid].sdata = ga.toStdString ();
+    m_core_font.glyphs.css[gid].assign (ga.toStdString ());
 }
 
 void CffTable::packData () {
+    FS_TRACE_SCOPE ("CFF pack");
     QByteArray ba, tda, priva;
     QBuffer buf (&ba);
     QBuffer sec_buf;
@@ -1744,10 +1802,9 @@ void CffTable::packData () {
     QDataStream sec_os (&sec_buf);
     uint8_t off_size = (m_glyphs.size () > 256) ? 4 : 2;
     uint8_t hdr_size = (m_version > 1) ? 5 : 4;
-    auto cs_data_extractor = [](const struct charstring &cs) { return cs.sdata; };
-
-    delete[] data; data = nullptr;
 
+    // Unmodified charstrings still point to the old data, so it should
+    // be kept until the new table is ready
     std::vector<uint16_t> gmod;
     gmod.reserve (m_glyphs.size ());
     for (size_t i=0; i<m_glyphs.size (); i++) {
@@ -1762,21 +1819,13 @@ void CffTable::packData () {
     // glyphs doesn't exceed an arbitrary (small) number, then compile
     // only those glyphs, but without subroutines; otherwise update
     // everything
-    if (gmod.size () > 5) {
-	if (cidKeyed () || m_version > 1) {
-	    for (int i=0; i<numSubFonts (); i++)
-		updateCharStrings (m_core_font.glyphs, i, m_version);
-	} else
-	    updateCharStrings (m_core_font.glyphs, 0, m_version);
-
-	// Currently we don't use gsubrs, so it is safe to clear them after
-	// rebuilding charstring data
-	m_gsubrs.css.clear ();
-	m_gsubrs.cnt = 0;
+    if (gmod.size () > 5 || m_rebuild_all) {
+	updateCharStrings (m_core_font.glyphs, m_version);
     } else {
 	for (uint16_t gid: gmod)
 	    updateGlyph (gid);
     }
+    m_rebuild_all = false;
 
     os << (uint8_t) m_version;
     os << (uint8_t) 0;
@@ -1816,13 +1865,8 @@ void CffTable::packData () {
     if (m_version < 2) {
 	write_string_array (os, buf, m_core_font.strings, m_version);
     }
-    {
-        std::vector<std::string> ls;
-        ls.reserve (m_gsubrs.cnt);
-        std::transform (m_gsubrs.css.cbegin (), m_gsubrs.css.cend (),
-	    std::back_inserter (ls), cs_data_extractor);
-        write_string_array (os, buf, ls, m_version);
-    }
+    uint32_t gsubrs_pos = buf.pos ();
+    write_charstrings (os, buf, m_gsubrs, m_version);
     if (m_version > 1 && m_core_font.top_dict.has_key (cff::vstore)) {
 	uint32_t cur_pos = buf.pos ();
 	buf.seek (m_core_font.top_dict[cff::vstore].i + pre_td_pos);
@@ -1845,11 +1889,7 @@ void CffTable::packData () {
 	m_core_font.top_dict[cff::CharStrings].i = cur_pos;
 	buf.seek (cur_pos);
 
-        std::vector<std::string> ls;
-        ls.reserve (m_core_font.glyphs.cnt);
-        std::transform (m_core_font.glyphs.css.cbegin (), m_core_font.glyphs.css.cend (),
-	    std::back_inserter (ls), cs_data_extractor);
-	write_string_array (os, buf, ls, m_version);
+	write_charstrings (os, buf, m_core_font.glyphs, m_version);
     }
     if (m_version < 2 && m_core_font.top_dict.has_key (cff::Private)) {
 	uint32_t cur_pos = buf.pos ();
@@ -1859,13 +1899,8 @@ void CffTable::packData () {
 	buf.seek (cur_pos);
 
 	buf.write (priva);
-	if (m_core_font.private_dict.has_key (cff::Subrs)) {
-	    std::vector<std::string> ls;
-	    ls.reserve (m_core_font.local_subrs.cnt);
-	    std::transform (m_core_font.local_subrs.css.cbegin (), m_core_font.local_subrs.css.cend (),
-		std::back_inserter (ls), cs_data_extractor);
-	    write_string_array (os, buf, ls, m_version);
-	}
+	if (m_core_font.private_dict.has_key (cff::Subrs))
+	    write_charstrings (os, buf, m_core_font.local_subrs, m_version);
     }
     if (m_version < 2 && m_core_font.top_dict.has_key (cff::charset)) {
 	uint32_t cur_pos = buf.pos ();
@@ -1901,9 +1936,86 @@ void CffTable::packData () {
     start = 0xffffffff;
     m_tags[0] = m_version > 1 ? CHR('C','F','F','2') : CHR('C','F','F',' ');
 
+    releaseData ();
     newlen = ba.length ();
     data = new char[newlen];
     std::copy (ba.begin (), ba.end (), data);
+    bindCharStrings (gsubrs_pos);
+}
+
+// Local subroutines are always written just after the Private DICT
+void CffTable::bindCharStrings (uint32_t gsubrs_pos) {
+    bind_charstrings (m_gsubrs, data, gsubrs_pos, m_version);
+    if (m_core_font.top_dict.has_key (cff::CharStrings))
+	bind_charstrings (m_core_font.glyphs, data, m_core_font.top_dict[cff::CharStrings].i, m_version);
+    if (m_version < 2 && m_core_font.top_dict.has_key (cff::Private) &&
+	m_core_font.private_dict.has_key (cff::Subrs)) {
+	uint32_t off = m_core_font.top_dict[cff::Private].so.offset + m_core_font.top_dict[cff::Private].so.size;
+	bind_charstrings (m_core_font.local_subrs, data, off, m_version);
+    }
+    if (m_core_font.top_dict.has_key (cff::FDArray)) {
+	for (auto &subf : m_core_font.subfonts) {
+	    if (subf.top_dict.has_key (cff::Private) && subf.private_dict.has_key (cff::Subrs)) {
+		uint32_t off = subf.top_dict[cff::Private].so.offset + subf.top_dict[cff::Private].so.size;
+		bind_charstrings (subf.local_subrs, data, off, m_version);
+	    }
+	}
+    }
+}
+
+// Unmodified charstrings are views into 'data', so must follow it
+void CffTable::dataMoved (const char *old_data) {
+    auto rebase = [old_data, this] (struct pschars &chars) {
+	for (auto &cs : chars.css)
+	    cs.rebase (old_data, data);
+    };
+    rebase (m_gsubrs);
+    rebase (m_core_font.glyphs);
+    rebase (m_core_font.local_subrs);
+    for (auto &subf : m_core_font.subfonts)
+	rebase (subf.local_subrs);
+}
+
+// Heavily subroutinized fonts call the same subroutines thousands of times,
+// so decode each INDEX to tokens once, rather than every time a glyph is
+// interpreted. Glyphs may be decoded from several threads at once
+const struct subr_tokens *CffTable::subrTokens (const struct pschars &subrs) {
+    if (subrs.css.empty ())
+	return nullptr;
+    std::lock_guard<std::mutex> lock (m_subr_tokens_lock);
+    auto &entry = m_subr_tokens[&subrs];
+    if (!entry) {
+	FS_TRACE_SCOPE ("CFF subr tokenize");
+	entry = std::unique_ptr<struct subr_tokens> (new subr_tokens ());
+	ConicGlyph::tokenizeSubrs (subrs, *entry, m_version);
+	FS_TRACE_COUNTER ("CFF subr tokens", entry->tokens.size ());
+    }
+    return entry.get ();
+}
+
+// Must be called whenever global or local subroutines are replaced
+void CffTable::invalidateSubrTokens () {
+    std::lock_guard<std::mutex> lock (m_subr_tokens_lock);
+    m_subr_tokens.clear ();
+}
+
+// Unlike packData (), which keeps the existing charstrings if only a few
+// glyphs have been modified, always rebuild the entire charstring set,
+// so that the subroutines are recalculated from scratch
+void CffTable::subroutinize (sFont *fnt) {
+    if (!usable ())
+	return;
+    std::vector<uint16_t> gids;
+    gids.reserve (m_glyphs.size ());
+    for (size_t i=0; i<m_glyphs.size (); i++) {
+	if (!m_glyphs[i])
+	    gids.push_back (i);
+    }
+    QtConcurrent::blockingMap (gids, [this, fnt] (uint16_t &gid) {
+	glyph (fnt, gid);
+    });
+    m_rebuild_all = true;
+    packData ();
 }
 
 ConicGlyph* CffTable::glyph (sFont* fnt, uint16_t gid) {
@@ -1911,7 +2023,11 @@ ConicGlyph* CffTable::glyph (sFont* fnt, uint16_t gid) {
 	return nullptr;
     if (m_glyphs[gid])
         return m_glyphs[gid];
+    return decodeGlyph (fnt, gid, nullptr);
+}
 
+ConicGlyph* CffTable::decodeGlyph (sFont* fnt, uint16_t gid, const std::vector<std::vector<double>> *scalars) {
+    FS_TRACE_SCOPE ("CFF glyph decode");
     TopDict &dict = m_core_font.top_dict;
     int sub_idx = 0;
     uint16_t emsize = 1000;
@@ -1933,15 +2049,19 @@ ConicGlyph* CffTable::glyph (sFont* fnt, uint16_t gid) {
 	m_gsubrs,
 	lsubrs,
 	pdict,
+	subrTokens (m_gsubrs),
+	subrTokens (lsubrs),
+	scalars,
     };
 
     BaseMetrics gm = {emsize, fnt->ascent, fnt->descent};
-    ConicGlyph *g = glyph_pool.construct (gid, gm);
+    ConicGlyph *g = newGlyph (gid, gm);
     m_glyphs[gid] = g;
     if (m_hmtx)
         g->setHMetrics (m_hmtx->lsb (gid), m_hmtx->aw (gid));
 
-    BoostIn buf (m_core_font.glyphs.css[gid].sdata.c_str (), m_core_font.glyphs.css[gid].sdata.length ());
+    const struct charstring &cs = m_core_font.glyphs.css[gid];
+    SpanIn buf (cs.data (), cs.size ());
 
     g->fromPS (buf, ctx);
     if (!g->refs.empty () && fnt->enc->isUnicode ()) {
@@ -1958,7 +2078,7 @@ ConicGlyph* CffTable::glyph (sFont* fnt, uint16_t gid) {
 uint16_t CffTable::addGlyph (sFont* fnt, uint8_t subfont) {
     BaseMetrics gm = {fnt->units_per_em, fnt->ascent, fnt->descent};
     uint16_t gid = m_glyphs.size ();
-    ConicGlyph *g = glyph_pool.construct (gid, gm);
+    ConicGlyph *g = newGlyph (gid, gm);
     int aw = fnt->units_per_em/3;
     g->setHMetrics (aw, aw);
     g->setOutlinesType (OutlinesType::PS);
@@ -1996,6 +2116,45 @@ bool CffTable::usable () const {
     return (td_loaded && !m_bad_cff);
 }
 
+// Charstrings are independent from each other (the variation store index
+// CFF2 charstrings may switch is tracked by the decoder itself)
+bool CffTable::parallelDecodable () const {
+    return true;
+}
+
+size_t CffTable::memoryUsage () const {
+    auto pschars_size = [] (const struct pschars &chars) {
+	size_t ret = 0;
+	for (auto &cs : chars.css)
+	    ret += cs.memoryUsage ();
+	return ret;
+    };
+    size_t ret = GlyphContainer::memoryUsage ();
+    ret += pschars_size (m_gsubrs);
+    ret += pschars_size (m_core_font.glyphs);
+    ret += pschars_size (m_core_font.local_subrs);
+    for (auto &sub : m_core_font.subfonts)
+	ret += pschars_size (sub.local_subrs);
+    std::lock_guard<std::mutex> lock (m_subr_tokens_lock);
+    for (auto &pair : m_subr_tokens)
+	ret += pair.second->memoryUsage ();
+    return ret;
+}
+
+bool CffTable::evictable () const {
+    return reloadable ();
+}
+
+void CffTable::evict () {
+    clearGlyphs ();
+    invalidateSubrTokens ();
+    m_core_font = cff_font ();
+    m_gsubrs = pschars ();
+    m_bad_cff = false;
+    m_rebuild_all = false;
+    FontTable::evict ();
+}
+
 int CffTable::numSubFonts () const {
     return m_core_font.subfonts.size ();
 }
@@ -2075,47 +2234,101 @@ void CffTable::setFdSelect (uint16_t gid, uint16_t val) {
  * project and uses the same approach, i. e. SEQUITUR (Nevill-Manning)
  * algorithm (see http://www.eecs.harvard.edu/~michaelm/CS222/sequitur.pdf),
  * but with several modifications intended to improve both consistency
- * and compression ratio. One important difference is that I don't attempt
- * to split subroutines between "global" and "local" (as this difference
- * IMO makes no sense, unless there are multiple subfonts in CFF) and just
- * put everything to local subrs.
+ * and compression ratio. The whole font is processed at once: sequences
+ * shared by glyphs of several Font DICTs (in CID-keyed fonts and CFF2)
+ * go to global subrs, and everything else to local subrs.
  * This version of algorithm gives significantly better compression ratio
  * than one used in FontForge and is only slightly less effective than
- * FontLab and Adobe's makeotf utility. It is also fast enough */
+ * FontLab and Adobe's makeotf utility. Tokens are interned and digrams are
+ * looked up by integer hashes, so it scales to large CJK fonts */
 
 enum class SeqNode {
     GuardNode, GlyphNode, RuleNode, TerminalNode
 };
 
+// Identity of a token sequence (i. e. of the charstring fragment a node
+// expands to): two independent polynomial hashes of its terminal IDs plus
+// its length. The hash of a concatenation is calculated from those of its
+// parts, so that segments previously split into rules in different ways
+// (say (ab)c vs. a(bc)) still get the same key without being expanded
+struct seq_key {
+    uint64_t h1 = 0, h2 = 0;
+    uint32_t len = 0;
+
+    bool operator == (const seq_key &other) const {
+	return (h1 == other.h1 && h2 == other.h2 && len == other.len);
+    };
+};
+
+struct seq_content {
+    seq_key key;
+    // base^len for both hashes, needed to append this sequence to another one
+    uint64_t p1 = 1, p2 = 1;
+};
+
+static const uint64_t seq_mod2 = (1ULL<<61) - 1;
+static const uint64_t seq_base1 = 0x100000001B3ULL;
+static const uint64_t seq_base2 = 0x1F3D5B79ULL;
+
+// Multiplication modulo 2^61-1 without 128-bit integers
+static uint64_t mulmod61 (uint64_t a, uint64_t b) {
+    uint64_t a1 = a>>32, a0 = a&0xFFFFFFFF;
+    uint64_t b1 = b>>32, b0 = b&0xFFFFFFFF;
+    uint64_t mid = a1*b0 + a0*b1;
+    uint64_t lo = a0*b0;
+    uint64_t ret = ((a1*b1)<<3) + (mid>>29) + ((mid&0x1FFFFFFF)<<32) +
+	(lo&seq_mod2) + (lo>>61);
+    ret = (ret&seq_mod2) + (ret>>61);
+    return (ret >= seq_mod2) ? ret - seq_mod2 : ret;
+}
+
+static seq_content seq_concat (const seq_content &a, const seq_content &b) {
+    seq_content ret;
+    ret.key.h1 = a.key.h1*b.p1 + b.key.h1;
+    ret.key.h2 = mulmod61 (a.key.h2, b.p2) + b.key.h2;
+    if (ret.key.h2 >= seq_mod2) ret.key.h2 -= seq_mod2;
+    ret.key.len = a.key.len + b.key.len;
+    ret.p1 = a.p1*b.p1;
+    ret.p2 = mulmod61 (a.p2, b.p2);
+    return ret;
+}
+
 struct seq_node;
 
 struct sub_rule {
-    static int rule_cnt;
     static const int min_length = 8;
-    static const int min_usecnt = 2;
     static const int max_depth = 10;
-
-    int use_cnt = 0, ID = 0, subrID = -1;
+    // With the largest bias subr numbers span the whole int16 range, but
+    // a CFF (v1) INDEX can hold no more than 65535 entries (the count is Card16)
+    static const int max_subrs = 65536;
+    static const int max_cff1_subrs = 65535;
+
+    int ID = 0, subrID = -1;
+    // Subr number as encoded in charstrings (i. e. with bias subtracted)
+    int callNum = 0;
+    // Global subr, or a local subr of the specified Font DICT
+    bool global = false;
+    int fd = 0;
     struct seq_node *head;
+    seq_content content;
 
-    const std::string getCharString (int bias, bool needs_return, bool &endchar, bool pack=true) const;
-    int depth () const;
-    bool isWrapper () const;
-    void handleWrapper ();
+    const std::string getCharString (const std::vector<std::string> &terms,
+	bool needs_return, bool &endchar, bool pack=true) const;
 };
 
-int sub_rule::rule_cnt = 0;
-
 struct seq_node {
     SeqNode ntype = SeqNode::TerminalNode;
     bool endchar = false;
-    int sub_idx = 0, gid = -1;
-    std::string sdata, hexdata;
+    // Font DICT index, for glyph nodes
+    uint16_t fd = 0;
+    int gid = -1;
+    uint32_t term = 0;
     struct seq_node *prev=nullptr, *next=nullptr;
     struct sub_rule *rule=nullptr, *outer=nullptr;
 
-    void setData (const std::string &s);
-    std::string strID () const;
+    bool token () const {
+	return (ntype == SeqNode::TerminalNode || ntype == SeqNode::RuleNode);
+    };
     void insertSingle (seq_node *n);
     // insert two nodes after this node
     void insertDouble (seq_node *n);
@@ -2123,42 +2336,9 @@ struct seq_node {
     void replaceDouble (seq_node *n);
     // replace the node after this node with the specified node (currently unused)
     void replaceSingle (seq_node *n);
-    void makeRule (std::map<std::string, struct seq_node*> &dhash,
-	boost::object_pool<struct seq_node> &npool, std::deque<struct sub_rule> &rules);
     bool packed ();
 };
 
-void seq_node::setData (const std::string &s) {
-    std::stringstream ss;
-    ss << std::hex << std::setfill ('0');
-    for (auto ch: s)
-        ss << std::setw (2) << (ch&0xff);
-
-    sdata = s;
-    hexdata = ss.str ();
-}
-
-// Nodes (both rules and terminal) are identified by their contents,
-// while any other details are ignored. So we get identical keys
-// even for those segments which have been previously splitted to rules
-// by a different way (say (ab)c vs. a(bc)). This is a crucial point
-// in order to get same representation for identical glyphs and glyph
-// fragments, no matter what was the order of their processing
-std::string seq_node::strID () const {
-    std::stringstream ss;
-    if (ntype == SeqNode::RuleNode) {
-	seq_node *subn = rule->head;
-	do {
-	    if (subn->ntype == SeqNode::RuleNode || subn->ntype == SeqNode::TerminalNode)
-		ss << subn->strID ();
-	    subn = subn->next;
-	} while (subn != rule->head);
-    } else {
-        ss << "-+-" << hexdata;
-    }
-    return ss.str ();
-}
-
 void seq_node::insertSingle (seq_node *n) {
     n->next = this->next;
     this->next->prev = n;
@@ -2190,63 +2370,261 @@ void seq_node::replaceSingle (seq_node *n) {
     n->prev = this;
 }
 
-void seq_node::makeRule (std::map<std::string, struct seq_node*> &dhash,
-    boost::object_pool<struct seq_node> &npool,
-    std::deque<struct sub_rule> &rules) {
-    // first get key, then set node type (otherwise would recur to
-    // subnodes which don't exist yet)
-    std::string key (this->strID ());
-    ntype = SeqNode::RuleNode;
-
-    if (dhash.count (key)) {
-        this->rule = dhash[key]->outer;
-        this->rule->use_cnt++;
-    } else {
-        rules.emplace_back ();
-        struct sub_rule *r = &rules.back ();
-        r->ID = sub_rule::rule_cnt++;
-        rule = r;
-        this->rule = r;
-        this->rule->use_cnt++;
-
-        struct seq_node *guard = npool.construct ();
-        guard->ntype = SeqNode::GuardNode;
-        struct seq_node *sub = npool.construct ();
-        sub->setData (this->sdata);
-        guard->next = sub;
-        sub->prev = guard;
-        sub->next = guard;
-        guard->prev = sub;
-        r->head = guard;
-        sub->outer = r;
-        dhash[sub->strID ()] = sub;
-    }
-    setData (std::string ());
-}
-
 bool seq_node::packed () {
     bool ret = (this->prev->ntype == SeqNode::GuardNode &&
     	    this->next->next->ntype == SeqNode::GuardNode);
     return ret;
 }
 
-const std::string sub_rule::getCharString (int bias, bool needs_return, bool &endchar, bool pack) const {
+// Digram index: maps the content of a pair of adjacent nodes to the first
+// node of the pair. Open addressing with linear probing; deleted entries are
+// removed by shifting the subsequent entries back, so that there are no
+// tombstones to slow down lookups as digrams come and go
+class digram_table {
+public:
+    digram_table () : m_cnt (0) {
+	m_slots.resize (4096);
+    };
+
+    seq_node *find (const seq_key &key) const {
+	size_t mask = m_slots.size () - 1;
+	for (size_t i = slot (key);; i = (i+1)&mask) {
+	    const entry &e = m_slots[i];
+	    if (!e.node || e.key == key)
+		return e.node;
+	}
+    };
+
+    void insert (const seq_key &key, seq_node *n) {
+	if ((m_cnt+1)*2 > m_slots.size ())
+	    grow ();
+	size_t mask = m_slots.size () - 1;
+	size_t i = slot (key);
+	while (m_slots[i].node && !(m_slots[i].key == key))
+	    i = (i+1)&mask;
+	if (!m_slots[i].node)
+	    m_cnt++;
+	m_slots[i].key = key;
+	m_slots[i].node = n;
+    };
+
+    // Remove the entry only if it still points to the given node
+    void erase (const seq_key &key, const seq_node *n) {
+	size_t mask = m_slots.size () - 1;
+	size_t i = slot (key);
+	while (m_slots[i].node && !(m_slots[i].key == key))
+	    i = (i+1)&mask;
+	if (m_slots[i].node != n || !n)
+	    return;
+	m_slots[i].node = nullptr;
+	m_cnt--;
+	for (size_t j = (i+1)&mask; m_slots[j].node; j = (j+1)&mask) {
+	    size_t home = slot (m_slots[j].key);
+	    // Move the entry to the hole if the hole is cyclically between
+	    // its home slot and its current position
+	    if (((j - home)&mask) >= ((j - i)&mask)) {
+		m_slots[i] = m_slots[j];
+		m_slots[j].node = nullptr;
+		i = j;
+	    }
+	}
+    };
+
+    size_t memoryUsage () const {
+	return m_slots.capacity () * sizeof (entry);
+    };
+
+private:
+    struct entry {
+	seq_key key;
+	seq_node *node = nullptr;
+    };
+
+    size_t slot (const seq_key &key) const {
+	uint64_t h = (key.h1 ^ (key.h2 * 0x9E3779B97F4A7C15ULL) ^ key.len) * 0xFF51AFD7ED558CCDULL;
+	return (h >> 32) & (m_slots.size () - 1);
+    };
+
+    void grow () {
+	std::vector<entry> old (m_slots.size () * 2);
+	old.swap (m_slots);
+	m_cnt = 0;
+	for (auto &e : old) {
+	    if (e.node)
+		insert (e.key, e.node);
+	}
+    };
+
+    std::vector<entry> m_slots;
+    size_t m_cnt;
+};
+
+// The grammar being built: the list of charstring tokens (starting from
+// 'head') and the rules the repeated digrams are replaced with. Terminals
+// (charstring fragments, each ending with an operator) are interned, so that
+// nodes only store their integer IDs
+struct seq_graph {
+    FontShepherd::ObjectArena<seq_node> npool;
+    std::deque<struct sub_rule> rules;
+    digram_table digrams;
+    std::vector<std::string> terms;
+    std::vector<seq_content> term_content;
+    std::vector<struct sub_rule *> term_rules;
+    std::unordered_map<std::string, uint32_t> term_ids;
+    seq_node *head;
+
+    seq_graph ();
+    uint32_t terminal (const std::string &s);
+    const seq_content &content (const seq_node *n) const;
+    seq_key pairKey (const seq_node *n) const;
+    sub_rule *newRule ();
+    void makeRule (seq_node *n);
+    void append (seq_node *n);
+    size_t memoryUsage () const;
+};
+
+seq_graph::seq_graph () {
+    head = npool.construct ();
+    head->ntype = SeqNode::GuardNode;
+    head->next = head->prev = head;
+}
+
+uint32_t seq_graph::terminal (const std::string &s) {
+    auto it = term_ids.find (s);
+    if (it != term_ids.end ())
+	return it->second;
+
+    uint32_t id = terms.size ();
+    seq_content c;
+    c.key.h1 = c.key.h2 = id + 1;
+    c.key.len = 1;
+    c.p1 = seq_base1;
+    c.p2 = seq_base2;
+    terms.push_back (s);
+    term_content.push_back (c);
+    term_rules.push_back (nullptr);
+    term_ids.emplace (s, id);
+    return id;
+}
+
+const seq_content &seq_graph::content (const seq_node *n) const {
+    return (n->ntype == SeqNode::RuleNode) ? n->rule->content : term_content[n->term];
+}
+
+// Key of the digram starting from the given node
+seq_key seq_graph::pairKey (const seq_node *n) const {
+    return seq_concat (content (n), content (n->next)).key;
+}
+
+sub_rule *seq_graph::newRule () {
+    rules.emplace_back ();
+    sub_rule *r = &rules.back ();
+    r->ID = rules.size () - 1;
+    r->head = npool.construct ();
+    r->head->ntype = SeqNode::GuardNode;
+    r->head->next = r->head->prev = r->head;
+    return r;
+}
+
+// Long terminals are always turned into rules, so that they can be
+// matched as a whole, even if used only once within a longer sequence
+void seq_graph::makeRule (seq_node *n) {
+    sub_rule *&r = term_rules[n->term];
+    if (!r) {
+	r = newRule ();
+	r->content = term_content[n->term];
+	seq_node *sub = npool.construct ();
+	sub->term = n->term;
+	sub->endchar = n->endchar;
+	sub->outer = r;
+	r->head->insertSingle (sub);
+    }
+    n->ntype = SeqNode::RuleNode;
+    n->rule = r;
+}
+
+void seq_graph::append (seq_node *node) {
+    while (true) {
+	seq_node *last = head->prev;
+	if (!last->token ()) {
+	    last->insertSingle (node);
+	    return;
+	}
+	seq_key key = seq_concat (content (last), content (node)).key;
+	seq_node *ins = digrams.find (key);
+	// Don't let a digram overlap with itself (as in "aaa")
+	if (!ins || ins->next == last) {
+	    if (!ins)
+		digrams.insert (key, last);
+	    last->insertSingle (node);
+	    return;
+	}
+
+	sub_rule *r;
+	if (!ins->packed ()) {
+	    if (ins->prev->token ())
+		digrams.erase (pairKey (ins->prev), ins->prev);
+	    if (ins->next->next->token ())
+		digrams.erase (pairKey (ins->next), ins->next);
+
+	    seq_node *repl = npool.construct ();
+	    r = newRule ();
+	    r->content = seq_concat (content (ins), content (ins->next));
+	    ins->prev->replaceDouble (repl);
+	    repl->rule = r;
+	    repl->ntype = SeqNode::RuleNode;
+	    r->head->insertDouble (ins);
+
+	    if (repl->prev->token () && !digrams.find (pairKey (repl->prev)))
+		digrams.insert (pairKey (repl->prev), repl->prev);
+	    if (repl->next->token () && !digrams.find (pairKey (repl)))
+		digrams.insert (pairKey (repl), repl);
+	    ins->outer = r;
+	} else {
+	    r = ins->outer;
+	}
+	// The last node in the list is absorbed by our rule, so first remove
+	// the pair it forms with the previous node, and then the node itself
+	last = head->prev;
+	if (last->prev->token ())
+	    digrams.erase (pairKey (last->prev), last->prev);
+	last->prev->next = head;
+	head->prev = last->prev;
+	npool.destroy (last);
+
+	node->ntype = SeqNode::RuleNode;
+	node->rule = r;
+	// Loop to check if we can do one more replacement
+    }
+}
+
+size_t seq_graph::memoryUsage () const {
+    size_t ret = npool.memoryUsage () + digrams.memoryUsage ();
+    ret += rules.size () * sizeof (sub_rule);
+    ret += term_content.capacity () * sizeof (seq_content) + term_rules.capacity () * sizeof (sub_rule *);
+    for (auto &s : terms)
+	ret += s.capacity () * 2 + sizeof (std::string) * 2;
+    return ret;
+}
+
+const std::string sub_rule::getCharString (const std::vector<std::string> &terms,
+    bool needs_return, bool &endchar, bool pack) const {
     seq_node *n = head->next;
     std::stringstream sout;
     do {
 	switch (n->ntype) {
 	  case SeqNode::RuleNode:
 	    if (pack && n->rule->subrID >= 0) {
-		CffTable::encodeInt (sout, n->rule->subrID - bias);
-		sout.put (cff::cs::callsubr);
+		CffTable::encodeInt (sout, n->rule->callNum);
+		sout.put (n->rule->global ? cff::cs::callgsubr : cff::cs::callsubr);
 	    } else {
-		sout << n->rule->getCharString (bias, false, endchar);
+		sout << n->rule->getCharString (terms, false, endchar);
 		if (endchar)
 		    return sout.str ();
 	    }
 	    break;
 	  case SeqNode::TerminalNode:
-	    sout << n->sdata;
+	    sout << terms[n->term];
 	    endchar = n->endchar;
 	    if (endchar)
 		return sout.str ();
@@ -2261,78 +2639,20 @@ const std::string sub_rule::getCharString (int bias, bool needs_return, bool &en
     return sout.str ();
 }
 
-int sub_rule::depth () const {
-    struct seq_node *tn = this->head;
-    int max = 0;
-    do {
-        int dp = (tn->ntype == SeqNode::RuleNode) ? tn->rule->depth () : 0;
-        if (dp > max) max = dp;
-        tn = tn->next;
-    } while (tn != this->head);
-    if (use_cnt >= sub_rule::min_usecnt) max+= 1;
-    return max;
-}
-
-// Suppose we have a rule which joins either two other rules or a rule
-// and a single-byte op without operands (most typically endchar).
-// If we convert this rule to a subr it would probably take from 3 to 5 bytes
-// ("x callsubr y callsubr return" or "x callsubr endchar") plus an offset to
-// the subr, while calling such a subr from another charstring requires
-// at least 2 bytes (z callsubr). Thus if there are only two calls to
-// a subr, then it would be cheaper in terms of the disk space to place
-// the subr contents directly into the corresponding charstrings. On the
-// other hand, it is also possible to remove the "inner" subrs placing their
-// contents into the "outer" subr. In fact determining which subrs to keep is
-// the key point which must be maintained to achieve an effective
-// compression instead of making the CFF table even bigger. Now we
-// determine this by comparing the use counter and resetting it to zero
-// for less commonly used subrs
-bool sub_rule::isWrapper () const {
-    struct seq_node *tn = this->head;
-    bool ret = true;
-    do {
-	if ((tn->ntype == SeqNode::TerminalNode && !tn->endchar) ||
-	    (tn->ntype == SeqNode::RuleNode && tn->rule->use_cnt < sub_rule::min_usecnt))
-	    ret = false;
-    } while (tn != this->head && ret);
-    return ret;
-}
-
-void sub_rule::handleWrapper () {
-    struct seq_node *tn = this->head;
-    int max_used = 0;
-    do {
-	if (tn->ntype == SeqNode::RuleNode && tn->rule->use_cnt > max_used)
-	    max_used = tn->rule->use_cnt;
-	tn = tn->next;
-    } while (tn != this->head);
-
-    if (max_used <= this->use_cnt) {
-	tn = this->head;
-	do {
-	    if (tn->ntype == SeqNode::RuleNode)
-		tn->rule->use_cnt = 0;
-	    tn = tn->next;
-	} while (tn != this->head);
-    } else
-	this->use_cnt = 0;
-}
-
 #if CS_DEBUG
 
-static void show_graph (struct seq_node *head, int level) {
+static void show_graph (const seq_graph &graph, struct seq_node *head, int level) {
     struct seq_node *n = head->next;
     while (n != head) {
 	for (int i=0; i<level; i++)
 	    std::cerr << "\t";
 	switch (n->ntype) {
 	  case SeqNode::RuleNode:
-	    std::cerr << n->strID () << " " << n->rule->subrID
-		<< " used: " << n->rule->use_cnt << " depth: " << n->rule->depth () << std::endl;
-	    show_graph (n->rule->head, level+1);
+	    std::cerr << "rule " << n->rule->ID << " subr " << n->rule->subrID << std::endl;
+	    show_graph (graph, n->rule->head, level+1);
 	    break;
 	  case SeqNode::TerminalNode:
-	    std::cerr << print_ps (n->sdata) << std::endl;
+	    std::cerr << print_ps (graph.terms[n->term]) << std::endl;
 	    break;
 	  case SeqNode::GlyphNode:
 	    std::cerr << "glyph " << n->gid << std::endl;
@@ -2346,217 +2666,419 @@ static void show_graph (struct seq_node *head, int level) {
 
 #endif
 
-static void add_to_graph (struct seq_node *nhead,
-    std::map<std::string, struct seq_node*> &dhash,
-    boost::object_pool<struct seq_node> &npool,
-    std::deque<struct sub_rule> &rules,
-    struct seq_node *node) {
-
-    if (nhead->prev->ntype == SeqNode::TerminalNode || nhead->prev->ntype == SeqNode::RuleNode) {
-	std::stringstream skey;
-	skey << nhead->prev->strID () << node->strID ();
-	if (dhash.count (skey.str ())) {
-	    struct seq_node *ins = dhash[skey.str ()];
-	    struct sub_rule *r;
-	    std::stringstream snextkey, sprevkey;
-	    if (!ins->packed ()) {
-		sprevkey << ins->prev->strID () << ins->strID ();
-		if (dhash.count (sprevkey.str ()) && dhash[sprevkey.str ()] == ins->prev)
-		    dhash.erase (sprevkey.str ());
-		snextkey << ins->next->strID () << ins->next->next->strID ();
-		if (dhash.count (snextkey.str ()) && dhash[snextkey.str ()] == ins->next)
-		    dhash.erase (snextkey.str ());
-
-		struct seq_node *repl = npool.construct ();
-		ins->prev->replaceDouble (repl);
-
-		rules.emplace_back ();
-		r = &rules.back ();
-		r->ID = sub_rule::rule_cnt++;
-		repl->rule = r;
-		repl->ntype = SeqNode::RuleNode;
-		r->use_cnt++;
-
-		r->head = npool.construct ();
-		r->head->ntype = SeqNode::GuardNode;
-		r->head->next = r->head->prev = r->head;
-		r->head->insertDouble (ins);
-
-		sprevkey.str (std::string ());
-		sprevkey << repl->prev->strID () << repl->strID ();
-		if (!dhash.count (sprevkey.str ()))
-		    dhash[sprevkey.str ()] = repl->prev;
-		snextkey.str (std::string ());
-		snextkey << repl->strID () << repl->next->strID ();
-		if (!dhash.count (snextkey.str ()))
-		    dhash[snextkey.str ()] = repl;
-
-		if (ins->ntype == SeqNode::RuleNode) ins->rule->use_cnt--;
-		if (ins->next->ntype == SeqNode::RuleNode) ins->next->rule->use_cnt--;
-		ins->outer = r;
+static int encoded_int_size (int val) {
+    if (val >= -107 && val <= 107)
+	return 1;
+    else if (val >= -1131 && val <= 1131)
+	return 2;
+    else if (val >= -32768 && val < 32768)
+	return 3;
+    return 5;
+}
+
+static int subrs_bias (int cnt) {
+    return cnt < 1240 ? 107 : cnt < 33900 ? 1131 : 32768;
+}
+
+// Selecting rules to be converted to subroutines is the key point which must
+// be maintained to achieve an effective compression instead of making the CFF
+// table even bigger. A subr costs its own body, a return op and an offset in
+// the INDEX, while each call to it costs the subr number and a callsubr op.
+// So a rule is kept only if inlining it everywhere would take more bytes.
+// Both the number of times a rule is actually emitted and its body size depend
+// on which other rules are kept, so the estimate is refined over several
+// passes: top-down to count emissions, bottom-up (rules only refer to earlier
+// ones) to measure bodies and select. The final pass uses the real call cost
+// for the subr numbers assigned (the most frequently called subrs get the
+// shortest numbers).
+// Rules reached from glyphs of more than one Font DICT go to global subrs,
+// and the rest to the local subrs of their Font DICT. As a rule is reached
+// from everywhere its parents are, a global subr never has to call a local one
+class subr_selector {
+public:
+    subr_selector (seq_graph &graph, int fd_cnt, bool needs_return, size_t max_subrs) :
+	m_graph (graph), m_fd_cnt (fd_cnt), m_return (needs_return), m_max_subrs (max_subrs) {};
+    void select ();
+    int globalCount () const;
+    int localCount (int fd) const;
+
+private:
+    // Font DICT scope of a rule: not reached, reached from a single Font DICT
+    // (its index), or from several of them
+    enum { no_fd = -1, multi_fd = -2 };
+
+    void findScopes ();
+    void countCalls ();
+    void measure (std::function<int (const sub_rule &)> call_cost);
+    void assignIDs ();
+
+    seq_graph &m_graph;
+    int m_fd_cnt;
+    bool m_return;
+    size_t m_max_subrs;
+    std::vector<uint32_t> m_calls, m_main;
+    std::vector<uint32_t> m_len;
+    std::vector<uint8_t> m_depth;
+    std::vector<bool> m_endchar, m_sel;
+    std::vector<int> m_scope;
+    int m_global_cnt = 0;
+    std::vector<int> m_local_cnt;
+};
+
+static int merge_scope (int s1, int s2) {
+    if (s1 == s2 || s2 == -1)
+	return s1;
+    return (s1 == -1) ? s2 : -2;
+}
+
+void subr_selector::findScopes () {
+    auto &rules = m_graph.rules;
+    seq_node *head = m_graph.head;
+    int fd = 0;
+
+    m_main.assign (rules.size (), 0);
+    m_scope.assign (rules.size (), no_fd);
+    for (seq_node *n = head->next; n != head; n = n->next) {
+	if (n->ntype == SeqNode::GlyphNode)
+	    fd = n->fd;
+	else if (n->ntype == SeqNode::RuleNode) {
+	    m_main[n->rule->ID]++;
+	    m_scope[n->rule->ID] = merge_scope (m_scope[n->rule->ID], fd);
+	}
+    }
+    for (size_t i=rules.size (); i>0; i--) {
+	const sub_rule &r = rules[i-1];
+	for (seq_node *n = r.head->next; n != r.head; n = n->next) {
+	    if (n->ntype == SeqNode::RuleNode)
+		m_scope[n->rule->ID] = merge_scope (m_scope[n->rule->ID], m_scope[r.ID]);
+	}
+    }
+}
+
+void subr_selector::countCalls () {
+    auto &rules = m_graph.rules;
+    m_calls = m_main;
+    for (size_t i=rules.size (); i>0; i--) {
+	const sub_rule &r = rules[i-1];
+	uint32_t mult = m_sel[r.ID] ? 1 : m_calls[r.ID];
+	for (seq_node *n = r.head->next; n != r.head; n = n->next) {
+	    if (n->ntype == SeqNode::RuleNode)
+		m_calls[n->rule->ID] += mult;
+	}
+    }
+}
+
+void subr_selector::measure (std::function<int (const sub_rule &)> call_cost) {
+    for (auto &r : m_graph.rules) {
+	uint32_t len = 0;
+	int depth = 0;
+	bool endchar = false;
+	for (seq_node *n = r.head->next; n != r.head; n = n->next) {
+	    if (n->ntype == SeqNode::RuleNode) {
+		const sub_rule &c = *n->rule;
+		if (m_sel[c.ID]) {
+		    len += call_cost (c);
+		    depth = std::max (depth, m_depth[c.ID] + 1);
+		} else {
+		    len += m_len[c.ID];
+		    depth = std::max<int> (depth, m_depth[c.ID]);
+		}
+		endchar = m_endchar[c.ID];
 	    } else {
-		r = ins->outer;
+		len += m_graph.terms[n->term].size ();
+		endchar = n->endchar;
 	    }
-	    // Remove pair for two previous nodes
-	    sprevkey.str (std::string ());
-	    sprevkey << nhead->prev->prev->strID () << nhead->prev->strID ();
-	    if (dhash.count (sprevkey.str ()) && dhash[sprevkey.str ()] == nhead->prev->prev)
-		dhash.erase (sprevkey.str ());
-
-	    // Remove the last node in the list (absorbed by our rule)
-	    struct seq_node *del = nhead->prev;
-	    nhead->prev->prev->next = nhead;
-	    nhead->prev = nhead->prev->prev;
-	    npool.free (del);
-
-	    node->ntype = SeqNode::RuleNode;
-	    node->setData (std::string ());
-	    node->rule = r;
-	    r->use_cnt++;
-
-	    // Recursion to check if we can do one more replacement
-	    add_to_graph (nhead, dhash, npool, rules, node);
-	} else {
-	    dhash[skey.str ()] = nhead->prev;
-	    nhead->prev->insertSingle (node);
+	    if (endchar)
+		break;
 	}
-    } else {
-        nhead->prev->insertSingle (node);
+	m_len[r.ID] = len;
+	m_depth[r.ID] = depth;
+	m_endchar[r.ID] = endchar;
+
+	uint64_t calls = m_calls[r.ID];
+	int ret = (m_return && !endchar) ? 1 : 0;
+	// 2 bytes for the INDEX offset is a reasonable average
+	uint64_t inlined = calls * len;
+	uint64_t called = calls * call_cost (r) + len + ret + 2;
+	m_sel[r.ID] = (calls >= 2 && depth + 1 < sub_rule::max_depth && called < inlined);
     }
 }
 
-static void make_subrs (struct pschars &chars, struct pschars &subrs,
-    struct seq_node *head, std::deque<struct sub_rule> &rules, bool needs_return) {
+void subr_selector::assignIDs () {
+    // Global subrs first, then local subrs of each Font DICT
+    std::vector<std::vector<sub_rule *>> sel (m_fd_cnt + 1);
+    for (auto &r : m_graph.rules) {
+	r.subrID = -1;
+	if (!m_sel[r.ID])
+	    continue;
+	int scope = m_scope[r.ID];
+	r.global = (scope == multi_fd);
+	if (r.global)
+	    sel[0].push_back (&r);
+	else if (scope >= 0 && scope < m_fd_cnt) {
+	    r.fd = scope;
+	    sel[scope+1].push_back (&r);
+	}
+	else
+	    m_sel[r.ID] = false;
+    }
+
+    m_local_cnt.assign (m_fd_cnt, 0);
+    for (size_t i=0; i<sel.size (); i++) {
+	auto &lst = sel[i];
+	std::stable_sort (lst.begin (), lst.end (), [this] (const sub_rule *r1, const sub_rule *r2) {
+	    return m_calls[r1->ID] > m_calls[r2->ID];
+	});
+	if (lst.size () > m_max_subrs) {
+	    for (size_t j=m_max_subrs; j<lst.size (); j++)
+		m_sel[lst[j]->ID] = false;
+	    lst.resize (m_max_subrs);
+	}
+	int bias = subrs_bias (lst.size ());
+	for (size_t j=0; j<lst.size (); j++) {
+	    lst[j]->subrID = j;
+	    lst[j]->callNum = j - bias;
+	}
+	if (i == 0)
+	    m_global_cnt = lst.size ();
+	else
+	    m_local_cnt[i-1] = lst.size ();
+    }
+}
+
+void subr_selector::select () {
+    size_t cnt = m_graph.rules.size ();
+    m_len.assign (cnt, 0);
+    m_depth.assign (cnt, 0);
+    m_endchar.assign (cnt, false);
+    m_sel.assign (cnt, false);
+    findScopes ();
+
+    auto estimated_cost = [] (const sub_rule &) { return 3; };
+    for (int pass=0; pass<3; pass++) {
+	countCalls ();
+	measure (estimated_cost);
+    }
+    countCalls ();
+    assignIDs ();
 
-    int subr_id = 0, gid = 0;
+    auto real_cost = [] (const sub_rule &r) {
+	return r.subrID >= 0 ? encoded_int_size (r.callNum) + 1 : 3;
+    };
+    measure (real_cost);
+    assignIDs ();
+}
+
+int subr_selector::globalCount () const {
+    return m_global_cnt;
+}
+
+int subr_selector::localCount (int fd) const {
+    return m_local_cnt[fd];
+}
+
+static void make_subrs (struct pschars &chars, struct pschars &gsubrs, std::vector<struct pschars *> &lsubrs,
+    seq_graph &graph, double version) {
+    bool needs_return = (version < 2);
+    int gid = -1;
     std::stringstream sout;
+    seq_node *head = graph.head;
     struct seq_node *n = head->next;
 
-    for (auto &rule: rules) {
-	if (rule.isWrapper () && rule.use_cnt >= sub_rule::min_usecnt)
-	    rule.handleWrapper ();
-    }
-    for (auto &rule: rules) {
-	if (rule.use_cnt >= sub_rule::min_usecnt && rule.depth () < sub_rule::max_depth)
-	    rule.subrID = subr_id++;
-    }
-    subrs.cnt = subr_id;
-    subrs.bias = subrs.cnt < 1240 ? 107 : subrs.cnt < 33900 ? 1131 : 32768;
-    subrs.css.resize (subrs.cnt);
-    for (auto &rule: rules) {
+    subr_selector selector (graph, lsubrs.size (), needs_return,
+	version < 2 ? sub_rule::max_cff1_subrs : sub_rule::max_subrs);
+    selector.select ();
+    gsubrs.cnt = selector.globalCount ();
+    gsubrs.bias = subrs_bias (gsubrs.cnt);
+    gsubrs.css.resize (gsubrs.cnt);
+    for (size_t i=0; i<lsubrs.size (); i++) {
+	lsubrs[i]->cnt = selector.localCount (i);
+	lsubrs[i]->bias = subrs_bias (lsubrs[i]->cnt);
+	lsubrs[i]->css.resize (lsubrs[i]->cnt);
+    }
+    for (auto &rule: graph.rules) {
 	bool endchar = false;
-	if (rule.subrID >= 0)
-	    subrs.css[rule.subrID].sdata = rule.getCharString (subrs.bias, needs_return, endchar);
+	if (rule.subrID < 0)
+	    continue;
+	struct pschars &subrs = rule.global ? gsubrs : *lsubrs[rule.fd];
+	subrs.css[rule.subrID].assign (rule.getCharString (graph.terms, needs_return, endchar));
     }
 
     while (n != head) {
 	switch (n->ntype) {
 	  case SeqNode::RuleNode:
 	    if (n->rule->subrID >= 0) {
-		CffTable::encodeInt (sout, n->rule->subrID - subrs.bias);
-		sout.put (cff::cs::callsubr);
+		CffTable::encodeInt (sout, n->rule->callNum);
+		sout.put (n->rule->global ? cff::cs::callgsubr : cff::cs::callsubr);
 	    } else {
 		bool endchar = false;
-		sout << n->rule->getCharString (subrs.bias, false, endchar);
+		sout << n->rule->getCharString (graph.terms, false, endchar);
 	    }
 	    break;
 	  case SeqNode::TerminalNode:
-	    sout << n->sdata;
+	    sout << graph.terms[n->term];
 	    break;
 	  case SeqNode::GlyphNode:
-	    if (n->gid > gid) {
-		chars.css[gid].sdata = sout.str ();
-		sout.str (std::string ());
-		gid = n->gid;
-	    }
+	    if (gid >= 0)
+		chars.css[gid].assign (sout.str ());
+	    sout.str (std::string ());
+	    gid = n->gid;
 	  default:
 	    ;
 	}
 	n = n->next;
     }
     // last glyph
-    chars.css[gid].sdata = sout.str ();
-}
-
-void CffTable::updateCharStrings (struct pschars &chars, int sub_idx, double version) {
-    std::vector<std::string> st;
-    std::map<std::string, struct seq_node*> dhash;
-    boost::object_pool<struct seq_node> npool;
-    std::deque<struct sub_rule> rules;
-
-    struct pschars &lsubrs = (cidKeyed () || m_version > 1) ?
-	m_core_font.subfonts[sub_idx].local_subrs : m_core_font.local_subrs;
-    PrivateDict &pdict = (cidKeyed () || m_version > 1) ?
-	m_core_font.subfonts[sub_idx].private_dict : m_core_font.private_dict;
+    if (gid >= 0)
+	chars.css[gid].assign (sout.str ());
+}
+
+// All Font DICTs are processed at once, so that sequences shared between
+// them can be moved to global subrs
+void CffTable::updateCharStrings (struct pschars &chars, double version) {
+    FS_TRACE_SCOPE ("CFF subroutinize");
+    seq_graph graph;
+    uint32_t token_cnt = 0;
+    bool multi = (cidKeyed () || m_version > 1);
+    int fd_cnt = multi ? numSubFonts () : 1;
+    std::vector<struct pschars *> lsubrs (fd_cnt);
+    std::vector<PrivateDict *> pdicts (fd_cnt);
+
+    for (int i=0; i<fd_cnt; i++) {
+	lsubrs[i] = multi ? &m_core_font.subfonts[i].local_subrs : &m_core_font.local_subrs;
+	pdicts[i] = multi ? &m_core_font.subfonts[i].private_dict : &m_core_font.private_dict;
+	PrivateDict &pdict = *pdicts[i];
 
-    private_entry pe;
-    // Charstring builder needs to know defaultWidthX, except in CFF2
-    if (m_version < 2 && !pdict.has_key (cff::defaultWidthX)) {
-        pe.setType (pt_blend);
-        pe.n.base = stdWidth (m_hmtx, sub_idx);
-        pdict[cff::defaultWidthX] = pe;
-    }
-    if (!pdict.has_key (cff::Subrs)) {
-        pe.setType (pt_uint);
-        pdict[cff::Subrs] = pe;
+	private_entry pe;
+	// Charstring builder needs to know defaultWidthX, except in CFF2
+	if (m_version < 2 && !pdict.has_key (cff::defaultWidthX)) {
+	    pe.setType (pt_blend);
+	    pe.n.base = stdWidth (m_hmtx, i);
+	    pdict[cff::defaultWidthX] = pe;
+	}
+	if (!pdict.has_key (cff::Subrs)) {
+	    pe.setType (pt_uint);
+	    pdict[cff::Subrs] = pe;
+	}
     }
 
-    struct cffcontext ctx = {
-        m_version,
-        0,
-        0,
-        m_core_font.vstore,
-        m_gsubrs,
-        lsubrs,
-        pdict,
-    };
-
-    struct seq_node *nhead = npool.construct ();
-    nhead->ntype = SeqNode::GuardNode;
-    nhead->next = nhead->prev = nhead;
-
+    // Converting references reads other glyphs, so do this beforehand.
+    // Seac-like references are normally resolved by the GUI, so when running
+    // in batch mode they have to be resolved here. Glyph 0 can't be a seac
+    // component, so it means the component hasn't been found
+    std::vector<uint16_t> gids;
+    gids.reserve (m_glyphs.size ());
     for (size_t i=0; i<m_glyphs.size (); i++) {
-    	uint8_t select = cidKeyed () ? m_core_font.fdselect[i] : 0;
-	if (select != sub_idx)
+	uint16_t fd = cidKeyed () ? m_core_font.fdselect[i] : 0;
+	if (fd >= fd_cnt)
 	    continue;
 	ConicGlyph *g = m_glyphs[i];
+	for (auto it = g->refs.begin (); it != g->refs.end (); ) {
+	    if (!it->cc && it->GID > 0 && it->GID < m_glyphs.size () && it->GID != i)
+		it->setGlyph (m_glyphs[it->GID]);
+	    if (it->cc) {
+		it++;
+	    } else {
+		FontShepherd::postError (tr ("Unresolved reference in glyph %1 has been dropped").arg (i));
+		it = g->refs.erase (it);
+	    }
+	}
+	g->unlinkRefsForPS ();
+	gids.push_back (i);
+    }
+
+    // Glyphs are split to tokens in parallel, batch by batch, but then added
+    // to the graph strictly in GID order, so that the result doesn't depend
+    // on the number of threads. Batches limit the amount of tokens waiting
+    // to be merged
+    const size_t batch_size = 1024;
+    struct glyph_tokens {
+	uint16_t gid, fd;
 	std::vector<std::pair<int, std::string>> splitted;
+    };
+    std::vector<glyph_tokens> batch;
+    auto split = [this, &lsubrs, &pdicts] (glyph_tokens &gt) {
+	struct cffcontext ctx = {
+	    m_version,
+	    0,
+	    0,
+	    m_core_font.vstore,
+	    m_gsubrs,
+	    *lsubrs[gt.fd],
+	    *pdicts[gt.fd],
+	    nullptr,
+	    nullptr,
+	    nullptr,
+	};
+	m_glyphs[gt.gid]->splitToPS (gt.splitted, ctx);
+    };
 
-	if (pdict.has_key (cff::vsindex))
-	    m_core_font.vstore.index = pdict[cff::vsindex].i;
-	g->splitToPS (splitted, ctx);
-
-    	// a GlyphNode marks the beginning of a new glyph and stores its gid
-	// (charstring index), so that later we know where to output it
-	struct seq_node *sep = npool.construct ();
-	sep->ntype = SeqNode::GlyphNode;
-    	sep->gid = i;
-    	nhead->prev->insertSingle (sep);
-
-	for (auto &pair: splitted) {
-	    // There is no much difference between endchar and other codes
-	    // (especially as in CFF2 it is not used anyway), but we have
-	    // to keep track of endchars in order to avoid having both
-	    // endchar and return at the end of a subr
-	    struct seq_node *node = npool.construct ();
-	    node->endchar = (pair.first == cff::cs::endchar);
-	    node->setData (pair.second);
-	    if (node->sdata.length () > sub_rule::min_length)
-		node->makeRule (dhash, npool, rules);
-	    add_to_graph (nhead, dhash, npool, rules, node);
+    for (size_t start=0; start<gids.size (); start+=batch_size) {
+	size_t end = std::min (start + batch_size, gids.size ());
+	batch.clear ();
+	batch.resize (end - start);
+	for (size_t i=start; i<end; i++) {
+	    batch[i-start].gid = gids[i];
+	    batch[i-start].fd = cidKeyed () ? m_core_font.fdselect[gids[i]] : 0;
+	}
+	QtConcurrent::blockingMap (batch, split);
+
+	for (auto &gt : batch) {
+	    // a GlyphNode marks the beginning of a new glyph and stores its gid
+	    // (charstring index), so that later we know where to output it
+	    struct seq_node *sep = graph.npool.construct ();
+	    sep->ntype = SeqNode::GlyphNode;
+	    sep->gid = gt.gid;
+	    sep->fd = gt.fd;
+	    graph.head->prev->insertSingle (sep);
+
+	    for (auto &pair: gt.splitted) {
+		// There is no much difference between endchar and other codes
+		// (especially as in CFF2 it is not used anyway), but we have
+		// to keep track of endchars in order to avoid having both
+		// endchar and return at the end of a subr
+		struct seq_node *node = graph.npool.construct ();
+		node->endchar = (pair.first == cff::cs::endchar);
+		node->term = graph.terminal (pair.second);
+		if (pair.second.length () > sub_rule::min_length)
+		    graph.makeRule (node);
+		graph.append (node);
+		token_cnt++;
+	    }
 	}
     }
 
-    // Don't clear gsubrs at this point, as they may be needed for processing
-    // next subfont. Currently we aren't using them anyway, so it's safe to
-    // clear them later
-    lsubrs.css.clear ();
-    lsubrs.cnt = 0;
+    // Old subrs are no longer needed once all glyphs have been converted
+    invalidateSubrTokens ();
+    m_gsubrs.css.clear ();
+    m_gsubrs.cnt = 0;
+    for (auto subrs : lsubrs) {
+	subrs->css.clear ();
+	subrs->cnt = 0;
+    }
 
-    make_subrs (chars, lsubrs, nhead, rules, (version < 2));
+    make_subrs (chars, m_gsubrs, lsubrs, graph, version);
 #if CS_DEBUG
-    show_graph (nhead, 0);
+    show_graph (graph, graph.head, 0);
 #endif
+
+    if (FontShepherd::trace::enabled ()) {
+	size_t subr_bytes = 0, lsubr_cnt = 0;
+	for (auto &cs : m_gsubrs.css)
+	    subr_bytes += cs.size ();
+	for (auto subrs : lsubrs) {
+	    lsubr_cnt += subrs->cnt;
+	    for (auto &cs : subrs->css)
+		subr_bytes += cs.size ();
+	}
+	FS_TRACE_COUNTER ("CFF subr tokens", token_cnt);
+	FS_TRACE_COUNTER ("CFF subr unique terminals", graph.terms.size ());
+	FS_TRACE_COUNTER ("CFF subr rules", graph.rules.size ());
+	FS_TRACE_COUNTER ("CFF global subrs", m_gsubrs.cnt);
+	FS_TRACE_COUNTER ("CFF local subrs", lsubr_cnt);
+	FS_TRACE_COUNTER ("CFF subr bytes", subr_bytes);
+	FS_TRACE_COUNTER ("CFF subroutinizer memory", graph.memoryUsage ());
+    }
 }
 
 // Everything related with conversion from CFF to CFF2 and vice versa
@@ -2618,6 +3140,7 @@ void CffTable::convertToCFF (sFont *fnt, GlyphNameProvider &gnp) {
     if (!name || !post || !os_2 || !head || !m_hmtx)
         throw TableDataCompileException ("CFF",
     	"Can't switch to CFF: some required font data not present!");
+    invalidateSubrTokens ();
 
     m_core_font.fontname = name->bestName (6).toStdString ();
     auto &dict = m_core_font.top_dict;
@@ -2759,6 +3282,7 @@ void CffTable::convertToCFF (sFont *fnt, GlyphNameProvider &gnp) {
 }
 
 void CffTable::convertToCFF2 () {
+    invalidateSubrTokens ();
     auto &dict = m_core_font.top_dict;
     for (int i=dict.size () - 1; i>=0; i--) {
         auto &op = dict.by_idx (i).first;
@@ -2808,6 +3332,69 @@ void CffTable::setVersion (double val, sFont *fnt, GlyphNameProvider &gnp) {
     m_version = val;
 }
 
+// Produce a static CFF table for the given location. Region scalars are
+// evaluated once, and then applied to every blended value in Private DICTs
+// and charstrings. Glyphs modified since loading are compiled as they are,
+// i. e. they keep their default design
+void CffTable::instantiate (sFont *fnt, GlyphNameProvider &gnp, const std::vector<double> &coords) {
+    if (m_version < 2)
+        throw TableDataCompileException ("CFF",
+    	"Can't instantiate: not a variable font table!");
+    FS_TRACE_SCOPE ("CFF2 instantiate");
+
+    std::vector<std::vector<double>> scalars;
+    std::vector<PrivateDict> saved;
+    FontVariations::dataScalars (m_core_font.vstore, coords, scalars);
+
+    for (auto &sub : m_core_font.subfonts) {
+	saved.push_back (sub.private_dict);
+	auto &pd = sub.private_dict;
+	uint16_t vsidx = pd.has_key (cff::vsindex) ? pd[cff::vsindex].i : 0;
+	if (vsidx >= scalars.size ())
+	    continue;
+	for (size_t i=0; i<pd.size (); i++) {
+	    auto &entry = pd.by_idx (i).second;
+	    if (entry.type () == pt_blend) {
+		entry.n.base += FontVariations::applyDeltas
+		    (entry.n.deltas.data (), scalars[vsidx], entry.n.deltas.size ());
+	    } else if (entry.type () == pt_blend_list) {
+		for (auto &b: entry.list)
+		    b.base += FontVariations::applyDeltas
+			(b.deltas.data (), scalars[vsidx], b.deltas.size ());
+	    }
+	}
+    }
+
+    size_t cnt = m_glyphs.size ();
+    for (size_t i=0; i<cnt; i++) {
+	if (m_glyphs[i] && m_glyphs[i]->isModified ())
+	    updateGlyph (i);
+    }
+    clearGlyphs ();
+    m_glyphs.resize (cnt, nullptr);
+
+    std::vector<uint16_t> gids (cnt);
+    for (size_t i=0; i<cnt; i++)
+	gids[i] = i;
+    QtConcurrent::blockingMap (gids, [this, fnt, &scalars] (uint16_t &gid) {
+	decodeGlyph (fnt, gid, &scalars);
+    });
+
+    // Also drops the deltas, the variation store and marks all glyphs
+    // as modified
+    try {
+	setVersion (1.0, fnt, gnp);
+    } catch (TableDataCompileException &) {
+	// Still CFF2, so go back to the default design
+	for (size_t i=0; i<saved.size (); i++)
+	    m_core_font.subfonts[i].private_dict = saved[i];
+	clearGlyphs ();
+	m_glyphs.resize (cnt, nullptr);
+	throw;
+    }
+    m_rebuild_all = true;
+}
+
 private_entry::private_entry () {
     ptype = pt_uint;
     i = 0;
@@ -28,6 +28,9 @@
 #ifndef _FONSHEPHERD_CFF_H
 #define _FONSHEPHERD_CFF_H
 #include <stdint.h>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <QtGlobal>
 
 #include "cffstuff.h"
@@ -44,13 +47,19 @@ public:
     ~CffTable ();
     void unpackData (sFont *font);
     void packData ();
+    void subroutinize (sFont *fnt);
     ConicGlyph *glyph (sFont* fnt, uint16_t gid);
     uint16_t addGlyph (sFont* fnt, uint8_t subfont=0);
     std::string glyphName (uint16_t gid);
     bool cidKeyed () const;
     int version () const;
     bool usable () const;
+    bool parallelDecodable () const override;
+    void dataMoved (const char *old_data) override;
     int numSubFonts () const;
+    size_t memoryUsage () const override;
+    bool evictable () const override;
+    void evict () override;
     PrivateDict *privateDict (uint16_t subidx=0);
     TopDict *topDict ();
     std::string fontName () const;
@@ -62,6 +71,7 @@ public:
     uint16_t fdSelect (uint16_t gid);
     void setFdSelect (uint16_t gid, uint16_t val);
     void setVersion (double val, sFont *fnt, GlyphNameProvider &gnp);
+    void instantiate (sFont *fnt, GlyphNameProvider &gnp, const std::vector<double> &coords);
 
     static void encodeInt (QDataStream &os, int val);
     static void encodeInt (std::ostream &os, int val);
@@ -74,7 +84,7 @@ public:
     static void encodeOff (QDataStream &os, uint8_t offsize, uint32_t val);
 
 private:
-    void updateCharStrings (struct pschars &chars, int sub_idx, double version);
+    void updateCharStrings (struct pschars &chars, double version);
     int stdWidth (HmtxTable *hmtx, int sub_idx);
 
     int  readcffthing (int *_ival, double *dval, uint16_t *operand);
@@ -96,6 +106,10 @@ private:
     void writefdselect (QDataStream &os, QBuffer &);
     void writevstore (QDataStream &os, QBuffer &buf);
     void updateGlyph (uint16_t gid);
+    ConicGlyph *decodeGlyph (sFont* fnt, uint16_t gid, const std::vector<std::vector<double>> *scalars);
+    void bindCharStrings (uint32_t gsubrs_pos);
+    const struct subr_tokens *subrTokens (const struct pschars &subrs);
+    void invalidateSubrTokens ();
 
     void convertToCFF (sFont *fnt, GlyphNameProvider &gnp);
     void convertToCFF2 ();
@@ -103,9 +117,13 @@ private:
     double m_version;
     uint16_t m_td_idx; // normally zero
     bool m_bad_cff;
+    bool m_rebuild_all;
     uint32_t m_pos;
     struct pschars m_gsubrs;
     struct cff_font m_core_font;
+    // Pre-tokenized global and local subroutines, built on demand
+    std::map<const struct pschars *, std::unique_ptr<struct subr_tokens>> m_subr_tokens;
+    mutable std::mutex m_subr_tokens_lock;
 };
 
 #endif
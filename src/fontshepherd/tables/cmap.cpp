@@ -33,11 +33,13 @@
 #include <iconv.h>
 
 #include "sfnt.h"
-#include "editors/cmapedit.h"
+#include "tables.h"
 #include "tables/cmap.h"
 #include "tables/glyphnames.h"
 #include "fs_notify.h"
+#include "fs_trace.h"
 #include "exceptions.h"
+#include "charbuffer.h"
 #include "commonlists.h"
 
 static int rcomp_mappings_by_code  (const struct enc_mapping m1, const struct enc_mapping m2) {
@@ -58,7 +60,7 @@ CmapTable::CmapTable (sfntFile *fontfile, TableHeader &props) :
 
 CmapTable::~CmapTable () {
     if (tv) {
-        tv->close ();
+        tv->closeEditor ();
         tv = nullptr;
     }
 }
@@ -73,6 +75,7 @@ void CmapTable::unpackData (sFont *font) {
 
     if (td_loaded)
         return;
+    FS_TRACE_SCOPE ("cmap unpack");
     this->fillup ();
 
     m_version = this->getushort (0);
@@ -119,8 +122,11 @@ void CmapTable::unpackData (sFont *font) {
 	switch (enc->format ()) {
           case 0:
             {
+		SpanIn buf = span (fpos);
                 for (i=0; i<256; ++i)
-                    enc->addMapping (i, (uint8_t) this->data[fpos++]);
+                    enc->addMapping (i, buf.getByte ());
+		if (buf.fail ())
+		    throw TableDataCorruptException (stringName ().c_str ());
             }
             break;
 
@@ -190,33 +196,34 @@ void CmapTable::unpackData (sFont *font) {
 		std::vector<uint16_t> glyphs;
 		std::vector<struct enc_range4> ranges;
 
-		segCount = this->getushort (fpos)/2; fpos+=2;
-                /* searchRange = */ this->getushort (fpos); fpos+=2;
-                /* entrySelector = */ this->getushort (fpos); fpos+=2;
-                /* rangeShift = */ this->getushort (fpos); fpos+=2;
+		SpanIn buf = span (fpos);
+		segCount = buf.getUShort ()/2;
+                /* searchRange, entrySelector, rangeShift */
+                buf.skip (6);
                 ranges.resize (segCount);
                 for (i=0; i<segCount; ++i) {
-		    ranges[i].end_code = this->getushort (fpos); fpos+=2;
+		    ranges[i].end_code = buf.getUShort ();
                 }
-                if (this->getushort (fpos)!=0 )
+                if (buf.getUShort ()!=0 )
                     fprintf (stderr, "Expected 0 in true type font\n");
-                fpos += 2;
                 for (i=0; i<segCount; ++i) {
-                    ranges[i].start_code = this->getushort (fpos); fpos+=2;
+                    ranges[i].start_code = buf.getUShort ();
                 }
                 for (i=0; i<segCount; ++i) {
-                    ranges[i].id_delta = this->getushort (fpos); fpos+=2;
+                    ranges[i].id_delta = buf.getUShort ();
                 }
                 for (i=0; i<segCount; ++i) {
-                    ranges[i].id_range_off = this->getushort (fpos); fpos+=2;
+                    ranges[i].id_range_off = buf.getUShort ();
                 }
                 slen = enc->length () - 16 - segCount*8;
                 /* that's the amount of space left in the subtable and it must */
                 /*  be filled with glyphIDs */
                 glyphs.reserve (slen);
-                for (i=0; i<slen/2; ++i) {
-                    glyphs.push_back (this->getushort (fpos)); fpos+=2;
+                for (i=0; i<slen/2 && !buf.fail (); ++i) {
+                    glyphs.push_back (buf.getUShort ());
                 }
+		if (buf.fail ())
+		    throw TableDataCorruptException (stringName ().c_str ());
                 for (i=0; i<segCount; ++i) {
                     if (ranges[i].id_range_off==0 && ranges[i].start_code==0xffff)
                         /* Done */;
@@ -253,12 +260,15 @@ void CmapTable::unpackData (sFont *font) {
           case 6:
 	    {
                 /* For contiguous ranges of codes, such as in 8-bit encodings */
-                uint16_t first = this->getushort (fpos); fpos+=2;
-                uint16_t count = this->getushort (fpos); fpos+=2;
-                for (i=0; i<count; ++i) {
-                    j = this->getushort (fpos); fpos+=2;
+		SpanIn buf = span (fpos);
+                uint16_t first = buf.getUShort ();
+                uint16_t count = buf.getUShort ();
+                for (i=0; i<count && !buf.fail (); ++i) {
+                    j = buf.getUShort ();
                     enc->addMapping (first+i, j);
                 }
+		if (buf.fail ())
+		    throw TableDataCorruptException (stringName ().c_str ());
             }
             break;
 
@@ -273,23 +283,29 @@ void CmapTable::unpackData (sFont *font) {
           case 10:
 	    {
                 uint32_t first, count;
-                first = this->getlong (fpos); fpos+=4;
-                count = this->getlong (fpos); fpos+=4;
-                for (i=0; i<count; ++i) {
-                    j = this->getlong (fpos); fpos+=4;
+		SpanIn buf = span (fpos);
+                first = buf.getLong ();
+                count = buf.getLong ();
+                for (i=0; i<count && !buf.fail (); ++i) {
+                    j = buf.getLong ();
                     enc->addMapping (first+i, j, 1);
                 }
+		if (buf.fail ())
+		    throw TableDataCorruptException (stringName ().c_str ());
             }
             break;
 
           case 12:
           case 13:
             {
-                uint32_t ngroups = this->getlong (fpos); fpos+=4;
+		SpanIn buf = span (fpos);
+                uint32_t ngroups = buf.getLong ();
                 for (i=0; i<ngroups; i++) {
-                    uint32_t start = this->getlong (fpos); fpos+=4;
-                    uint32_t end = this->getlong (fpos); fpos+=4;
-                    uint32_t startgc = this->getlong (fpos); fpos+=4;
+                    uint32_t start = buf.getLong ();
+                    uint32_t end = buf.getLong ();
+                    uint32_t startgc = buf.getLong ();
+		    if (buf.fail ())
+			throw TableDataCorruptException (stringName ().c_str ());
                     enc->addMapping (start, startgc, end - start + 1);
                 }
             }
@@ -805,11 +821,12 @@ void CmapTable::encodeFormat14 (std::ostream &os, CmapEnc *enc) {
 }
 
 void CmapTable::packData () {
+    FS_TRACE_SCOPE ("cmap pack");
     int pos;
     std::stringstream s;
     std::string st;
 
-    delete[] data; data = nullptr;
+    releaseData ();
     putushort (s, (uint16_t) 0);
     putushort (s, cmap_tables.size ());
     for (auto &et : cmap_tables) {
@@ -991,19 +1008,6 @@ void CmapTable::setSubTablesModified (bool val) {
     m_subtables_changed = val;
 }
 
-void CmapTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr)
-        fillup ();
-
-    if (tv == nullptr) {
-        CmapEdit *cmapedit = new CmapEdit (tptr, fnt, caller);
-        tv = cmapedit;
-        cmapedit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 CmapEncTable::CmapEncTable (uint16_t platform, uint16_t specific, uint32_t offset) :
     m_platform (platform), m_specific (specific), m_offset (offset), m_subtable (nullptr) {
 }
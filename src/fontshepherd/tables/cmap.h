@@ -24,7 +24,7 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE. */
 
-#include <QtWidgets>
+#include <QtCore>
 
 typedef void* iconv_t;
 class sfntFile;
@@ -199,7 +199,6 @@ public:
     CmapTable (sfntFile* fontfile, TableHeader &props);
     ~CmapTable ();
     void unpackData (sFont *font);
-    void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) override;
 
     uint16_t numTables ();
     CmapEncTable* getTable (uint16_t idx);
@@ -34,8 +34,7 @@
 #include <cmath>
 
 #include "sfnt.h"
-#include "editors/cpaledit.h"
-#include "editors/fontview.h"
+#include "tables.h"
 #include "tables/colr.h"
 #include "tables/mtx.h"
 #include "tables/name.h"
@@ -428,22 +427,6 @@ std::vector<struct layer_record> &ColrTable::glyphLayers (uint16_t gid) {
     throw std::exception ();
 }
 
-// NB: same function as for GlyphContainer
-void ColrTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    // No fillup here, as it is done by fontview
-    if (!tv) {
-        FontView *fv = new FontView (tptr, fnt, caller);
-        if (!fv->isValid ()) {
-            fv->close ();
-            return;
-        }
-        tv = fv;
-        fv->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 void ColrTable::packData () {
 }
 
@@ -605,7 +588,7 @@ ConicGlyph* ColrTable::glyph (sFont* fnt, uint16_t gid) {
 	otype = OutlinesType::PS;
 
     BaseMetrics gm = {fnt->units_per_em, fnt->ascent, fnt->descent};
-    ConicGlyph *g = glyph_pool.construct (gid, gm);
+    ConicGlyph *g = newGlyph (gid, gm);
     g->setOutlinesType (OutlinesType::COLR);
     m_glyphs[gid] = g;
     if (m_hmtx)
@@ -656,20 +639,6 @@ CpalTable::CpalTable (sfntFile *fontfile, TableHeader &props) :
 CpalTable::~CpalTable () {
 }
 
-void CpalTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr)
-        fillup ();
-
-    if (tv == nullptr) {
-	unpackData (fnt);
-        CpalEdit *cpaledit = new CpalEdit (tptr, fnt, caller);
-        tv = cpaledit;
-        cpaledit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 void CpalTable::unpackData (sFont *) {
     uint32_t pos = 0;
     uint16_t i;
@@ -753,7 +722,7 @@ void CpalTable::packData () {
     std::ostringstream os;
     uint32_t cr_off, type_off, plbl_off, elbl_off;
 
-    delete[] data; data = nullptr;
+    releaseData ();
     putushort (os, m_version);
     putushort (os, m_numPaletteEntries);
     putushort (os, m_paletteList.size ());
@@ -856,7 +825,7 @@ QStringList CpalTable::paletteList (NameTable *name) {
 	if (m_version > 0 && name)
 	    user_name = name->bestName (m_paletteList[i]->label_idx, "Palette");
 	ret.push_back (QString (
-	    QApplication::tr ("%1: %2")).arg (i).arg (user_name));
+	    tr ("%1: %2")).arg (i).arg (user_name));
     }
     return ret;
 }
@@ -37,10 +37,10 @@
 #include "head.h"
 #include "glyf.h"
 #include "devmetrics.h"
-#include "editors/devmetricsedit.h"
-#include "editors/headedit.h"
 
 #include "fs_notify.h"
+#include "exceptions.h"
+#include "charbuffer.h"
 
 VdmxTable::VdmxTable (sfntFile *fontfile, TableHeader &props) :
     FontTable (fontfile, props) {
@@ -53,43 +53,46 @@ void VdmxTable::unpackData (sFont*) {
     uint32_t pos = 0;
     this->fillup ();
 
-    m_version = getushort (pos); pos+=2;
-    pos+=2; // numRecs; seems to be not used
-    uint16_t numRatios = getushort (pos); pos+=2;
+    SpanIn buf = span (pos);
+    m_version = buf.getUShort ();
+    buf.skip (2); // numRecs; seems to be not used
+    uint16_t numRatios = buf.getUShort ();
     records.resize (numRatios);
     for (size_t i=0; i<numRatios; i++) {
 	auto &rat = records[i];
-	rat.bCharSet = static_cast<uint8_t> (data[pos++]);
-	rat.xRatio = static_cast<uint8_t> (data[pos++]);
-	rat.yStartRatio = static_cast<uint8_t> (data[pos++]);
-	rat.yEndRatio = static_cast<uint8_t> (data[pos++]);
+	rat.bCharSet = buf.getByte ();
+	rat.xRatio = buf.getByte ();
+	rat.yStartRatio = buf.getByte ();
+	rat.yEndRatio = buf.getByte ();
     }
     for (size_t i=0; i<numRatios; i++) {
 	auto &rat = records[i];
-	rat.groupOff = getushort (pos); pos+=2;
+	rat.groupOff = buf.getUShort ();
     }
-    for (size_t i=0; i<numRatios; i++) {
+    for (size_t i=0; i<numRatios && !buf.fail (); i++) {
 	auto &rat = records[i];
-	pos = rat.groupOff;
-	uint16_t numRecs = getushort (pos); pos+=2;
+	buf.seek (rat.groupOff);
+	uint16_t numRecs = buf.getUShort ();
 	rat.entries.resize (numRecs);
-	rat.startsz = static_cast<uint8_t> (data[pos++]);
-	rat.endsz = static_cast<uint8_t> (data[pos++]);
+	rat.startsz = buf.getByte ();
+	rat.endsz = buf.getByte ();
 
 	for (size_t j=0; j<numRecs; j++) {
 	    auto &ent = rat.entries[j];
-	    ent.yPelHeight = getushort (pos); pos+=2;
-	    ent.yMax = static_cast<int16_t> (getushort (pos)); pos+=2;
-	    ent.yMin = static_cast<int16_t> (getushort (pos)); pos+=2;
+	    ent.yPelHeight = buf.getUShort ();
+	    ent.yMax = static_cast<int16_t> (buf.getUShort ());
+	    ent.yMin = static_cast<int16_t> (buf.getUShort ());
 	}
     }
+    if (buf.fail ())
+	throw TableDataCorruptException (stringName ().c_str ());
 }
 
 void VdmxTable::packData () {
     std::ostringstream s;
     std::string st;
 
-    delete[] data; data = nullptr;
+    releaseData ();
 
     putushort (s, m_version);
     putushort (s, records.size ());
@@ -129,20 +132,6 @@ void VdmxTable::packData () {
     std::copy (st.begin (), st.end (), data);
 }
 
-void VdmxTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr && !is_new)
-        fillup ();
-
-    if (tv == nullptr) {
-	unpackData (fnt);
-        VdmxEdit *edit = new VdmxEdit (tptr, fnt, caller);
-        tv = edit;
-        edit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 uint16_t VdmxTable::version () const {
     return m_version;
 }
@@ -206,20 +195,23 @@ void HdmxTable::unpackData (sFont*) {
     uint32_t pos = 0;
     this->fillup ();
 
-    m_version = getushort (pos); pos+=2;
-    uint16_t numRecords = getushort (pos); pos+=2;
-    uint32_t sizeDeviceRecord = getlong (pos); pos+=4;
+    SpanIn buf = span (pos);
+    m_version = buf.getUShort ();
+    uint16_t numRecords = buf.getUShort ();
+    uint32_t sizeDeviceRecord = buf.getLong ();
+    // Each record should also fit into the table, which is checked before
+    // allocating memory for it
+    if (sizeDeviceRecord < 2 || buf.remaining () / sizeDeviceRecord < numRecords)
+	throw TableDataCorruptException (stringName ().c_str ());
 
     for (size_t i=0; i<numRecords; i++) {
-	uint8_t pixelSize = data[pos]; pos++;
+	uint8_t pixelSize = buf.getByte ();
 	records[pixelSize] = {};
 	auto &rec = records.at (pixelSize);
 	rec.resize (sizeDeviceRecord-2);
 
-	/* maxWidth (not needed) */ pos++;
-	for (size_t j=0; j<sizeDeviceRecord-2; j++) {
-	    rec[j] = data[pos++];
-	}
+	/* maxWidth (not needed) */ buf.skip (1);
+	buf.read (rec.data (), rec.size ());
     }
 }
 
@@ -227,7 +219,7 @@ void HdmxTable::packData () {
     std::ostringstream s;
     std::string st;
 
-    delete[] data; data = nullptr;
+    releaseData ();
 
     putushort (s, m_version);
     putushort (s, records.size ());
@@ -259,20 +251,6 @@ void HdmxTable::packData () {
     std::copy (st.begin (), st.end (), data);
 }
 
-void HdmxTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr && !is_new)
-        fillup ();
-
-    if (tv == nullptr) {
-	unpackData (fnt);
-        HdmxEdit *edit = new HdmxEdit (tptr, fnt, caller);
-        tv = edit;
-        edit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 uint16_t HdmxTable::version () const {
     return m_version;
 }
@@ -332,20 +310,21 @@ void LtshTable::unpackData (sFont*) {
     uint32_t pos = 0;
     this->fillup ();
 
-    m_version = getushort (pos); pos+=2;
-    uint16_t numGlyphs = getushort (pos); pos+=2;
+    SpanIn buf = span (pos);
+    m_version = buf.getUShort ();
+    uint16_t numGlyphs = buf.getUShort ();
     yPixels.resize (numGlyphs, 1);
 
-    for (size_t i=0; i<numGlyphs; i++) {
-	yPixels[i] = data[pos++];
-    }
+    buf.read (yPixels.data (), numGlyphs);
+    if (buf.fail ())
+	throw TableDataCorruptException (stringName ().c_str ());
 }
 
 void LtshTable::packData () {
     std::ostringstream s;
     std::string st;
 
-    delete[] data; data = nullptr;
+    releaseData ();
 
     putushort (s, m_version);
     putushort (s, yPixels.size ());
@@ -403,11 +382,8 @@ bool DeviceMetricsProvider::checkHead (const char *tag, QWidget *parent) {
 	    parent);
 	head->setBitFlag (4, true);
 	head->packData ();
-	TableEdit *ed = head->editor ();
-	if (ed) {
-	    HeadEdit *he = qobject_cast<HeadEdit *> (ed);
-	    if (he) he->resetData ();
-	}
+	TableEditor *ed = head->editor ();
+	if (ed) ed->resetData ();
     }
     return true;
 }
@@ -463,10 +439,8 @@ int DeviceMetricsProvider::calculateHdmx (HdmxTable &hdmx, QWidget *parent) {
     int ft_flags = FT_LOAD_RENDER | FT_LOAD_NO_BITMAP | FT_LOAD_NO_AUTOHINT | FT_LOAD_NO_SVG;
     if (!checkHead ("hdmx", parent)) return 1;
     uint8_t max = hdmx.maxSize ();
-    QProgressDialog progress (
-	tr ("Building 'hdmx' table"), tr ("Abort"), 2, max+1, parent);
-    progress.setWindowModality (Qt::WindowModal);
-    progress.show ();
+    FontShepherd::ProgressNotifier progress (
+	tr ("Building 'hdmx' table"), 2, max+1, parent);
     int overflow_at_size = 0;
     uint16_t overflow_at_glyph = 0xffff;
 
@@ -485,10 +459,8 @@ int DeviceMetricsProvider::calculateHdmx (HdmxTable &hdmx, QWidget *parent) {
 		rec[j] = static_cast<uint8_t> (rounded);
 	    }
 	}
-        qApp->instance ()->processEvents ();
-        if (progress.wasCanceled ())
+        if (!progress.setValue (i))
             return 1;
-        progress.setValue (i);
     }
     progress.setValue (max+1);
 
@@ -521,16 +493,16 @@ int DeviceMetricsProvider::calculateLtsh (LtshTable &ltsh, QWidget *parent) {
     std::vector<uint16_t> awidths (glyphcnt);
     std::vector<uint16_t> useMyMetrics (glyphcnt);
     for (size_t i=0; i<ltsh.numGlyphs (); i++) {
-	ConicGlyph *g = glyf->glyph (&m_font, i);
-	has_instrs[i] = !g->instructions.empty ();
-	awidths[i] = g->advanceWidth ();
-	useMyMetrics[i] = g->useMyMetricsGlyph ();
+	glyph_header hdr;
+	if (!glyf->glyphHeader (&m_font, i, hdr))
+	    return 1;
+	has_instrs[i] = hdr.instructionLength > 0;
+	awidths[i] = hdr.advanceWidth;
+	useMyMetrics[i] = hdr.useMyMetrics;
     }
 
-    QProgressDialog progress (
-	tr ("Building 'LTSH' table"), tr ("Abort"), 0, 255, parent);
-    progress.setWindowModality (Qt::WindowModal);
-    progress.show ();
+    FontShepherd::ProgressNotifier progress (
+	tr ("Building 'LTSH' table"), 0, 255, parent);
 
     for (size_t j=254; j>1; j--) {
         ftWrapper.setPixelSize (j, j);
@@ -545,10 +517,8 @@ int DeviceMetricsProvider::calculateLtsh (LtshTable &ltsh, QWidget *parent) {
 		}
 	    }
 	}
-        qApp->instance ()->processEvents ();
-        if (progress.wasCanceled ())
+        if (!progress.setValue (255-j))
             return 1;
-        progress.setValue (255-j);
     }
     for (size_t i=0; i<glyphcnt; i++) {
 	uint16_t msource = useMyMetrics[i];
@@ -574,13 +544,11 @@ int DeviceMetricsProvider::calculateVdmxLimit
 	// for 0:0 (which means 'default') just calculate 1:1 ratio
 	if (x==0 || y==0) { x=1; y=1; }
         double xrat = x/y;
-        QProgressDialog progress (
+        FontShepherd::ProgressNotifier progress (
 	    tr ("Building 'VDMX' table for ratio %1:%2-%3")
 	    .arg (rec.xRatio).arg (rec.yStartRatio).arg (rec.yEndRatio),
-	    tr ("Abort"), rec.startsz, rec.endsz, parent);
+	    rec.startsz, rec.endsz, parent);
 	for (auto &ent : rec.entries) {
-	    progress.setWindowModality (Qt::WindowModal);
-	    progress.show ();
 	    ftWrapper.setPixelSize (std::floor (ent.yPelHeight*xrat + .5), ent.yPelHeight);
 	    int16_t maxmin = 0;
 	    for (size_t i=0; i<12 && i<metrics.size (); i++) {
@@ -590,10 +558,8 @@ int DeviceMetricsProvider::calculateVdmxLimit
 	    }
 	    int16_t &limit = up ? ent.yMax : ent.yMin;
 	    limit = maxmin;
-	    qApp->instance ()->processEvents ();
-	    if (progress.wasCanceled ())
+	    if (!progress.setValue (ent.yPelHeight))
 		return 1;
-	    progress.setValue (ent.yPelHeight);
 	}
 	progress.setValue (rec.endsz);
     }
@@ -612,9 +578,9 @@ int DeviceMetricsProvider::calculateVdmx (VdmxTable &vdmx, QWidget *parent) {
     std::vector<std::pair<int, DBounds>> metrics;
     metrics.reserve (m_font.glyph_cnt);
     for (size_t i=0; i<m_font.glyph_cnt; i++) {
-	ConicGlyph *g = glyf->glyph (&m_font, i);
-	if (!g->isEmpty ())
-	    metrics.push_back ({i, g->bb});
+	glyph_header hdr;
+	if (glyf->glyphHeader (&m_font, i, hdr) && hdr.numberOfContours != 0)
+	    metrics.push_back ({i, hdr.bb});
     }
 
     int ret;
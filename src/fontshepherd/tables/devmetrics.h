@@ -38,7 +38,6 @@ public:
     ~HdmxTable () {};
     void unpackData (sFont *font);
     void packData ();
-    void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller);
 
     uint16_t version () const;
     uint16_t numRecords () const;
@@ -100,7 +99,6 @@ public:
     ~VdmxTable () {};
     void unpackData (sFont *font);
     void packData ();
-    void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller);
 
     uint16_t version () const;
     uint16_t numRatios () const;
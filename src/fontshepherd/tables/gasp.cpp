@@ -29,7 +29,6 @@
 #include <ios>
 
 #include "sfnt.h"
-#include "editors/gaspedit.h"
 #include "tables.h"
 #include "gasp.h"
 
@@ -56,7 +55,7 @@ void GaspTable::packData () {
     std::ostringstream s;
     std::string st;
 
-    delete[] data; data = nullptr;
+    releaseData ();
 
     putushort (s, contents.version);
     putushort (s, contents.ranges.size ());
@@ -76,20 +75,6 @@ void GaspTable::packData () {
     std::copy (st.begin (), st.end (), data);
 }
 
-void GaspTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr)
-        fillup ();
-
-    if (tv == nullptr) {
-	unpackData (fnt);
-        GaspEdit *gaspedit = new GaspEdit (tptr, fnt, caller);
-        tv = gaspedit;
-        gaspedit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 uint16_t GaspTable::version () const {
     return contents.version;
 }
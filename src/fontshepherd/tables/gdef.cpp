@@ -259,7 +259,7 @@ void GdefTable::packData () {
     buf.open (QIODevice::WriteOnly);
     QDataStream os (&buf);
 
-    delete[] data; data = nullptr;
+    releaseData ();
     os << (uint16_t) 1;
     uint16_t minor = 0;
     if (!m_varStore.regions.empty () || !m_varStore.data.empty ())
@@ -26,17 +26,150 @@
  * POSSIBILITY OF SUCH DAMAGE. */
 
 #include <assert.h>
+#include <deque>
+#include <string>
+#include <QtConcurrent>
 
 #include "sfnt.h"
-#include "editors/fontview.h" // Includes also tables.h
+#include "tables.h"
 #include "tables/glyphcontainer.h"
 #include "tables/glyf.h"
 #include "tables/head.h"
 #include "tables/maxp.h"
 #include "tables/mtx.h"
+#include "fs_notify.h"
+#include "fs_trace.h"
+
+// Composite glyph flags we need to skip component records
+enum CompositeFlags {
+    ARG_1_AND_2_ARE_WORDS = 0x0001,
+    ARGS_ARE_XY_VALUES = 0x0002,
+    WE_HAVE_A_SCALE = 0x0008,
+    MORE_COMPONENTS = 0x0020,
+    WE_HAVE_AN_X_AND_Y_SCALE = 0x0040,
+    WE_HAVE_A_TWO_BY_TWO = 0x0080,
+    WE_HAVE_INSTRUCTIONS = 0x0100,
+    USE_MY_METRICS = 0x0200
+};
+
+static inline uint16_t get16 (const uint8_t *p) {
+    return (p[0]<<8) | p[1];
+}
+
+void GlyfHeaderIndex::build (const char *data, uint32_t len, const LocaTable &loca, uint16_t gcnt) {
+    FS_TRACE_SCOPE ("glyf header index");
+    clear ();
+    m_xmin.resize (gcnt, 0); m_ymin.resize (gcnt, 0);
+    m_xmax.resize (gcnt, 0); m_ymax.resize (gcnt, 0);
+    m_contours.resize (gcnt, 0);
+    m_points.resize (gcnt, 0);
+    m_instr_len.resize (gcnt, 0);
+    m_comp_start.resize (gcnt+1, 0);
+
+    const uint8_t *base = reinterpret_cast<const uint8_t *> (data);
+    for (uint16_t gid=0; gid<gcnt; gid++) {
+	m_comp_start[gid] = m_comp_gids.size ();
+	uint32_t off = loca.getGlyphOffset (gid);
+	uint32_t noff = loca.getGlyphOffset (gid+1);
+	// Empty glyph or broken loca: in the last case an attempt to decode
+	// the glyph would produce an error message, so just skip it here
+	if (noff <= off || noff > len || noff - off < 10)
+	    continue;
+
+	const uint8_t *p = base + off;
+	const uint8_t *end = base + noff;
+	int16_t path_cnt = get16 (p);
+	m_xmin[gid] = get16 (p+2);
+	m_ymin[gid] = get16 (p+4);
+	m_xmax[gid] = get16 (p+6);
+	m_ymax[gid] = get16 (p+8);
+	m_contours[gid] = path_cnt;
+	p += 10;
+
+	if (path_cnt > 0) {
+	    if (end - p < path_cnt*2 + 2)
+		continue;
+	    // Last point index in endPtsOfContours array gives us the point count
+	    m_points[gid] = get16 (p + (path_cnt-1)*2) + 1;
+	    m_instr_len[gid] = get16 (p + path_cnt*2);
+	} else if (path_cnt < 0) {
+	    uint16_t flags = 0;
+	    do {
+		if (end - p < 4)
+		    break;
+		flags = get16 (p);
+		m_comp_flags.push_back (flags);
+		m_comp_gids.push_back (get16 (p+2));
+		p += (flags & ARG_1_AND_2_ARE_WORDS) ? 8 : 6;
+		if (flags & WE_HAVE_A_SCALE)
+		    p += 2;
+		else if (flags & WE_HAVE_AN_X_AND_Y_SCALE)
+		    p += 4;
+		else if (flags & WE_HAVE_A_TWO_BY_TWO)
+		    p += 8;
+	    } while (flags & MORE_COMPONENTS);
+	    if ((flags & WE_HAVE_INSTRUCTIONS) && end - p >= 2)
+		m_instr_len[gid] = get16 (p);
+	}
+    }
+    m_comp_start[gcnt] = m_comp_gids.size ();
+}
+
+void GlyfHeaderIndex::clear () {
+    m_xmin.clear (); m_ymin.clear ();
+    m_xmax.clear (); m_ymax.clear ();
+    m_contours.clear ();
+    m_points.clear ();
+    m_instr_len.clear ();
+    m_comp_start.clear ();
+    m_comp_gids.clear ();
+    m_comp_flags.clear ();
+}
+
+bool GlyfHeaderIndex::empty () const {
+    return m_comp_start.empty ();
+}
+
+uint16_t GlyfHeaderIndex::size () const {
+    return m_contours.size ();
+}
+
+size_t GlyfHeaderIndex::memoryUsage () const {
+    return m_contours.size () * (sizeof (int16_t)*5 + sizeof (uint16_t)*2 + sizeof (uint32_t)) +
+	m_comp_gids.size () * sizeof (uint16_t)*2;
+}
+
+void GlyfHeaderIndex::header (uint16_t gid, glyph_header &hdr) const {
+    hdr.bb.minx = m_xmin[gid]; hdr.bb.miny = m_ymin[gid];
+    hdr.bb.maxx = m_xmax[gid]; hdr.bb.maxy = m_ymax[gid];
+    hdr.numberOfContours = m_contours[gid];
+    hdr.numPoints = m_points[gid];
+    hdr.instructionLength = m_instr_len[gid];
+    hdr.numComponents = m_comp_start[gid+1] - m_comp_start[gid];
+    hdr.useMyMetrics = 0xFFFF;
+    for (uint32_t i=m_comp_start[gid]; i<m_comp_start[gid+1]; i++) {
+	if (m_comp_flags[i] & USE_MY_METRICS) {
+	    hdr.useMyMetrics = m_comp_gids[i];
+	    break;
+	}
+    }
+    hdr.advanceWidth = 0;
+}
+
+std::vector<uint16_t> GlyfHeaderIndex::components (uint16_t gid) const {
+    return std::vector<uint16_t> (
+	m_comp_gids.begin () + m_comp_start[gid], m_comp_gids.begin () + m_comp_start[gid+1]);
+}
+
+std::vector<uint16_t> GlyfHeaderIndex::componentFlags (uint16_t gid) const {
+    return std::vector<uint16_t> (
+	m_comp_flags.begin () + m_comp_start[gid], m_comp_flags.begin () + m_comp_start[gid+1]);
+}
 
 GlyfTable::GlyfTable (sfntFile *fontfile, TableHeader &props) :
     GlyphContainer (fontfile, props) {
+    QSettings settings (QCoreApplication::organizationName (), QCoreApplication::applicationName ());
+    m_optimize = settings.value ("glyf/optimize", false).toBool ();
 }
 
 GlyfTable::~GlyfTable () {
@@ -53,40 +186,422 @@ void GlyfTable::setLoca (sFont *font) {
 void GlyfTable::unpackData (sFont *font) {
     if (td_loaded)
         return;
+    FS_TRACE_SCOPE ("glyf unpack");
     GlyphContainer::unpackData (font);
     setLoca (font);
+    // Only needed to decide which point numbers should be kept when optimizing
+    m_gvar = font->sharedTable (CHR ('g','v','a','r'));
+    m_gpos = font->sharedTable (CHR ('G','P','O','S'));
 
     if (m_loca)
 	td_loaded = true;
 }
 
-void GlyfTable::packData () {
-    QByteArray ba;
-    QBuffer buf (&ba);
+// A group of glyphs encoded by the same worker: their data are stored
+// one after another, along with statistics for the 'maxp' table
+struct glyf_chunk {
+    std::vector<uint16_t> gids;
+    std::vector<uint32_t> ends;
+    QByteArray data;
+    maxp_data stats;
+};
+
+static const size_t glyf_chunk_size = 256;
+
+static void encodeChunk (glyf_chunk &chunk, std::vector<ConicGlyph *> &glyphs, const std::vector<uint8_t> &elide) {
+    QBuffer buf (&chunk.data);
     buf.open (QIODevice::WriteOnly);
     QDataStream os (&buf);
-    uint16_t gid = 0;
 
-    delete[] data; data = nullptr;
+    chunk.ends.reserve (chunk.gids.size ());
+    for (uint16_t gid : chunk.gids) {
+	glyphs[gid]->toTTF (buf, os, chunk.stats, elide[gid]);
+	chunk.ends.push_back (buf.pos ());
+    }
+    buf.close ();
+}
+
+// Re-encode glyphs which would otherwise be copied from the old table data,
+// choosing the smallest flag and coordinate encoding and, where possible,
+// dropping implied on-curve points. Trailing padding is never kept. If a glyph
+// doesn't get smaller this way, its original bytes are used
+static void recodeChunk (glyf_chunk &chunk, const std::vector<const char *> &src,
+    const std::vector<uint32_t> &src_len, const std::vector<uint8_t> &elide) {
+    QBuffer buf (&chunk.data);
+    buf.open (QIODevice::WriteOnly);
+    QDataStream os (&buf);
 
-    m_loca->setGlyphCount (m_glyphs.size ());
-    m_loca->setGlyphOffset (gid++, 0);
-    for (auto *g : m_glyphs) {
-	uint32_t off = g->toTTF (buf, os, m_maxp);
-	m_loca->setGlyphOffset (gid++, off);
-	m_hmtx->setaw (g->gid (), g->advanceWidth ());
-	m_hmtx->setlsb (g->gid (), g->leftSideBearing ());
+    chunk.ends.reserve (chunk.gids.size ());
+    for (uint16_t gid : chunk.gids) {
+	SpanIn in (src[gid], src_len[gid]);
+	flat_outline fo;
+	uint32_t start = buf.pos ();
+
+	bool has_data = ConicGlyph::readFlatTTF (in, fo, gid, 0);
+	// Damaged glyphs are kept as they are rather than rebuilt from
+	// partially read data
+	if (in.fail ()) {
+	    os.writeRawData (src[gid], src_len[gid]);
+	} else if (has_data) {
+	    uint32_t used = std::min<uint32_t> (in.pos (), src_len[gid]);
+	    if (fo.numberOfContours >= 0) {
+		std::vector<uint16_t> endpts;
+		std::vector<uint8_t> flags, x_data, y_data;
+		fo.toTTF (endpts, flags, x_data, y_data, elide[gid] && fo.instructions.empty ());
+
+		os << fo.numberOfContours;
+		os << (int16_t) fo.bb.minx;
+		os << (int16_t) fo.bb.miny;
+		os << (int16_t) fo.bb.maxx;
+		os << (int16_t) fo.bb.maxy;
+		for (uint16_t end : endpts)
+		    os << end;
+		os << (uint16_t) fo.instructions.size ();
+		os.writeRawData (reinterpret_cast<const char *> (fo.instructions.data ()), fo.instructions.size ());
+		os.writeRawData (reinterpret_cast<const char *> (flags.data ()), flags.size ());
+		os.writeRawData (reinterpret_cast<const char *> (x_data.data ()), x_data.size ());
+		os.writeRawData (reinterpret_cast<const char *> (y_data.data ()), y_data.size ());
+	    }
+	    if (fo.numberOfContours < 0 || buf.pos () - start >= used) {
+		buf.seek (start);
+		os.writeRawData (src[gid], used);
+	    }
+	}
+	chunk.ends.push_back (buf.pos ());
     }
     buf.close ();
+}
+
+static void splitIntoChunks (const std::vector<uint16_t> &gids, std::vector<glyf_chunk> &chunks) {
+    for (size_t i=0; i<gids.size (); i+=glyf_chunk_size) {
+	chunks.emplace_back ();
+	size_t end = std::min (i+glyf_chunk_size, gids.size ());
+	chunks.back ().gids.assign (gids.begin () + i, gids.begin () + end);
+    }
+}
+
+// Collect glyphs whose GPOS anchors (format 2) are attached to contour points,
+// as their point numbers must be preserved as well. Only the lookup types
+// which may contain anchors are looked at: cursive, mark-to-base,
+// mark-to-ligature and mark-to-mark (also wrapped into extension lookups)
+static void gpos_point_anchors (const char *data, uint32_t len, uint16_t gcnt, std::vector<uint8_t> &anchored) {
+    auto u16 = [data, len] (uint32_t pos) -> uint16_t {
+	if (pos + 2 > len) return 0;
+	return (static_cast<uint8_t> (data[pos])<<8) | static_cast<uint8_t> (data[pos+1]);
+    };
+    auto u32 = [&u16] (uint32_t pos) -> uint32_t {
+	return (static_cast<uint32_t> (u16 (pos))<<16) | u16 (pos+2);
+    };
+    // Glyphs listed in a coverage table, in coverage index order
+    auto coverage = [&u16, len] (uint32_t pos) {
+	std::vector<uint16_t> ret;
+	uint16_t format = u16 (pos);
+	uint16_t cnt = u16 (pos+2);
+	if (format == 1) {
+	    for (uint16_t i=0; i<cnt && pos+4+i*2 < len; i++)
+		ret.push_back (u16 (pos+4+i*2));
+	} else if (format == 2) {
+	    for (uint16_t i=0; i<cnt && pos+4+i*6 < len; i++) {
+		uint16_t first = u16 (pos+4+i*6), last = u16 (pos+6+i*6);
+		for (uint32_t gid=first; gid<=last && ret.size () < 0x10000; gid++)
+		    ret.push_back (gid);
+	    }
+	}
+	return ret;
+    };
+    auto check = [&u16, &anchored, gcnt] (uint32_t anchor_pos, uint16_t gid) {
+	if (gid < gcnt && u16 (anchor_pos) == 2)
+	    anchored[gid] = true;
+    };
+    // An array of records, each containing 'cnt' anchor offsets (possibly
+    // preceded by other fields), relative to the array start
+    auto anchor_array = [&u16, &check, len] (uint32_t pos, const std::vector<uint16_t> &glyphs,
+	uint16_t skip, uint16_t cnt) {
+	uint16_t rec_cnt = u16 (pos);
+	uint32_t rec_size = (skip + cnt) * 2;
+	for (uint16_t i=0; i<rec_cnt && i<glyphs.size (); i++) {
+	    uint32_t rec = pos + 2 + i*rec_size;
+	    if (rec + rec_size > len)
+		break;
+	    for (uint16_t j=0; j<cnt; j++) {
+		uint16_t off = u16 (rec + (skip+j)*2);
+		if (off) check (pos + off, glyphs[i]);
+	    }
+	}
+    };
+
+    anchored.assign (gcnt, false);
+    if (len < 10)
+	return;
+    uint32_t ll_pos = u16 (8);
+    uint16_t lookup_cnt = u16 (ll_pos);
+    for (uint16_t i=0; i<lookup_cnt; i++) {
+	uint32_t lu_pos = ll_pos + u16 (ll_pos + 2 + i*2);
+	uint16_t type = u16 (lu_pos);
+	uint16_t sub_cnt = u16 (lu_pos+4);
+	for (uint16_t j=0; j<sub_cnt; j++) {
+	    uint32_t st_pos = lu_pos + u16 (lu_pos + 6 + j*2);
+	    uint16_t st_type = type;
+	    if (type == 9) {
+		st_type = u16 (st_pos+2);
+		st_pos += u32 (st_pos+4);
+	    }
+	    if (st_pos >= len)
+		continue;
+	    switch (st_type) {
+	      case 3: {
+		std::vector<uint16_t> cov = coverage (st_pos + u16 (st_pos+2));
+		anchor_array (st_pos+4, cov, 0, 2);
+	      } break;
+	      case 4: case 6: {
+		std::vector<uint16_t> marks = coverage (st_pos + u16 (st_pos+2));
+		std::vector<uint16_t> bases = coverage (st_pos + u16 (st_pos+4));
+		uint16_t class_cnt = u16 (st_pos+6);
+		anchor_array (st_pos + u16 (st_pos+8), marks, 1, 1);
+		anchor_array (st_pos + u16 (st_pos+10), bases, 0, class_cnt);
+	      } break;
+	      case 5: {
+		std::vector<uint16_t> marks = coverage (st_pos + u16 (st_pos+2));
+		std::vector<uint16_t> ligs = coverage (st_pos + u16 (st_pos+4));
+		uint16_t class_cnt = u16 (st_pos+6);
+		anchor_array (st_pos + u16 (st_pos+8), marks, 1, 1);
+		uint32_t la_pos = st_pos + u16 (st_pos+10);
+		uint16_t lig_cnt = u16 (la_pos);
+		for (uint16_t k=0; k<lig_cnt && k<ligs.size (); k++) {
+		    uint32_t att_pos = la_pos + u16 (la_pos + 2 + k*2);
+		    std::vector<uint16_t> comps (u16 (att_pos), ligs[k]);
+		    anchor_array (att_pos, comps, 0, class_cnt);
+		}
+	      } break;
+	    }
+	}
+    }
+}
+
+// Point numbers of a glyph matter if it has instructions or a GPOS anchor
+// attached to a contour point, or if it is used (directly or through other
+// composites) by such a glyph or by a composite glyph positioning its
+// components by point matching. In a variable font deltas in 'gvar' are
+// stored per point, so nothing can be renumbered at all
+void GlyfTable::lockPointNumbers (std::vector<uint8_t> &locked) {
+    uint16_t gcnt = m_glyphs.size ();
+    std::vector<uint16_t> stack;
+    std::vector<uint8_t> anchored (gcnt, false);
+
+    if (!m_gvar.expired ()) {
+	locked.assign (gcnt, true);
+	return;
+    }
+    locked.assign (gcnt, false);
+    if (auto gpos = m_gpos.lock ()) {
+	gpos->fillup ();
+	if (gpos->rawData ())
+	    gpos_point_anchors (gpos->rawData (), gpos->dataLength (), gcnt, anchored);
+    }
+
+    for (uint16_t gid=0; gid<gcnt; gid++) {
+	ConicGlyph *g = m_glyphs[gid];
+	uint16_t instr_len = 0;
+	bool matched = false;
+	std::vector<uint16_t> comps;
+
+	if (g && (g->gid () != gid || g->isModified () || !headerIndexed (gid))) {
+	    instr_len = g->instructions.size ();
+	    for (auto &ref : g->refs) {
+		comps.push_back (ref.GID);
+		matched |= ref.point_match;
+	    }
+	} else if (headerIndexed (gid)) {
+	    glyph_header hdr;
+	    m_index.header (gid, hdr);
+	    instr_len = hdr.instructionLength;
+	    comps = m_index.components (gid);
+	    for (uint16_t flags : m_index.componentFlags (gid))
+		matched |= !(flags & ARGS_ARE_XY_VALUES);
+	}
+	if (instr_len || anchored[gid])
+	    locked[gid] = true;
+	if (instr_len || anchored[gid] || matched)
+	    stack.insert (stack.end (), comps.begin (), comps.end ());
+    }
+
+    while (!stack.empty ()) {
+	uint16_t gid = stack.back ();
+	stack.pop_back ();
+	if (gid >= gcnt || locked[gid] == 2)
+	    continue;
+	locked[gid] = 2;
+	ConicGlyph *g = m_glyphs[gid];
+	if (g && (g->gid () != gid || g->isModified () || !headerIndexed (gid))) {
+	    for (auto &ref : g->refs)
+		stack.push_back (ref.GID);
+	} else if (headerIndexed (gid)) {
+	    std::vector<uint16_t> comps = m_index.components (gid);
+	    stack.insert (stack.end (), comps.begin (), comps.end ());
+	}
+    }
+}
+
+// Glyphs which have not been modified (including those decoded just for
+// display) are copied from the old table data as is, so that only edited
+// and new glyphs have to be encoded. Unmodified composites referring
+// (possibly indirectly) to edited glyphs are copied too, but get their
+// bounding box and left side bearing recalculated. The encoding is done in parallel in two
+// passes: simple glyphs first, as they renumber their points, and then composites,
+// which only read their components. Then loca offsets are calculated from
+// glyph lengths, and glyph data are concatenated into the new table.
+// In the optimization mode the copied glyphs are re-encoded as well, and
+// glyphs are padded to 2 bytes rather than 4, which is enough for a short loca
+void GlyfTable::packData () {
+    FS_TRACE_SCOPE ("glyf pack");
+    uint16_t gcnt = m_glyphs.size ();
+
+    fillup ();
+    uint32_t old_len = data ? dataLength () : 0;
+    uint32_t old_loca_len = m_loca->dataLength ();
+    std::vector<uint8_t> elide (gcnt, false);
+    if (m_optimize) {
+	lockPointNumbers (elide);
+	for (auto &val : elide)
+	    val = !val;
+    }
+    std::vector<uint32_t> old_offsets;
+    if (data) {
+	old_offsets.resize (m_loca->glyphCount () + 1);
+	for (size_t i=0; i<old_offsets.size (); i++)
+	    old_offsets[i] = m_loca->getGlyphOffset (i);
+    }
+
+    std::vector<const char *> src (gcnt, nullptr);
+    std::vector<uint32_t> src_len (gcnt, 0);
+    std::vector<uint16_t> simple, composite, copied;
+    std::deque<std::string> patched;
+    for (uint16_t gid=0; gid<gcnt; gid++) {
+	ConicGlyph *g = m_glyphs[gid];
+	bool clean = !g || (g->gid () == gid && !g->isModified ());
+	if (clean && gid+1u < old_offsets.size ()) {
+	    uint32_t off = old_offsets[gid], noff = old_offsets[gid+1];
+	    if (off <= noff && noff <= old_len) {
+		src[gid] = data + off;
+		src_len[gid] = noff - off;
+		DBounds bb;
+		// No font is needed here, as glyphs missing from the old data
+		// are never decoded: they have all been created as new ones
+		if (src_len[gid] >= 10 && componentsModified (gid) &&
+		    composedBounds (nullptr, gid, bb)) {
+		    patched.emplace_back (src[gid], src_len[gid]);
+		    char *hdr = &patched.back ()[0];
+		    putushort (hdr+2, (int16_t) bb.minx);
+		    putushort (hdr+4, (int16_t) bb.miny);
+		    putushort (hdr+6, (int16_t) bb.maxx);
+		    putushort (hdr+8, (int16_t) bb.maxy);
+		    src[gid] = hdr;
+		    if (m_hmtx && m_hmtx->lsb (gid) != (int16_t) bb.minx)
+			m_hmtx->setlsb (gid, (int16_t) bb.minx);
+		}
+		if (m_optimize && src_len[gid])
+		    copied.push_back (gid);
+		continue;
+	    }
+	}
+	if (g) {
+	    // Unlinking references modifies outlines, so can't be done by workers
+	    g->unlinkMixedRefs ();
+	    if (g->refs.empty ())
+		simple.push_back (gid);
+	    else
+		composite.push_back (gid);
+	}
+    }
+
+    std::vector<glyf_chunk> simple_chunks, composite_chunks;
+    splitIntoChunks (simple, simple_chunks);
+    splitIntoChunks (composite, composite_chunks);
+    auto encode = [this, &elide] (glyf_chunk &chunk) {
+	encodeChunk (chunk, m_glyphs, elide);
+    };
+    for (auto *chunks : { &simple_chunks, &composite_chunks }) {
+	if (chunks->size () > 1)
+	    QtConcurrent::blockingMap (*chunks, encode);
+	else if (chunks->size () == 1)
+	    encode (chunks->front ());
+
+	for (auto &chunk : *chunks) {
+	    for (size_t i=0; i<chunk.gids.size (); i++) {
+		uint16_t gid = chunk.gids[i];
+		uint32_t start = i ? chunk.ends[i-1] : 0;
+		src[gid] = chunk.data.constData () + start;
+		src_len[gid] = chunk.ends[i] - start;
+		ConicGlyph *g = m_glyphs[gid];
+		m_hmtx->setaw (g->gid (), g->advanceWidth ());
+		m_hmtx->setlsb (g->gid (), g->leftSideBearing ());
+	    }
+	    m_maxp->mergeGlyphStats (chunk.stats);
+	}
+    }
+    FS_TRACE_COUNTER ("glyf glyphs encoded", simple.size () + composite.size ());
+
+    std::vector<glyf_chunk> copied_chunks;
+    splitIntoChunks (copied, copied_chunks);
+    auto recode = [&src, &src_len, &elide] (glyf_chunk &chunk) {
+	recodeChunk (chunk, src, src_len, elide);
+    };
+    if (copied_chunks.size () > 1)
+	QtConcurrent::blockingMap (copied_chunks, recode);
+    else if (copied_chunks.size () == 1)
+	recode (copied_chunks.front ());
+    m_savings = glyf_savings ();
+    for (auto &chunk : copied_chunks) {
+	for (size_t i=0; i<chunk.gids.size (); i++) {
+	    uint16_t gid = chunk.gids[i];
+	    uint32_t start = i ? chunk.ends[i-1] : 0;
+	    uint32_t len = chunk.ends[i] - start;
+	    if (len < src_len[gid])
+		m_savings.glyphs.emplace_back (gid, src_len[gid] - len);
+	    src[gid] = chunk.data.constData () + start;
+	    src_len[gid] = len;
+	}
+    }
+
+    // Glyph offsets should be at least even, as otherwise they can't be
+    // stored into a short loca table. By default each glyph is padded to 4 bytes,
+    // which is recommended for performance reasons
+    uint32_t pad = m_optimize ? 1 : 3;
+    uint32_t pos = 0;
+    m_loca->setGlyphCount (gcnt);
+    m_loca->setGlyphOffset (0, 0);
+    for (uint16_t gid=0; gid<gcnt; gid++) {
+	pos += (src_len[gid] + pad)&~pad;
+	m_loca->setGlyphOffset (gid+1, pos);
+    }
+    char *newdata = new char[pos] ();
+    for (uint16_t gid=0; gid<gcnt; gid++) {
+	if (src_len[gid])
+	    std::copy (src[gid], src[gid] + src_len[gid], newdata + m_loca->getGlyphOffset (gid));
+    }
+
+    releaseData ();
+    m_index.clear ();
 
     changed = false;
     td_changed = true;
     start = 0xffffffff;
 
-    newlen = ba.length ();
-    data = new char[newlen];
-    std::copy (ba.begin (), ba.end (), data);
+    newlen = pos;
+    data = newdata;
     m_loca->packData ();
+
+    if (m_optimize) {
+	m_savings.glyf = static_cast<int64_t> (old_len) - pos;
+	m_savings.loca = static_cast<int64_t> (old_loca_len) - m_loca->dataLength ();
+	FS_TRACE_COUNTER ("glyf bytes saved", m_savings.glyf);
+    }
+}
+
+// Compiling glyf rebuilds loca and updates both glyph metrics in hmtx
+// and glyph statistics in maxp
+std::vector<uint32_t> GlyfTable::packTargets () const {
+    return { CHR ('l','o','c','a'), CHR ('h','m','t','x'), CHR ('m','a','x','p') };
 }
 
 ConicGlyph* GlyfTable::glyph (sFont* fnt, uint16_t gid) {
@@ -95,18 +610,19 @@ ConicGlyph* GlyfTable::glyph (sFont* fnt, uint16_t gid) {
     if (m_glyphs[gid])
         return m_glyphs[gid];
 
+    FS_TRACE_SCOPE ("glyf glyph decode");
     uint32_t off = m_loca->getGlyphOffset (gid);
     uint32_t noff = m_loca->getGlyphOffset (gid+1);
     if (off == 0xFFFFFFFF || noff == 0xFFFFFFFF)
         return nullptr;
 
     BaseMetrics gm = {fnt->units_per_em, fnt->ascent, fnt->descent};
-    ConicGlyph *g = glyph_pool.construct (gid, gm);
+    ConicGlyph *g = newGlyph (gid, gm);
     m_glyphs[gid] = g;
     if (m_hmtx)
         g->setHMetrics (m_hmtx->lsb (gid), m_hmtx->aw (gid));
 
-    BoostIn buf (data+off, noff-off);
+    SpanIn buf (data+off, noff-off);
     g->fromTTF (buf, off);
     return g;
 }
@@ -114,7 +630,7 @@ ConicGlyph* GlyfTable::glyph (sFont* fnt, uint16_t gid) {
 uint16_t GlyfTable::addGlyph (sFont* fnt, uint8_t) {
     BaseMetrics gm = {fnt->units_per_em, fnt->ascent, fnt->descent};
     uint16_t gid = m_glyphs.size ();
-    ConicGlyph *g = glyph_pool.construct (gid, gm);
+    ConicGlyph *g = newGlyph (gid, gm);
     g->setAdvanceWidth (fnt->units_per_em/3);
     g->setOutlinesType (OutlinesType::TT);
     m_glyphs.push_back (g);
@@ -125,13 +641,131 @@ bool GlyfTable::usable () const {
     return td_loaded;
 }
 
+// Each glyph is decoded from its own slice of the table, so nothing is shared
+// except the allocator
+bool GlyfTable::parallelDecodable () const {
+    return true;
+}
+
+// The index describes glyph data as it is stored in the table, so glyphs
+// modified since the table has been compiled (as well as new glyphs)
+// have to be examined directly
+bool GlyfTable::headerIndexed (uint16_t gid) {
+    if (!m_loca)
+	return false;
+    if (gid < m_glyphs.size () && m_glyphs[gid] && m_glyphs[gid]->isModified ())
+	return false;
+    if (m_index.empty ()) {
+	fillup ();
+	if (!data)
+	    return false;
+	m_index.build (data, dataLength (), *m_loca, m_loca->glyphCount ());
+    }
+    return gid < m_index.size ();
+}
+
+// Whether any of the components a composite glyph refers to (directly or
+// through other composites) has been modified since the table was compiled.
+// If so, the bounding box stored for the composite is no longer valid
+bool GlyfTable::componentsModified (uint16_t gid, uint16_t depth) {
+    const uint16_t max_depth = 64;
+    if (depth > max_depth || !headerIndexed (gid))
+	return false;
+    for (uint16_t comp : m_index.components (gid)) {
+	if (comp >= m_glyphs.size ())
+	    continue;
+	ConicGlyph *g = m_glyphs[comp];
+	if (g && (g->gid () != comp || g->isModified ()))
+	    return true;
+	if (componentsModified (comp, depth+1))
+	    return true;
+    }
+    return false;
+}
+
+// Bounding box of a glyph with all its components substituted, taking
+// off-curve points into account, the same way ConicGlyph::toTTF () does
+bool GlyfTable::composedBounds (sFont* fnt, uint16_t gid, DBounds &bb) {
+    flat_outline fo;
+    if (!composedOutline (fnt, gid, fo))
+	return false;
+    fo.calcBounds (bb);
+    return true;
+}
+
+bool GlyfTable::glyphHeader (sFont* fnt, uint16_t gid, glyph_header &hdr) {
+    if (!headerIndexed (gid))
+	return GlyphContainer::glyphHeader (fnt, gid, hdr);
+    m_index.header (gid, hdr);
+    if (hdr.numberOfContours < 0 && componentsModified (gid))
+	composedBounds (fnt, gid, hdr.bb);
+    if (gid < m_glyphs.size () && m_glyphs[gid])
+	hdr.advanceWidth = m_glyphs[gid]->advanceWidth ();
+    else if (m_hmtx)
+	hdr.advanceWidth = m_hmtx->aw (gid);
+    return true;
+}
+
+std::vector<uint16_t> GlyfTable::glyphComponents (sFont* fnt, uint16_t gid) {
+    if (!headerIndexed (gid))
+	return GlyphContainer::glyphComponents (fnt, gid);
+    return m_index.components (gid);
+}
+
+// Unmodified glyphs are read directly from the table data
+bool GlyfTable::flatOutline (sFont* fnt, uint16_t gid, flat_outline &out) {
+    if (!m_loca || gid >= m_glyphs.size ())
+	return false;
+    ConicGlyph *g = m_glyphs[gid];
+    if ((g && (g->gid () != gid || g->isModified ())) || gid >= m_loca->glyphCount ())
+	return GlyphContainer::flatOutline (fnt, gid, out);
+    fillup ();
+    if (!data)
+	return GlyphContainer::flatOutline (fnt, gid, out);
+
+    uint32_t off = m_loca->getGlyphOffset (gid);
+    uint32_t noff = m_loca->getGlyphOffset (gid+1);
+    if (off == 0xFFFFFFFF || noff == 0xFFFFFFFF || noff < off || noff > dataLength ())
+	return false;
+    SpanIn buf (data+off, noff-off);
+    // False is returned for empty glyphs, which is not an error here
+    ConicGlyph::readFlatTTF (buf, out, gid, off);
+    return true;
+}
+
+size_t GlyfTable::memoryUsage () const {
+    return GlyphContainer::memoryUsage () + m_index.memoryUsage ();
+}
+
+// Optimization mode: re-encode all glyphs as compactly as possible on packData ()
+void GlyfTable::setOptimized (bool val) {
+    m_optimize = val;
+}
+
+bool GlyfTable::optimized () const {
+    return m_optimize;
+}
+
+const glyf_savings &GlyfTable::savings () const {
+    return m_savings;
+}
+
+bool GlyfTable::evictable () const {
+    return reloadable ();
+}
+
+// 'loca' is small, so it is kept, as well as other tables glyphs depend on
+void GlyfTable::evict () {
+    clearGlyphs ();
+    FontTable::evict ();
+}
+
 LocaTable::LocaTable (sfntFile *fontfile, TableHeader &props) :
     FontTable (fontfile, props) {
 }
 
 void LocaTable::unpackData (sFont *font) {
     int i, shift;
-    uint32_t pos = 0;
 
     m_head = dynamic_cast<HeadTable *> (font->table (CHR ('h','e','a','d')));
     if (!m_head)
@@ -144,16 +778,16 @@ void LocaTable::unpackData (sFont *font) {
     shift = is_long ? 4 : 2;
     offsets.reserve (font->glyph_cnt+1);
 
+    SpanIn buf = span (0);
     for (i=0; i<font->glyph_cnt+1; i++) {
-        if ((pos + shift) > len) {
-            QMessageBox::critical (0, QMessageBox::tr ("Error"),
-                QMessageBox::tr ("Broken loca table: got %1 glyph offsets, expected %2.")
+        if (buf.remaining () < (size_t) shift) {
+            FontShepherd::postError (tr ("Error"),
+                tr ("Broken loca table: got %1 glyph offsets, expected %2.")
                 .arg (i).arg (font->glyph_cnt+1));
             break;
         }
-        uint32_t off = is_long ? getlong (pos) : getushort (pos) * 2;
+        uint32_t off = is_long ? buf.getLong () : buf.getUShort () * 2;
         offsets.push_back (off);
-        pos += shift;
     }
     td_loaded = true;
 }
@@ -163,7 +797,7 @@ void LocaTable::packData () {
     std::string st;
     bool is_long = (offsets.back ()/2 > 0xffff);
 
-    delete[] data; data = nullptr;
+    releaseData ();
 
     changed = false;
     td_changed = true;
@@ -177,7 +811,8 @@ void LocaTable::packData () {
     }
     if (is_long != m_head->indexToLocFormat ()) {
 	m_head->setIndexToLocFormat (is_long);
-	if (m_head->editor ())
+	// If compiled in a worker thread, the editor is reset by the caller
+	if (m_head->editor () && QThread::currentThread () == QCoreApplication::instance ()->thread ())
 	    m_head->editor ()->resetData ();
     }
 
@@ -187,6 +822,10 @@ void LocaTable::packData () {
     std::copy (st.begin (), st.end (), data);
 }
 
+std::vector<uint32_t> LocaTable::packTargets () const {
+    return { CHR ('h','e','a','d') };
+}
+
 uint32_t LocaTable::getGlyphOffset (uint16_t gid) const {
     if (gid >= offsets.size ())
         return 0xFFFFFFFF;
@@ -198,6 +837,10 @@ void LocaTable::setGlyphOffset (uint16_t gid, uint32_t off) {
 	offsets[gid] = off;
 }
 
+uint16_t LocaTable::glyphCount () const {
+    return offsets.empty () ? 0 : offsets.size () - 1;
+}
+
 void LocaTable::setGlyphCount (uint16_t cnt) {
     if (cnt != offsets.size ()-1)
 	offsets.resize (cnt+1);
@@ -30,6 +30,41 @@ class FontTable;
 class HeadTable;
 class LocaTable;
 class ConicGlyph;
+struct glyph_header;
+
+// Result of the size optimization mode of GlyfTable::packData: changes in table
+// sizes (positive if they became smaller), and glyphs copied from the old table
+// data which became smaller when re-encoded, with numbers of bytes saved
+struct glyf_savings {
+    int64_t glyf = 0;
+    int64_t loca = 0;
+    std::vector<std::pair<uint16_t, uint32_t>> glyphs;
+};
+
+// Glyph headers, component lists and instruction lengths, collected in a single
+// pass over 'glyf' data. Stored as a set of parallel arrays indexed by GID,
+// with components of all glyphs packed into a common array
+class GlyfHeaderIndex {
+public:
+    void build (const char *data, uint32_t len, const LocaTable &loca, uint16_t gcnt);
+    void clear ();
+    bool empty () const;
+    uint16_t size () const;
+    size_t memoryUsage () const;
+
+    void header (uint16_t gid, glyph_header &hdr) const;
+    std::vector<uint16_t> components (uint16_t gid) const;
+    std::vector<uint16_t> componentFlags (uint16_t gid) const;
+
+private:
+    std::vector<int16_t> m_xmin, m_ymin, m_xmax, m_ymax;
+    std::vector<int16_t> m_contours;
+    std::vector<uint16_t> m_points;
+    std::vector<uint16_t> m_instr_len;
+    std::vector<uint32_t> m_comp_start;
+    std::vector<uint16_t> m_comp_gids;
+    std::vector<uint16_t> m_comp_flags;
+};
 
 class GlyfTable : public GlyphContainer {
 public:
@@ -38,12 +73,33 @@ public:
     void unpackData (sFont *font);
     void setLoca (sFont *font);
     void packData ();
+    std::vector<uint32_t> packTargets () const;
     ConicGlyph* glyph (sFont* fnt, uint16_t gid);
     uint16_t addGlyph (sFont* fnt, uint8_t subfont=0);
     bool usable () const;
+    bool glyphHeader (sFont* fnt, uint16_t gid, glyph_header &hdr) override;
+    std::vector<uint16_t> glyphComponents (sFont* fnt, uint16_t gid) override;
+    bool flatOutline (sFont* fnt, uint16_t gid, flat_outline &out) override;
+    bool parallelDecodable () const override;
+    size_t memoryUsage () const override;
+    bool evictable () const override;
+    void evict () override;
+
+    void setOptimized (bool val);
+    bool optimized () const;
+    const glyf_savings &savings () const;
 
 private:
+    bool headerIndexed (uint16_t gid);
+    bool componentsModified (uint16_t gid, uint16_t depth=0);
+    bool composedBounds (sFont* fnt, uint16_t gid, DBounds &bb);
+    void lockPointNumbers (std::vector<uint8_t> &locked);
+
     std::shared_ptr<LocaTable> m_loca;
+    std::weak_ptr<FontTable> m_gvar, m_gpos;
+    GlyfHeaderIndex m_index;
+    bool m_optimize;
+    glyf_savings m_savings;
 };
 
 class LocaTable : public FontTable {
@@ -52,8 +108,10 @@ public:
     ~LocaTable () {};
     void unpackData (sFont *font);
     void packData ();
+    std::vector<uint32_t> packTargets () const;
     uint32_t getGlyphOffset (uint16_t gid) const;
     void setGlyphOffset (uint16_t gid, uint32_t off);
+    uint16_t glyphCount () const;
     void setGlyphCount (uint16_t cnt);
 
 private:
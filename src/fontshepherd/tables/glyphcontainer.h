@@ -28,11 +28,25 @@
 #define _FONSHEPHERD_GLYPHCONTAINER_H
 
 #include <stdint.h>
+#include <mutex>
 
 #include "splineglyph.h"
 
 class HmtxTable;
 class CmapEnc;
+
+// Per-glyph metadata, which bulk operations (such as 'maxp' or 'VDMX' calculation)
+// may need without decoding glyph outlines
+struct glyph_header {
+    DBounds bb;
+    int16_t numberOfContours;	// -1 for composite glyphs, 0 for empty ones
+    uint16_t numPoints;		// for simple glyphs only
+    uint16_t instructionLength;
+    uint16_t numComponents;
+    uint16_t useMyMetrics;	// 0xFFFF if none of the components has this flag
+    int advanceWidth;
+};
+
 class GlyphContainer : public FontTable {
 public:
     GlyphContainer (sfntFile* fontfile, const TableHeader &props);
@@ -40,18 +54,29 @@ public:
 
     virtual void unpackData (sFont*);
     virtual void packData () = 0;
-    virtual void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller);
+    virtual std::vector<uint32_t> packTargets () const;
     virtual ConicGlyph* glyph (sFont* fnt, uint16_t gid) = 0;
     virtual uint16_t addGlyph (sFont* fnt, uint8_t subfont=0) = 0;
     virtual bool usable () const = 0;
+    virtual bool glyphHeader (sFont* fnt, uint16_t gid, glyph_header &hdr);
+    virtual std::vector<uint16_t> glyphComponents (sFont* fnt, uint16_t gid);
+    virtual bool flatOutline (sFont* fnt, uint16_t gid, flat_outline &out);
+    bool composedOutline (sFont* fnt, uint16_t gid, flat_outline &out, uint16_t depth=0);
+    // Whether glyph () may be called for different GIDs from several threads at once
+    virtual bool parallelDecodable () const;
     uint16_t countGlyphs ();
     OutlinesType outlinesType () const;
+    size_t memoryUsage () const override;
 
 protected:
+    void clearGlyphs ();
+    ConicGlyph *newGlyph (uint16_t gid, BaseMetrics gm);
+
     MaxpTable *m_maxp;
     HmtxTable *m_hmtx;
     std::vector<ConicGlyph *> m_glyphs;
     boost::object_pool<ConicGlyph> glyph_pool;
+    std::mutex m_pool_lock;
 };
 
 #endif
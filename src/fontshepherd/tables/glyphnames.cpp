@@ -37,11 +37,10 @@
 #include "tables/glyphcontainer.h" // also includes splineglyph.h
 #include "tables/glyf.h"
 #include "tables/cff.h"
-#include "editors/postedit.h"
 #include "tables/glyphnames.h"
-#include "editors/fontview.h"
 #include "fs_notify.h"
-#include <QtWidgets>
+#include "exceptions.h"
+#include "charbuffer.h"
 
 std::array<std::string, 258> PostTable::macRomanNames = {
     ".notdef", ".null", "nonmarkingreturn",
@@ -114,23 +113,25 @@ void PostTable::unpackData (sFont*) {
 	names.reserve (contents.numberOfGlyphs);
 	m_glyphNames.resize (contents.numberOfGlyphs);
 
+	SpanIn buf = span (pos);
         for (i=0; i<contents.numberOfGlyphs; i++) {
-            idx = getushort (pos);
+            idx = buf.getUShort ();
 	    if (idx > maxidx) maxidx = idx;
             glyphNameIndex.push_back (idx);
-            pos+=2;
         }
 	/* NB: numberNewGlyphs should not necessarily be equal to the number
 	 * of references to glyph names, listed previously (in AcademyOSTT:
 	 * .notdef is present in the name list, but not referenced) */
 	if ((maxidx - 257) > 0)
 	    numberNewGlyphs = maxidx - 257;
-        for (i=0; i<numberNewGlyphs; i++) {
-            uint8_t len = data[pos]; pos++;
-	    auto gn = std::string (data + pos, len);
+        for (i=0; i<numberNewGlyphs && !buf.fail (); i++) {
+            uint8_t len = buf.getByte ();
+	    std::string gn (len, '\0');
+	    buf.read (reinterpret_cast<uint8_t *> (&gn[0]), len);
             names.push_back (gn);
-	    pos+=len;
         }
+	if (buf.fail ())
+	    throw TableDataCorruptException (stringName ().c_str ());
 	for (i=0; i<contents.numberOfGlyphs; i++) {
 	    if (glyphNameIndex[i] < 258)
 		m_glyphNames[i] = macRomanNames[glyphNameIndex[i]];
@@ -139,9 +140,13 @@ void PostTable::unpackData (sFont*) {
 	}
     } else if (contents.version == 2.5) {
         uint16_t i;
+	SpanIn buf = span (pos);
+	m_glyphNames.resize (contents.numberOfGlyphs);
         for (i=0; i<contents.numberOfGlyphs; i++) {
-	    int8_t shift = data[pos+i];
+	    int8_t shift = buf.getByte ();
 	    int idx = i + shift;
+	    if (buf.fail () || idx < 0 || idx >= 258)
+		throw TableDataCorruptException (stringName ().c_str ());
 	    m_glyphNames[i] = macRomanNames[idx];
 	}
     }
@@ -153,7 +158,7 @@ void PostTable::packData () {
     std::vector<int> glyph_ids;
     glyph_ids.resize (m_glyphNames.size ());
 
-    delete[] data; data = nullptr;
+    releaseData ();
     putfixed (s, contents.version);
     putfixed (s, contents.italicAngle);
     putushort (s, contents.underlinePosition);
@@ -199,23 +204,6 @@ void PostTable::packData () {
     std::copy (st.begin (), st.end (), data);
 }
 
-void PostTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr)
-        fillup ();
-
-    if (tv == nullptr) {
-	unpackData (fnt);
-        PostEdit *postedit = new PostEdit (tptr, fnt, caller);
-        tv = postedit;
-	FontView *fv = caller->findChild<FontView *> ();
-	if (fv)
-	    QObject::connect (postedit, &PostEdit::glyphNamesChanged, fv, &FontView::updateGlyphNames);
-        postedit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 std::string PostTable::glyphName (uint16_t gid) {
     if (gid < m_glyphNames.size ())
 	return m_glyphNames[gid];
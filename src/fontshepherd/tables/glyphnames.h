@@ -48,7 +48,6 @@ public:
     ~PostTable ();
     void unpackData (sFont *font);
     void packData ();
-    void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) override;
     std::string glyphName (uint16_t gid);
 
     double version () const;
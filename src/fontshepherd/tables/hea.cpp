@@ -29,7 +29,7 @@
 #include <ios>
 
 #include "sfnt.h"
-#include "editors/heaedit.h"
+#include "tables.h"
 #include "tables/hea.h"
 
 HeaTable::HeaTable (sfntFile *fontfile, TableHeader &props) :
@@ -69,7 +69,7 @@ void HeaTable::packData () {
     std::ostringstream s;
     std::string st;
 
-    delete[] data; data = nullptr;
+    releaseData ();
 
     putfixed (s, contents.version);
     putushort (s, contents.ascent);
@@ -103,20 +103,6 @@ bool HeaTable::isVertical () const {
     return m_tags[0] == CHR('v','h','e','a');
 }
 
-void HeaTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr)
-        fillup ();
-
-    if (tv == nullptr) {
-	unpackData (fnt);
-        HeaEdit *heaedit = new HeaEdit (tptr, fnt, caller);
-        tv = heaedit;
-        heaedit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 double HeaTable::version () const {
     return contents.version;
 }
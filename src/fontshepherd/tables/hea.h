@@ -59,7 +59,6 @@ public:
     ~HeaTable () {};
     void unpackData (sFont *font);
     void packData ();
-    void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) override;
 
     bool isVertical () const;
 
@@ -31,7 +31,7 @@
 #include <chrono>
 
 #include "sfnt.h"
-#include "editors/headedit.h"
+#include "tables.h"
 #include "tables/head.h"
 
 HeadTable::HeadTable (sfntFile *fontfile, TableHeader &props) :
@@ -76,7 +76,7 @@ void HeadTable::packData () {
     std::ostringstream s;
     std::string st;
 
-    delete[] data; data = nullptr;
+    releaseData ();
     putfixed (s, contents.version);
     putfixed (s, contents.fontRevision);
     putlong (s, contents.checkSumAdjustment);
@@ -109,20 +109,6 @@ void HeadTable::packData () {
     std::copy (st.begin (), st.end (), data);
 }
 
-void HeadTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr)
-        fillup ();
-
-    if (tv == nullptr) {
-	unpackData (fnt);
-        HeadEdit *headedit = new HeadEdit (tptr, fnt, caller);
-        tv = headedit;
-        headedit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 double HeadTable::version () const {
     return contents.version;
 }
@@ -207,11 +193,13 @@ void HeadTable::updateModified () {
 }
 
 void HeadTable::setCheckSumAdjustment (uint32_t adj) {
+    detachData ();
     putlong (data+2*sizeof (uint32_t), adj);
     contents.checkSumAdjustment = adj;
 }
 
 void HeadTable::setIndexToLocFormat (bool is_long) {
+    detachData ();
     putushort (data+32, is_long);
     contents.indexToLocFormat = is_long;
 }
@@ -60,7 +60,6 @@ public:
     ~HeadTable () {};
     void unpackData (sFont *font);
     void packData ();
-    void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) override;
 
     double version () const;
     double fontRevision () const;
@@ -24,15 +24,148 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE. */
 
-#include <QtGlobal>
+#ifndef _FONSHEPHERD_INSTR_H
+#define _FONSHEPHERD_INSTR_H
+
+#include <set>
+#include <map>
+#include <array>
+#include <vector>
+#include <string>
+#include <QtCore>
 
 class FontTable;
 
+#ifndef _FS_STRUCT_BASEPOINT_DEFINED
+#define _FS_STRUCT_BASEPOINT_DEFINED
+typedef struct ipoint {
+    int32_t x = 0;
+    int32_t y = 0;
+} IPoint;
+
+typedef struct basepoint {
+    double x;
+    double y;
+
+    void transform (basepoint *from, const std::array<double, 6> &transform);
+} BasePoint;
+#endif
+
+struct instr_def {
+    std::string name;
+    uint8_t rangeStart;
+    uint8_t rangeEnd;
+    int nPops;
+    int nPushes;
+    std::string toolTip;
+};
+
+struct instr_data {
+    bool isInstr;
+    int16_t code;
+    uint8_t base;
+    uint8_t nPushes;
+    std::string repr;
+    std::string toolTip;
+};
+
+struct flat_outline;
+
+struct instr_props {
+    uint16_t maxTwilight;
+    uint16_t maxStackDepth;
+    uint16_t maxStorage;
+    uint16_t rBearingPointNum;
+    uint16_t numIdefs;
+    bool z0used;
+    bool rBearingTouched;
+    std::vector<std::vector<uint8_t>> fdefs;
+};
+
+struct GraphicsState {
+    uint8_t size;
+    uint16_t upm;
+    size_t nloop;
+    BasePoint projVector;
+    BasePoint freeVector;
+    BasePoint dualVector;
+    std::array<uint16_t, 3> zp;
+    std::array<uint16_t, 3> rp;
+    bool flip;
+    int errorCode;
+    uint32_t errorPos;
+    std::vector<int32_t> istack;
+    std::vector<int32_t> storage;
+    std::vector<int16_t> cvt;
+    std::vector<IPoint> twilightPts;
+    // Glyph zone points, followed by two phantom points
+    const flat_outline *outline;
+    int advanceWidth;
+
+    GraphicsState () :
+	nloop (1), projVector { 1.0, 0.0 }, freeVector { 1.0, 0.0 },
+	zp { 1, 1, 1 }, rp { 0, 0, 0 }, flip (true), errorCode (0), outline (nullptr), advanceWidth (0) {};
+    bool getPoint (uint32_t num, int zp_num, IPoint &pt);
+    bool setZonePointer (instr_props &props, int idx, int val);
+    int16_t readCvt (int idx);
+    bool writeCvt (int idx, int16_t val);
+    int32_t readStorage (size_t idx);
+    void writeStorage (size_t idx, int32_t val);
+    bool pop (int32_t &val);
+    bool pop2 (int32_t &val1, int32_t &val2);
+};
+
+namespace TTFinstrs {
+    enum ParseError {
+	Parse_OK = 0,
+	Parse_WrongInstr = 1,
+	Parse_NeedsNumber = 2,
+	Parse_NeedsInstr = 3,
+	Parse_NeedsBracket = 4,
+	Parse_TooLarge = 5,
+	Parse_TooLargeByte = 6,
+	Parse_TooLargeWord = 7,
+	Parse_Unexpected = 8,
+
+	Parse_WrongZone,
+	Parse_WrongPointNumber,
+	Parse_WrongTwilightPointNumber,
+	Parse_WrongFunctionNumber,
+	Parse_WrongCvtIndex,
+	Parse_WrongStorageIndex,
+	Parse_StackExceeded,
+	Parse_UnexpectedEnd,
+    };
+};
+
+// TrueType instruction set, as needed both by the instruction editor
+// and by the code calculating 'maxp' table values
+class TTFInstructions {
+    Q_DECLARE_TR_FUNCTIONS (TTFInstructions)
+
+public:
+    static instr_data byCode (uint8_t code);
+    static int byInstr (std::string instr);
+    static instr_data invalidCode (uint8_t code);
+    static void checkCodeArgs (instr_data &d, std::string &name);
+
+    static int quickExecute (std::vector<uint8_t> &bytecode, GraphicsState &state, instr_props &props, int level=0);
+    static void reportError (GraphicsState &state, uint32_t table, uint16_t gid);
+
+    static const std::map<uint8_t, instr_def> InstrSet;
+    static const std::map<std::string, uint8_t> ByArg;
+
+private:
+    static std::map<std::string, uint8_t> ByInstr;
+    static int skipBranch (std::vector<uint8_t> &bytecode, uint32_t &pos, bool def, int level);
+};
+
 class InstrTable : public FontTable {
 public:
     InstrTable (sfntFile* fontfile, TableHeader &props);
-    void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) override;
     char* getData ();
     uint32_t length ();
     void setData (const std::vector<uint8_t> &instr);
 };
+
+#endif
@@ -27,11 +27,16 @@
 #include <assert.h>
 #include <sstream>
 #include <ios>
+#include <algorithm>
+#include <cmath>
 
 #include "sfnt.h"
 #include "tables.h"
 #include "maxp.h"
-#include "editors/maxpedit.h"
+#include "glyphcontainer.h"
+#include "instr.h"
+#include "splineglyph.h"
+#include "fs_notify.h"
 
 MaxpTable::MaxpTable (sfntFile *fontfile, TableHeader &props) :
     FontTable (fontfile, props) {
@@ -70,7 +75,7 @@ void MaxpTable::packData () {
     std::ostringstream s;
     std::string st;
 
-    delete[] data; data = nullptr;
+    releaseData ();
 
     putfixed (s, contents.version);
     putushort (s, contents.numGlyphs);
@@ -101,20 +106,6 @@ void MaxpTable::packData () {
     std::copy (st.begin (), st.end (), data);
 }
 
-void MaxpTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr && !is_new)
-        fillup ();
-
-    if (tv == nullptr) {
-	unpackData (fnt);
-        MaxpEdit *edit = new MaxpEdit (tptr, fnt, caller);
-        tv = edit;
-        edit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 double MaxpTable::version () const {
     return contents.version;
 }
@@ -180,3 +171,221 @@ void MaxpTable::setGlyphCount (uint16_t cnt) {
     contents.numGlyphs = cnt;
     changed = true;
 }
+
+// Raise glyph-related limits to the values collected while compiling glyphs
+void MaxpTable::mergeGlyphStats (const maxp_data &d) {
+    contents.maxPoints = std::max (contents.maxPoints, d.maxPoints);
+    contents.maxContours = std::max (contents.maxContours, d.maxContours);
+    contents.maxCompositePoints = std::max (contents.maxCompositePoints, d.maxCompositePoints);
+    contents.maxCompositeContours = std::max (contents.maxCompositeContours, d.maxCompositeContours);
+    contents.maxSizeOfInstructions = std::max (contents.maxSizeOfInstructions, d.maxSizeOfInstructions);
+    contents.maxComponentElements = std::max (contents.maxComponentElements, d.maxComponentElements);
+    contents.maxComponentDepth = std::max (contents.maxComponentDepth, d.maxComponentDepth);
+    changed = true;
+}
+
+void MaxpTable::setContents (const maxp_data &d) {
+    contents = d;
+    changed = true;
+}
+
+// Calculation is done by static methods, so that it can be performed both
+// from the editor window and by the batch processor
+bool MaxpTable::calculate (sFont *font, maxp_data &d, QWidget *parent) {
+    GlyphContainer *glyf = dynamic_cast<GlyphContainer*> (font->table (CHR ('g','l','y','f')));
+    GlyphContainer *cff = dynamic_cast<GlyphContainer*> (font->table (CHR ('C','F','F',' ')));
+    GlyphContainer *cff2 = dynamic_cast<GlyphContainer*> (font->table (CHR ('C','F','F','2')));
+    if (glyf)
+	return calculateTTF (font, glyf, d, parent);
+    else if (cff)
+	calculateCFF (font, cff, d);
+    else if (cff2)
+	calculateCFF (font, cff2, d);
+    else {
+        FontShepherd::postError (
+            tr ("'maxp' table error"),
+            tr ("This font has neither 'glyf' nor 'CFF' or 'CFF2' tables. "
+		"Don't know how to calculate 'maxp' table contents"),
+            parent);
+	return false;
+    }
+    return true;
+}
+
+void MaxpTable::calculateCFF (sFont *font, GlyphContainer *cff, maxp_data &d) {
+    d.version = 0.5;
+    cff->fillup ();
+    cff->unpackData (font);
+    d.numGlyphs = cff->countGlyphs ();
+}
+
+struct composite_stats {
+    uint16_t points = 0, contours = 0, depth = 0;
+    // 0: not yet visited, 1: being processed, 2: done, -1: broken reference
+    int8_t state = 0;
+};
+
+// Same as numCompositePoints (), numCompositeContours () and componentDepth (),
+// but using glyph headers, so that there is no need to decode and link glyphs.
+// Returns false for a broken chain of references, which the caller should report
+static bool compositeStats (sFont *font, GlyphContainer *glyf, uint16_t gid, std::vector<composite_stats> &stats) {
+    composite_stats &st = stats[gid];
+    if (st.state == 2)
+	return true;
+    else if (st.state != 0)
+	return false;
+    st.state = 1;
+
+    glyph_header hdr;
+    if (!glyf->glyphHeader (font, gid, hdr)) {
+	st.state = -1;
+	return false;
+    }
+    if (hdr.numberOfContours >= 0) {
+	st.points = hdr.numPoints;
+	st.contours = hdr.numberOfContours;
+    } else {
+	for (uint16_t ref : glyf->glyphComponents (font, gid)) {
+	    if (ref >= stats.size () || !compositeStats (font, glyf, ref, stats)) {
+		st.state = -1;
+		return false;
+	    }
+	    const composite_stats &rst = stats[ref];
+	    st.points += rst.points;
+	    st.contours += rst.contours;
+	    if (rst.depth + 1 > st.depth)
+		st.depth = rst.depth + 1;
+	}
+    }
+    st.state = 2;
+    return true;
+}
+
+bool MaxpTable::calculateTTF (sFont *font, GlyphContainer *glyf, maxp_data &d, QWidget *parent) {
+    InstrTable *fpgm = dynamic_cast<InstrTable*> (font->table (CHR ('f','p','g','m')));
+    InstrTable *prep = dynamic_cast<InstrTable*> (font->table (CHR ('p','r','e','p')));
+    FontTable *cvt = font->table (CHR ('c','v','t',' '));
+
+    d = maxp_data ();
+    d.version = 1.0;
+
+    instr_props props;
+    props.maxTwilight = 0;
+    props.maxStackDepth = 0;
+    props.maxStorage = 0;
+    props.numIdefs = 0;
+    props.z0used = false;
+    props.rBearingTouched = false;
+
+    GraphicsState state;
+    state.size = 24;
+    state.upm = font->units_per_em;
+
+    if (fpgm) {
+	fpgm->fillup ();
+	std::vector<uint8_t> vdata (reinterpret_cast<uint8_t *> (fpgm->getData ()),
+	    reinterpret_cast<uint8_t *> (fpgm->getData ()) + fpgm->length ());
+	TTFInstructions::quickExecute (vdata, state, props);
+	TTFInstructions::reportError (state, CHR ('f','p','g','m'), 0xFFFF);
+    }
+    if (cvt) {
+	cvt->fillup ();
+	state.cvt.reserve (cvt->dataLength ()/2);
+	uint32_t pos = 0;
+	while (pos < cvt->dataLength ()) {
+	    int16_t cvt_val = cvt->getushort (pos);
+	    pos += 2;
+	    state.cvt.push_back (std::lround (static_cast<double> (cvt_val) * state.size / state.upm * 64));
+	}
+    }
+    if (prep) {
+	prep->fillup ();
+        std::vector<uint8_t> vdata (reinterpret_cast<uint8_t *> (prep->getData ()),
+	    reinterpret_cast<uint8_t *> (prep->getData ()) + prep->length ());
+        TTFInstructions::quickExecute (vdata, state, props);
+	TTFInstructions::reportError (state, CHR ('p','r','e','p'), 0xFFFF);
+    }
+
+    glyf->fillup ();
+    glyf->unpackData (font);
+    uint16_t gcnt = glyf->countGlyphs ();
+
+    // probably there is no reason in attempting to execute glyph program, if there was
+    // an error reading 'prep'
+    if (!state.errorCode) {
+	FontShepherd::ProgressNotifier progress (
+	    tr ("Executing glyph programs"), 0, gcnt, parent);
+
+	std::vector<composite_stats> stats (gcnt);
+	for (size_t i=0; i<gcnt; i++) {
+	    if (!progress.setValue (i))
+		return false;
+
+	    // Everything but glyph programs can be obtained from glyph headers
+	    glyph_header hdr;
+	    if (!glyf->glyphHeader (font, i, hdr))
+		continue;
+	    if (!compositeStats (font, glyf, i, stats)) {
+		FontShepherd::postError (
+		    tr ("Bad glyf data"),
+		    tr ("Glyph %1 refers to a glyph which doesn't exist "
+			"or refers back to glyph %1").arg (i),
+		    parent);
+		continue;
+	    }
+	    const composite_stats &st = stats[i];
+	    if (hdr.numberOfContours >= 0) {
+		if (st.points > d.maxPoints)
+		    d.maxPoints = st.points;
+		if (st.contours > d.maxContours)
+		    d.maxContours = st.contours;
+	    } else {
+		if (st.points > d.maxCompositePoints)
+		    d.maxCompositePoints = st.points;
+		if (st.contours > d.maxCompositeContours)
+		    d.maxCompositeContours = st.contours;
+		if (hdr.numComponents > d.maxComponentElements)
+		    d.maxComponentElements = hdr.numComponents;
+		if (st.depth > d.maxComponentDepth)
+		    d.maxComponentDepth = st.depth;
+	    }
+	    if (hdr.instructionLength == 0)
+		continue;
+	    if (hdr.instructionLength > d.maxSizeOfInstructions)
+		d.maxSizeOfInstructions = hdr.instructionLength;
+
+	    // Glyph programs only need point coordinates, so there is no need
+	    // to build splines: a flat outline with components substituted is enough
+	    flat_outline fo;
+	    if (!glyf->composedOutline (font, i, fo))
+		continue;
+	    props.rBearingPointNum = fo.numPoints ()+1;
+	    props.rBearingTouched = false;
+
+	    GraphicsState gstate = state;
+	    gstate.outline = &fo;
+	    gstate.advanceWidth = hdr.advanceWidth;
+	    for (size_t j=0; j<3; j++) {
+		gstate.zp[j] = 1;
+		gstate.rp[j] = 0;
+	    }
+
+	    TTFInstructions::quickExecute (fo.instructions, gstate, props);
+	    TTFInstructions::reportError (gstate, CHR ('g','l','y','f'), i);
+	    if (gstate.twilightPts.size () > props.maxTwilight)
+		props.maxTwilight = gstate.twilightPts.size ();
+	    if (gstate.storage.size () > props.maxStorage)
+		props.maxStorage = gstate.storage.size ();
+	}
+	progress.setValue (gcnt);
+    }
+
+    d.numGlyphs = gcnt;
+    d.maxZones = props.z0used ? 2 : 1;
+    d.maxTwilightPoints = props.maxTwilight;
+    d.maxStorage = props.maxStorage;
+    d.maxFunctionDefs = props.fdefs.size ();
+    d.maxInstructionDefs = props.numIdefs;
+    d.maxStackElements = props.maxStackDepth;
+    return true;
+}
@@ -28,6 +28,8 @@
 #include <ctime>
 
 class ConicGlyph;
+class GlyphContainer;
+class QWidget;
 
 struct maxp_data {
     double version;
@@ -52,6 +54,8 @@ class MaxpEdit;
 
 class MaxpTable : public FontTable {
     friend class ConicGlyph;
+class GlyphContainer;
+class QWidget;
     friend class MaxpEdit;
 public:
     MaxpTable (sfntFile* fontfile, TableHeader &props);
@@ -59,9 +63,10 @@ public:
     ~MaxpTable () {};
     void unpackData (sFont *font);
     void packData ();
-    void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller);
 
     void setGlyphCount (uint16_t cnt);
+    void setContents (const maxp_data &d);
+    void mergeGlyphStats (const maxp_data &d);
 
     double version () const;
     uint16_t numGlyphs () const;
@@ -79,6 +84,11 @@ public:
     uint16_t maxComponentElements () const;
     uint16_t maxComponentDepth () const;
 
+    static bool calculate (sFont *font, maxp_data &d, QWidget *parent);
+
 private:
+    static void calculateCFF (sFont *font, GlyphContainer *cff, maxp_data &d);
+    static bool calculateTTF (sFont *font, GlyphContainer *glyf, maxp_data &d, QWidget *parent);
+
     struct maxp_data contents;
 };
@@ -32,6 +32,8 @@
 #include "tables.h"
 #include "mtx.h"
 #include "hea.h"
+#include "charbuffer.h"
+#include "exceptions.h"
 
 HmtxTable::HmtxTable (sfntFile *fontfile, TableHeader &props) :
     FontTable (fontfile, props), m_hhea (nullptr) {
@@ -42,7 +44,6 @@ HmtxTable::~HmtxTable () {
 
 void HmtxTable::unpackData (sFont *font) {
     uint16_t i;
-    uint32_t pos = 0;
 
     m_hhea = dynamic_cast<HeaTable *> (font->table (CHR ('h','h','e','a')));
 
@@ -56,18 +57,19 @@ void HmtxTable::unpackData (sFont *font) {
     m_lbearings.resize (font->glyph_cnt);
     m_widths.resize (font->glyph_cnt);
 
+    SpanIn buf = span (0);
     for (i=0; i<m_hhea->numOfMetrics (); i++) {
-        m_widths[i] = getushort (pos); pos+=2;
-	uint16_t tmp = getushort (pos); pos+=2;
-        m_lbearings[i] = static_cast<int16_t> (tmp);
+        m_widths[i] = buf.getUShort ();
+        m_lbearings[i] = static_cast<int16_t> (buf.getUShort ());
     }
     int lastw = m_widths[i-1];
 
     for (i=m_hhea->numOfMetrics (); i<font->glyph_cnt; i++) {
         m_widths[i] = lastw;
-	uint16_t tmp = getushort (pos); pos+=2;
-        m_lbearings[i] = static_cast<int16_t> (tmp);
+        m_lbearings[i] = static_cast<int16_t> (buf.getUShort ());
     }
+    if (buf.fail ())
+        throw TableDataCorruptException (stringName ().c_str ());
     td_loaded = true;
 }
 
@@ -76,7 +78,7 @@ void HmtxTable::packData () {
     std::string st;
     uint16_t i;
 
-    delete[] data; data = nullptr;
+    releaseData ();
 
     int numhm = m_widths.size ();
     while (numhm > 1 && m_widths[numhm-1] == m_widths[numhm-2])
@@ -104,6 +106,11 @@ void HmtxTable::packData () {
     std::copy (st.begin (), st.end (), data);
 }
 
+// numberOfHMetrics is stored in hhea
+std::vector<uint32_t> HmtxTable::packTargets () const {
+    return { CHR ('h','h','e','a') };
+}
+
 int HmtxTable::lsb (uint16_t gid) const {
     if (gid < m_lbearings.size ())
         return (m_lbearings[gid]);
@@ -34,6 +34,7 @@ public:
     ~HmtxTable ();
     void unpackData (sFont *font);
     void packData ();
+    std::vector<uint32_t> packTargets () const;
     int lsb (uint16_t gid) const;
     uint16_t aw (uint16_t gid) const;
 
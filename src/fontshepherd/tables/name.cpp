@@ -31,9 +31,10 @@
 #include <iconv.h>
 
 #include "sfnt.h"
-#include "editors/nameedit.h"
+#include "tables.h"
 #include "tables/name.h"
 #include "fs_notify.h"
+#include "fs_trace.h"
 #include "exceptions.h"
 #include "commonlists.h"
 
@@ -150,6 +151,7 @@ void NameTable::unpackData (sFont *) {
     std::string uni_enc = is_big_endian () ? "UTF-16BE" : "UTF-16LE";
     if (td_loaded)
         return;
+    FS_TRACE_SCOPE ("name unpack");
 
     this->fillup ();
     m_version = this->getushort (fpos); fpos += 2;
@@ -247,7 +249,7 @@ void NameTable::packData () {
 	}
     }
 
-    delete[] data; data = nullptr;
+    releaseData ();
     putushort (s, format);
     putushort (s, count);
     putushort (s, off);
@@ -294,20 +296,6 @@ void NameTable::packData () {
     std::copy (st.begin (), st.end (), data);
 }
 
-void NameTable::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr)
-        fillup ();
-
-    if (tv == nullptr) {
-	unpackData (fnt);
-        NameEdit *nameedit = new NameEdit (tptr, fnt, caller);
-        tv = nameedit;
-        nameedit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 uint16_t NameTable::version () {
     return m_version;
 }
@@ -26,7 +26,7 @@
 
 #ifndef _FONSHEPHERD_NAME_H
 #define _FONSHEPHERD_NAME_H
-#include <QtWidgets>
+#include <QtCore>
 #include "commonlists.h"
 
 typedef void* iconv_t;
@@ -62,7 +62,6 @@ public:
     ~NameTable ();
     void unpackData (sFont *font);
     void packData ();
-    void edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) override;
     uint16_t version ();
 
     uint16_t numNameRecords () const;
@@ -30,7 +30,7 @@
 #include <assert.h>
 
 #include "sfnt.h"
-#include "editors/os_2edit.h"
+#include "tables.h"
 #include "tables/os_2.h"
 
 OS_2Table::OS_2Table (sfntFile *fontfile, TableHeader &props) :
@@ -101,7 +101,7 @@ void OS_2Table::packData () {
     std::ostringstream s;
     std::string st;
 
-    delete[] data; data = nullptr;
+    releaseData ();
 
     putushort (s, contents.version);
     putushort (s, contents.xAvgCharWidth);
@@ -162,20 +162,6 @@ void OS_2Table::packData () {
     std::copy (st.begin (), st.end (), data);
 }
 
-void OS_2Table::edit (sFont* fnt, std::shared_ptr<FontTable> tptr, QWidget* caller) {
-    if (data == nullptr)
-        fillup ();
-
-    if (tv == nullptr) {
-	unpackData (fnt);
-        OS_2Edit *os_2edit = new OS_2Edit (tptr, fnt, caller);
-        tv = os_2edit;
-        os_2edit->show ();
-    } else {
-        tv->raise ();
-    }
-}
-
 uint16_t OS_2Table::version () const {
     return contents.version;
 }
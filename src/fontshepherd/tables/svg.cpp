@@ -30,8 +30,9 @@
 #include <iomanip>
 
 #include "fs_notify.h"
+#include "fs_trace.h"
 #include "sfnt.h"
-#include "editors/fontview.h" // Includes also tables.h
+#include "tables.h"
 #include "tables/glyphcontainer.h"
 #include "tables/svg.h"
 #include "tables/cff.h"
@@ -277,7 +278,7 @@ void SvgTable::packData () {
     start = 0xffffffff;
 
     newlen = ba.length ();
-    delete[] data;
+    releaseData ();
     data = new char[newlen];
     std::copy (ba.begin (), ba.end (), data);
 }
@@ -332,13 +333,14 @@ ConicGlyph* SvgTable::glyph (sFont* fnt, uint16_t gid) {
 	return nullptr;
     if (m_glyphs[gid])
         return m_glyphs[gid];
+    FS_TRACE_SCOPE ("SVG glyph decode");
 
     if (m_docIdx[gid] < 0)
 	return nullptr;
     auto &entry = m_iEntries[m_docIdx[gid]];
 
     BaseMetrics gm = {fnt->units_per_em, fnt->ascent, fnt->descent};
-    ConicGlyph *g = glyph_pool.construct (gid, gm);
+    ConicGlyph *g = newGlyph (gid, gm);
     m_glyphs[gid] = g;
 
     if (m_hmtx)
@@ -361,7 +363,7 @@ ConicGlyph* SvgTable::glyph (sFont* fnt, uint16_t gid) {
 
 void SvgTable::addGlyphAt (sFont* fnt, uint16_t gid) {
     BaseMetrics gm = {fnt->units_per_em, fnt->ascent, fnt->descent};
-    ConicGlyph *g = glyph_pool.construct (gid, gm);
+    ConicGlyph *g = newGlyph (gid, gm);
     g->setAdvanceWidth (fnt->units_per_em/3);
     g->setOutlinesType (OutlinesType::SVG);
     if (gid < m_glyphs.size ())
@@ -149,3 +149,52 @@ void FontVariations::readIndexMap (char *data, uint32_t pos, struct delta_set_in
     size_t entry_size = ((map.entryFormat & MAP_ENTRY_SIZE_MASK) >> 4) + 1;
     map.data = std::string (data, pos, cnt*entry_size);
 }
+
+// See "Algorithm for interpolation of instance values" in the OpenType spec
+double FontVariations::regionScalar (const std::vector<struct axis_coordinates> &region, const std::vector<double> &coords) {
+    double scalar = 1;
+    for (size_t i=0; i<region.size (); i++) {
+	const struct axis_coordinates &ac = region[i];
+	double coord = i < coords.size () ? coords[i] : 0;
+	// Invalid or non-intermediate ranges, as well as a zero peak,
+	// make the axis irrelevant
+	if (ac.startCoord > ac.peakCoord || ac.peakCoord > ac.endCoord)
+	    continue;
+	if (ac.startCoord < 0 && ac.endCoord > 0)
+	    continue;
+	if (ac.peakCoord == 0 || coord == ac.peakCoord)
+	    continue;
+	if (coord <= ac.startCoord || coord >= ac.endCoord)
+	    return 0;
+	if (coord < ac.peakCoord)
+	    scalar *= (coord - ac.startCoord) / (ac.peakCoord - ac.startCoord);
+	else
+	    scalar *= (ac.endCoord - coord) / (ac.endCoord - ac.peakCoord);
+    }
+    return scalar;
+}
+
+void FontVariations::dataScalars (const struct variation_store &vstore, const std::vector<double> &coords,
+    std::vector<std::vector<double>> &scalars) {
+    // Each region is evaluated just once, even if shared by several subtables
+    std::vector<double> region_scalars (vstore.regions.size ());
+    for (size_t i=0; i<vstore.regions.size (); i++)
+	region_scalars[i] = regionScalar (vstore.regions[i], coords);
+
+    scalars.resize (vstore.data.size ());
+    for (size_t i=0; i<vstore.data.size (); i++) {
+	const std::vector<uint16_t> &ri = vstore.data[i].regionIndexes;
+	scalars[i].resize (ri.size ());
+	for (size_t j=0; j<ri.size (); j++)
+	    scalars[i][j] = ri[j] < region_scalars.size () ? region_scalars[ri[j]] : 0;
+    }
+}
+
+double FontVariations::applyDeltas (const double *deltas, const std::vector<double> &scalars, size_t cnt) {
+    double ret = 0;
+    if (cnt > scalars.size ())
+	cnt = scalars.size ();
+    for (size_t i=0; i<cnt; i++)
+	ret += deltas[i] * scalars[i];
+    return ret;
+}
@@ -65,6 +65,15 @@ namespace FontVariations {
     void readVariationStore (char *data, uint32_t pos, variation_store &vstore);
     void writeVariationStore (QDataStream &os, QBuffer &buf, variation_store &vstore);
     void readIndexMap (char *data, uint32_t pos, delta_set_index_map &map);
+
+    // coords are normalized (-1..1), one per axis, missing axes are at default
+    double regionScalar (const std::vector<struct axis_coordinates> &region, const std::vector<double> &coords);
+    // Scalars for each ItemVariationData subtable, in the order its deltas
+    // are stored (i. e. indexed by vsindex, then by regionIndexes position)
+    void dataScalars (const variation_store &vstore, const std::vector<double> &coords,
+	std::vector<std::vector<double>> &scalars);
+    // Net adjustment from up to cnt deltas, one per region
+    double applyDeltas (const double *deltas, const std::vector<double> &scalars, size_t cnt);
 };
 
 #endif
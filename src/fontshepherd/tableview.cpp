@@ -30,12 +30,13 @@
 #include "tableview.h"
 #include "sfnt.h"
 #include "tables.h"
+#include "editors/tableedit.h"
 #include "tables/devmetrics.h"
 
 #include "fs_notify.h"
 
 TableViewContainer::TableViewContainer (QString &path, QWidget* parent_w) :
-    QTabWidget (parent_w) {
+    QTabWidget (parent_w), m_watcher (new QFileSystemWatcher (this)) {
     m_has_font = false;
     curTab = 0;
     m_uGroup = std::unique_ptr<QUndoGroup> (new QUndoGroup (this));
@@ -72,6 +73,21 @@ TableViewContainer::TableViewContainer (QString &path, QWidget* parent_w) :
         addTab (tbl_matrix, fnt->fontname);
     }
     connect (this, &TableViewContainer::fileModified, fsptr, &FontShepherdMain::setModified);
+    // A file replaced by renaming another one over it is no longer watched,
+    // so the list should be refreshed on each change
+    connect (m_watcher, &QFileSystemWatcher::fileChanged, this, [this] (const QString &) {
+	fontFile->checkSources ();
+	watchSources ();
+    });
+    watchSources ();
+}
+
+void TableViewContainer::watchSources () {
+    for (int i=0; i<fontFile->fontCount (); i++) {
+	QString src = fontFile->path (i);
+	if (!src.isEmpty () && !m_watcher->files ().contains (src) && QFileInfo::exists (src))
+	    m_watcher->addPath (src);
+    }
 }
 
 TableViewContainer::~TableViewContainer () {
@@ -114,6 +130,7 @@ bool TableViewContainer::loadFont (QString &path) {
 	connect (tbl_matrix, &TableView::rowSelected, fsptr, &FontShepherdMain::enableEditActions);
         addTab (tbl_matrix, fnt->fontname);
     }
+    watchSources ();
     return true;
 }
 
@@ -129,7 +146,7 @@ QString TableViewContainer::checkPath (QString &path) {
     QString ret = path;
     if (path.isEmpty ())
         ret = QFileDialog::getOpenFileName(this, tr ("Open Font"), "",
-            tr ("OpenType Font Files (*.ttf *.otf *.ttc)"));
+            tr ("OpenType Font Files (*.ttf *.otf *.ttc);;WOFF Files (*.woff *.woff2)"));
 
     if (!ret.isEmpty ())
         return ret;
@@ -146,7 +163,7 @@ void TableViewContainer::saveFont (bool overwrite, bool ttc) {
     try {
         if (!overwrite || !fontFile->hasSource (fidx, ttc)) {
             newpath = QFileDialog::getSaveFileName (this, tr ("Save Font"), "",
-                tr ("OpenType Font Files (*.ttf *.TTF *.otf *.OTF *.ttc *.TTC)"));
+                tr ("OpenType Font Files (*.ttf *.TTF *.otf *.OTF *.ttc *.TTC);;WOFF Files (*.woff *.WOFF *.woff2 *.WOFF2)"));
 
             if (!newpath.isEmpty ())
                 fontFile->save (newpath, ttc, fidx);
@@ -174,6 +191,7 @@ void TableViewContainer::saveFont (bool overwrite, bool ttc) {
     }
 
     emit fileModified (false);
+    watchSources ();
     for (auto w: m_uStackMap.keys ())
 	m_uStackMap[w]->setClean ();
     // NB: the following is connected to QUndoStack::cleanChanged, but
@@ -498,14 +516,15 @@ void TableView::unselect () {
 
 void TableView::editTable (std::shared_ptr<FontTable> tptr, bool hex) {
     if (hex)
-	tptr->hexEdit (m_font, tptr, this);
+	TableEdit::hexEdit (m_font, tptr, this);
     else
-	tptr->edit (m_font, tptr, this);
+	TableEdit::edit (m_font, tptr, this);
     TableViewContainer *contptr = qobject_cast<TableViewContainer *> (m_parent);
-    if (tptr->editor ()) {
+    TableEdit *ed = dynamic_cast<TableEdit *> (tptr->editor ());
+    if (ed) {
 	TableViewModel *modptr = dynamic_cast<TableViewModel *> (m_model.get ());
-        connect (tptr->editor (), &TableEdit::update, modptr, &TableViewModel::updateViews);
-        connect (tptr->editor (), &TableEdit::update, contptr, [=] () {
+        connect (ed, &TableEdit::update, modptr, &TableViewModel::updateViews);
+        connect (ed, &TableEdit::update, contptr, [=] () {
 	    contptr->setFontModified (m_index, true);
 	});
     }
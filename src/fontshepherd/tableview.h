@@ -120,8 +120,11 @@ signals:
 
 private:
     QString checkPath (QString &path);
+    void watchSources ();
 
     std::unique_ptr<sfntFile> fontFile;
+    // Source files are watched, as they may be mapped into memory
+    QFileSystemWatcher *m_watcher;
     int curTab;
     bool m_has_font;
     std::unique_ptr<QUndoGroup> m_uGroup;
@@ -0,0 +1,166 @@
+/* Copyright (C) 2022 by Alexey Kryukov
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE. */
+
+
+#include <cmath>
+#include "tracepanel.h"
+#include "fs_trace.h"
+#include "fs_notify.h"
+
+TracePanel *TracePanel::instance () {
+    static QPointer<TracePanel> panel;
+    if (!panel)
+	panel = new TracePanel (nullptr);
+    return panel;
+}
+
+TracePanel::TracePanel (QWidget *parent) : QDialog (parent) {
+    setAttribute (Qt::WA_DeleteOnClose);
+    setWindowTitle (tr ("Performance trace"));
+
+    m_enableBox = new QCheckBox (tr ("&Enable tracing"));
+    m_enableBox->setChecked (FontShepherd::trace::enabled ());
+    connect (m_enableBox, &QCheckBox::toggled, this, &TracePanel::setTracing);
+
+    m_table = new QTableWidget (0, 8);
+    m_table->setHorizontalHeaderLabels (QStringList ()
+	<< tr ("Operation") << tr ("Count") << tr ("Total, ms") << tr ("Mean, ms")
+	<< tr ("Median, ms") << tr ("95%, ms") << tr ("Max, ms") << tr ("Histogram (µs, log2)"));
+    m_table->setEditTriggers (QAbstractItemView::NoEditTriggers);
+    m_table->setSelectionBehavior (QAbstractItemView::SelectRows);
+    m_table->verticalHeader ()->setVisible (false);
+    m_table->horizontalHeader ()->setStretchLastSection (true);
+    m_table->setSortingEnabled (true);
+
+    m_droppedLabel = new QLabel ();
+
+    QPushButton *refreshButton = new QPushButton (tr ("&Refresh"));
+    QPushButton *resetButton = new QPushButton (tr ("Re&set"));
+    QPushButton *exportButton = new QPushButton (tr ("E&xport Chrome trace..."));
+    QPushButton *closeButton = new QPushButton (tr ("&Close"));
+    connect (refreshButton, &QPushButton::clicked, this, &TracePanel::refresh);
+    connect (resetButton, &QPushButton::clicked, this, &TracePanel::reset);
+    connect (exportButton, &QPushButton::clicked, this, &TracePanel::exportTrace);
+    connect (closeButton, &QPushButton::clicked, this, &TracePanel::close);
+
+    QHBoxLayout *buttLayout = new QHBoxLayout ();
+    buttLayout->addWidget (refreshButton);
+    buttLayout->addWidget (resetButton);
+    buttLayout->addWidget (exportButton);
+    buttLayout->addStretch ();
+    buttLayout->addWidget (closeButton);
+
+    QVBoxLayout *layout = new QVBoxLayout ();
+    layout->addWidget (m_enableBox);
+    layout->addWidget (m_table);
+    layout->addWidget (m_droppedLabel);
+    layout->addLayout (buttLayout);
+    setLayout (layout);
+    resize (900, 400);
+
+    m_timer = new QTimer (this);
+    connect (m_timer, &QTimer::timeout, this, &TracePanel::refresh);
+    m_timer->start (1000);
+    refresh ();
+}
+
+// One character per bucket, from the first to the last non-empty one,
+// scaled relatively to the largest bucket
+QString TracePanel::histogramString (const std::array<uint64_t, 32> &hist) {
+    static const QString bars = QString::fromUtf8 ("▁▂▃▄▅▆▇█");
+    int first = -1, last = -1;
+    uint64_t max = 0;
+    for (int i=0; i<(int) hist.size (); i++) {
+	if (!hist[i])
+	    continue;
+	if (first < 0) first = i;
+	last = i;
+	max = std::max (max, hist[i]);
+    }
+    if (first < 0)
+	return QString ();
+
+    QString ret = QString ("%1 ").arg (first ? 1u << (first-1) : 0);
+    for (int i=first; i<=last; i++)
+	ret += hist[i] ? bars[(int) ((hist[i]*(bars.length ()-1) + max-1)/max)] : QChar (' ');
+    ret += QString (" %1").arg (1u << last);
+    return ret;
+}
+
+void TracePanel::refresh () {
+    // Numeric data, so that columns are sorted properly
+    auto numItem = [] (double val) {
+	QTableWidgetItem *item = new QTableWidgetItem ();
+	item->setData (Qt::DisplayRole, val);
+	item->setTextAlignment (Qt::AlignRight | Qt::AlignVCenter);
+	return item;
+    };
+    auto ms = [] (double us) {
+	return std::round (us)/1000;
+    };
+    std::vector<FontShepherd::trace::OpSummary> ops = FontShepherd::trace::summary ();
+
+    m_table->setSortingEnabled (false);
+    m_table->setRowCount (ops.size ());
+    for (size_t i=0; i<ops.size (); i++) {
+	auto &op = ops[i];
+	double mean = static_cast<double> (op.total_us)/op.count;
+	m_table->setItem (i, 0, new QTableWidgetItem (QString::fromStdString (op.name)));
+	m_table->setItem (i, 1, numItem (op.count));
+	m_table->setItem (i, 2, numItem (ms (op.total_us)));
+	m_table->setItem (i, 3, numItem (ms (mean)));
+	m_table->setItem (i, 4, numItem (ms (op.p50_us)));
+	m_table->setItem (i, 5, numItem (ms (op.p95_us)));
+	m_table->setItem (i, 6, numItem (ms (op.max_us)));
+	m_table->setItem (i, 7, new QTableWidgetItem (histogramString (op.histogram)));
+    }
+    m_table->setSortingEnabled (true);
+    m_table->resizeColumnsToContents ();
+
+    uint64_t dropped = FontShepherd::trace::dropped ();
+    m_droppedLabel->setText (dropped ?
+	tr ("%1 events have been dropped, as trace buffers are full").arg (dropped) : QString ());
+}
+
+void TracePanel::setTracing (bool val) {
+    QSettings settings (QCoreApplication::organizationName (), QCoreApplication::applicationName ());
+    settings.setValue ("trace/enabled", val);
+    FontShepherd::trace::setEnabled (val);
+}
+
+void TracePanel::reset () {
+    FontShepherd::trace::reset ();
+    refresh ();
+}
+
+void TracePanel::exportTrace () {
+    QString path = QFileDialog::getSaveFileName (this, tr ("Export trace"), "trace.json",
+	tr ("Chrome trace files (*.json)"));
+    if (path.isEmpty ())
+	return;
+    if (!FontShepherd::trace::exportChromeTrace (QFile::encodeName (path).toStdString ()))
+	FontShepherd::postError (tr ("Export trace"), tr ("Could not write %1").arg (path), this);
+}